@@ -0,0 +1,658 @@
+/*
+ * ftbench.c
+ *
+ * Benchmark ftranspose end to end: generate deterministic synthetic
+ * matrices from a seed, run the ftranspose binary on each with every
+ * engine and thread count asked for, and print a table of time, MB/s and
+ * peak RSS, optionally compared against a saved baseline.
+ *
+ * cc --std=c99 -O2 -o ftbench ftbench.c
+ * ./ftbench -b ./ftranspose -S 64 --save base.txt
+ * ./ftbench -b ./ftranspose -S 64 --compare base.txt
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define ARG_STR_LEN            512
+#define MAX_LIST               16
+#define MAX_RESULTS            1024
+#define GEN_BLOCK              (1 << 20)   /* bytes buffered per write() while generating */
+#define DEFAULT_SCALE_MB       64
+#define DEFAULT_REPEATS        3
+#define DEFAULT_THRESHOLD      5.0         /* % slower than baseline that fails --compare */
+
+#define VERSION_STR   "1.3"
+
+enum {
+    OPT_SAVE = 256,
+    OPT_COMPARE,
+    OPT_THRESHOLD,
+    OPT_TMPDIR,
+    OPT_VERIFY,
+    OPT_KEEP
+};
+
+enum { SHAPE_SQUARE, SHAPE_TALL, SHAPE_WIDE };
+enum { ALPHA_NUMERIC, ALPHA_SMALL, ALPHA_LETTERS };
+
+/* one synthetic matrix */
+typedef struct {
+    const char *name;
+    int   shape;           /* SHAPE_*                                       */
+    int   narrow;          /* rows (SHAPE_WIDE) or columns (SHAPE_TALL)     */
+    int   min_width;       /* field lengths are uniform in [min, max] ...   */
+    int   max_width;
+    int   skew;            /* ... or mostly min_width with a long tail      */
+    int   alphabet;        /* ALPHA_*                                       */
+    int   sparse;          /* % of fields that are "0"                      */
+    char  delim;
+    int   quoted;          /* CSV: wrap every field in double quotes        */
+} case_t;
+
+static const case_t cases[] = {
+    { "square-num",    SHAPE_SQUARE,  0, 1,  8, 0, ALPHA_NUMERIC,  0, '\t', 0 },
+    { "tall-num",      SHAPE_TALL,   16, 1,  8, 0, ALPHA_NUMERIC,  0, '\t', 0 },
+    { "wide-num",      SHAPE_WIDE,   16, 1,  8, 0, ALPHA_NUMERIC,  0, '\t', 0 },
+    { "square-acgt",   SHAPE_SQUARE,  0, 1,  1, 0, ALPHA_SMALL,    0, '\t', 0 },
+    { "square-sparse", SHAPE_SQUARE,  0, 1,  8, 0, ALPHA_NUMERIC, 95, '\t', 0 },
+    { "square-skewed", SHAPE_SQUARE,  0, 2, 18, 1, ALPHA_LETTERS,  0, '\t', 0 },
+    { "square-csv",    SHAPE_SQUARE,  0, 1,  8, 0, ALPHA_LETTERS,  0, ',',  1 },
+};
+#define N_CASES  ( (int)(sizeof(cases) / sizeof(cases[0])) )
+
+typedef struct {
+    char   binary[ ARG_STR_LEN ];
+    char   tmpdir[ ARG_STR_LEN ];
+    char   save[ ARG_STR_LEN ];
+    char   compare[ ARG_STR_LEN ];
+    char   filter[ ARG_STR_LEN ];
+    char  *engines[ MAX_LIST ];
+    int    n_engines;
+    int    threads[ MAX_LIST ];
+    int    n_threads;
+    long   scale;          /* MB of input per case                          */
+    long   seed;
+    int    repeats;
+    double threshold;
+    int    verify;         /* check every run's output hashes the same      */
+    int    keep;           /* leave the generated inputs in --tmpdir        */
+} args_t;
+static args_t args;
+
+typedef struct {
+    char   name[ 64 ];
+    char   engine[ 16 ];
+    int    threads;
+    double seconds;        /* best of args.repeats                          */
+    double mbps;
+    long   rss_kb;         /* peak RSS of the fastest run                   */
+} result_t;
+
+static result_t results[ MAX_RESULTS ];
+static int      n_results;
+
+
+
+void usage( int rc )
+{
+    fprintf( stderr, "\nftbench OPTIONS\n"                                            \
+                     "  Version: " VERSION_STR "\n\n"                                 \
+                     "  - benchmark ftranspose on synthetic matrices\n"               \
+		     " OPTIONS\n"                                                     \
+		     "   -h                     help (this)\n"                        \
+		     "   -b binary              ftranspose to run (default ./ftranspose)\n" \
+		     "   -S MB                  input size per case (default %d)\n"   \
+		     "   -s seed                generator seed (default 1)\n"         \
+		     "   -r #                   runs per measurement, best kept\n"    \
+		     "                          (default %d)\n"                       \
+		     "   -e list                engines, e.g. memory,external\n"      \
+		     "                          (default auto)\n"                     \
+		     "   -t list                thread counts, e.g. 1,2,4 (default 1)\n" \
+		     "   -c name                only cases whose name contains this\n" \
+		     "   --save filename        save the results as a baseline\n"     \
+		     "   --compare filename     compare against a saved baseline;\n"  \
+		     "                          exit 1 on a regression\n"            \
+		     "   --threshold %%          regression threshold (default %.0f)\n" \
+		     "   --tmpdir dir           where inputs are generated\n"         \
+		     "   --verify               check all runs of a case produce the\n" \
+		     "                          same output\n"                        \
+		     "   --keep                 keep the generated inputs\n\n",
+             DEFAULT_SCALE_MB, DEFAULT_REPEATS, DEFAULT_THRESHOLD );
+    exit( rc );
+}
+
+static double clock_seconds( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* splitmix64: the same seed gives the same matrix on every machine */
+static uint64_t next_random( uint64_t *state )
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static long isqrt( long n )
+{
+    long x = n, y = (n + 1) / 2;
+
+    while ( y < x )
+    {
+        x = y;
+        y = (x + n / x) / 2;
+    }
+    return x;
+}
+
+/* write() all 'size' bytes */
+static int write_all( int fd, const char *buf, size_t size )
+{
+    size_t  done = 0;
+    ssize_t n;
+
+    while ( done < size )
+    {
+        if ( (n = write( fd, buf + done, size - done )) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static int field_width( const case_t *c, uint64_t *rng )
+{
+    int span = c->max_width - c->min_width + 1;
+
+    /* skewed: 7 in 8 fields short, the rest anywhere up to max_width */
+    if ( c->skew && (next_random( rng ) & 7) != 0 )
+        span = span > 4 ? span / 4 : 1;
+    return c->min_width + (int)(next_random( rng ) % span);
+}
+
+/* mean bytes per field, delimiter included, for sizing the matrix */
+static double field_bytes( const case_t *c )
+{
+    double w = (c->min_width + c->max_width) / 2.0;
+
+    if ( c->skew )
+    {
+        int span = c->max_width - c->min_width + 1;
+        int low = span > 4 ? span / 4 : 1;
+        w = c->min_width + (7.0 / 8.0) * (low - 1) / 2.0 + (1.0 / 8.0) * (span - 1) / 2.0;
+    }
+    if ( c->sparse )
+        w = (c->sparse / 100.0) * 1.0 + (1.0 - c->sparse / 100.0) * w;
+    return w + 1.0 + (c->quoted ? 2.0 : 0.0);
+}
+
+/* generate case 'c' into 'path'; returns the # of bytes written or -1 */
+static long generate( const case_t *c, const char *path, long *rows_out, long *cols_out )
+{
+    static const char small[] = "ACGT";
+    uint64_t rng = (uint64_t)args.seed * 1000003u + (uint64_t)(c - cases);
+    long fields = (long)(args.scale * 1e6 / field_bytes( c )), rows, cols, r, k, total = 0;
+    char *buf, *o;
+    int fd, w, j;
+
+    switch ( c->shape )
+    {
+    case SHAPE_TALL:
+        cols = c->narrow;
+        rows = fields / cols;
+        break;
+    case SHAPE_WIDE:
+        rows = c->narrow;
+        cols = fields / rows;
+        break;
+    default:
+        rows = cols = isqrt( fields );
+        break;
+    }
+    if ( rows < 1 )
+        rows = 1;
+    if ( cols < 1 )
+        cols = 1;
+    *rows_out = rows;
+    *cols_out = cols;
+
+    if ( (fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0600 )) < 0 )
+    {
+        perror( path );
+        return -1;
+    }
+    if ( (buf = malloc( GEN_BLOCK + 64 )) == (char *)0 )
+    {
+        close( fd );
+        return -1;
+    }
+    o = buf;
+    for( r = 0; r < rows; r++ )
+        for( k = 0; k < cols; k++ )
+        {
+            if ( c->quoted )
+                *o++ = '"';
+            if ( c->sparse && (int)(next_random( &rng ) % 100) < c->sparse )
+                *o++ = '0';
+            else
+            {
+                w = field_width( c, &rng );
+                for( j = 0; j < w; j++ )
+                {
+                    uint64_t x = next_random( &rng );
+                    switch ( c->alphabet )
+                    {
+                    case ALPHA_SMALL:
+                        *o++ = small[ x & 3 ];
+                        break;
+                    case ALPHA_LETTERS:
+                        *o++ = 'a' + (char)(x % 26);
+                        break;
+                    default:
+                        *o++ = '0' + (char)(x % 10);
+                        break;
+                    }
+                }
+            }
+            if ( c->quoted )
+                *o++ = '"';
+            *o++ = (k == cols - 1) ? '\n' : c->delim;
+
+            if ( o - buf >= GEN_BLOCK )
+            {
+                if ( write_all( fd, buf, o - buf ) < 0 )
+                {
+                    perror( path );
+                    free( (void *)buf );
+                    close( fd );
+                    return -1;
+                }
+                total += o - buf;
+                o = buf;
+            }
+        }
+    if ( write_all( fd, buf, o - buf ) < 0 )
+    {
+        perror( path );
+        total = -1;
+    }
+    else
+        total += o - buf;
+    free( (void *)buf );
+    close( fd );
+    return total;
+}
+
+/* FNV-1a of a whole file, for --verify */
+static uint64_t hash_file( const char *path )
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    char *buf = malloc( GEN_BLOCK );
+    ssize_t n, i;
+    int fd;
+
+    if ( buf == (char *)0 || (fd = open( path, O_RDONLY )) < 0 )
+    {
+        free( (void *)buf );
+        return 0;
+    }
+    while ( (n = read( fd, buf, GEN_BLOCK )) > 0 )
+        for( i = 0; i < n; i++ )
+            h = (h ^ (unsigned char)buf[i]) * 0x100000001b3ULL;
+    close( fd );
+    free( (void *)buf );
+    return h;
+}
+
+/* run ftranspose once; returns its wall time, or -1 if it failed */
+static double run_once( char **argv, long *rss_kb )
+{
+    struct rusage ru;
+    double start;
+    pid_t pid;
+    int status;
+
+    start = clock_seconds();
+    if ( (pid = fork()) < 0 )
+    {
+        perror( "fork" );
+        return -1.0;
+    }
+    if ( pid == 0 )
+    {
+        execv( argv[0], argv );
+        perror( argv[0] );
+        _exit( 127 );
+    }
+    while ( wait4( pid, &status, 0, &ru ) < 0 )
+        if ( errno != EINTR )
+        {
+            perror( "wait4" );
+            return -1.0;
+        }
+    if ( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+        return -1.0;
+    *rss_kb = ru.ru_maxrss;
+    return clock_seconds() - start;
+}
+
+static void bench_case( const case_t *c )
+{
+    char in[ ARG_STR_LEN + 64 ], out[ ARG_STR_LEN + 64 ];
+    char width[ 16 ], delim[ 8 ], threads[ 16 ];
+    char *argv[ 32 ];
+    uint64_t first_hash = 0, h;
+    long bytes, rows, cols, rss, best_rss;
+    double t, best;
+    int e, k, i, n, ok;
+
+    snprintf( in, sizeof(in), "%s/ftbench-%s-%ld-%ld.txt", args.tmpdir, c->name, args.seed, args.scale );
+    snprintf( out, sizeof(out), "%s/ftbench-%s.out", args.tmpdir, c->name );
+    if ( (bytes = generate( c, in, &rows, &cols )) < 0 )
+        return;
+    fprintf( stderr, "%s: %ld x %ld, %.1f MB\n", c->name, rows, cols, bytes / 1e6 );
+
+    snprintf( width, sizeof(width), "%d", c->max_width + (c->quoted ? 2 : 0) );
+    snprintf( delim, sizeof(delim), "%c", c->delim );
+    for( e = 0; e < args.n_engines; e++ )
+        for( k = 0; k < args.n_threads; k++ )
+        {
+            n = 0;
+            argv[ n++ ] = args.binary;
+            argv[ n++ ] = "-i";
+            argv[ n++ ] = in;
+            argv[ n++ ] = "-o";
+            argv[ n++ ] = args.verify ? out : "/dev/null";
+            argv[ n++ ] = "-d";
+            argv[ n++ ] = delim;
+            argv[ n++ ] = "-f";
+            argv[ n++ ] = width;
+            argv[ n++ ] = "-e";
+            argv[ n++ ] = args.engines[e];
+            argv[ n++ ] = "-t";
+            snprintf( threads, sizeof(threads), "%d", args.threads[k] );
+            argv[ n++ ] = threads;
+            argv[ n++ ] = "--tmpdir";
+            argv[ n++ ] = args.tmpdir;
+            argv[ n ] = (char *)0;
+
+            best = -1.0;
+            best_rss = 0;
+            ok = 1;
+            for( i = 0; i < args.repeats && ok; i++ )
+            {
+                if ( (t = run_once( argv, &rss )) < 0.0 )
+                    ok = 0;
+                else if ( best < 0.0 || t < best )
+                {
+                    best = t;
+                    best_rss = rss;
+                }
+            }
+            if ( !ok )
+            {
+                fprintf( stderr, "%s: %s -t %d failed\n", c->name, args.engines[e], args.threads[k] );
+                continue;
+            }
+            if ( args.verify )
+            {
+                h = hash_file( out );
+                if ( first_hash == 0 )
+                    first_hash = h;
+                else if ( h != first_hash )
+                    fprintf( stderr, "%s: %s -t %d output differs from the first run\n",
+                             c->name, args.engines[e], args.threads[k] );
+            }
+            if ( n_results < MAX_RESULTS )
+            {
+                result_t *res = &results[ n_results++ ];
+                snprintf( res->name, sizeof(res->name), "%s", c->name );
+                snprintf( res->engine, sizeof(res->engine), "%s", args.engines[e] );
+                res->threads = args.threads[k];
+                res->seconds = best;
+                res->mbps    = bytes / best / 1e6;
+                res->rss_kb  = best_rss;
+            }
+        }
+
+    if ( !args.keep )
+        unlink( in );
+    unlink( out );
+}
+
+static result_t *find_baseline( result_t *base, int n, result_t *r )
+{
+    int i;
+
+    for( i = 0; i < n; i++ )
+        if ( strcmp( base[i].name, r->name ) == 0 && strcmp( base[i].engine, r->engine ) == 0 &&
+             base[i].threads == r->threads )
+            return &base[i];
+    return (result_t *)0;
+}
+
+static int load_baseline( const char *path, result_t *base )
+{
+    char line[ 256 ];
+    FILE *fp;
+    int n = 0;
+
+    if ( (fp = fopen( path, "r" )) == (FILE *)0 )
+    {
+        perror( path );
+        return -1;
+    }
+    while ( n < MAX_RESULTS && fgets( line, sizeof(line), fp ) )
+    {
+        result_t *r = &base[ n ];
+        if ( line[0] == '#' )
+            continue;
+        if ( sscanf( line, "%63s %15s %d %lf %lf %ld", r->name, r->engine, &r->threads,
+                     &r->seconds, &r->mbps, &r->rss_kb ) == 6 )
+            n++;
+    }
+    fclose( fp );
+    return n;
+}
+
+static int save_baseline( const char *path )
+{
+    FILE *fp;
+    int i;
+
+    if ( (fp = fopen( path, "w" )) == (FILE *)0 )
+    {
+        perror( path );
+        return -1;
+    }
+    fprintf( fp, "# ftbench %s, seed %ld, %ld MB per case\n", VERSION_STR, args.seed, args.scale );
+    fprintf( fp, "# case engine threads seconds mb_per_second peak_rss_kb\n" );
+    for( i = 0; i < n_results; i++ )
+        fprintf( fp, "%s %s %d %.6f %.3f %ld\n", results[i].name, results[i].engine,
+                 results[i].threads, results[i].seconds, results[i].mbps, results[i].rss_kb );
+    return fclose( fp ) == 0 ? 0 : -1;
+}
+
+/* print the table; returns the # of regressions against the baseline */
+static int report( result_t *base, int n_base )
+{
+    int i, regressions = 0;
+
+    printf( "%-14s %-10s %7s %9s %9s %10s", "case", "engine", "threads", "seconds", "MB/s", "peak RSS" );
+    if ( base )
+        printf( " %10s", "vs base" );
+    printf( "\n" );
+    for( i = 0; i < n_results; i++ )
+    {
+        result_t *r = &results[i], *b;
+
+        printf( "%-14s %-10s %7d %9.3f %9.1f %8.1fMB", r->name, r->engine, r->threads,
+                r->seconds, r->mbps, r->rss_kb / 1024.0 );
+        if ( base )
+        {
+            if ( (b = find_baseline( base, n_base, r )) == (result_t *)0 )
+                printf( " %10s", "new" );
+            else
+            {
+                double change = 100.0 * (r->seconds - b->seconds) / b->seconds;
+                printf( " %+9.1f%%", change );
+                if ( change > args.threshold )
+                {
+                    printf( "  slower" );
+                    regressions++;
+                }
+            }
+        }
+        printf( "\n" );
+    }
+    return regressions;
+}
+
+/* split "a,b,c" in place */
+static int split_list( char *s, char **items )
+{
+    int n = 0;
+    char *tok;
+
+    for( tok = strtok( s, "," ); tok && n < MAX_LIST; tok = strtok( (char *)0, "," ) )
+        items[ n++ ] = tok;
+    return n;
+}
+
+int main( int argc, char *argv[] )
+{
+    static char engine_list[ ARG_STR_LEN ], thread_list[ ARG_STR_LEN ];
+    static result_t base[ MAX_RESULTS ];
+    char *items[ MAX_LIST ], *tmp;
+    int c, i, n_base = -1, regressions;
+    static struct option long_options[] = {
+        { "save", required_argument, 0, OPT_SAVE },
+        { "compare", required_argument, 0, OPT_COMPARE },
+        { "threshold", required_argument, 0, OPT_THRESHOLD },
+        { "tmpdir", required_argument, 0, OPT_TMPDIR },
+        { "verify", no_argument, 0, OPT_VERIFY },
+        { "keep", no_argument, 0, OPT_KEEP },
+        { 0, 0, 0, 0 }
+    };
+
+    memset( (void *)&args, 0UL, sizeof(args_t) );
+    strcpy( args.binary, "./ftranspose" );
+    strcpy( engine_list, "auto" );
+    strcpy( thread_list, "1" );
+    tmp = getenv( "TMPDIR" );
+    snprintf( args.tmpdir, sizeof(args.tmpdir), "%s", tmp && tmp[0] ? tmp : "/tmp" );
+    args.scale     = DEFAULT_SCALE_MB;
+    args.seed      = 1;
+    args.repeats   = DEFAULT_REPEATS;
+    args.threshold = DEFAULT_THRESHOLD;
+    while( (c = getopt_long( argc, argv, "hb:S:s:r:e:t:c:", long_options, (int *)0 )) != -1 )
+    {
+        switch ( c )
+        {
+        case 'b':
+            snprintf( args.binary, sizeof(args.binary), "%s", optarg );
+            break;
+        case 'S':
+            args.scale = atol( optarg );
+            break;
+        case 's':
+            args.seed = atol( optarg );
+            break;
+        case 'r':
+            args.repeats = atoi( optarg );
+            break;
+        case 'e':
+            snprintf( engine_list, sizeof(engine_list), "%s", optarg );
+            break;
+        case 't':
+            snprintf( thread_list, sizeof(thread_list), "%s", optarg );
+            break;
+        case 'c':
+            snprintf( args.filter, sizeof(args.filter), "%s", optarg );
+            break;
+        case OPT_SAVE:
+            snprintf( args.save, sizeof(args.save), "%s", optarg );
+            break;
+        case OPT_COMPARE:
+            snprintf( args.compare, sizeof(args.compare), "%s", optarg );
+            break;
+        case OPT_THRESHOLD:
+            args.threshold = atof( optarg );
+            break;
+        case OPT_TMPDIR:
+            snprintf( args.tmpdir, sizeof(args.tmpdir), "%s", optarg );
+            break;
+        case OPT_VERIFY:
+            args.verify = 1;
+            break;
+        case OPT_KEEP:
+            args.keep = 1;
+            break;
+        case 'h':
+            usage( EXIT_SUCCESS );
+            break;
+        default:
+            usage( EXIT_FAILURE );
+            break;
+        }
+    }
+    if ( args.scale < 1 || args.repeats < 1 )
+    {
+        fprintf( stderr, "Error: -S and -r must be at least 1\n" );
+        usage( EXIT_FAILURE );
+    }
+    args.n_engines = split_list( engine_list, args.engines );
+    args.n_threads = split_list( thread_list, items );
+    for( i = 0; i < args.n_threads; i++ )
+        if ( (args.threads[i] = atoi( items[i] )) < 1 )
+        {
+            fprintf( stderr, "Error: invalid thread count: %s\n", items[i] );
+            usage( EXIT_FAILURE );
+        }
+    if ( access( args.binary, X_OK ) != 0 )
+    {
+        perror( args.binary );
+        return EXIT_FAILURE;
+    }
+    if ( args.compare[0] && (n_base = load_baseline( args.compare, base )) < 0 )
+        return EXIT_FAILURE;
+
+    for( i = 0; i < N_CASES; i++ )
+        if ( !args.filter[0] || strstr( cases[i].name, args.filter ) )
+            bench_case( &cases[i] );
+
+    regressions = report( n_base >= 0 ? base : (result_t *)0, n_base );
+    if ( args.save[0] && save_baseline( args.save ) < 0 )
+    {
+        perror( args.save );
+        return EXIT_FAILURE;
+    }
+    if ( regressions )
+        fprintf( stderr, "%d result%s more than %.1f%% slower than %s\n", regressions,
+                 regressions == 1 ? "" : "s", args.threshold, args.compare );
+    return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
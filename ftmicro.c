@@ -0,0 +1,351 @@
+/*
+ * ftmicro.c
+ *
+ * Micro-benchmarks for the hot kernels of ftranspose, run in isolation on
+ * in-memory data: the tokenizer, the tile gather for each element width,
+ * the line formatter and the output writer.  Each reports ns/element and
+ * GB/s as the best and median of -r timed runs after -w warmup runs.
+ *
+ * libftranspose.c is compiled in, so the kernels measured are the ones
+ * shipped:
+ *
+ * cc --std=c99 -O2 -pthread -o ftmicro ftmicro.c
+ * ./ftmicro
+ */
+
+#include "libftranspose.c"
+#include <getopt.h>
+
+#define MICRO_BYTES            (32 << 20)  /* data per kernel run                 */
+#define MICRO_WARMUP           2
+#define MICRO_REPEATS          9
+#define MICRO_MAX_REPEATS      1000
+
+static const int micro_widths[] = { 1, 2, 4, 8, 16, 20, 32, 64 };
+#define N_MICRO_WIDTHS  ( (int)(sizeof(micro_widths) / sizeof(micro_widths[0])) )
+
+typedef struct {
+    int   warmup;
+    int   repeats;
+    idx_t bytes;
+    int   pipe;            /* writer: a pipe drained by a thread, not /dev/null */
+    char  filter[ ARG_STR_LEN ];
+} micro_args_t;
+static micro_args_t margs;
+static ft_ctx_t *micro_ctx;    /* profile sizes and phase totals */
+
+/* one kernel: run() does the work once and returns the elements and bytes
+ * it handled
+ */
+typedef struct {
+    const char *name;
+    void      (*run)( void *ctx, idx_t *elements, idx_t *bytes );
+    void       *ctx;
+} kernel_t;
+
+static void micro_usage( int rc )
+{
+    fprintf( stderr, "\nftmicro OPTIONS\n"                                            \
+                     "  Version: " FT_VERSION "\n\n"                                  \
+                     "  - time the ftranspose kernels in isolation\n"                 \
+		     " OPTIONS\n"                                                     \
+		     "   -h                     help (this)\n"                        \
+		     "   -w #                   warmup runs per kernel (default %d)\n" \
+		     "   -r #                   timed runs per kernel (default %d)\n"  \
+		     "   -S MB                  data per run (default %d)\n"          \
+		     "   -k name                only kernels whose name contains this\n" \
+		     "   --pipe                 time the writer into a pipe instead\n" \
+		     "                          of /dev/null\n\n",
+             MICRO_WARMUP, MICRO_REPEATS, MICRO_BYTES >> 20 );
+    exit( rc );
+}
+
+static int compare_doubles( const void *a, const void *b )
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void micro_run( kernel_t *k )
+{
+    static double times[ MICRO_MAX_REPEATS ];
+    idx_t elements = 0, bytes = 0;
+    double t, best, median;
+    int i;
+
+    if ( margs.filter[0] && !strstr( k->name, margs.filter ) )
+        return;
+    for( i = 0; i < margs.warmup; i++ )
+        k->run( k->ctx, &elements, &bytes );
+    for( i = 0; i < margs.repeats; i++ )
+    {
+        t = clock_seconds( CLOCK_MONOTONIC );
+        k->run( k->ctx, &elements, &bytes );
+        times[i] = clock_seconds( CLOCK_MONOTONIC ) - t;
+    }
+    qsort( times, margs.repeats, sizeof(double), compare_doubles );
+    best   = times[0];
+    median = times[ margs.repeats / 2 ];
+    printf( "%-18s %12ld %10.2f %10.2f %9.2f %9.2f\n", k->name, elements,
+            best * 1e9 / elements, median * 1e9 / elements,
+            bytes / best / 1e9, bytes / median / 1e9 );
+    fflush( stdout );
+}
+
+/* a rows x cols matrix of random digit strings, and the same as text */
+typedef struct {
+    array_t *a;
+    char    *text;
+    idx_t    text_bytes;
+    char    *tile;         /* gather_tile() / format_fields() scratch  */
+    char    *out;
+} micro_data_t;
+
+static int micro_data( micro_data_t *d, int es, idx_t bytes )
+{
+    unsigned int seed = 1;
+    idx_t n, i;
+    char *o;
+
+    memset( (void *)d, 0, sizeof(*d) );
+    for( n = 16; 4 * n * n * es <= bytes; n *= 2 )
+        ;
+    if ( (d->a = new_array( micro_ctx, es )) == (array_t *)0 || tune_matrix( d->a, n, n, &seed ) < 0 )
+        return -1;
+    d->text = malloc( n * n * (es + 1) );
+    d->tile = malloc( micro_ctx->tune.tile_bytes + es );
+    d->out  = malloc( (micro_ctx->tune.tile_bytes / es + 1) * (es + 1) );
+    if ( d->text == (char *)0 || d->tile == (char *)0 || d->out == (char *)0 )
+        return -1;
+    o = d->text;
+    for( i = 0; i < n; i++ )
+        o = format_fields( o, &d->a->data[ i * n * es ], n, es, TAB, 1 );
+    d->text_bytes = o - d->text;
+    return 0;
+}
+
+static void micro_free( micro_data_t *d )
+{
+    free_array( d->a );
+    free( (void *)d->text );
+    free( (void *)d->tile );
+    free( (void *)d->out );
+}
+
+/* tokenizer: parse_block() over the whole text into a reused matrix */
+static void run_tokenize( void *ctx, idx_t *elements, idx_t *bytes )
+{
+    micro_data_t *d = (micro_data_t *)ctx;
+    static array_t *a;
+    parser_t ps;
+
+    if ( a == (array_t *)0 || a->element_size != d->a->element_size )
+    {
+        free_array( a );
+        a = new_array( micro_ctx, d->a->element_size );
+        reserve_elements( a, d->a->element_count );
+    }
+    reset_array( a );
+    parser_init( &ps, TAB, a->element_size, 0, ALL_COLUMNS, (const keyset_t *)0, (text_t *)0, 0 );
+    parse_block( &ps, a, d->text, d->text_bytes, ALL_COLUMNS );
+    parse_finish( &ps, a );
+    parser_free( &ps );
+    *elements = a->element_count;
+    *bytes = d->text_bytes;
+}
+
+/* tile transpose: gather_tile() over the whole matrix */
+static void run_gather( void *ctx, idx_t *elements, idx_t *bytes )
+{
+    micro_data_t *d = (micro_data_t *)ctx;
+    array_t *a = d->a;
+    idx_t row, col, nr, nc, tr, tc;
+
+    tile_shape( micro_ctx, a->rows, a->cols, a->element_size, &tr, &tc );
+    for( col = 0; col < a->cols; col += tc )
+    {
+        nc = (a->cols - col < tc) ? a->cols - col : tc;
+        for( row = 0; row < a->rows; row += tr )
+        {
+            nr = (a->rows - row < tr) ? a->rows - row : tr;
+            gather_tile( a, row, col, nr, nc, d->tile );
+        }
+    }
+    *elements = a->element_count;
+    *bytes = a->element_count * a->element_size;
+}
+
+/* formatter: format_fields() from stored matrix rows, one tile at a time */
+static void run_format( void *ctx, idx_t *elements, idx_t *bytes )
+{
+    micro_data_t *d = (micro_data_t *)ctx;
+    array_t *a = d->a;
+    idx_t es = a->element_size, per = micro_ctx->tune.tile_bytes / es, i, n, out = 0;
+
+    for( i = 0; i < a->element_count; i += per )
+    {
+        n = (a->element_count - i < per) ? a->element_count - i : per;
+        out += format_fields( d->out, &a->data[ i * es ], n, es, TAB, 1 ) - d->out;
+    }
+    *elements = a->element_count;
+    *bytes = out;
+}
+
+/* writer: write_block() of the text in tile-sized pieces */
+typedef struct {
+    micro_data_t *d;
+    output_t      out;
+} micro_writer_t;
+
+static void run_write( void *ctx, idx_t *elements, idx_t *bytes )
+{
+    micro_writer_t *w = (micro_writer_t *)ctx;
+    micro_data_t *d = w->d;
+    idx_t off, n, tile = micro_ctx->tune.tile_bytes;
+
+    for( off = 0; off < d->text_bytes; off += tile )
+    {
+        n = (d->text_bytes - off < tile) ? d->text_bytes - off : tile;
+        write_block( micro_ctx, &w->out, d->text + off, n );
+    }
+    *elements = d->a->element_count;
+    *bytes = d->text_bytes;
+}
+
+/* the other end of --pipe */
+static void *drain( void *arg )
+{
+    int fd = *(int *)arg;
+    char *buf = malloc( 1 << 16 );
+
+    while ( buf && read( fd, buf, 1 << 16 ) > 0 )
+        ;
+    free( (void *)buf );
+    return (void *)0;
+}
+
+int main( int argc, char *argv[] )
+{
+    static struct option long_options[] = {
+        { "pipe", no_argument, 0, 'p' },
+        { 0, 0, 0, 0 }
+    };
+    char name[ 32 ];
+    micro_data_t d;
+    micro_writer_t w;
+    ft_options_t opt;
+    kernel_t k;
+    pthread_t reader;
+    int c, i, fds[2];
+
+    memset( (void *)&margs, 0, sizeof(margs) );
+    margs.warmup  = MICRO_WARMUP;
+    margs.repeats = MICRO_REPEATS;
+    margs.bytes   = MICRO_BYTES;
+    while( (c = getopt_long( argc, argv, "hw:r:S:k:", long_options, (int *)0 )) != -1 )
+    {
+        switch ( c )
+        {
+        case 'w':
+            margs.warmup = atoi( optarg );
+            break;
+        case 'r':
+            margs.repeats = atoi( optarg );
+            break;
+        case 'S':
+            margs.bytes = (idx_t)atol( optarg ) << 20;
+            break;
+        case 'k':
+            snprintf( margs.filter, sizeof(margs.filter), "%s", optarg );
+            break;
+        case 'p':
+            margs.pipe = 1;
+            break;
+        case 'h':
+            micro_usage( EXIT_SUCCESS );
+            break;
+        default:
+            micro_usage( EXIT_FAILURE );
+            break;
+        }
+    }
+    if ( margs.warmup < 0 || margs.repeats < 1 || margs.repeats > MICRO_MAX_REPEATS || margs.bytes < 1 )
+    {
+        fprintf( stderr, "Error: invalid -w, -r or -S\n" );
+        micro_usage( EXIT_FAILURE );
+    }
+    ft_options_init( &opt );
+    if ( (micro_ctx = ft_create( &opt )) == (ft_ctx_t *)0 )
+    {
+        perror( "ftmicro" );
+        return EXIT_FAILURE;
+    }
+    ft_load_profile( micro_ctx, (const char *)0 );
+
+    printf( "%-18s %12s %10s %10s %9s %9s\n", "kernel", "elements",
+            "ns/el", "ns/el med", "GB/s", "GB/s med" );
+
+    /* tokenizer and formatter at the default width, gather at every width */
+    for( i = 0; i < N_MICRO_WIDTHS; i++ )
+    {
+        int es = micro_widths[i];
+
+        if ( micro_data( &d, es, margs.bytes ) < 0 )
+        {
+            fprintf( stderr, "ftmicro: out of memory\n" );
+            return EXIT_FAILURE;
+        }
+        k.ctx = &d;
+        if ( es == DEFAULT_FIELD_LENGTH )
+        {
+            k.name = "tokenize";
+            k.run = run_tokenize;
+            micro_run( &k );
+            k.name = "format";
+            k.run = run_format;
+            micro_run( &k );
+        }
+        snprintf( name, sizeof(name), "gather/%d", es );
+        k.name = name;
+        k.run = run_gather;
+        micro_run( &k );
+
+        if ( es == DEFAULT_FIELD_LENGTH )
+        {
+            w.d = &d;
+            memset( (void *)&w.out, 0, sizeof(w.out) );
+            if ( margs.pipe )
+            {
+                if ( pipe( fds ) < 0 || pthread_create( &reader, (pthread_attr_t *)0, drain, &fds[0] ) != 0 )
+                {
+                    perror( "pipe" );
+                    return EXIT_FAILURE;
+                }
+                w.out.fd = fds[1];
+                k.name = "write/pipe";
+            }
+            else
+            {
+                if ( (w.out.fd = open( "/dev/null", O_WRONLY )) < 0 )
+                {
+                    perror( "/dev/null" );
+                    return EXIT_FAILURE;
+                }
+                k.name = "write/devnull";
+            }
+            k.run = run_write;
+            k.ctx = &w;
+            micro_run( &k );
+            close( w.out.fd );
+            if ( margs.pipe )
+            {
+                pthread_join( reader, (void **)0 );
+                close( fds[0] );
+            }
+        }
+        micro_free( &d );
+    }
+    ft_destroy( micro_ctx );
+    return EXIT_SUCCESS;
+}
@@ -15,17 +15,91 @@
  *      - truncates data elements to fit size limit
  */
  
+
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-#define ARG_STR_LEN            512
+#include "ftranspose.h"
+
+#define ARG_STR_LEN            FT_PATH_LEN
 #define DEFAULT_FIELD_LENGTH   20
 #define BACKSLASH 92
 #define TAB 9
 
-#define VERSION_STR   "1.3"
+#define MAX_THREADS            256
+#define PROGRESS_INTERVAL      1.0         /* seconds between progress lines             */
+#define TRACE_RING_SIZE        65536       /* spans kept per thread for --trace          */
+#define PROBE_BYTES            (64 << 20)  /* buffer size for the --bandwidth probe      */
+#define PROBE_SECONDS          0.25        /* minimum time spent probing                 */
+#define BATCH_PREFETCH         2           /* --batch inputs read ahead by default       */
+#define BATCH_MAX_PREFETCH     64
+#define BATCH_BUFFER_BYTES     (64 << 20)  /* larger inputs are read ahead by the kernel */
+#define KEEP_BYTES             (256 << 20) /* matrix buffer kept between --batch inputs
+                                            * and --serve jobs                           */
+#define SERVE_JOBS             4           /* --serve jobs run at once by default        */
+#define SERVE_MAX_JOBS         64
+#define SERVE_BACKLOG          64
+
+#define VERSION_STR   FT_VERSION
+
+
+/* long-only options */
+enum {
+    OPT_STATS = 256,
+    OPT_PROGRESS,
+    OPT_TRACE,
+    OPT_PERF,
+    OPT_BANDWIDTH,
+    OPT_TMPDIR,
+    OPT_PLAN,
+    OPT_AUTOTUNE,
+    OPT_PROFILE,
+    OPT_BATCH,
+    OPT_PREFETCH,
+    OPT_SERVE,
+    OPT_CONNECT,
+    OPT_JOBS,
+    OPT_ARENA,
+    OPT_JOIN,
+    OPT_PASTE,
+    OPT_WINDOW,
+    OPT_WINDOW_SEP,
+    OPT_WINDOW_INDEX,
+    OPT_APPEND,
+    OPT_RENDER,
+    OPT_SEGMENTS,
+    OPT_LINES,
+    OPT_INDEX,
+    OPT_BUILD_INDEX,
+    OPT_KEEP_ROWS,
+    OPT_HEADER,
+    OPT_LABELS,
+    OPT_COLUMN_WIDTHS,
+    OPT_NUMA,
+    OPT_NO_SMT,
+    OPT_DIRECT,
+    OPT_SPILL_CODEC,
+    OPT_CHECKPOINT,
+    OPT_RESUME
+};
+
+typedef long int idx_t;
 
 typedef struct {
     int  element_size;
@@ -33,22 +107,102 @@ typedef struct {
     char in_delim;
     char out_delim;
     char in_filename[ ARG_STR_LEN ];
+    char **inputs;         /* every -i, stacked as rows if more than one */
+    int  n_inputs;
     char out_filename[ ARG_STR_LEN ];
+    char stats_filename[ ARG_STR_LEN ];
+    int  progress_fd;      /* -1 = no progress reporting */
+    char trace_filename[ ARG_STR_LEN ];
+    int  perf;             /* read hardware counters around each phase */
+    int  bandwidth;        /* probe peak memory bandwidth at startup   */
+    int  engine;           /* FT_ENGINE_*                              */
+    idx_t memory_budget;   /* -M bytes, 0 = from free memory           */
+    char tmpdir[ ARG_STR_LEN ];
+    int  plan_only;        /* print the plan and exit                  */
+    int  threads;          /* -t, 0 = from the profile                 */
+    int  autotune;         /* benchmark and save a profile, then exit  */
+    char profile[ ARG_STR_LEN ];
+    char batch_filename[ ARG_STR_LEN ]; /* manifest of input/output pairs */
+    int  prefetch;         /* --batch inputs read ahead                */
+    char serve_socket[ ARG_STR_LEN ];   /* run as a server on this socket */
+    char connect_socket[ ARG_STR_LEN ]; /* send the job to a server       */
+    int  jobs;             /* --serve jobs run at once                 */
+    idx_t arena;           /* --serve matrix buffer per job, 0 = grow  */
+    char join_filename[ ARG_STR_LEN ];  /* list of single-column files   */
+    int  join_columns;     /* --paste: each file is an output column   */
+    idx_t window_rows;     /* --window: transpose every this many rows */
+    char window_sep[ ARG_STR_LEN ];     /* line after each block         */
+    int  has_window_sep;
+    int  window_index;     /* block # as the first field of each line  */
+    char store_dir[ ARG_STR_LEN ];      /* --append to / --render a store */
+    int  store_render;
+    idx_t seg_first;       /* --segments: first to render              */
+    idx_t seg_count;       /* and how many, 0 = through the last       */
+    int64_t *lines;        /* --lines: input columns to write, from 0  */
+    idx_t n_lines;
+    char index_filename[ ARG_STR_LEN ]; /* --index, "" = input.ftidx     */
+    int  build_index;      /* build the index and exit                 */
+    char keep_filename[ ARG_STR_LEN ];  /* keys of the rows to keep      */
+    int  header;           /* first row: column names, kept whole      */
+    int  labels;           /* first field: row names, kept whole       */
+    int  column_widths;    /* slots sized per column from a sample     */
+    int  numa;             /* FT_NUMA_*: matrix placement, pinning     */
+    int  no_smt;           /* one pinned worker per core               */
+    int  direct_io;        /* spill with O_DIRECT                      */
+    int  spill_codec;      /* FT_CODEC_*: spilled band compression     */
+    char checkpoint[ ARG_STR_LEN ]; /* external engine journal         */
+    int  resume;           /* carry on from the journal                */
 } args_t;
 static args_t args;
 
-typedef long int idx_t;
+/* what the library does not see: the whole run and the probe around it */
+typedef struct {
+    double        start;     /* wall clock at program start                  */
+    double        cpu_start; /* process CPU seconds when start was taken     */
+    double        peak_bw;   /* measured memcpy bandwidth, bytes/s (0 = none)*/
+} run_t;
+static run_t run;
+
+/* --progress: a sampling thread reads the counters the library publishes */
+typedef struct {
+    ft_ctx_t       *ctx;
+    int             fd;    /* where status lines go                          */
+    int             tty;   /* rewrite a single line instead of appending     */
+    int             running;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+} progress_t;
+static progress_t progress;
 
+/* --trace: each thread records spans into its own ring buffer, so the hot
+ * paths never share a cache line or take a lock; the buffers are linked
+ * into a list when a thread records its first span and written out as
+ * Chrome trace JSON at exit.  The library reports spans through the
+ * on_span hook, which is only set when tracing is on.
+ */
 typedef struct {
-  idx_t rows;              /* # rows in matrix                                        */
-  idx_t cols;              /* # columns in matrix                                     */
-  idx_t element_capacity;  /* maximum # of elements that can be stored in data buffer */
-  idx_t element_count;     /* current # of elements stored in data buffer             */
-  idx_t pos;               /* cursor for writing new elements to data buffer          */
-  int   element_size;      /* # of bytes in each data element (fixed width)           */
-  char *data;              /* data buffer                                             */
-  idx_t bytes_allocated;   /* metrics; total amount of RAM used                       */
-}array_t;
+    const char *name;      /* static string                                  */
+    double      start;     /* seconds, CLOCK_MONOTONIC                       */
+    double      end;
+    idx_t       bytes;
+} trace_span_t;
+
+typedef struct trace_buf_s {
+    struct trace_buf_s *next;
+    int           tid;     /* small sequential id, in registration order     */
+    char          name[ 32 ]; /* thread name shown in the timeline           */
+    idx_t         count;   /* spans ever recorded; ring slot = count % size  */
+    trace_span_t  spans[ TRACE_RING_SIZE ];
+} trace_buf_t;
+
+static int              trace_enabled;
+static double           trace_origin;
+static trace_buf_t     *trace_threads;
+static int              trace_next_tid;
+static pthread_mutex_t  trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread trace_buf_t *trace_local;
+static __thread const char  *trace_thread_name;
 
 
 
@@ -64,329 +218,2108 @@ void usage( int rc )
 		     "   -d delim               input delimiter\n"                    \
 		     "   -D delim               output delimiter\n"                   \
 		     "   -f #                   field width (default %d chars)\n"     \
-		     "   -i filename            input filename\n"                     \
-		     "   -o filename            output filename\n\n",
-             DEFAULT_FIELD_LENGTH  );
+		     "   -i filename            input filename; repeat to stack\n"   \
+		     "                          files with the same columns as rows\n" \
+		     "   -o filename            output filename\n"                    \
+		     "   --stats filename       write run statistics as JSON\n"       \
+		     "                          ('-' for stderr)\n"                  \
+		     "   --progress[=fd]        report progress, rate and ETA on\n"   \
+		     "                          stderr (or file descriptor fd)\n"    \
+		     "   --trace filename       write a Chrome trace (JSON) of the\n" \
+		     "                          pipeline phases on each thread\n"    \
+		     "   --perf                 add hardware counters (cycles, IPC,\n" \
+		     "                          LLC/dTLB/branch misses) per phase\n"  \
+		     "                          to --stats\n"                         \
+		     "   --bandwidth            measure peak memory bandwidth first\n" \
+		     "                          and report each phase against it\n"  \
+		     "   -e engine              auto (default), memory, multipass,\n" \
+		     "                          external or cursor\n"               \
+		     "   -M size                memory budget, e.g. 512M or 4G\n"    \
+		     "                          (default: 80%% of free memory)\n"    \
+		     "   --tmpdir dir[:dir...]  scratch space for the external\n"    \
+		     "                          engine (default $TMPDIR or /tmp);\n" \
+		     "                          spill files go round robin over\n" \
+		     "                          several, given once or repeated\n" \
+		     "   --direct               spill with O_DIRECT, past the page\n" \
+		     "                          cache\n"                           \
+		     "   --spill-codec CODEC    auto, none or lz: compress spilled\n" \
+		     "                          bands; auto samples the first\n"  \
+		     "                          (default auto)\n"                 \
+		     "   --checkpoint file      external engine: journal the bands\n" \
+		     "                          and output lines done, keeping the\n" \
+		     "                          spill files until the end\n"       \
+		     "   --resume               carry on from the --checkpoint\n"  \
+		     "                          journal of an interrupted run\n"   \
+		     "   --plan                 print the shape, budget and engine\n" \
+		     "                          estimates, then exit\n"             \
+		     "   -t #                   threads transposing and formatting\n" \
+		     "                          (default from the profile, else 1)\n" \
+		     "   --autotune             time tile, block and page sizes and\n" \
+		     "                          thread counts, save them to this\n"  \
+		     "                          host's profile, then exit\n"        \
+		     "   --profile filename     profile to load or save (default\n"  \
+		     "                          ~/.config/ftranspose/HOST.profile)\n" \
+		     "   --batch manifest       transpose each 'input<TAB>output'\n" \
+		     "                          line of manifest ('-' for stdin)\n" \
+		     "   --prefetch #           --batch inputs read ahead while\n"  \
+		     "                          one is transposed (default %d)\n"   \
+		     "   --serve socket         run transpose jobs sent to a Unix\n" \
+		     "                          socket until SIGINT or SIGTERM\n"  \
+		     "   --jobs #               --serve jobs run at once (default %d)\n" \
+		     "   --arena size           --serve matrix buffer allocated per\n" \
+		     "                          job up front, on huge pages\n"     \
+		     "   --connect socket       send this transpose to a --serve\n" \
+		     "                          process instead of running it\n"   \
+		     "   --join list            write each single-column file named\n" \
+		     "                          in list as one output line\n"      \
+		     "   --paste list           write each as one output column\n"  \
+		     "   --window #             transpose every # input rows as a\n" \
+		     "                          block of its own, as they arrive\n" \
+		     "   --window-sep string    write string as a line after each\n" \
+		     "                          block\n"                           \
+		     "   --window-index         start each output line with the\n" \
+		     "                          number of its block\n"             \
+		     "   --append dir           add the input's rows to the store\n" \
+		     "                          in dir (made if need be), kept\n"  \
+		     "                          transposed in binary segments\n"   \
+		     "   --render dir           write the store in dir as text\n"  \
+		     "   --segments n[-m]       --render segments n to m only\n"  \
+		     "   --lines n,m-k,...      write only these output lines (input\n" \
+		     "                          columns, from 1), using an index of\n" \
+		     "                          the input file\n"                 \
+		     "   --index filename       the index (default input.ftidx),\n" \
+		     "                          rebuilt when the input changes\n"  \
+		     "   --build-index          build the index, then exit\n"    \
+		     "   --keep-rows filename   keep only rows whose first field\n" \
+		     "                          is a line of filename\n"          \
+		     "   --header               the first row names the columns;\n" \
+		     "                          names are kept whole, whatever -f\n" \
+		     "   --labels               the first field names its row\n"   \
+		     "   --column-widths        memory engine: size each column's\n" \
+		     "                          fields from the first rows, up to\n" \
+		     "                          -f, and keep longer ones apart\n" \
+		     "   --numa mode            pin threads over NUMA nodes and put\n" \
+		     "                          the matrix near them: local, each\n" \
+		     "                          band of rows on the node writing it\n" \
+		     "                          out, interleave, or off (default)\n" \
+		     "   --no-smt               pin one thread per core\n\n",
+             DEFAULT_FIELD_LENGTH, BATCH_PREFETCH, SERVE_JOBS  );
     exit( rc );
 }
 
-void free_array( array_t *a )
+static double clock_seconds( clockid_t id )
+{
+    struct timespec ts;
+
+    clock_gettime( id, &ts );
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* name the calling thread in the trace; call before its first span */
+static void trace_name_thread( const char *name )
+{
+    trace_thread_name = name;
+}
+
+static trace_buf_t *trace_register( void )
+{
+    trace_buf_t *tb = calloc( 1, sizeof(trace_buf_t) );
+
+    if ( tb == (trace_buf_t *)0 )
+    {
+        trace_enabled = 0;
+        return tb;
+    }
+    snprintf( tb->name, sizeof(tb->name), "%s", trace_thread_name ? trace_thread_name : "worker" );
+    pthread_mutex_lock( &trace_lock );
+    tb->tid  = ++trace_next_tid;
+    tb->next = trace_threads;
+    trace_threads = tb;
+    pthread_mutex_unlock( &trace_lock );
+    return tb;
+}
+
+static void trace_span( const char *name, double start, double end, idx_t bytes )
 {
-    if ( a == (array_t *)0 )
+    trace_buf_t *tb = trace_local;
+    trace_span_t *sp;
+
+    if ( tb == (trace_buf_t *)0 && (tb = trace_local = trace_register()) == (trace_buf_t *)0 )
         return;
-    free( (void *)a->data );
-    free( (void *)a );
-    return;
+    sp = &tb->spans[ tb->count++ % TRACE_RING_SIZE ];
+    sp->name  = name;
+    sp->start = start;
+    sp->end   = end;
+    sp->bytes = bytes;
+}
+
+/* ft_options_t.on_span */
+static void trace_on_span( void *user, const char *name, double start, double end, int64_t bytes )
+{
+    (void)user;
+    trace_span( name, start, end, bytes );
 }
 
-inline void insert_element( array_t *a, char *e )
+/* ft_options_t.on_thread: the library names the threads it starts */
+static void trace_on_thread( void *user, const char *name )
 {
-    int new_elements = 0;
+    (void)user;
+    trace_name_thread( name );
+}
+
+static void trace_write( void )
+{
+    FILE *fp;
+    trace_buf_t *tb;
+    idx_t i, first;
 
-    /* 'a' might not be big enough to hold this next element.
-     * If it isn't, then realloc.
-     */
-    if ( a->element_count >= a->element_capacity )
+    if ( !trace_enabled )
+        return;
+    trace_enabled = 0;
+    if ( (fp = fopen( args.trace_filename, "w" )) == (FILE *)0 )
     {
-        /* not big enough, re-allocate a huge chunk */
-        array_t b;
+        perror( args.trace_filename );
+        return;
+    }
 
-        /* double current elements or start with a reasonable number
-         * if first time through
-         */
-        if ( (new_elements = a->element_capacity) == 0 )
-            new_elements = (4096 / a->element_size);
+    fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+    fprintf( fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"ftranspose\"}}",
+             (int)getpid() );
+    pthread_mutex_lock( &trace_lock );
+    for( tb = trace_threads; tb; tb = tb->next )
+    {
+        fprintf( fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"name\":\"%s\"}}", (int)getpid(), tb->tid, tb->name );
+        fprintf( fp, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"sort_index\":%d}}", (int)getpid(), tb->tid, tb->tid );
+        if ( tb->count > TRACE_RING_SIZE )
+            fprintf( fp, ",\n{\"name\":\"spans dropped\",\"ph\":\"i\",\"s\":\"t\",\"ts\":0,"
+                         "\"pid\":%d,\"tid\":%d,\"args\":{\"count\":%ld}}",
+                     (int)getpid(), tb->tid, tb->count - TRACE_RING_SIZE );
 
-        /* if the huge chunk allocate fails this loop will cut down on the
-         * requested bytes.  Ex. Imagine you've allocated 64MB.  The next time
-         * we allocate data we'd request 128MB.  That might fail and if we
-         * only needed +1MB (65MB) then this loop will allow the program
-         * to continue */
-        while( 1 )
+        first = tb->count > TRACE_RING_SIZE ? tb->count - TRACE_RING_SIZE : 0;
+        for( i = first; i < tb->count; i++ )
         {
-            /* try for double what we already have allocated */
-            size_t size_bytes = a->element_size * (a->element_capacity + new_elements);
+            trace_span_t *sp = &tb->spans[ i % TRACE_RING_SIZE ];
+            fprintf( fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                         "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"bytes\":%ld}}",
+                     sp->name, (int)getpid(), tb->tid,
+                     (sp->start - trace_origin) * 1e6, (sp->end - sp->start) * 1e6, sp->bytes );
+        }
+    }
+    pthread_mutex_unlock( &trace_lock );
+    fprintf( fp, "\n]}\n" );
+    fclose( fp );
+}
 
-            /* ensure we allocate an integer multiple pages (4096 bytes) */
-            size_bytes = ((4095 + size_bytes) >> 12) << 12;
+static void format_eta( char *s, size_t size, double seconds )
+{
+    long t = (long)(seconds + 0.5);
 
-            if ( args.verbosity >= 3 )
-            {
-                printf( "FAILED\nattempting realloc( %ld ) .. ", size_bytes );
-                fflush(NULL);
-            }
+    if ( t >= 3600 )
+        snprintf( s, size, "%ld:%02ld:%02ld", t / 3600, (t / 60) % 60, t % 60 );
+    else
+        snprintf( s, size, "%ld:%02ld", t / 60, t % 60 );
+}
 
-            /* try to grab more memory */
-            b.data = (char *)realloc( (void *)a->data, size_bytes );
+/* print one status line for 'stage' from the published counters, with
+ * rates measured from 'since' to 'until' (now if 0)
+ */
+static void progress_report( int stage, double since, double until, int final )
+{
+    char line[ 256 ], eta[ 32 ];
+    ft_progress_t p;
+    double elapsed = (until > 0.0 ? until : clock_seconds( CLOCK_MONOTONIC )) - since;
+    int n = 0;
 
-            /* if the realloc fails, adjust the requested amount and try again */
-            if ( b.data == (char *)0 )
-            {
-                /* each failed alloc results in a 50% reduction in extra requested
-                 * space until we hit the lower limit of 1 page, 4096 bytes.
-                 */
-                new_elements >>= 1;
-                if ( new_elements == 0 )
-                {
-                    fprintf( stderr, "\nfailed to realloc in %s\n", __func__ );
-                    free_array( a );
-                    exit( EXIT_FAILURE );
-                }
-
-                /* go back to top of loop to retry the alloc with
-                 * less memory requested */
-                continue;
-            }
+    if ( elapsed <= 0.0 )
+        elapsed = 1e-9;
+    eta[0] = '\0';
+    ft_progress( progress.ctx, &p );
 
-            /* realloc successful, break out of loop */
-            a->bytes_allocated = size_bytes;
-            break;
+    if ( stage == FT_STAGE_READ )
+    {
+        idx_t bytes = p.bytes_in;
+        idx_t total = p.bytes_total;
+        idx_t rows  = p.rows_in;
+
+        if ( total > 0 && bytes > 0 && bytes < total )
+            format_eta( eta, sizeof(eta), (total - bytes) * elapsed / bytes );
+        n = snprintf( line, sizeof(line), "ftranspose: read %.1f MB", bytes / 1e6 );
+        if ( total > 0 )
+            n += snprintf( line + n, sizeof(line) - n, " of %.1f MB (%d%%)",
+                           total / 1e6, (int)(100.0 * bytes / total) );
+        n += snprintf( line + n, sizeof(line) - n, ", %ld rows, %.0f rows/s, %.1f MB/s",
+                       rows, rows / elapsed, bytes / elapsed / 1e6 );
+    }
+    else if ( stage == FT_STAGE_WRITE )
+    {
+        idx_t lines = p.lines_out;
+        idx_t total = p.lines_total;
+        idx_t bytes = p.bytes_out;
+
+        if ( total > 0 && lines > 0 && lines < total )
+            format_eta( eta, sizeof(eta), (total - lines) * elapsed / lines );
+        n = snprintf( line, sizeof(line), "ftranspose: wrote %ld of %ld lines (%d%%), "
+                      "%.0f lines/s, %.1f MB/s",
+                      lines, total, total > 0 ? (int)(100.0 * lines / total) : 100,
+                      lines / elapsed, bytes / elapsed / 1e6 );
+    }
+    else
+        return;
+
+    if ( eta[0] && n < (int)sizeof(line) )
+        n += snprintf( line + n, sizeof(line) - n, ", ETA %s", eta );
+    if ( n >= (int)sizeof(line) )
+        n = sizeof(line) - 1;
+
+    if ( progress.tty )
+        dprintf( progress.fd, "\r%s\033[K%s", line, final ? "\n" : "" );
+    else
+        dprintf( progress.fd, "%s\n", line );
+}
+
+/* sampling thread: wakes every PROGRESS_INTERVAL seconds and reports */
+static void *progress_main( void *unused )
+{
+    struct timespec deadline;
+    double since = 0.0;
+    int stage = FT_STAGE_IDLE;
+    ft_progress_t p;
+
+    (void)unused;
+    pthread_mutex_lock( &progress.lock );
+    while ( progress.running )
+    {
+        clock_gettime( CLOCK_REALTIME, &deadline );
+        deadline.tv_sec  += (time_t)PROGRESS_INTERVAL;
+        deadline.tv_nsec += (long)((PROGRESS_INTERVAL - (time_t)PROGRESS_INTERVAL) * 1e9);
+        if ( deadline.tv_nsec >= 1000000000L )
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
         }
+        pthread_cond_timedwait( &progress.wake, &progress.lock, &deadline );
 
-        /* indicate successful reallocation */
-        if ( args.verbosity >= 3 )
+        /* finish the previous stage's line and switch rate clocks */
+        ft_progress( progress.ctx, &p );
+        if ( p.stage != stage )
         {
-            printf( "PASSED\n" );
-            fflush(NULL);
+            double start = p.stage_start * 1e-9;
+
+            if ( stage != FT_STAGE_IDLE )
+                progress_report( stage, since, start, 1 );
+            stage = p.stage;
+            since = start;
         }
+        if ( stage != FT_STAGE_IDLE )
+            progress_report( stage, since, 0.0, !progress.running );
+    }
+    pthread_mutex_unlock( &progress.lock );
+    return (void *)0;
+}
 
-        /* update the main array */
-        a->data = b.data;
-        a->element_capacity += new_elements;
+static void progress_start( ft_ctx_t *ctx, int fd )
+{
+    progress.ctx = ctx;
+    progress.fd  = fd;
+    progress.tty = isatty( fd );
+    progress.running = 1;
+    pthread_mutex_init( &progress.lock, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &progress.wake, (pthread_condattr_t *)0 );
+    if ( pthread_create( &progress.thread, (pthread_attr_t *)0, progress_main, (void *)0 ) != 0 )
+    {
+        fprintf( stderr, "failed to start progress thread\n" );
+        progress.running = 0;
     }
+}
 
-    memcpy( &(a->data[ a->pos ]), e, a->element_size );
-    a->pos += a->element_size;
-    a->element_count++;
+static void progress_stop( void )
+{
+    if ( !progress.running )
+        return;
+    pthread_mutex_lock( &progress.lock );
+    progress.running = 0;
+    pthread_cond_signal( &progress.wake );
+    pthread_mutex_unlock( &progress.lock );
+    pthread_join( progress.thread, (void **)0 );
+    pthread_mutex_destroy( &progress.lock );
+    pthread_cond_destroy( &progress.wake );
 }
 
-array_t *read_array( char delim, char *filename, int element_size )
+/* parse "123", "64K", "512M", "4G" or "1T" into bytes; -1 if invalid */
+static idx_t parse_size( const char *s )
 {
-    idx_t col;
-    FILE *fp;
-    array_t *a = (array_t *)0;
-    int i;
-    char *e;
-    int c;
+    char *end;
+    double v = strtod( s, &end );
 
-	if (filename[0] == '\0') {
-		if ((fp = stdin) == NULL) usage(EXIT_FAILURE);
-	}
-	else  if ( (fp = fopen(filename, "r")) == (FILE *)0 )
+    if ( end == s || v < 0 )
+        return -1;
+    switch ( *end )
     {
-        perror( filename );
-		return;
+    case 'k': case 'K': v *= 1024.0; end++; break;
+    case 'm': case 'M': v *= 1024.0 * 1024.0; end++; break;
+    case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; end++; break;
+    case 't': case 'T': v *= 1024.0 * 1024.0 * 1024.0 * 1024.0; end++; break;
     }
+    if ( *end == 'b' || *end == 'B' )
+        end++;
+    return *end == '\0' ? (idx_t)v : -1;
+}
 
-    if ( args.verbosity >= 1 )
+/* write 's' as a JSON string literal */
+static void json_string( FILE *fp, const char *s )
+{
+    fputc( '"', fp );
+    for( ; *s; s++ )
     {
-        printf( "reading array ... " ); fflush(NULL);
+        unsigned char c = (unsigned char)*s;
+        if ( c == '"' || c == '\\' )
+            fprintf( fp, "\\%c", c );
+        else if ( c < 0x20 )
+            fprintf( fp, "\\u%04x", c );
+        else
+            fputc( c, fp );
     }
-    a = calloc( 1, sizeof(array_t) );
-    a->element_size = element_size;
-    e = calloc( 1, a->element_size );
-    col = 0;
-    i = 0;
-    while( (c = fgetc(fp)) != EOF )
-    {
-		/* seek to end of field if reached size limit*/
-		if ( ! ( (c == delim) || (c == '\n') || (c == EOF) ) && i >= a->element_size )
-		{
-			fprintf( stderr, "element @[%ld,%ld] size exceeded\n", a->rows, col);
-			while ((c = fgetc(fp)) != '\n' && c != EOF && c != delim);
-			i = a->element_size - 1;
-        }	
-			
-        /* end of a data element */
-        if ( (c == delim) || (c == '\n') || (c == EOF) )
-        {
-            if ( i > 0 )
-            {
-                e[i] = '\0';
+    fputc( '"', fp );
+}
 
-                /* insert element into array */
-                insert_element( a, e );
-                col++;
-            }
+static double mbps( idx_t bytes, double seconds )
+{
+    return seconds > 0.0 ? (double)bytes / seconds / 1e6 : 0.0;
+}
 
-            /* end of a row */
-            if ( c == '\n')
-            {	
-                a->rows++;
+/* peak resident set size of the process, in bytes */
+static idx_t peak_rss( void )
+{
+    struct rusage ru;
 
-                /* adjust maximum row length */
-                if ( col > a->cols )
-                    a->cols = col;
+    if ( getrusage( RUSAGE_SELF, &ru ) != 0 )
+        return 0;
+    return (idx_t)ru.ru_maxrss * 1024;
+}
 
-                /* print something helpful for large runs */
-                if ( args.verbosity >= 2 )
-                {
-                    printf( "row=%ld\n", a->rows);
-                    fflush(NULL);
-                }
+/* user plus system CPU time of the process so far, in seconds */
+static double cpu_seconds( void )
+{
+    struct rusage ru;
 
-                /* reset column counter */
-                col = 0;
-            }
+    if ( getrusage( RUSAGE_SELF, &ru ) != 0 )
+        return 0.0;
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
 
-            /* reset data element char index */
-            i = 0;
-        }
-		/* write to buffer */
-        else e[i++] = c;
+/* --bandwidth: time memcpy() between two buffers larger than the caches
+ * and keep the best repetition.  Every phase reads and writes the bytes it
+ * handles about once, like memcpy, so phase bytes/s over this figure says
+ * how close to the hardware limit the phase ran.
+ */
+static double bandwidth_probe( void )
+{
+    char *src, *dst;
+    double best = 0.0, begin, t0, t1;
+    int reps = 0;
+
+    src = malloc( PROBE_BYTES );
+    dst = malloc( PROBE_BYTES );
+    if ( src == (char *)0 || dst == (char *)0 )
+    {
+        fprintf( stderr, "bandwidth probe: out of memory\n" );
+        free( src );
+        free( dst );
+        return 0.0;
     }
 
-    if ( args.verbosity >= 1 )
+    /* fault the pages in so the probe times copying, not page faults */
+    memset( src, 1, PROBE_BYTES );
+    memset( dst, 0, PROBE_BYTES );
+
+    begin = clock_seconds( CLOCK_MONOTONIC );
+    do
+    {
+        t0 = clock_seconds( CLOCK_MONOTONIC );
+        memcpy( dst, src, PROBE_BYTES );
+        t1 = clock_seconds( CLOCK_MONOTONIC );
+        if ( t1 > t0 && PROBE_BYTES / (t1 - t0) > best )
+            best = PROBE_BYTES / (t1 - t0);
+        /* read the destination so the copy cannot be optimised away */
+        src[ reps % PROBE_BYTES ] = dst[ (reps * 4099) % PROBE_BYTES ];
+        reps++;
+    } while ( reps < 3 || t1 - begin < PROBE_SECONDS );
+
+    free( src );
+    free( dst );
+    return best;
+}
+
+/* achieved bandwidth of each phase as a fraction of the probe, on stderr */
+static void bandwidth_report( const ft_stats_t *st )
+{
+    int ph;
+
+    fprintf( stderr, "memory bandwidth: peak memcpy %.1f MB/s\n", run.peak_bw / 1e6 );
+    for( ph = 0; ph < FT_N_PHASES; ph++ )
     {
-        printf( "DONE\nread in %ld elements (r=%ld, c=%ld)\n", a->element_count, a->rows, a->cols );
+        const ft_phase_stats_t *p = &st->phase[ ph ];
+        fprintf( stderr, "  %-10s %10.1f MB/s  %5.1f%% of peak\n", ft_phase_name( ph ),
+                 mbps( p->bytes, p->wall ), 100.0 * mbps( p->bytes, p->wall ) * 1e6 / run.peak_bw );
     }
+}
 
-    fclose( fp );
-    free( (void *)e );
+/* hardware counters of one phase, plus the ratios that tell a TLB-bound
+ * phase from a bandwidth-bound one: IPC and misses per KB handled
+ */
+static void write_counters( FILE *fp, const ft_stats_t *st, const ft_phase_stats_t *p )
+{
+    double kb = p->bytes / 1024.0;
+    int i;
 
-    return a;
+    fprintf( fp, ",\n      \"counters\": {" );
+    for( i = 0; i < FT_N_HW_COUNTERS; i++ )
+        if ( st->hw_mask & (1u << i) )
+            fprintf( fp, " \"%s\": %llu,", ft_hw_counter_name( i ), (unsigned long long)p->hw[i] );
+    fprintf( fp, " \"ipc\": %.3f",
+             p->hw[ FT_HW_CYCLES ] ? (double)p->hw[ FT_HW_INSTRUCTIONS ] / p->hw[ FT_HW_CYCLES ] : 0.0 );
+    if ( st->hw_mask & (1u << FT_HW_LLC_MISSES) )
+        fprintf( fp, ", \"llc_misses_per_kb\": %.3f", kb > 0 ? p->hw[ FT_HW_LLC_MISSES ] / kb : 0.0 );
+    if ( st->hw_mask & (1u << FT_HW_DTLB_MISSES) )
+        fprintf( fp, ", \"dtlb_misses_per_kb\": %.3f", kb > 0 ? p->hw[ FT_HW_DTLB_MISSES ] / kb : 0.0 );
+    fprintf( fp, " }" );
 }
 
-void write_array_transposed( array_t *a, char *filename, char delim )
+void write_stats( ft_ctx_t *ctx, char *filename )
 {
-    idx_t row, col;
+    const ft_stats_t *st = ft_stats( ctx );
     FILE *fp;
-    char *buf = (char *)0;
-
-    if ( a == (array_t *)0 )
-        return;
+    double wall, cpu;
+    idx_t bytes_in, bytes_out;
+    int ph;
 
-	if (filename[0] == '\0') {
-		if ((fp = stdout) == (FILE*)0) usage(EXIT_FAILURE);
-	}
-	else  if ( (fp = fopen(filename, "w")) == (FILE *)0 )
+    if ( strcmp( filename, "-" ) == 0 )
+        fp = stderr;
+    else if ( (fp = fopen( filename, "w" )) == (FILE *)0 )
     {
         perror( filename );
-		return;
+        return;
     }
 
-    buf = malloc( a->element_size + 1 );
+    wall = clock_seconds( CLOCK_MONOTONIC ) - run.start;
+    cpu  = cpu_seconds() - run.cpu_start;
+    bytes_in  = st->phase[ FT_PHASE_READ ].bytes;
+    bytes_out = st->phase[ FT_PHASE_WRITE ].bytes;
 
-    if ( args.verbosity >= 1 )
+    fprintf( fp, "{\n" );
+    fprintf( fp, "  \"version\": \"%s\",\n", VERSION_STR );
+    fprintf( fp, "  \"input\": " );
+    json_string( fp, args.in_filename[0] ? args.in_filename : "-" );
+    fprintf( fp, ",\n  \"output\": " );
+    json_string( fp, args.out_filename[0] ? args.out_filename : "-" );
+    fprintf( fp, ",\n" );
+    fprintf( fp, "  \"engine\": \"%s\",\n", st->engine );
+    fprintf( fp, "  \"threads\": %d,\n", st->threads );
+    fprintf( fp, "  \"tuning\": { \"source\": " );
+    json_string( fp, st->tune_source );
+    fprintf( fp, ", \"page_bytes\": %ld, \"io_block\": %ld, \"tile_bytes\": %ld },\n",
+             st->page_bytes, st->io_block, st->tile_bytes );
+    if ( strcmp( st->engine, "multipass" ) == 0 )
+        fprintf( fp, "  \"passes\": %ld,\n", st->passes );
+    if ( strcmp( st->engine, "external" ) == 0 )
     {
-        printf( "writing array transposed ... " );
-		fflush( NULL );
+        fprintf( fp, "  \"bands\": %d,\n", st->bands );
+        fprintf( fp, "  \"spill\": { \"codec\": " );
+        json_string( fp, st->spill_codec );
+        fprintf( fp, ", \"raw_bytes\": %ld },\n", st->spill_raw );
     }
-
-    for( col = 0; col < a->cols; col++ )
+    if ( st->windows > 0 )
+        fprintf( fp, "  \"windows\": %ld,\n", st->windows );
+    if ( st->rows_skipped > 0 )
+        fprintf( fp, "  \"rows_skipped\": %ld,\n", st->rows_skipped );
+    if ( st->numa_nodes > 0 )
+        fprintf( fp, "  \"numa_nodes\": %d,\n", st->numa_nodes );
+    fprintf( fp, "  \"plan\": { \"seconds\": %.6f, \"budget_bytes\": %ld, "
+                 "\"predicted_seconds\": %.3f, \"predicted_memory_bytes\": %ld },\n",
+             st->plan_seconds, st->budget, st->predicted_seconds, st->predicted_memory );
+    fprintf( fp, "  \"rows\": %ld,\n", st->rows );
+    fprintf( fp, "  \"cols\": %ld,\n", st->cols );
+    fprintf( fp, "  \"elements\": %ld,\n", st->elements );
+    fprintf( fp, "  \"element_size\": %d,\n", args.element_size );
+    fprintf( fp, "  \"bytes_in\": %ld,\n", bytes_in );
+    fprintf( fp, "  \"bytes_out\": %ld,\n", bytes_out );
+    fprintf( fp, "  \"matrix_bytes\": %ld,\n", st->matrix_bytes );
+    fprintf( fp, "  \"peak_rss_bytes\": %ld,\n", peak_rss() );
+    fprintf( fp, "  \"wall_seconds\": %.6f,\n", wall );
+    fprintf( fp, "  \"cpu_seconds\": %.6f,\n", cpu );
+    fprintf( fp, "  \"mb_per_second_in\": %.3f,\n", mbps( bytes_in, wall ) );
+    fprintf( fp, "  \"mb_per_second_out\": %.3f,\n", mbps( bytes_out, wall ) );
+    if ( run.peak_bw > 0.0 )
+        fprintf( fp, "  \"peak_memcpy_mb_per_second\": %.3f,\n", run.peak_bw / 1e6 );
+    if ( args.perf )
     {
-        for( row = 0; row < (a->rows-1); row++ )
+        fprintf( fp, "  \"perf\": { \"available\": %s", st->hw_mask ? "true" : "false" );
+        if ( st->hw_error )
         {
-            memcpy( (void *)buf,
-                    (void *)&(a->data[ (row * a->cols + col) * a->element_size ]),
-                    a->element_size );
-            buf[ a->element_size ] = '\0';
-			fprintf( fp, "%s%c", buf, delim );
+            fprintf( fp, ", \"error\": " );
+            json_string( fp, st->hw_error );
         }
-        memcpy( (void *)buf,
-                (void *)&(a->data[ (row * a->cols + col) * a->element_size ]),
-                a->element_size );
-        buf[ a->element_size ] = '\0';
-		fprintf( fp, "%s\n", buf );
-        if ( args.verbosity >= 3 )
+        fprintf( fp, " },\n" );
+    }
+    fprintf( fp, "  \"phases\": {\n" );
+    for( ph = 0; ph < FT_N_PHASES; ph++ )
+    {
+        const ft_phase_stats_t *p = &st->phase[ ph ];
+        fprintf( fp, "    \"%s\": { \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, "
+                     "\"bytes\": %ld, \"mb_per_second\": %.3f",
+                 ft_phase_name( ph ), p->wall, p->cpu, p->bytes, mbps( p->bytes, p->wall ) );
+        if ( run.peak_bw > 0.0 )
+            fprintf( fp, ", \"peak_fraction\": %.4f", mbps( p->bytes, p->wall ) * 1e6 / run.peak_bw );
+        if ( st->hw_mask )
+            write_counters( fp, st, p );
+        fprintf( fp, " }%s\n", ph == FT_N_PHASES - 1 ? "" : "," );
+    }
+    fprintf( fp, "  }\n" );
+    fprintf( fp, "}\n" );
+
+    if ( fp != stderr )
+        fclose( fp );
+}
+
+/* --segments n or n-m */
+static int parse_segments( const char *s )
+{
+    char *end;
+
+    args.seg_first = strtol( s, &end, 10 );
+    args.seg_count = 1;
+    if ( *end == '-' )
+        args.seg_count = strtol( end + 1, &end, 10 ) - args.seg_first + 1;
+    return end > s && *end == '\0' && args.seg_first >= 0 && args.seg_count > 0;
+}
+
+/* --lines n,m-k,... from 1, kept from 0 */
+static int parse_lines( const char *s )
+{
+    idx_t first, last, max = 0;
+    int64_t *grown;
+    char *end;
+
+    do
+    {
+        first = last = strtol( s, &end, 10 );
+        if ( *end == '-' )
+            last = strtol( end + 1, &end, 10 );
+        if ( end == s || first < 1 || last < first || (*end != ',' && *end != '\0') )
+            return 0;
+        for( ; first <= last; first++ )
         {
-            if ( ((col % 10000) == 0) && (col > 1 ) )
+            if ( args.n_lines == max )
             {
-                printf( "line=%ld\n", col );
-                fflush( NULL );
+                max = max ? 2 * max : 64;
+                if ( (grown = realloc( args.lines, max * sizeof(int64_t) )) == (int64_t *)0 )
+                    return 0;
+                args.lines = grown;
             }
+            args.lines[ args.n_lines++ ] = first - 1;
         }
+        s = end + 1;
+    } while ( *end == ',' );
+    return 1;
+}
+
+/* accept a single character or "\t" */
+static char parse_delim( const char *s )
+{
+    if ( strlen(s) == 1 )
+        return *s;
+    if ( strlen(s) > 1 && s[0] == BACKSLASH && s[1] == 't' )
+        return TAB;
+    return '\0';
+}
+
+static int open_input( char *filename )
+{
+    int fd;
+
+	if (filename[0] == '\0')
+		return STDIN_FILENO;
+    if ( (fd = open(filename, O_RDONLY)) < 0 )
+        perror( filename );
+    return fd;
+}
+
+static void close_input( int fd )
+{
+    if ( fd != STDIN_FILENO && fd >= 0 )
+        close( fd );
+}
+
+static int open_output( char *filename )
+{
+    int fd;
+
+	if (filename[0] == '\0')
+		return STDOUT_FILENO;
+    /* a resumed run keeps the lines already written */
+    if ( (fd = open(filename, O_WRONLY | O_CREAT | (args.resume ? 0 : O_TRUNC), 0666)) < 0 )
+        perror( filename );
+    return fd;
+}
+
+static void close_output( int fd )
+{
+    if ( fd != STDOUT_FILENO )
+        close( fd );
+}
+
+/* start what surrounds the timed run: the bandwidth probe, the trace and
+ * the progress reporter
+ */
+static void run_begin( ft_ctx_t *ctx )
+{
+    /* the probe is not part of the timed run */
+    if ( args.bandwidth )
+    {
+        run.peak_bw   = bandwidth_probe();
+        run.start     = clock_seconds( CLOCK_MONOTONIC );
+        run.cpu_start = cpu_seconds();
     }
-    fclose( fp );
-    if ( args.verbosity >= 1 )
+
+    /* written from atexit() so a failing run still leaves its trace */
+    if ( args.trace_filename[0] )
     {
-        printf( "DONE\n" );
-        fflush( NULL );
+        trace_origin  = run.start;
+        trace_enabled = 1;
+        trace_name_thread( "main" );
+        atexit( trace_write );
     }
-    free( (void *)buf );
+
+    if ( args.progress_fd >= 0 )
+        progress_start( ctx, args.progress_fd );
 }
 
-int main( int argc, char *argv[] )
+/* --join / --paste: the file names, one per line, of 'filename' ('-' for
+ * stdin); returns the # of names or -1
+ */
+static idx_t read_list( const char *filename, char ***names )
 {
-    int c;
-    array_t *a, *b;
+    char line[ ARG_STR_LEN + 2 ], **list = (char **)0, **grown;
+    idx_t n = 0, cap = 0, lineno = 0;
+    FILE *fp = strcmp( filename, "-" ) == 0 ? stdin : fopen( filename, "r" );
 
-    memset( (void *)&args, 0UL, sizeof(args_t));
-	args.element_size = DEFAULT_FIELD_LENGTH;
-    while( (c = getopt( argc, argv, "f:hd:D:i:o:v:" )) != -1 )
+    if ( fp == (FILE *)0 )
     {
-        switch ( c )
+        perror( filename );
+        return -1;
+    }
+    while ( fgets( line, sizeof(line), fp ) )
+    {
+        lineno++;
+        if ( strchr( line, '\n' ) == (char *)0 && !feof( fp ) )
         {
-        case 'v':
-            args.verbosity = atoi(optarg);
-            break;
-        case 'f':
-            args.element_size = atoi(optarg);
-            break;
-	case 'd':
-		if(strlen(optarg) == 1) args.in_delim = *optarg;
-		if(strlen(optarg) > 1) 
-			if(optarg[1] == 't' && *optarg == BACKSLASH) args.in_delim = TAB;
-		if(!args.in_delim)
-		{
-			fprintf(stderr, "Error: invalid input delimiter: %s\n", optarg);
-			usage( EXIT_FAILURE );
-		}
-		break;
-	case 'D':
-		if(strlen(optarg) == 1) args.out_delim = *optarg;
-		if(strlen(optarg) > 1) 
-			if(optarg[1] == 't' && *optarg == BACKSLASH) args.out_delim = TAB;
-		if(!args.out_delim)
-		{
-			fprintf(stderr, "Error: invalid output delimiter: %s\n", optarg);
-			usage( EXIT_FAILURE );
-		}
-		break;
-        case 'i':
-            strncpy(args.in_filename, optarg, ARG_STR_LEN);
-            args.in_filename[ ARG_STR_LEN - 1 ] = '\0';
-            break;
-        case 'o':
-            strncpy(args.out_filename, optarg, ARG_STR_LEN);
-            args.in_filename[ ARG_STR_LEN - 1 ] = '\0';
-            break;
-        case 'h':
-            usage( EXIT_SUCCESS );
-            break;
-        default:
-            usage( EXIT_FAILURE );
+            fprintf( stderr, "%s:%ld: file name too long\n", filename, lineno );
+            n = -1;
             break;
         }
+        line[ strcspn( line, "\r\n" ) ] = '\0';
+        if ( line[0] == '\0' || line[0] == '#' )
+            continue;
+        if ( n == cap )
+        {
+            cap = cap ? 2 * cap : 1024;
+            if ( (grown = realloc( list, cap * sizeof(char *) )) == (char **)0 )
+                break;
+            list = grown;
+        }
+        if ( (list[n] = strdup( line )) == (char *)0 )
+            break;
+        n++;
     }
-    if(args.verbosity > 0 && !args.out_filename[0])
+    if ( n >= 0 && !feof( fp ) )
     {
-	fprintf(stderr, " verbosity setting overriden to 0 to preserve stdout\n");
-	args.verbosity = 0;
+        fprintf( stderr, "%s: out of memory\n", filename );
+        n = -1;
     }
+    if ( fp != stdin )
+        fclose( fp );
+    *names = list;
+    return n;
+}
 
-	//if (args.in_filename[0] == '\0' && stdin == NULL) usage(EXIT_FAILURE);
-	//if (args.out_filename[0] == '\0' && stdout == NULL) usage(EXIT_FAILURE);
+static int run_join( ft_ctx_t *ctx, int out_fd )
+{
+    struct rlimit rl;
+    char **names;
+    idx_t i, n;
+    int rc;
 
-    if ( args.verbosity >= 2 )
+    if ( (n = read_list( args.join_filename, &names )) < 0 )
+        return -1;
+
+    /* pasting opens many files at once: use all the descriptors allowed */
+    if ( getrlimit( RLIMIT_NOFILE, &rl ) == 0 && rl.rlim_cur < rl.rlim_max )
     {
-        printf( "field width  = [%d chars]\n", args.element_size );
-        printf( "in_delim     = [%c]\n", args.in_delim );
-        printf( "out_delim    = [%c]\n", args.out_delim );
-        printf( "in_filename  = [%s]\n", args.in_filename );
-        printf( "out_filename = [%s]\n", args.out_filename );
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &rl );
+    }
+    if ( args.verbosity >= 1 )
+        printf( "%s %ld files as output %s\n", args.join_columns ? "pasting" : "joining", n,
+                args.join_columns ? "columns" : "lines" );
+    if ( (rc = ft_join_files( ctx, (const char *const *)names, n, out_fd,
+                              args.join_columns ? FT_JOIN_COLUMNS : FT_JOIN_ROWS )) < 0 )
+        fprintf( stderr, "%s\n", ft_error( ctx ) );
+    for( i = 0; i < n; i++ )
+        free( (void *)names[i] );
+    free( (void *)names );
+    return rc;
+}
+
+/* --append each input to the store in order, or --render it */
+static int run_store( ft_ctx_t *ctx, int *in_fds, int n, int out_fd )
+{
+    int i, rc = 0;
+
+    if ( args.store_render )
+        rc = ft_store_render( ctx, args.store_dir, args.seg_first, args.seg_count, out_fd );
+    for( i = 0; i < n && !args.store_render && rc == 0; i++ )
+    {
+        if ( args.n_inputs > 1 )
+            ft_set_names( ctx, args.inputs[i], args.store_dir );
+        rc = ft_store_append( ctx, args.store_dir, in_fds[i] );
+    }
+    if ( rc < 0 )
+        fprintf( stderr, "%s\n", ft_error( ctx ) );
+    return rc;
+}
+
+/* --lines through the input's index, or --build-index alone */
+static int run_query( ft_ctx_t *ctx, int in_fd, int out_fd )
+{
+    char index[ ARG_STR_LEN + 8 ];
+    int rc;
+
+    if ( args.index_filename[0] )
+        snprintf( index, sizeof(index), "%s", args.index_filename );
+    else
+        snprintf( index, sizeof(index), "%s.ftidx", args.in_filename );
+    if ( args.build_index )
+        rc = ft_index_fd( ctx, in_fd, index );
+    else
+        rc = ft_query_fd( ctx, in_fd, index, args.lines, args.n_lines, out_fd );
+    if ( rc < 0 )
+        fprintf( stderr, "%s\n", ft_error( ctx ) );
+    return rc;
+}
+
+/* --batch: transpose each (input, output) pair of a manifest on one
+ * context, so the worker threads, matrix buffer and input buffer are set
+ * up once.  A reader thread stays up to --prefetch inputs ahead of the
+ * transpose, reading small ones into memory and asking the kernel to read
+ * ahead on the rest, so the next input arrives while this one is written.
+ */
+typedef struct {
+    char   input[ ARG_STR_LEN ];
+    char   output[ ARG_STR_LEN ];
+    idx_t  line;           /* in the manifest                                */
+    int    fd;             /* input, -1 if it could not be opened            */
+    int    error;          /* errno from opening or reading the input        */
+    int    buffered;       /* the whole input is in buf                      */
+    char  *buf;            /* kept across items that use this slot           */
+    size_t len, cap, pos;
+} batch_item_t;
+
+typedef struct {
+    FILE           *manifest;
+    const char     *name;
+    idx_t           line;
+    int             buffer_ok;     /* the engine can take a buffered input  */
+    int             slots;         /* items held at once, --prefetch + 1     */
+    batch_item_t    item[ BATCH_MAX_PREFETCH + 1 ];
+    idx_t           read;          /* items the reader has filled            */
+    idx_t           done;          /* items the transpose has finished       */
+    int             eof;           /* no more items after 'read'             */
+    idx_t           bad;           /* manifest lines that were not a pair    */
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  filled;
+    pthread_cond_t  freed;
+} batch_t;
+
+static batch_t batch;
+
+/* split "input<TAB>output" (or the first blank) into the item; returns 0
+ * for blank lines and comments, -1 if there is no output name
+ */
+static int batch_parse( char *s, batch_item_t *it )
+{
+    char *out, *end;
+
+    s[ strcspn( s, "\r\n" ) ] = '\0';
+    if ( s[0] == '\0' || s[0] == '#' )
+        return 0;
+    if ( (out = strchr( s, TAB )) == (char *)0 && (out = strchr( s, ' ' )) == (char *)0 )
+        return -1;
+    *out++ = '\0';
+    while ( *out == TAB || *out == ' ' )
+        out++;
+    for( end = out + strlen( out ); end > out && (end[-1] == TAB || end[-1] == ' '); )
+        *--end = '\0';
+    if ( s[0] == '\0' || out[0] == '\0' || strlen( s ) >= sizeof(it->input) ||
+         strlen( out ) >= sizeof(it->output) )
+        return -1;
+    strcpy( it->input, s );
+    strcpy( it->output, out );
+    return 1;
+}
+
+/* open the input and read it into memory if it is small enough */
+static void batch_fill( batch_item_t *it )
+{
+    struct stat st;
+    ssize_t n;
+    char *grown;
+
+    it->buffered = 0;
+    it->len = it->pos = 0;
+    it->error = 0;
+    if ( (it->fd = open( it->input, O_RDONLY )) < 0 )
+    {
+        it->error = errno;
+        return;
+    }
+    if ( fstat( it->fd, &st ) != 0 || !S_ISREG( st.st_mode ) )
+        return;
+    if ( !batch.buffer_ok || st.st_size > BATCH_BUFFER_BYTES )
+    {
+        posix_fadvise( it->fd, 0, 0, POSIX_FADV_WILLNEED );
+        return;
+    }
+    if ( it->cap < (size_t)st.st_size + 1 )
+    {
+        if ( (grown = realloc( it->buf, (size_t)st.st_size + 1 )) == (char *)0 )
+            return;
+        it->buf = grown;
+        it->cap = (size_t)st.st_size + 1;
     }
+    while ( it->len < (size_t)st.st_size &&
+            (n = read( it->fd, it->buf + it->len, (size_t)st.st_size - it->len )) != 0 )
+    {
+        if ( n < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            it->error = errno;
+            return;
+        }
+        it->len += n;
+    }
+    it->buffered = 1;
+}
+
+static void *batch_reader( void *unused )
+{
+    char line[ 2 * ARG_STR_LEN + 2 ];
+    batch_item_t *it;
+    int rc;
+
+    (void)unused;
+    trace_name_thread( "prefetch" );
+    for( ;; )
+    {
+        pthread_mutex_lock( &batch.lock );
+        while ( batch.read - batch.done >= batch.slots )
+            pthread_cond_wait( &batch.freed, &batch.lock );
+        pthread_mutex_unlock( &batch.lock );
+
+        it = &batch.item[ batch.read % batch.slots ];
+        rc = 0;
+        while ( rc == 0 && fgets( line, sizeof(line), batch.manifest ) )
+        {
+            batch.line++;
+            if ( (rc = batch_parse( line, it )) < 0 )
+            {
+                fprintf( stderr, "%s:%ld: expected an input and an output name\n", batch.name, batch.line );
+                batch.bad++;
+                rc = 0;
+            }
+        }
+        if ( rc <= 0 )
+            break;
+        it->line = batch.line;
+        batch_fill( it );
+
+        pthread_mutex_lock( &batch.lock );
+        batch.read++;
+        pthread_cond_signal( &batch.filled );
+        pthread_mutex_unlock( &batch.lock );
+    }
+
+    pthread_mutex_lock( &batch.lock );
+    batch.eof = 1;
+    pthread_cond_signal( &batch.filled );
+    pthread_mutex_unlock( &batch.lock );
+    return (void *)0;
+}
+
+/* ft_read_fn over a prefetched input */
+static ssize_t batch_read( void *user, char *buf, size_t size )
+{
+    batch_item_t *it = (batch_item_t *)user;
+
+    if ( size > it->len - it->pos )
+        size = it->len - it->pos;
+    memcpy( buf, it->buf + it->pos, size );
+    it->pos += size;
+    return (ssize_t)size;
+}
+
+/* ft_write_fn to a file descriptor */
+static int batch_write( void *user, const char *buf, size_t size )
+{
+    int fd = *(int *)user;
+    ssize_t n;
+
+    while ( size > 0 )
+    {
+        if ( (n = write( fd, buf, size )) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            return -1;
+        }
+        buf  += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* returns the # of items that failed, or -1 if the manifest is unusable */
+static idx_t run_batch( ft_ctx_t *ctx, const char *manifest )
+{
+    batch_item_t *it;
+    idx_t failed = 0, bytes = 0;
+    double started = clock_seconds( CLOCK_MONOTONIC );
+    int i, out_fd, rc;
+
+    memset( (void *)&batch, 0, sizeof(batch_t) );
+    batch.name = strcmp( manifest, "-" ) == 0 ? "stdin" : manifest;
+    if ( (batch.manifest = strcmp( manifest, "-" ) == 0 ? stdin : fopen( manifest, "r" )) == (FILE *)0 )
+    {
+        perror( manifest );
+        return -1;
+    }
+    batch.slots = args.prefetch + 1;
+    batch.buffer_ok = args.engine == FT_ENGINE_AUTO || args.engine == FT_ENGINE_MEMORY ||
+                      args.engine == FT_ENGINE_EXTERNAL;
+    pthread_mutex_init( &batch.lock, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &batch.filled, (pthread_condattr_t *)0 );
+    pthread_cond_init( &batch.freed, (pthread_condattr_t *)0 );
+    if ( pthread_create( &batch.thread, (pthread_attr_t *)0, batch_reader, (void *)0 ) != 0 )
+    {
+        fprintf( stderr, "failed to start prefetch thread\n" );
+        if ( batch.manifest != stdin )
+            fclose( batch.manifest );
+        return -1;
+    }
+
+    for( ;; )
+    {
+        pthread_mutex_lock( &batch.lock );
+        while ( batch.done == batch.read && !batch.eof )
+            pthread_cond_wait( &batch.filled, &batch.lock );
+        if ( batch.done == batch.read )
+        {
+            pthread_mutex_unlock( &batch.lock );
+            break;
+        }
+        pthread_mutex_unlock( &batch.lock );
+
+        it = &batch.item[ batch.done % batch.slots ];
+        rc = -1;
+        if ( it->error )
+            fprintf( stderr, "%s: %s\n", it->input, strerror( it->error ) );
+        else if ( (out_fd = open( it->output, O_WRONLY | O_CREAT | O_TRUNC, 0666 )) < 0 )
+            perror( it->output );
+        else
+        {
+            ft_set_names( ctx, it->input, it->output );
+            if ( args.verbosity >= 1 )
+                printf( "%s:%ld: %s -> %s%s\n", batch.name, it->line, it->input, it->output,
+                        it->buffered ? " (prefetched)" : "" );
+            if ( it->buffered )
+                rc = ft_transpose_stream( ctx, batch_read, (void *)it, batch_write, (void *)&out_fd );
+            else
+                rc = ft_transpose_fd( ctx, it->fd, out_fd );
+            if ( rc < 0 )
+                fprintf( stderr, "%s\n", ft_error( ctx ) );
+            if ( close( out_fd ) != 0 && rc == 0 )
+            {
+                perror( it->output );
+                rc = -1;
+            }
+            bytes += ft_stats( ctx )->phase[ FT_PHASE_PARSE ].bytes;
+        }
+        if ( rc < 0 )
+            failed++;
+        if ( it->fd >= 0 )
+            close( it->fd );
+
+        pthread_mutex_lock( &batch.lock );
+        batch.done++;
+        pthread_cond_signal( &batch.freed );
+        pthread_mutex_unlock( &batch.lock );
+    }
+
+    pthread_join( batch.thread, (void **)0 );
+    failed += batch.bad;
+    if ( batch.manifest != stdin )
+        fclose( batch.manifest );
+    for( i = 0; i < batch.slots; i++ )
+        free( (void *)batch.item[i].buf );
+    pthread_mutex_destroy( &batch.lock );
+    pthread_cond_destroy( &batch.filled );
+    pthread_cond_destroy( &batch.freed );
+
+    if ( args.verbosity >= 1 )
+        printf( "batch: %ld inputs, %ld failed, %.1f MB in %.3f s\n", batch.done, failed,
+                bytes / 1e6, clock_seconds( CLOCK_MONOTONIC ) - started );
+    return failed;
+}
+
+/* --serve: a warm process that runs transpose jobs sent over a Unix
+ * domain socket.  Each of --jobs server threads owns a context (and with
+ * --arena, a matrix buffer allocated up front on huge pages) and accepts
+ * connections in turn; all of them share one worker pool.  A request is
+ * one line of tab-separated key=value words:
+ *
+ *   input=PATH output=PATH width=N in_delim=C out_delim=C engine=NAME budget=BYTES
+ *
+ * where the delimiters are decimal byte values and everything but the
+ * files is optional.  A client that passes two descriptors (SCM_RIGHTS)
+ * with the request has them used as the input and output instead of the
+ * paths.  The reply is one line: "ok" followed by engine=, rows=, cols=
+ * and seconds=, or "error" and the message.
+ *
+ * Jobs share the memory budget (-M, else 80% of free memory): a job plans
+ * for what is left of it and holds what its engine is predicted to use
+ * until it finishes, waiting while others hold too much.
+ */
+typedef struct {
+    int             listen_fd;
+    int             jobs;          /* server threads                         */
+    idx_t           budget;        /* bytes all running jobs may use         */
+    idx_t           in_use;        /* held by running jobs                   */
+    int             running;
+    pthread_mutex_t lock;
+    pthread_cond_t  freed;
+    ft_options_t    opt;           /* defaults for every job                 */
+} serve_t;
+
+static serve_t serve;
+static volatile int serve_stopping;
+
+/* read one request line into 'buf' (NUL-terminated, without the newline),
+ * keeping any bytes after it for the next call, and collect descriptors
+ * passed with it; returns 0 at the end of the connection
+ */
+static int serve_recv( int fd, char *buf, size_t size, size_t *len, int *fds, int *nfds )
+{
+    union {
+        struct cmsghdr hdr;
+        char           space[ CMSG_SPACE( 2 * sizeof(int) ) ];
+    } control;
+    struct cmsghdr *cm;
+    struct msghdr msg;
+    struct iovec iov;
+    struct pollfd pfd;
+    char *eol;
+    ssize_t n;
+    int i;
+
+    for( ;; )
+    {
+        if ( (eol = memchr( buf, '\n', *len )) != (char *)0 )
+        {
+            *eol = '\0';
+            return 1;
+        }
+        if ( *len >= size - 1 )
+            return -1;
+
+        /* wake up now and then to notice a shutdown */
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        if ( (n = poll( &pfd, 1, 1000 )) <= 0 )
+        {
+            if ( serve_stopping )
+                return 0;
+            if ( n < 0 && errno != EINTR )
+                return -1;
+            continue;
+        }
+
+        memset( (void *)&msg, 0, sizeof(msg) );
+        iov.iov_base = buf + *len;
+        iov.iov_len  = size - 1 - *len;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.space;
+        msg.msg_controllen = sizeof(control.space);
+        if ( (n = recvmsg( fd, &msg, MSG_CMSG_CLOEXEC )) <= 0 )
+        {
+            if ( n < 0 && errno == EINTR )
+                continue;
+            return n == 0 && *len == 0 ? 0 : -1;
+        }
+        *len += n;
+        for( cm = CMSG_FIRSTHDR( &msg ); cm; cm = CMSG_NXTHDR( &msg, cm ) )
+        {
+            if ( cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS )
+                continue;
+            for( i = 0; i < (int)((cm->cmsg_len - CMSG_LEN( 0 )) / sizeof(int)); i++ )
+            {
+                int passed;
+
+                memcpy( &passed, CMSG_DATA( cm ) + i * sizeof(int), sizeof(int) );
+                if ( *nfds < 2 )
+                    fds[ (*nfds)++ ] = passed;
+                else
+                    close( passed );
+            }
+        }
+    }
+}
+
+static int socket_address( struct sockaddr_un *addr, const char *path )
+{
+    memset( (void *)addr, 0, sizeof(*addr) );
+    addr->sun_family = AF_UNIX;
+    if ( strlen( path ) >= sizeof(addr->sun_path) )
+    {
+        fprintf( stderr, "%s: socket path too long\n", path );
+        return -1;
+    }
+    strcpy( addr->sun_path, path );
+    return 0;
+}
+
+/* wait for a share of the budget, plan the job within it and hold what
+ * the plan needs; returns the bytes held
+ */
+static idx_t serve_admit( ft_ctx_t *ctx, ft_options_t *opt, int in_fd, idx_t asked )
+{
+    struct stat st;
+    idx_t avail, want;
+    int seekable = fstat( in_fd, &st ) == 0 && S_ISREG( st.st_mode );
+
+    pthread_mutex_lock( &serve.lock );
+    for( ;; )
+    {
+        while ( serve.running > 0 && serve.budget - serve.in_use < serve.budget / (2 * serve.jobs) )
+            pthread_cond_wait( &serve.freed, &serve.lock );
+        avail = serve.budget - serve.in_use;
+        if ( avail < 1 )
+            avail = 1;
+        if ( asked > 0 && asked < avail )
+            avail = asked;
+        pthread_mutex_unlock( &serve.lock );
+
+        /* a stream cannot be planned ahead: hold an even share */
+        opt->memory_budget = avail;
+        want = serve.budget / serve.jobs;
+        if ( seekable && ft_reconfigure( ctx, opt ) == 0 && ft_plan_fd( ctx, in_fd ) == 0 )
+            want = ft_stats( ctx )->predicted_memory;
+        if ( want > avail )
+            want = avail;
+
+        pthread_mutex_lock( &serve.lock );
+        if ( serve.running == 0 || serve.in_use + want <= serve.budget )
+            break;
+        pthread_cond_wait( &serve.freed, &serve.lock );
+    }
+    serve.in_use += want;
+    serve.running++;
+    pthread_mutex_unlock( &serve.lock );
+    return want;
+}
+
+static void serve_release( idx_t held )
+{
+    pthread_mutex_lock( &serve.lock );
+    serve.in_use -= held;
+    serve.running--;
+    pthread_cond_broadcast( &serve.freed );
+    pthread_mutex_unlock( &serve.lock );
+}
+
+/* run the request in 'line'; the reply goes to 'reply' */
+static void serve_job( ft_ctx_t *ctx, char *line, int *fds, int nfds, char *reply, size_t size )
+{
+    ft_options_t opt = serve.opt;
+    const ft_stats_t *st;
+    const char *input = (const char *)0, *output = (const char *)0;
+    char *word, *value, *save = (char *)0;
+    idx_t asked = 0, held;
+    double started = clock_seconds( CLOCK_MONOTONIC );
+    int in_fd = -1, out_fd = -1, rc;
+
+    for( word = strtok_r( line, "\t", &save ); word; word = strtok_r( (char *)0, "\t", &save ) )
+    {
+        if ( (value = strchr( word, '=' )) == (char *)0 )
+        {
+            snprintf( reply, size, "error\texpected key=value: %s\n", word );
+            return;
+        }
+        *value++ = '\0';
+        if ( strcmp( word, "input" ) == 0 )
+            input = value;
+        else if ( strcmp( word, "output" ) == 0 )
+            output = value;
+        else if ( strcmp( word, "width" ) == 0 )
+            opt.element_size = atoi( value );
+        else if ( strcmp( word, "in_delim" ) == 0 )
+            opt.in_delim = (char)atoi( value );
+        else if ( strcmp( word, "out_delim" ) == 0 )
+            opt.out_delim = (char)atoi( value );
+        else if ( strcmp( word, "budget" ) == 0 )
+            asked = atol( value );
+        else if ( strcmp( word, "engine" ) == 0 )
+        {
+            for( opt.engine = 0; opt.engine < FT_N_ENGINES; opt.engine++ )
+                if ( strcmp( value, ft_engine_name( opt.engine ) ) == 0 )
+                    break;
+        }
+        else
+        {
+            snprintf( reply, size, "error\tunknown key: %s\n", word );
+            return;
+        }
+    }
+    if ( opt.element_size < 1 || opt.engine >= FT_N_ENGINES || !opt.in_delim || !opt.out_delim )
+    {
+        snprintf( reply, size, "error\tinvalid width, delimiter or engine\n" );
+        return;
+    }
+
+    if ( nfds == 2 )
+    {
+        in_fd  = fds[0];
+        out_fd = fds[1];
+        opt.input_name  = input ? input : "client input";
+        opt.output_name = output ? output : "client output";
+    }
+    else if ( input == (const char *)0 || output == (const char *)0 )
+    {
+        snprintf( reply, size, "error\tneed input= and output=, or two descriptors\n" );
+        return;
+    }
+    else if ( (in_fd = open( input, O_RDONLY | O_CLOEXEC )) < 0 )
+    {
+        snprintf( reply, size, "error\t%s: %s\n", input, strerror( errno ) );
+        return;
+    }
+    else if ( (out_fd = open( output, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 )) < 0 )
+    {
+        snprintf( reply, size, "error\t%s: %s\n", output, strerror( errno ) );
+        close( in_fd );
+        return;
+    }
+    else
+    {
+        opt.input_name  = input;
+        opt.output_name = output;
+    }
+
+    held = serve_admit( ctx, &opt, in_fd, asked );
+    if ( (rc = ft_reconfigure( ctx, &opt )) == 0 )
+        rc = ft_transpose_fd( ctx, in_fd, out_fd );
+    serve_release( held );
+
+    st = ft_stats( ctx );
+    if ( rc < 0 )
+        snprintf( reply, size, "error\t%s\n", ft_error( ctx ) );
+    else
+        snprintf( reply, size, "ok\tengine=%s\trows=%ld\tcols=%ld\tseconds=%.6f\n", st->engine,
+                  (idx_t)st->rows, (idx_t)st->cols, clock_seconds( CLOCK_MONOTONIC ) - started );
+    if ( args.verbosity >= 1 )
+    {
+        printf( "%s -> %s: %s", opt.input_name, opt.output_name, reply );
+        fflush( stdout );
+    }
+    if ( nfds != 2 )
+    {
+        close( in_fd );
+        close( out_fd );
+    }
+}
+
+static void serve_connection( ft_ctx_t *ctx, int fd )
+{
+    char line[ 4 * ARG_STR_LEN ], reply[ 2 * FT_PATH_LEN + 64 ];
+    size_t len = 0, used;
+    int fds[2], nfds = 0, i;
+
+    while ( serve_recv( fd, line, sizeof(line), &len, fds, &nfds ) > 0 )
+    {
+        used = strlen( line ) + 1;
+        serve_job( ctx, line, fds, nfds, reply, sizeof(reply) );
+        for( i = 0; i < nfds; i++ )
+            close( fds[i] );
+        nfds = 0;
+        memmove( line, line + used, len - used );
+        len -= used;
+        if ( send( fd, reply, strlen( reply ), MSG_NOSIGNAL ) < 0 )
+            break;
+    }
+    for( i = 0; i < nfds; i++ )
+        close( fds[i] );
+}
+
+static void *serve_main( void *arg )
+{
+    ft_ctx_t *ctx = (ft_ctx_t *)arg;
+    int fd;
+
+    trace_name_thread( "server" );
+    while ( !serve_stopping )
+    {
+        if ( (fd = accept4( serve.listen_fd, (struct sockaddr *)0, (socklen_t *)0, SOCK_CLOEXEC )) < 0 )
+        {
+            if ( errno == EINTR || errno == ECONNABORTED )
+                continue;
+            break;
+        }
+        serve_connection( ctx, fd );
+        close( fd );
+    }
+    return (void *)0;
+}
+
+/* run the server until SIGINT or SIGTERM */
+static int run_serve( const ft_options_t *opt, const char *profile )
+{
+    struct sockaddr_un addr;
+    ft_ctx_t *ctx[ SERVE_MAX_JOBS ];
+    pthread_t thread[ SERVE_MAX_JOBS ];
+    ft_pool_t *pool;
+    sigset_t stop;
+    int i, sig, made, started = 0, rc = -1;
+
+    if ( socket_address( &addr, args.serve_socket ) < 0 )
+        return -1;
+
+    memset( (void *)&serve, 0, sizeof(serve_t) );
+    serve.listen_fd = -1;
+    serve.jobs   = args.jobs;
+    serve.budget = args.memory_budget;
+    if ( serve.budget <= 0 )
+        serve.budget = (idx_t)(sysconf( _SC_AVPHYS_PAGES ) * (double)sysconf( _SC_PAGESIZE ) * 0.8);
+    serve.opt = *opt;
+    serve.opt.verbosity = 0;       /* one line per job instead, from serve_job() */
+    serve.opt.log = (FILE *)0;
+    pthread_mutex_init( &serve.lock, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &serve.freed, (pthread_condattr_t *)0 );
+
+    /* the threads started below inherit the mask; main waits for these */
+    sigemptyset( &stop );
+    sigaddset( &stop, SIGINT );
+    sigaddset( &stop, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, &stop, (sigset_t *)0 );
+
+    if ( (pool = ft_pool_create( args.threads > 0 ? args.threads : (int)sysconf( _SC_NPROCESSORS_ONLN ) )) == (ft_pool_t *)0 )
+    {
+        perror( "ftranspose" );
+        return -1;
+    }
+    serve.opt.pool = pool;
+    serve.opt.keep_bytes = KEEP_BYTES;
+    for( made = 0; made < serve.jobs; made++ )
+    {
+        if ( (ctx[ made ] = ft_create( &serve.opt )) == (ft_ctx_t *)0 )
+        {
+            perror( "ftranspose" );
+            goto out;
+        }
+        if ( ft_load_profile( ctx[ made ], profile ) < 0 ||
+             (args.arena > 0 && ft_reserve( ctx[ made ], args.arena, 1 ) < 0) )
+        {
+            fprintf( stderr, "%s\n", ft_error( ctx[ made ] ) );
+            made++;
+            goto out;
+        }
+    }
+
+    unlink( addr.sun_path );
+    if ( (serve.listen_fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) < 0 ||
+         bind( serve.listen_fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0 ||
+         listen( serve.listen_fd, SERVE_BACKLOG ) != 0 )
+    {
+        perror( args.serve_socket );
+        goto out;
+    }
+    for( started = 0; started < serve.jobs; started++ )
+        if ( pthread_create( &thread[ started ], (pthread_attr_t *)0, serve_main, (void *)ctx[ started ] ) != 0 )
+            break;
+    if ( args.verbosity >= 1 )
+    {
+        printf( "serving on %s: %d jobs, %d threads, budget %ld bytes, arena %ld bytes per job\n",
+                args.serve_socket, started, pool->threads, serve.budget, args.arena );
+        fflush( stdout );
+    }
+
+    sigwait( &stop, &sig );
+    serve_stopping = 1;
+    shutdown( serve.listen_fd, SHUT_RDWR );
+    for( i = 0; i < started; i++ )
+        pthread_join( thread[i], (void **)0 );
+    unlink( addr.sun_path );
+    rc = 0;
+
+out:
+    if ( serve.listen_fd >= 0 )
+        close( serve.listen_fd );
+    while ( made-- > 0 )
+        ft_destroy( ctx[ made ] );
+    ft_pool_destroy( pool );
+    return rc;
+}
+
+/* --connect: send this invocation's files and options to a server */
+static int run_connect( int in_fd, int out_fd )
+{
+    struct sockaddr_un addr;
+    union {
+        struct cmsghdr hdr;
+        char           space[ CMSG_SPACE( 2 * sizeof(int) ) ];
+    } control;
+    struct msghdr msg;
+    struct iovec iov;
+    char line[ 2 * ARG_STR_LEN + 256 ], reply[ 2 * FT_PATH_LEN + 64 ];
+    int fd, fds[2] = { in_fd, out_fd };
+    ssize_t n;
+    size_t len = 0;
+
+    if ( socket_address( &addr, args.connect_socket ) < 0 )
+        return -1;
+    if ( (fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) < 0 ||
+         connect( fd, (struct sockaddr *)&addr, sizeof(addr) ) != 0 )
+    {
+        perror( args.connect_socket );
+        return -1;
+    }
+
+    snprintf( line, sizeof(line), "input=%s\toutput=%s\twidth=%d\tin_delim=%d\tout_delim=%d\tengine=%s\tbudget=%ld\n",
+              args.in_filename[0] ? args.in_filename : "stdin", args.out_filename[0] ? args.out_filename : "stdout",
+              args.element_size, args.in_delim, args.out_delim, ft_engine_name( args.engine ), args.memory_budget );
+    memset( (void *)&msg, 0, sizeof(msg) );
+    memset( (void *)&control, 0, sizeof(control) );
+    iov.iov_base = line;
+    iov.iov_len  = strlen( line );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+    CMSG_FIRSTHDR( &msg )->cmsg_level = SOL_SOCKET;
+    CMSG_FIRSTHDR( &msg )->cmsg_type  = SCM_RIGHTS;
+    CMSG_FIRSTHDR( &msg )->cmsg_len   = CMSG_LEN( 2 * sizeof(int) );
+    memcpy( CMSG_DATA( CMSG_FIRSTHDR( &msg ) ), fds, sizeof(fds) );
+    if ( sendmsg( fd, &msg, MSG_NOSIGNAL ) != (ssize_t)iov.iov_len )
+    {
+        perror( args.connect_socket );
+        close( fd );
+        return -1;
+    }
+
+    while ( len < sizeof(reply) - 1 && memchr( reply, '\n', len ) == (void *)0 &&
+            (n = read( fd, reply + len, sizeof(reply) - 1 - len )) > 0 )
+        len += n;
+    close( fd );
+    reply[ len ] = '\0';
+    if ( strncmp( reply, "ok", 2 ) != 0 )
+    {
+        fprintf( stderr, "%s", strncmp( reply, "error\t", 6 ) == 0 ? reply + 6 : "no reply from server\n" );
+        return -1;
+    }
+    if ( args.verbosity >= 1 )
+        fprintf( stderr, "%s", reply );
+    return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+    ft_options_t opt;
+    ft_ctx_t *ctx;
+    char profile[ ARG_STR_LEN ], stacked_name[ ARG_STR_LEN ];
+    int c, i, rc, in_fd, out_fd, *in_fds = &in_fd;
+    static struct option long_options[] = {
+        { "stats", required_argument, 0, OPT_STATS },
+        { "progress", optional_argument, 0, OPT_PROGRESS },
+        { "trace", required_argument, 0, OPT_TRACE },
+        { "perf", no_argument, 0, OPT_PERF },
+        { "bandwidth", no_argument, 0, OPT_BANDWIDTH },
+        { "engine", required_argument, 0, 'e' },
+        { "memory", required_argument, 0, 'M' },
+        { "tmpdir", required_argument, 0, OPT_TMPDIR },
+        { "plan", no_argument, 0, OPT_PLAN },
+        { "threads", required_argument, 0, 't' },
+        { "autotune", no_argument, 0, OPT_AUTOTUNE },
+        { "profile", required_argument, 0, OPT_PROFILE },
+        { "batch", required_argument, 0, OPT_BATCH },
+        { "prefetch", required_argument, 0, OPT_PREFETCH },
+        { "serve", required_argument, 0, OPT_SERVE },
+        { "connect", required_argument, 0, OPT_CONNECT },
+        { "jobs", required_argument, 0, OPT_JOBS },
+        { "arena", required_argument, 0, OPT_ARENA },
+        { "join", required_argument, 0, OPT_JOIN },
+        { "paste", required_argument, 0, OPT_PASTE },
+        { "window", required_argument, 0, OPT_WINDOW },
+        { "window-sep", required_argument, 0, OPT_WINDOW_SEP },
+        { "window-index", no_argument, 0, OPT_WINDOW_INDEX },
+        { "append", required_argument, 0, OPT_APPEND },
+        { "render", required_argument, 0, OPT_RENDER },
+        { "segments", required_argument, 0, OPT_SEGMENTS },
+        { "lines", required_argument, 0, OPT_LINES },
+        { "index", required_argument, 0, OPT_INDEX },
+        { "build-index", no_argument, 0, OPT_BUILD_INDEX },
+        { "keep-rows", required_argument, 0, OPT_KEEP_ROWS },
+        { "header", no_argument, 0, OPT_HEADER },
+        { "labels", no_argument, 0, OPT_LABELS },
+        { "column-widths", no_argument, 0, OPT_COLUMN_WIDTHS },
+        { "numa", required_argument, 0, OPT_NUMA },
+        { "no-smt", no_argument, 0, OPT_NO_SMT },
+        { "direct", no_argument, 0, OPT_DIRECT },
+        { "spill-codec", required_argument, 0, OPT_SPILL_CODEC },
+        { "checkpoint", required_argument, 0, OPT_CHECKPOINT },
+        { "resume", no_argument, 0, OPT_RESUME },
+        { 0, 0, 0, 0 }
+    };
+
+    memset( (void *)&args, 0UL, sizeof(args_t));
+    memset( (void *)&run, 0UL, sizeof(run_t));
+    run.start = clock_seconds( CLOCK_MONOTONIC );
+	args.element_size = DEFAULT_FIELD_LENGTH;
+    args.progress_fd = -1;
+    args.in_delim  = TAB;
+    args.out_delim = TAB;
+    args.prefetch  = BATCH_PREFETCH;
+    args.jobs      = SERVE_JOBS;
+    while( (c = getopt_long( argc, argv, "f:hd:D:i:o:v:e:M:t:", long_options, (int *)0 )) != -1 )
+    {
+        switch ( c )
+        {
+        case 'v':
+            args.verbosity = atoi(optarg);
+            break;
+        case 'f':
+            args.element_size = atoi(optarg);
+            break;
+	case 'd':
+		if(!(args.in_delim = parse_delim(optarg)))
+		{
+			fprintf(stderr, "Error: invalid input delimiter: %s\n", optarg);
+			usage( EXIT_FAILURE );
+		}
+		break;
+	case 'D':
+		if(!(args.out_delim = parse_delim(optarg)))
+		{
+			fprintf(stderr, "Error: invalid output delimiter: %s\n", optarg);
+			usage( EXIT_FAILURE );
+		}
+		break;
+        case 'i':
+            if ( args.n_inputs == 0 )
+            {
+                strncpy(args.in_filename, optarg, ARG_STR_LEN);
+                args.in_filename[ ARG_STR_LEN - 1 ] = '\0';
+            }
+            if ( (args.inputs = realloc( args.inputs, (args.n_inputs + 1) * sizeof(char *) )) == (char **)0 )
+            {
+                perror( "ftranspose" );
+                return EXIT_FAILURE;
+            }
+            args.inputs[ args.n_inputs++ ] = optarg;
+            break;
+        case 'o':
+            strncpy(args.out_filename, optarg, ARG_STR_LEN);
+            args.out_filename[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_STATS:
+            strncpy(args.stats_filename, optarg, ARG_STR_LEN);
+            args.stats_filename[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_TRACE:
+            strncpy(args.trace_filename, optarg, ARG_STR_LEN);
+            args.trace_filename[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_PERF:
+            args.perf = 1;
+            break;
+        case OPT_BANDWIDTH:
+            args.bandwidth = 1;
+            break;
+        case 'e':
+            for( args.engine = 0; args.engine < FT_N_ENGINES; args.engine++ )
+                if ( strcmp( optarg, ft_engine_name( args.engine ) ) == 0 )
+                    break;
+            if ( args.engine == FT_N_ENGINES )
+            {
+                fprintf(stderr, "Error: unknown engine: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case 'M':
+            if ( (args.memory_budget = parse_size( optarg )) <= 0 )
+            {
+                fprintf(stderr, "Error: invalid memory budget: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_TMPDIR:
+            /* given again: spill files stripe over all of them */
+            if ( args.tmpdir[0] && strlen( args.tmpdir ) + strlen( optarg ) + 2 > ARG_STR_LEN )
+            {
+                fprintf(stderr, "Error: too many --tmpdir directories\n");
+                usage( EXIT_FAILURE );
+            }
+            if ( args.tmpdir[0] )
+                strcat( args.tmpdir, ":" );
+            strncat(args.tmpdir, optarg, ARG_STR_LEN - strlen( args.tmpdir ) - 1);
+            break;
+        case OPT_PLAN:
+            args.plan_only = 1;
+            break;
+        case 't':
+            args.threads = atoi(optarg);
+            if ( args.threads < 1 || args.threads > MAX_THREADS )
+            {
+                fprintf(stderr, "Error: invalid thread count: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_AUTOTUNE:
+            args.autotune = 1;
+            break;
+        case OPT_PROFILE:
+            strncpy(args.profile, optarg, ARG_STR_LEN);
+            args.profile[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_BATCH:
+            strncpy(args.batch_filename, optarg, ARG_STR_LEN);
+            args.batch_filename[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_PREFETCH:
+            args.prefetch = atoi(optarg);
+            if ( args.prefetch < 0 || args.prefetch > BATCH_MAX_PREFETCH )
+            {
+                fprintf(stderr, "Error: invalid prefetch count: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_SERVE:
+            strncpy(args.serve_socket, optarg, ARG_STR_LEN);
+            args.serve_socket[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_CONNECT:
+            strncpy(args.connect_socket, optarg, ARG_STR_LEN);
+            args.connect_socket[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_JOBS:
+            args.jobs = atoi(optarg);
+            if ( args.jobs < 1 || args.jobs > SERVE_MAX_JOBS )
+            {
+                fprintf(stderr, "Error: invalid job count: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_ARENA:
+            if ( (args.arena = parse_size( optarg )) <= 0 )
+            {
+                fprintf(stderr, "Error: invalid arena size: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_JOIN:
+        case OPT_PASTE:
+            strncpy(args.join_filename, optarg, ARG_STR_LEN);
+            args.join_filename[ ARG_STR_LEN - 1 ] = '\0';
+            args.join_columns = c == OPT_PASTE;
+            break;
+        case OPT_WINDOW:
+            if ( (args.window_rows = atol(optarg)) < 1 )
+            {
+                fprintf(stderr, "Error: invalid window row count: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_WINDOW_SEP:
+            strncpy(args.window_sep, optarg, ARG_STR_LEN);
+            args.window_sep[ ARG_STR_LEN - 1 ] = '\0';
+            args.has_window_sep = 1;
+            break;
+        case OPT_WINDOW_INDEX:
+            args.window_index = 1;
+            break;
+        case OPT_APPEND:
+        case OPT_RENDER:
+            strncpy(args.store_dir, optarg, ARG_STR_LEN);
+            args.store_dir[ ARG_STR_LEN - 1 ] = '\0';
+            args.store_render = c == OPT_RENDER;
+            break;
+        case OPT_SEGMENTS:
+            if ( !parse_segments( optarg ) )
+            {
+                fprintf(stderr, "Error: invalid segment range: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_LINES:
+            if ( !parse_lines( optarg ) )
+            {
+                fprintf(stderr, "Error: invalid line list: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_INDEX:
+            strncpy(args.index_filename, optarg, ARG_STR_LEN);
+            args.index_filename[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_BUILD_INDEX:
+            args.build_index = 1;
+            break;
+        case OPT_HEADER:
+            args.header = 1;
+            break;
+        case OPT_LABELS:
+            args.labels = 1;
+            break;
+        case OPT_COLUMN_WIDTHS:
+            args.column_widths = 1;
+            break;
+        case OPT_NUMA:
+            for( args.numa = 0; args.numa < FT_N_NUMA_MODES; args.numa++ )
+                if ( strcmp( optarg, ft_numa_name( args.numa ) ) == 0 )
+                    break;
+            if ( args.numa == FT_N_NUMA_MODES )
+            {
+                fprintf(stderr, "Error: unknown --numa mode: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_NO_SMT:
+            args.no_smt = 1;
+            break;
+        case OPT_DIRECT:
+            args.direct_io = 1;
+            break;
+        case OPT_SPILL_CODEC:
+            for( args.spill_codec = 0; args.spill_codec < FT_N_CODECS; args.spill_codec++ )
+                if ( strcmp( optarg, ft_codec_name( args.spill_codec ) ) == 0 )
+                    break;
+            if ( args.spill_codec == FT_N_CODECS )
+            {
+                fprintf(stderr, "Error: unknown --spill-codec: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case OPT_CHECKPOINT:
+            strncpy(args.checkpoint, optarg, ARG_STR_LEN);
+            args.checkpoint[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_RESUME:
+            args.resume = 1;
+            break;
+        case OPT_KEEP_ROWS:
+            strncpy(args.keep_filename, optarg, ARG_STR_LEN);
+            args.keep_filename[ ARG_STR_LEN - 1 ] = '\0';
+            break;
+        case OPT_PROGRESS:
+            args.progress_fd = optarg ? atoi(optarg) : STDERR_FILENO;
+            if ( args.progress_fd < 0 )
+            {
+                fprintf(stderr, "Error: invalid progress file descriptor: %s\n", optarg);
+                usage( EXIT_FAILURE );
+            }
+            break;
+        case 'h':
+            usage( EXIT_SUCCESS );
+            break;
+        default:
+            usage( EXIT_FAILURE );
+            break;
+        }
+    }
+    if ( args.element_size < 1 )
+    {
+        fprintf(stderr, "Error: invalid field width: %d\n", args.element_size);
+        usage( EXIT_FAILURE );
+    }
+    /* -v 2 used to print every row; that is now the progress reporter */
+    if ( args.verbosity >= 2 && args.progress_fd < 0 )
+        args.progress_fd = STDERR_FILENO;
+    if ( args.batch_filename[0] && (args.in_filename[0] || args.out_filename[0] ||
+                                    args.stats_filename[0] || args.plan_only) )
+    {
+        fprintf(stderr, "Error: --batch takes the file names from the manifest, and has no --stats or --plan\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.serve_socket[0] && (args.batch_filename[0] || args.connect_socket[0] || args.in_filename[0] ||
+                                  args.out_filename[0] || args.stats_filename[0] || args.plan_only) )
+    {
+        fprintf(stderr, "Error: --serve takes its jobs from the socket\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.join_filename[0] && (args.batch_filename[0] || args.serve_socket[0] || args.connect_socket[0] ||
+                                   args.in_filename[0] || args.plan_only) )
+    {
+        fprintf(stderr, "Error: --join and --paste read the files in the list\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.connect_socket[0] && (args.batch_filename[0] || args.stats_filename[0] || args.n_inputs > 1) )
+    {
+        fprintf(stderr, "Error: --connect sends a single transpose of one input and has no --stats\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.window_rows > 0 && (args.engine != FT_ENGINE_AUTO || args.join_filename[0] || args.connect_socket[0]) )
+    {
+        fprintf(stderr, "Error: --window transposes blocks in memory, and has no -e, --join, --paste or --connect\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.store_dir[0] && (args.batch_filename[0] || args.serve_socket[0] || args.connect_socket[0] ||
+                               args.join_filename[0] || args.window_rows > 0 || args.plan_only ||
+                               (args.store_render ? args.n_inputs > 0 : args.out_filename[0] != '\0')) )
+    {
+        fprintf(stderr, "Error: --append reads -i into the store, --render writes it to -o\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( (args.seg_first > 0 || args.seg_count > 0) && !args.store_render )
+    {
+        fprintf(stderr, "Error: --segments needs --render\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( (args.n_lines > 0 || args.build_index) &&
+         (!args.in_filename[0] || args.n_inputs > 1 || args.engine != FT_ENGINE_AUTO || args.batch_filename[0] ||
+          args.serve_socket[0] || args.connect_socket[0] || args.join_filename[0] || args.window_rows > 0 ||
+          args.store_dir[0] || args.plan_only) )
+    {
+        fprintf(stderr, "Error: --lines and --build-index read one -i file through its index\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.index_filename[0] && args.n_lines == 0 && !args.build_index )
+    {
+        fprintf(stderr, "Error: --index needs --lines or --build-index\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.build_index && args.out_filename[0] )
+    {
+        fprintf(stderr, "Error: --build-index writes no output\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.keep_filename[0] && (args.serve_socket[0] || args.connect_socket[0] || args.join_filename[0] ||
+                                   args.n_lines > 0 || args.build_index || args.store_render) )
+    {
+        fprintf(stderr, "Error: --keep-rows filters the rows this process parses\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( (args.header || args.labels) && (args.serve_socket[0] || args.connect_socket[0] || args.join_filename[0] ||
+                                          args.n_lines > 0 || args.build_index || args.store_dir[0]) )
+    {
+        fprintf(stderr, "Error: --header and --labels apply to a transpose run here, not to --lines or a store\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.resume && !args.checkpoint[0] )
+    {
+        fprintf(stderr, "Error: --resume needs the --checkpoint journal\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( args.checkpoint[0] && (args.batch_filename[0] || args.serve_socket[0] || args.connect_socket[0] ||
+                                args.n_inputs > 1 || args.window_rows > 0 || args.store_dir[0]) )
+    {
+        fprintf(stderr, "Error: --checkpoint applies to one external transpose of one -i file\n");
+        usage( EXIT_FAILURE );
+    }
+    if ( (args.has_window_sep || args.window_index) && args.window_rows == 0 )
+    {
+        fprintf(stderr, "Error: --window-sep and --window-index need --window\n");
+        usage( EXIT_FAILURE );
+    }
+    if(args.verbosity > 0 && !args.out_filename[0] && !args.batch_filename[0] && !args.serve_socket[0] &&
+       !(args.store_dir[0] && !args.store_render) && !args.build_index)
+    {
+	fprintf(stderr, " verbosity setting overriden to 0 to preserve stdout\n");
+	args.verbosity = 0;
+    }
+
+	//if (args.in_filename[0] == '\0' && stdin == NULL) usage(EXIT_FAILURE);
+	//if (args.out_filename[0] == '\0' && stdout == NULL) usage(EXIT_FAILURE);
+
+    ft_options_init( &opt );
+    opt.element_size  = args.element_size;
+    opt.in_delim      = args.in_delim;
+    opt.out_delim     = args.out_delim;
+    opt.engine        = args.engine;
+    opt.memory_budget = args.memory_budget;
+    opt.tmpdir        = args.tmpdir;
+    opt.threads       = args.threads;
+    opt.keep_bytes    = args.batch_filename[0] ? KEEP_BYTES : 0;
+    opt.window_rows   = args.window_rows;
+    opt.window_separator = args.has_window_sep ? args.window_sep : (const char *)0;
+    opt.window_index  = args.window_index;
+    opt.header        = args.header;
+    opt.labels        = args.labels;
+    opt.column_widths = args.column_widths;
+    opt.numa          = args.numa;
+    opt.no_smt        = args.no_smt;
+    opt.direct_io     = args.direct_io;
+    opt.spill_codec   = args.spill_codec;
+    opt.checkpoint    = args.checkpoint[0] ? args.checkpoint : (const char *)0;
+    opt.resume        = args.resume;
+    opt.perf          = args.perf;
+    opt.verbosity     = args.verbosity;
+    opt.log           = args.verbosity > 0 ? stdout : (FILE *)0;
+    opt.warn          = stderr;
+    opt.input_name    = args.join_filename[0] ? args.join_filename : args.in_filename[0] ? args.in_filename : "stdin";
+    if ( args.n_inputs > 1 )
+    {
+        snprintf( stacked_name, sizeof(stacked_name), "%.400s + %d more", args.in_filename, args.n_inputs - 1 );
+        opt.input_name = stacked_name;
+    }
+    opt.output_name   = args.out_filename[0] ? args.out_filename : "stdout";
+    if ( args.trace_filename[0] )
+    {
+        opt.on_span   = trace_on_span;
+        opt.on_thread = trace_on_thread;
+    }
+    if ( (ctx = ft_create( &opt )) == (ft_ctx_t *)0 )
+    {
+        perror( "ftranspose" );
+        return EXIT_FAILURE;
+    }
+
+    if ( args.profile[0] )
+        snprintf( profile, sizeof(profile), "%s", args.profile );
+    else
+        ft_default_profile( profile, sizeof(profile) );
+    if ( args.autotune )
+    {
+        rc = ft_autotune( ctx, profile, stderr );
+        if ( rc < 0 )
+            fprintf( stderr, "%s\n", ft_error( ctx ) );
+        ft_destroy( ctx );
+        return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    /* no profile yet is normal; a named one must exist */
+    if ( (rc = ft_load_profile( ctx, profile )) < 0 )
+        fprintf( stderr, "%s\n", ft_error( ctx ) );
+    else if ( rc > 0 && args.profile[0] )
+        fprintf( stderr, "%s: %s\n", profile, strerror( ENOENT ) );
+    if ( args.keep_filename[0] && ft_keep_rows( ctx, args.keep_filename ) < 0 )
+    {
+        fprintf( stderr, "%s\n", ft_error( ctx ) );
+        ft_destroy( ctx );
+        return EXIT_FAILURE;
+    }
+
+    if ( args.serve_socket[0] )
+    {
+        rc = run_serve( &opt, profile );
+        ft_destroy( ctx );
+        return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if ( args.batch_filename[0] )
+    {
+        run_begin( ctx );
+        rc = run_batch( ctx, args.batch_filename ) == 0 ? 0 : -1;
+        progress_stop();
+        if ( args.verbosity >= 1 )
+        {
+            printf( "peak RSS: %ld bytes.\n", peak_rss() );
+            fflush( NULL );
+        }
+        ft_destroy( ctx );
+        return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if ( args.join_filename[0] || args.store_render )
+        in_fd = -1;
+    else if ( args.n_inputs > 1 )
+    {
+        if ( (in_fds = calloc( args.n_inputs, sizeof(int) )) == (int *)0 )
+        {
+            perror( "ftranspose" );
+            ft_destroy( ctx );
+            return EXIT_FAILURE;
+        }
+        for( i = 0; i < args.n_inputs; i++ )
+            if ( (in_fds[i] = open_input( args.inputs[i] )) < 0 )
+            {
+                ft_destroy( ctx );
+                return EXIT_FAILURE;
+            }
+    }
+    else if ( (in_fd = open_input( args.in_filename )) < 0 )
+    {
+        ft_destroy( ctx );
+        return EXIT_FAILURE;
+    }
+    if ( args.plan_only )
+    {
+        if ( (rc = ft_plan_fds( ctx, in_fds, (const char *const *)args.inputs,
+                                args.n_inputs > 1 ? args.n_inputs : 1 )) < 0 )
+            fprintf( stderr, "%s\n", ft_error( ctx ) );
+        else
+            ft_print_plan( ctx, stdout );
+        for( i = 0; i < (args.n_inputs > 1 ? args.n_inputs : 1); i++ )
+            close_input( in_fds[i] );
+        ft_destroy( ctx );
+        return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if ( (out_fd = open_output( args.out_filename )) < 0 )
+    {
+        ft_destroy( ctx );
+        return EXIT_FAILURE;
+    }
+
+    if ( args.verbosity >= 2 )
+    {
+        printf( "field width  = [%d chars]\n", args.element_size );
+        printf( "in_delim     = [%c]\n", args.in_delim );
+        printf( "out_delim    = [%c]\n", args.out_delim );
+        printf( "in_filename  = [%s]\n", args.in_filename );
+        printf( "out_filename = [%s]\n", args.out_filename );
+    }
+
+    run_begin( ctx );
+    if ( args.connect_socket[0] )
+        rc = run_connect( in_fd, out_fd );
+    else if ( args.join_filename[0] )
+        rc = run_join( ctx, out_fd );
+    else if ( args.store_dir[0] )
+        rc = run_store( ctx, in_fds, args.n_inputs > 1 ? args.n_inputs : 1, out_fd );
+    else if ( args.n_lines > 0 || args.build_index )
+        rc = run_query( ctx, in_fd, out_fd );
+    else if ( (rc = ft_transpose_fds( ctx, in_fds, (const char *const *)args.inputs,
+                                      args.n_inputs > 1 ? args.n_inputs : 1, out_fd )) < 0 )
+        fprintf( stderr, "%s\n", ft_error( ctx ) );
 
-    a = read_array( args.in_delim, args.in_filename, args.element_size );
-    write_array_transposed( a, args.out_filename, args.out_delim );
+    progress_stop();
+    for( i = 0; i < (args.n_inputs > 1 ? args.n_inputs : 1); i++ )
+        close_input( in_fds[i] );
+    close_output( out_fd );
 
     if ( args.verbosity >= 1 )
     {
-        printf( "Total RAM used: %ld bytes.\n", a->bytes_allocated );
+        printf( "Matrix buffer: %ld bytes, peak RSS: %ld bytes.\n",
+                (idx_t)ft_stats( ctx )->matrix_bytes, peak_rss() );
         fflush( NULL );
     }
 
-    free_array( a );
+    if ( args.stats_filename[0] )
+        write_stats( ctx, args.stats_filename );
+    if ( run.peak_bw > 0.0 )
+        bandwidth_report( ft_stats( ctx ) );
+    ft_destroy( ctx );
 
-    return EXIT_SUCCESS;
+    return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,323 @@
+/*
+ * ftranspose.h
+ *
+ * libftranspose: transpose delimited text matrices.
+ *
+ * All state lives in an ft_ctx_t, so a process may run any number of
+ * transposes, one per context at a time, from any threads.  The ftranspose
+ * program is a thin wrapper over this interface.
+ *
+ *     ft_options_t opt;
+ *     ft_ctx_t *ctx;
+ *
+ *     ft_options_init( &opt );
+ *     opt.in_delim = ',';
+ *     if ( (ctx = ft_create( &opt )) == (ft_ctx_t *)0 )
+ *         ...
+ *     if ( ft_transpose_fd( ctx, in_fd, out_fd ) < 0 )
+ *         fprintf( stderr, "%s\n", ft_error( ctx ) );
+ *     ft_destroy( ctx );
+ *
+ * Functions returning int return 0 on success and -1 on failure, with the
+ * reason in ft_error().
+ */
+
+#ifndef FTRANSPOSE_H
+#define FTRANSPOSE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FT_VERSION             "1.3"
+#define FT_PATH_LEN            512
+
+/* transpose strategies; FT_ENGINE_AUTO lets the planner choose */
+enum {
+    FT_ENGINE_AUTO,
+    FT_ENGINE_MEMORY,      /* whole matrix in RAM                          */
+    FT_ENGINE_MULTIPASS,   /* re-read the input once per window of columns */
+    FT_ENGINE_EXTERNAL,    /* spill bands of rows to disk, then merge      */
+    FT_ENGINE_CURSOR,      /* one read cursor per row, advanced in step    */
+    FT_N_ENGINES
+};
+
+/* pipeline phases timed in ft_stats_t */
+enum {
+    FT_PHASE_READ,         /* read() from the input                   */
+    FT_PHASE_PARSE,        /* split input into elements, store matrix */
+    FT_PHASE_TRANSPOSE,    /* gather matrix tiles column by column    */
+    FT_PHASE_FORMAT,       /* build output lines from gathered tiles  */
+    FT_PHASE_WRITE,        /* write() to the output                   */
+    FT_PHASE_SPILL_WRITE,  /* external engine: write bands to scratch */
+    FT_PHASE_SPILL_READ,   /* external engine: read bands back        */
+    FT_N_PHASES
+};
+
+/* hardware counters read around each phase with ft_options_t.perf */
+enum {
+    FT_HW_CYCLES,
+    FT_HW_INSTRUCTIONS,
+    FT_HW_LLC_MISSES,
+    FT_HW_DTLB_MISSES,
+    FT_HW_BRANCH_MISSES,
+    FT_N_HW_COUNTERS
+};
+
+enum { FT_STAGE_IDLE, FT_STAGE_READ, FT_STAGE_WRITE };
+
+/* where the memory engine puts the matrix on a NUMA host; any mode but
+ * FT_NUMA_OFF also pins the context's worker threads, spread over nodes
+ */
+enum {
+    FT_NUMA_OFF,
+    FT_NUMA_LOCAL,         /* each band of rows on the node whose threads write it out */
+    FT_NUMA_INTERLEAVE,    /* pages spread round robin over the threads' nodes         */
+    FT_N_NUMA_MODES
+};
+
+/* how the external engine stores spilled bands: FT_CODEC_LZ cuts each
+ * into frames compressed on their own; FT_CODEC_AUTO does so only if a
+ * sample of the first band's frames shrinks enough
+ */
+enum {
+    FT_CODEC_AUTO,
+    FT_CODEC_NONE,
+    FT_CODEC_LZ,
+    FT_N_CODECS
+};
+
+/* ft_join_files(): each file becomes an output line, or an output column */
+enum { FT_JOIN_ROWS, FT_JOIN_COLUMNS };
+
+typedef struct ft_ctx ft_ctx_t;
+
+/* a thread pool: run( pool, job, arg ) calls job( arg ) on 'threads'
+ * threads, the calling thread included, and returns once all of them have
+ * returned.  Supply one in ft_options_t to share threads between contexts.
+ */
+typedef struct {
+    int    threads;
+    void (*run)( void *pool, void *(*job)( void * ), void *arg );
+    void  *pool;
+} ft_pool_t;
+
+/* streaming input: fill 'buf' with up to 'size' bytes; return the # of
+ * bytes, 0 at the end of the input or -1 on errors (with errno set)
+ */
+typedef ssize_t (*ft_read_fn)( void *user, char *buf, size_t size );
+
+/* streaming output: take all 'size' bytes at 'buf'; return 0 or -1 */
+typedef int (*ft_write_fn)( void *user, const char *buf, size_t size );
+
+typedef struct {
+    int         element_size;  /* bytes per field (default 20)                     */
+    char        in_delim;      /* default TAB                                       */
+    char        out_delim;     /* default TAB                                       */
+    int         engine;        /* FT_ENGINE_*                                       */
+    int64_t     memory_budget; /* bytes, 0 = a share of free memory                 */
+    const char *tmpdir;        /* scratch space, NULL = $TMPDIR or /tmp; several
+                                * directories separated by ':' take spill files
+                                * round robin                                      */
+    int         direct_io;     /* external engine: spill with O_DIRECT, past the
+                                * page cache                                       */
+    int         spill_codec;   /* external engine: FT_CODEC_*                       */
+    const char *checkpoint;    /* external engine: journal file; the spill files
+                                * are named and kept until the output is done      */
+    int         resume;        /* carry on from the 'checkpoint' journal, if it
+                                * holds a run on the same input and options        */
+    int         threads;       /* 0 = from the profile, else 1                      */
+    const ft_pool_t *pool;     /* NULL = the context starts its own threads         */
+    int64_t     keep_bytes;    /* matrix buffer kept for the next transpose on the
+                                * context, 0 = freed after each                     */
+    int64_t     window_rows;   /* > 0: transpose each block of this many input rows
+                                * as soon as it is read, for unbounded streams;
+                                * 'engine' does not apply                          */
+    const char *window_separator; /* line written after each block, NULL = none */
+    int         window_index;  /* start each output line with its block # (from 0) */
+    int         header;        /* the first row holds column names: each becomes the
+                                * first field of its output line                  */
+    int         labels;        /* the first field of each row is its name: they
+                                * become the first output line (after the first
+                                * row's, with 'header').  Names are kept apart from
+                                * the matrix, whole, whatever element_size is      */
+    int         column_widths; /* memory engine, single input: store each column with
+                                * slots sized from a sample of the first rows, up to
+                                * element_size, and longer fields apart           */
+    int         numa;          /* FT_NUMA_*, for the context's own threads          */
+    int         no_smt;        /* pin worker threads to one CPU per core            */
+    int         perf;          /* read hardware counters per phase                  */
+    int         verbosity;     /* 1: describe each step on 'log'                    */
+    FILE       *log;           /* -v output, NULL = none                            */
+    FILE       *warn;          /* warnings such as truncated fields, NULL = none    */
+    const char *input_name;    /* used in messages, default "input"                 */
+    const char *output_name;   /* used in messages, default "output"                */
+
+    /* instrumentation, called on the thread doing the work: a span for
+     * every phase and for each engine step, and the name of each thread
+     * the context starts
+     */
+    void      (*on_span)( void *user, const char *name, double start, double end, int64_t bytes );
+    void      (*on_thread)( void *user, const char *name );
+    void       *hook_user;
+} ft_options_t;
+
+typedef struct {
+    double   wall;             /* seconds of wall clock time, summed over threads */
+    double   cpu;              /* seconds of thread CPU time                       */
+    int64_t  bytes;            /* bytes consumed (read/parse/transpose) or
+                                * produced (format/write) by the phase            */
+    uint64_t hw[ FT_N_HW_COUNTERS ]; /* hardware counter deltas (user mode)       */
+} ft_phase_stats_t;
+
+/* what the last transpose on a context did */
+typedef struct {
+    ft_phase_stats_t phase[ FT_N_PHASES ];
+    const char *engine;
+    int         threads;
+    unsigned    hw_mask;       /* bit per FT_HW_* counter that was read            */
+    const char *hw_error;      /* why counters are unavailable                     */
+    double      plan_seconds;
+    int64_t     rows, cols, elements;
+    int64_t     matrix_bytes;  /* largest matrix buffer held at once               */
+    int64_t     passes;        /* multipass: passes over the input                 */
+    int         bands;         /* external: bands spilled                          */
+    const char *spill_codec;   /* external: how they were stored                   */
+    int64_t     spill_raw;     /* external: their bytes before compression         */
+    int64_t     windows;       /* window_rows: blocks written                      */
+    int64_t     rows_skipped;  /* ft_keep_rows(): input rows left out              */
+    int         numa_nodes;    /* nodes the matrix was placed on, 0 = not placed   */
+    int64_t     budget;        /* memory budget the plan used                      */
+    double      predicted_seconds;
+    int64_t     predicted_memory;
+    const char *tune_source;   /* profile the sizes below came from, or "defaults" */
+    int64_t     page_bytes, io_block, tile_bytes;
+} ft_stats_t;
+
+/* counters published by a running transpose, for ft_progress() */
+typedef struct {
+    int     stage;             /* FT_STAGE_*                                       */
+    int64_t stage_start;       /* CLOCK_MONOTONIC nanoseconds at stage start       */
+    int64_t bytes_in;          /* input bytes parsed so far                        */
+    int64_t bytes_total;       /* input size, 0 if unknown (pipe)                  */
+    int64_t rows_in;           /* input rows parsed so far                         */
+    int64_t lines_out;         /* output lines completed so far                    */
+    int64_t lines_total;       /* output lines to write                            */
+    int64_t bytes_out;         /* output bytes written so far                      */
+} ft_progress_t;
+
+void        ft_options_init( ft_options_t *opt );
+ft_ctx_t   *ft_create( const ft_options_t *opt );
+void        ft_destroy( ft_ctx_t *ctx );
+const char *ft_error( ft_ctx_t *ctx );
+
+/* replace a context's options between transposes; the profile it loaded
+ * is consulted again if the element width moves to another class
+ */
+int         ft_reconfigure( ft_ctx_t *ctx, const ft_options_t *opt );
+
+/* allocate the matrix buffer up front, backed by huge pages if asked, and
+ * keep it for every later transpose (opt.keep_bytes is raised to its size)
+ */
+int         ft_reserve( ft_ctx_t *ctx, int64_t bytes, int huge_pages );
+
+/* names used in messages for the next transpose, e.g. in a batch; the
+ * strings must outlive it
+ */
+void        ft_set_names( ft_ctx_t *ctx, const char *input_name, const char *output_name );
+
+/* keep only the input rows whose first field is one of the keys listed,
+ * one per line, in the file at 'path', for every later transpose on the
+ * context; NULL keeps all rows again.  Rows left out are skipped to their
+ * newline without being parsed.  Keys are at most 255 bytes.
+ */
+int         ft_keep_rows( ft_ctx_t *ctx, const char *path );
+
+/* load the --autotune profile entry for the context's element width;
+ * NULL is this host's default profile.  Returns 1 if there is no such file.
+ */
+int         ft_load_profile( ft_ctx_t *ctx, const char *path );
+int         ft_autotune( ft_ctx_t *ctx, const char *path, FILE *report );
+void        ft_default_profile( char *path, size_t size );
+
+/* transpose a regular file, pipe or socket; neither fd is closed */
+int         ft_transpose_fd( ft_ctx_t *ctx, int in_fd, int out_fd );
+
+/* transpose 'n' inputs stacked as rows, in order, as if concatenated.  All
+ * must have the same # of columns; regular files are prescanned to check
+ * that before any is parsed, and are parsed in parallel, in parts cut at
+ * line boundaries.  'names' (or NULL) are used in messages.
+ */
+int         ft_transpose_fds( ft_ctx_t *ctx, const int *in_fds, const char *const *names, int n,
+                              int out_fd );
+
+/* transpose 'in_size' bytes at 'in' into a malloc()ed buffer the caller
+ * frees
+ */
+int         ft_transpose_buffer( ft_ctx_t *ctx, const char *in, size_t in_size,
+                                 char **out, size_t *out_size );
+
+/* pull the input from 'rd' and push the output to 'wr' */
+int         ft_transpose_stream( ft_ctx_t *ctx, ft_read_fn rd, void *rd_user,
+                                 ft_write_fn wr, void *wr_user );
+
+/* join 'count' single-column files, one field per line, as the lines
+ * (FT_JOIN_ROWS) or the columns (FT_JOIN_COLUMNS, like paste) of the
+ * output.  Files are read in parallel; with FT_JOIN_COLUMNS and more files
+ * than free descriptors they are pasted in groups through spill files.
+ */
+int         ft_join_files( ft_ctx_t *ctx, const char *const *paths, int64_t count,
+                           int out_fd, int mode );
+
+/* a store: a directory that keeps a matrix transposed, as column-major
+ * binary segments plus a text manifest.  ft_store_append() creates it if
+ * need be and adds the rows of 'in_fd' as new segments, in one pass over
+ * just those rows; every append must have the store's # of columns, and
+ * fields are kept at the width of the first (opt.element_size then).
+ * ft_store_render() writes the transposed text of segments [first,
+ * first + count), or through the last if count is 0.
+ */
+int         ft_store_append( ft_ctx_t *ctx, const char *dir, int in_fd );
+int         ft_store_render( ft_ctx_t *ctx, const char *dir, int64_t first, int64_t count, int out_fd );
+
+/* a field index of a regular file: the offset of every 64th field of
+ * each row, saved at 'index_path' and rebuilt when the file's size or
+ * mtime changes.  ft_query_fd() writes input columns cols[0..n), numbered
+ * from 0, as output lines, as a full transpose would write them, reading
+ * only around those fields; it builds the index if it is missing or
+ * stale, in an unlinked temp file if 'index_path' is NULL.  Every row
+ * must have the first row's # of fields.
+ */
+int         ft_index_fd( ft_ctx_t *ctx, int in_fd, const char *index_path );
+int         ft_query_fd( ft_ctx_t *ctx, int in_fd, const char *index_path, const int64_t *cols, int64_t n,
+                         int out_fd );
+
+/* plan a transpose of 'in_fd' without running it, and describe the plan */
+int         ft_plan_fd( ft_ctx_t *ctx, int in_fd );
+int         ft_plan_fds( ft_ctx_t *ctx, const int *in_fds, const char *const *names, int n );
+void        ft_print_plan( ft_ctx_t *ctx, FILE *fp );
+
+const ft_stats_t *ft_stats( ft_ctx_t *ctx );
+
+/* a snapshot of the counters; safe to call from any thread */
+void        ft_progress( ft_ctx_t *ctx, ft_progress_t *p );
+
+/* a pool of worker threads usable as ft_options_t.pool by many contexts */
+ft_pool_t  *ft_pool_create( int threads );
+void        ft_pool_destroy( ft_pool_t *pool );
+
+const char *ft_engine_name( int engine );
+const char *ft_phase_name( int phase );
+const char *ft_numa_name( int mode );
+const char *ft_codec_name( int codec );
+const char *ft_hw_counter_name( int counter );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,7432 @@
+/*
+ * libftranspose.c
+ *
+ * The transpose engines behind ftranspose.h.  Everything a transpose
+ * touches hangs off its ft_ctx_t; the only state shared between contexts
+ * is each thread's hardware counter group, which counts the thread
+ * whichever context it is working for.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/file.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "ftranspose.h"
+
+#define ARG_STR_LEN            FT_PATH_LEN
+#define DEFAULT_FIELD_LENGTH   20
+#define TAB 9
+
+#define IO_BLOCK_SIZE          (1 << 20)   /* bytes per read() from the input            */
+#define TILE_BYTES             (1 << 20)   /* bytes of elements gathered per output tile */
+#define PAGE_BYTES             4096        /* matrix buffers grow in multiples of this   */
+#define HUGE_PAGE_BYTES        (2 << 20)   /* transparent huge page size on x86-64       */
+#define MAX_THREADS            256
+#define NUMA_MAX_NODES         64          /* nodes looked for in sysfs                  */
+#define NUMA_SYSFS             "/sys/devices/system"
+#define NUMA_CHUNK             HUGE_PAGE_BYTES /* matrix bytes placed on one node at once */
+#define SCRATCH_MAX            16          /* --tmpdir directories spill files stripe over */
+#define SPILL_PATH_LEN         (ARG_STR_LEN + 32) /* a spill file's name             */
+#define SPILL_ALIGN            4096        /* O_DIRECT offset, size and buffer alignment  */
+#define SPILL_STAGE            (1 << 20)   /* O_DIRECT bytes staged per write or read     */
+#define SPILL_FRAME            (64 << 10)  /* band bytes compressed on their own          */
+#define SPILL_SAMPLE           4           /* FT_CODEC_AUTO: first-band frames tried      */
+#define SPILL_GAIN             0.8         /* and kept compressed if they shrink to this  */
+#define LZ_HASH_BITS           14          /* match finder: 4-byte sequences hashed       */
+
+#define PLAN_FULL_SCAN         (64 << 20)  /* prescan counts every newline up to this    */
+#define PLAN_SAMPLES           64          /* otherwise it samples this many chunks      */
+#define PLAN_SAMPLE_SIZE       (256 << 10) /* of this many bytes                         */
+#define PLAN_MEMORY_SHARE      0.8         /* share of free memory the budget may take   */
+#define PLAN_PARSE_MBPS        150.0       /* planner throughput model: tokenize + store */
+#define PLAN_SCAN_MBPS         1000.0      /* skip columns / find newlines               */
+#define PLAN_EMIT_MBPS         250.0       /* transpose + format + write                 */
+#define PLAN_DISK_MBPS         400.0       /* scratch read or write                      */
+#define PLAN_SEEK_SECONDS      0.0001      /* cost of one cursor refill                  */
+#define CURSOR_MIN_BUF         4096        /* smallest read buffer per cursor            */
+#define CURSOR_MAX_BUF         (1 << 20)   /* largest read buffer per cursor             */
+#define ALL_COLUMNS            LONG_MAX
+#define PARTS_PER_THREAD       2           /* stacked inputs are cut into this many parts */
+#define PART_MIN_BYTES         (4 << 20)   /* per thread, but none smaller than this     */
+#define JOIN_FD_SPARE          8           /* descriptors left free by ft_join_files(),
+                                            * beyond those already open                  */
+#define JOIN_MIN_GROUP         64          /* fewest files per group pasted by a thread  */
+#define JOIN_MAX_FILES         (1 << 20)   /* files open at once with no RLIMIT_NOFILE   */
+#define STORE_MAGIC            "ftranspose-store 1"
+#define JOURNAL_MAGIC          "ftranspose-journal 1"
+#define STORE_MANIFEST         "manifest"
+#define STORE_NAME_LEN         64          /* segment file name, as %63s in the manifest */
+#define INDEX_MAGIC            "FTIDX1"
+#define INDEX_STRIDE           64          /* fields per mark in a field index          */
+#define INDEX_READ             4096        /* bytes read from a mark to find a field     */
+#define INDEX_FLUSH            (1 << 20)   /* marks buffered per thread while indexing   */
+#define QUERY_BYTES            (64 << 20)  /* fields gathered per group of query columns */
+#define QUERY_CLAIM            256         /* rows a query thread claims at a time       */
+#define KEY_MAX                255         /* longest --keep-rows key                    */
+#define COLUMN_SAMPLE_ROWS     4096        /* rows sampled to size column slots          */
+#define COLUMN_SAMPLE_BYTES    (16 << 20)  /* but no more than this many bytes of them   */
+#define COLUMN_OVERFLOW_SHARE  0.01        /* of sampled fields a slot may leave out     */
+#define COLUMN_NEW_WIDTH       8           /* slots of columns the sample did not have   */
+#define TUNE_MATRIX_BYTES      (16 << 20)  /* largest synthetic matrix for --autotune    */
+#define TUNE_REPEATS           3           /* --autotune keeps the best of this many     */
+#define N_WIDTH_CLASSES        5
+
+#define ATOMIC_SET( x, v )  __atomic_store_n( &(x), (v), __ATOMIC_RELAXED )
+#define ATOMIC_GET( x )     __atomic_load_n( &(x), __ATOMIC_RELAXED )
+
+static const char *engine_names[ FT_N_ENGINES ] = { "auto", "memory", "multipass", "external", "cursor" };
+static const char *numa_names[ FT_N_NUMA_MODES ] = { "off", "local", "interleave" };
+static const char *codec_names[ FT_N_CODECS ] = { "auto", "none", "lz" };
+
+static const char *phase_names[ FT_N_PHASES ] =
+    { "read", "parse", "transpose", "format", "write", "spill_write", "spill_read" };
+
+static const char *hw_counter_names[ FT_N_HW_COUNTERS ] =
+    { "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+
+typedef long int idx_t;
+
+typedef struct {
+  idx_t rows;              /* # rows in matrix                                        */
+  idx_t cols;              /* # columns in matrix                                     */
+  idx_t element_capacity;  /* maximum # of elements that can be stored in data buffer */
+  idx_t element_count;     /* current # of elements stored in data buffer             */
+  idx_t pos;               /* cursor for writing new elements to data buffer          */
+  int   element_size;      /* # of bytes in each data element (fixed width)           */
+  char *data;              /* data buffer                                             */
+  idx_t bytes_allocated;   /* metrics; size of the data buffer                        */
+  ft_ctx_t *ctx;           /* owner, for the allocation granule and messages          */
+  struct colstore_s *cs;   /* opt.column_widths: elements are stored here instead     */
+  idx_t chunks;            /* opt.numa: NUMA_CHUNKs placed over ctx->numa, 0 = none   */
+  idx_t node_bytes;        /* FT_NUMA_LOCAL: bytes of rows placed on each node        */
+  idx_t limit;             /* bytes the data buffer may grow to, 0 = no limit         */
+  int   full;              /* the limit was reached: parsing stops at the row's end   */
+}array_t;
+
+typedef struct {
+    int         feasible;
+    const char *why;       /* reason it is not feasible                     */
+    idx_t       memory;    /* predicted peak bytes                          */
+    idx_t       scratch;   /* predicted temp file bytes                     */
+    double      seconds;   /* predicted run time                            */
+} estimate_t;
+
+/* what the planner learned about the input and the machine */
+typedef struct {
+    int         engine;        /* engine to run, never FT_ENGINE_AUTO after planning */
+    int         seekable;      /* input is a regular file                       */
+    int         exact;         /* rows were counted, not estimated              */
+    idx_t       input_bytes;
+    idx_t       rows, cols;
+    double      field_mean;    /* mean non-empty field length                   */
+    int         field_max;     /* longest field seen                            */
+    idx_t       budget;        /* bytes of memory the run may use               */
+    const char *budget_source;
+    idx_t       mem_available; /* -1 if unknown                                 */
+    idx_t       cgroup_free;   /* -1 if no cgroup limit                         */
+    idx_t       scratch_free;  /* free bytes in --tmpdir, -1 if unknown         */
+    int         scratch_devices; /* distinct file systems among the directories */
+    idx_t       reserve;       /* elements to allocate up front, 0 = grow       */
+    idx_t       window_cols;   /* multipass: columns per pass                   */
+    idx_t       passes;
+    idx_t       matrix_limit;  /* memory: bytes the matrix may take before the
+                                * rows read so far are spilled as a band        */
+    idx_t       band_rows;     /* external: rows per band, 0 = from first row   */
+    idx_t       band_bytes;
+    idx_t       merge_bytes;   /* external: merge read buffer                   */
+    idx_t       cursor_buf;    /* cursor: read buffer per row                   */
+    estimate_t  est[ FT_N_ENGINES ];
+} plan_t;
+
+/* sizes that depend on the machine: the defaults above, or the entry in
+ * this host's --autotune profile for the element width in use
+ */
+typedef struct {
+    int    max_width;      /* widest element the entry is for, 0 = any */
+    idx_t  page_bytes;     /* matrix buffers grow in multiples of this */
+    idx_t  io_block;       /* bytes per read() from the input          */
+    idx_t  tile_bytes;     /* bytes of elements gathered per tile      */
+    int    threads;        /* threads gathering and formatting tiles   */
+    double mbps;           /* transpose rate --autotune measured       */
+} tune_t;
+
+static const int width_classes[ N_WIDTH_CLASSES ] = { 8, 16, 32, 64, 0 };
+
+/* variable-length fields kept apart from the matrix (opt.header and
+ * opt.labels): strings back to back, each NUL-terminated
+ */
+typedef struct {
+    char  *data;
+    idx_t  len, size;      /* bytes used, allocated                  */
+    idx_t  mark;           /* start of the string being added        */
+    idx_t *off;            /* start of each string                   */
+    idx_t  count, max;
+    idx_t  longest;
+} strpool_t;
+
+/* the header row's fields, and the first field of every other row */
+typedef struct {
+    strpool_t header;      /* with labels, [0] is the corner field   */
+    strpool_t labels;
+} text_t;
+
+enum { TEXT_HEADER = 1, TEXT_LABELS = 2 };
+
+/* the keys of the rows to keep: an open-addressing hash set, probed
+ * linearly, over the keys stored back to back
+ */
+typedef struct {
+    char    *pool;
+    struct keyslot {
+        uint64_t hash;
+        uint32_t off;
+        uint32_t len;      /* 0: an empty slot                       */
+    }       *slot;
+    uint64_t mask;         /* slots - 1, a power of two at least twice the keys */
+    idx_t    count;
+} keyset_t;
+
+/* worker threads that all run the same job; the calling thread runs it
+ * too, so with one thread pool_run() is a plain function call
+ */
+typedef struct pool_s {
+    int             threads;       /* including the calling thread           */
+    int             wanted;        /* threads asked for                      */
+    struct pool_thread {
+        struct pool_s  *pool;
+        pthread_t       tid;
+        char            name[ 16 ];
+        int             node;      /* NUMA node it is pinned to, -1 = none   */
+    }               thread[ MAX_THREADS ];
+    pthread_mutex_t lock;
+    pthread_mutex_t serial;        /* one job at a time                      */
+    pthread_cond_t  go;            /* a new job is posted                    */
+    pthread_cond_t  done;          /* the last worker finished the job       */
+    void         *(*job)( void * );
+    void           *arg;
+    idx_t           generation;    /* bumped for every job                   */
+    int             busy;          /* workers still running the job          */
+    int             quit;
+    int             pin;           /* ctx_pin() the workers were started for */
+    void          (*on_thread)( void *user, const char *name );
+    void           *hook_user;
+    ft_pool_t       api;           /* this pool as an ft_pool_t              */
+} pool_t;
+
+struct ft_ctx {
+    ft_options_t    opt;
+    char            tmpdir[ ARG_STR_LEN ];
+    char            checkpoint[ ARG_STR_LEN ];
+    char            scratch_dirs[ ARG_STR_LEN ]; /* tmpdir split at ':'      */
+    const char     *scratch[ SCRATCH_MAX ];
+    int             nscratch;
+    int             scratch_next;  /* directory of the next spill file       */
+    char            profile[ ARG_STR_LEN ];
+    const char     *tune_source;   /* 'profile', or "defaults"               */
+    ft_stats_t      stats;
+    plan_t          plan;
+    tune_t          tune;
+    ft_progress_t   progress;
+    pool_t         *pool;          /* own workers, started on first use      */
+    array_t        *arena;         /* matrix buffer kept for the next call   */
+    char           *io_buf;        /* input buffer, tune.io_block bytes      */
+    size_t          io_buf_size;
+    keyset_t       *keep;          /* rows to keep by first field, NULL = all */
+    text_t          text;          /* header and labels of the transpose     */
+    struct {
+        int         nodes;         /* opt.numa: nodes of the threads, if > 1 */
+        int         id[ NUMA_MAX_NODES ]; /* in ascending order              */
+    }               numa;
+    pthread_mutex_t lock;          /* merging per-thread phase totals        */
+    char            error[ 2 * ARG_STR_LEN ];
+};
+
+typedef struct {
+    double   wall;
+    double   cpu;
+    int      hw_valid;             /* hw[] holds a counter snapshot          */
+    uint64_t hw[ FT_N_HW_COUNTERS ];
+    uint64_t hw_enabled;           /* time the group was enabled / running,  */
+    uint64_t hw_running;           /* to scale for PMU multiplexing          */
+} stamp_t;
+
+/* set while a pool thread charges phases to its own totals */
+static __thread ft_phase_stats_t *phase_local;
+
+
+
+/* record why the current call fails; returns -1 */
+static int ft_fail( ft_ctx_t *ctx, const char *fmt, ... )
+{
+    va_list ap;
+
+    va_start( ap, fmt );
+    vsnprintf( ctx->error, sizeof(ctx->error), fmt, ap );
+    va_end( ap );
+    return -1;
+}
+
+/* as perror() */
+static int ft_fail_errno( ft_ctx_t *ctx, const char *what )
+{
+    return ft_fail( ctx, "%s: %s", what, strerror( errno ) );
+}
+
+static void ft_log( ft_ctx_t *ctx, const char *fmt, ... )
+{
+    va_list ap;
+
+    if ( ctx->opt.log == (FILE *)0 )
+        return;
+    va_start( ap, fmt );
+    vfprintf( ctx->opt.log, fmt, ap );
+    va_end( ap );
+    fflush( ctx->opt.log );
+}
+
+static void ft_warn( ft_ctx_t *ctx, const char *fmt, ... )
+{
+    va_list ap;
+
+    if ( ctx->opt.warn == (FILE *)0 )
+        return;
+    va_start( ap, fmt );
+    vfprintf( ctx->opt.warn, fmt, ap );
+    va_end( ap );
+}
+
+static double clock_seconds( clockid_t id )
+{
+    struct timespec ts;
+
+    clock_gettime( id, &ts );
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* close a span that began at 'start' (CLOCK_MONOTONIC seconds) */
+static void trace_end( ft_ctx_t *ctx, const char *name, double start, idx_t bytes )
+{
+    if ( ctx->opt.on_span )
+        ctx->opt.on_span( ctx->opt.hook_user, name, start, clock_seconds( CLOCK_MONOTONIC ), bytes );
+}
+
+/* perf: each thread opens one perf_event_open group (cycles as leader)
+ * on first use, counting that thread on any CPU in user mode.  A group read
+ * is one read() per phase_begin()/phase_end(), which happen once per input
+ * block or output tile.  Counters the PMU lacks are left out of the group.
+ * The group belongs to the thread, not to a context: a pool thread working
+ * for several contexts charges each the deltas of its own phases.  A
+ * thread-specific key closes the group when its thread exits.
+ */
+typedef struct {
+    int         leader;            /* -1 if counters are unavailable         */
+    int         slot[ FT_N_HW_COUNTERS ]; /* position in the group read, -1 if off */
+    int         fd[ FT_N_HW_COUNTERS ];   /* counter fds, -1 if off          */
+    int         n;                 /* # counters in the group                */
+    unsigned    mask;              /* counters in the group                  */
+    const char *error;             /* why the group could not be opened      */
+} perf_group_t;
+
+static __thread perf_group_t *perf_local;
+static pthread_key_t  perf_key;
+static pthread_once_t perf_once = PTHREAD_ONCE_INIT;
+
+#ifdef __linux__
+static int perf_open( int counter, int group_fd )
+{
+    struct perf_event_attr pe;
+
+    memset( &pe, 0, sizeof(pe) );
+    pe.size = sizeof(pe);
+    switch ( counter )
+    {
+    case FT_HW_CYCLES:
+        pe.type = PERF_TYPE_HARDWARE; pe.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case FT_HW_INSTRUCTIONS:
+        pe.type = PERF_TYPE_HARDWARE; pe.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case FT_HW_LLC_MISSES:
+        pe.type = PERF_TYPE_HARDWARE; pe.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case FT_HW_DTLB_MISSES:
+        pe.type   = PERF_TYPE_HW_CACHE;
+        pe.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case FT_HW_BRANCH_MISSES:
+        pe.type = PERF_TYPE_HARDWARE; pe.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    pe.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv     = 1;
+    pe.disabled       = (group_fd == -1);
+    return (int)syscall( SYS_perf_event_open, &pe, 0, -1, group_fd, 0 );
+}
+#endif
+
+static perf_group_t *perf_thread_open( void )
+{
+    perf_group_t *g = calloc( 1, sizeof(perf_group_t) );
+    int i;
+
+    if ( g == (perf_group_t *)0 )
+        return g;
+    g->leader = -1;
+    for( i = 0; i < FT_N_HW_COUNTERS; i++ )
+        g->slot[i] = g->fd[i] = -1;
+#ifdef __linux__
+    if ( (g->leader = perf_open( FT_HW_CYCLES, -1 )) < 0 )
+        g->error = (errno == EACCES || errno == EPERM) ?
+                   "not permitted (see /proc/sys/kernel/perf_event_paranoid)" :
+                   "no hardware PMU available";
+    else
+    {
+        g->fd[ FT_HW_CYCLES ]   = g->leader;
+        g->slot[ FT_HW_CYCLES ] = g->n++;
+        for( i = FT_HW_CYCLES + 1; i < FT_N_HW_COUNTERS; i++ )
+            if ( (g->fd[i] = perf_open( i, g->leader )) >= 0 )
+                g->slot[i] = g->n++;
+        ioctl( g->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+        ioctl( g->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+    }
+#else
+    g->error = "perf_event_open is Linux only";
+#endif
+    for( i = 0; i < FT_N_HW_COUNTERS; i++ )
+        if ( g->slot[i] >= 0 )
+            g->mask |= 1u << i;
+    return g;
+}
+
+/* thread exit: close the counters of the exiting thread's group */
+static void perf_thread_close( void *arg )
+{
+    perf_group_t *g = (perf_group_t *)arg;
+    int i;
+
+    for( i = 0; i < FT_N_HW_COUNTERS; i++ )
+        if ( g->fd[i] >= 0 )
+            close( g->fd[i] );
+    free( g );
+}
+
+static void perf_key_create( void )
+{
+    pthread_key_create( &perf_key, perf_thread_close );
+}
+
+/* note in the context's stats which counters this thread has */
+static void perf_note( ft_ctx_t *ctx, perf_group_t *g )
+{
+    if ( (ATOMIC_GET( ctx->stats.hw_mask ) & g->mask) != g->mask )
+        __atomic_fetch_or( &ctx->stats.hw_mask, g->mask, __ATOMIC_RELAXED );
+    if ( g->error && ATOMIC_GET( ctx->stats.hw_error ) == (const char *)0 )
+    {
+        pthread_mutex_lock( &ctx->lock );
+        if ( !ctx->stats.hw_error )
+        {
+            ctx->stats.hw_error = g->error;
+            ft_warn( ctx, "hardware counters unavailable: %s\n", g->error );
+        }
+        pthread_mutex_unlock( &ctx->lock );
+    }
+}
+
+/* snapshot this thread's counters into 't' */
+static void perf_sample( ft_ctx_t *ctx, stamp_t *t )
+{
+    perf_group_t *g = perf_local;
+    uint64_t buf[ 3 + FT_N_HW_COUNTERS ];
+    int i;
+
+    t->hw_valid = 0;
+    if ( g == (perf_group_t *)0 )
+    {
+        if ( (g = perf_local = perf_thread_open()) == (perf_group_t *)0 )
+            return;
+        pthread_once( &perf_once, perf_key_create );
+        pthread_setspecific( perf_key, g );
+    }
+    perf_note( ctx, g );
+    if ( g->leader < 0 || read( g->leader, buf, sizeof(buf) ) < (ssize_t)(3 * sizeof(uint64_t)) )
+        return;
+    t->hw_enabled = buf[1];
+    t->hw_running = buf[2];
+    for( i = 0; i < FT_N_HW_COUNTERS; i++ )
+        t->hw[i] = g->slot[i] >= 0 ? buf[ 3 + g->slot[i] ] : 0;
+    t->hw_valid = 1;
+}
+
+/* add the counter deltas since 't', scaled up if the PMU was multiplexed */
+static void perf_charge( ft_ctx_t *ctx, ft_phase_stats_t *p, stamp_t *t )
+{
+    stamp_t now;
+    double scale = 1.0;
+    int i;
+
+    perf_sample( ctx, &now );
+    if ( !t->hw_valid || !now.hw_valid )
+        return;
+    if ( now.hw_running > t->hw_running )
+        scale = (double)(now.hw_enabled - t->hw_enabled) / (double)(now.hw_running - t->hw_running);
+    for( i = 0; i < FT_N_HW_COUNTERS; i++ )
+        p->hw[i] += (uint64_t)((now.hw[i] - t->hw[i]) * scale);
+}
+
+static void phase_begin( ft_ctx_t *ctx, stamp_t *t )
+{
+    if ( ctx->opt.perf )
+        perf_sample( ctx, t );
+    t->wall = clock_seconds( CLOCK_MONOTONIC );
+    t->cpu  = clock_seconds( CLOCK_THREAD_CPUTIME_ID );
+}
+
+/* charge the time since phase_begin() and 'bytes' to a phase */
+static void phase_end( ft_ctx_t *ctx, int phase, stamp_t *t, idx_t bytes )
+{
+    ft_phase_stats_t *p = phase_local ? &phase_local[ phase ] : &ctx->stats.phase[ phase ];
+
+    double now = clock_seconds( CLOCK_MONOTONIC );
+
+    p->wall  += now - t->wall;
+    p->cpu   += clock_seconds( CLOCK_THREAD_CPUTIME_ID ) - t->cpu;
+    p->bytes += bytes;
+    if ( ctx->opt.perf )
+        perf_charge( ctx, p, t );
+    if ( ctx->opt.on_span )
+        ctx->opt.on_span( ctx->opt.hook_user, phase_names[ phase ], t->wall, now, bytes );
+}
+
+/* add a thread's phase totals to the run's; times add up across threads */
+static void phase_merge( ft_ctx_t *ctx, ft_phase_stats_t *local )
+{
+    int ph, i;
+
+    pthread_mutex_lock( &ctx->lock );
+    for( ph = 0; ph < FT_N_PHASES; ph++ )
+    {
+        ctx->stats.phase[ ph ].wall  += local[ ph ].wall;
+        ctx->stats.phase[ ph ].cpu   += local[ ph ].cpu;
+        ctx->stats.phase[ ph ].bytes += local[ ph ].bytes;
+        for( i = 0; i < FT_N_HW_COUNTERS; i++ )
+            ctx->stats.phase[ ph ].hw[i] += local[ ph ].hw[i];
+    }
+    pthread_mutex_unlock( &ctx->lock );
+}
+
+/* called by the worker when it moves to another stage */
+static void progress_stage( ft_ctx_t *ctx, int stage )
+{
+    ATOMIC_SET( ctx->progress.stage_start, (int64_t)(clock_seconds( CLOCK_MONOTONIC ) * 1e9) );
+    ATOMIC_SET( ctx->progress.stage, stage );
+}
+
+/* the host's NUMA nodes and cores, read from sysfs once: the node of each
+ * CPU the process may run on and its core, as the lowest numbered of its
+ * SMT siblings; -1 for the other CPUs.  A host without the node
+ * directories is one node.
+ */
+typedef struct {
+    int   ncpus;                   /* highest allowed CPU + 1                */
+    int   nodes;                   /* highest node + 1                       */
+    short node[ CPU_SETSIZE ];
+    short core[ CPU_SETSIZE ];
+} topology_t;
+
+static topology_t     topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+/* node of the calling thread as the last NUMA decision saw it, -1 = none */
+static __thread int thread_node = -1;
+
+/* the CPUs in a sysfs list such as "0-3,8-11" */
+static int read_cpulist( const char *path, cpu_set_t *set )
+{
+    char buf[ 4096 ], *p, *end;
+    long lo, hi;
+    ssize_t n;
+    int fd;
+
+    CPU_ZERO( set );
+    if ( (fd = open( path, O_RDONLY )) < 0 )
+        return -1;
+    n = read( fd, buf, sizeof(buf) - 1 );
+    close( fd );
+    if ( n < 0 )
+        return -1;
+    buf[n] = '\0';
+    for( p = buf; *p && *p != '\n'; p = *end == ',' ? end + 1 : end )
+    {
+        lo = hi = strtol( p, &end, 10 );
+        if ( end == p )
+            break;
+        if ( *end == '-' )
+            hi = strtol( end + 1, &end, 10 );
+        for( ; lo <= hi && lo < CPU_SETSIZE; lo++ )
+            CPU_SET( lo, set );
+    }
+    return 0;
+}
+
+static void topology_load( void )
+{
+    cpu_set_t allowed, set;
+    char path[ 128 ];
+    int cpu, sib, node;
+
+    if ( sched_getaffinity( 0, sizeof(allowed), &allowed ) != 0 )
+    {
+        CPU_ZERO( &allowed );
+        CPU_SET( 0, &allowed );
+    }
+    topology.nodes = 1;
+    for( cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+    {
+        topology.node[cpu] = topology.core[cpu] = -1;
+        if ( !CPU_ISSET( cpu, &allowed ) )
+            continue;
+        topology.node[cpu] = 0;
+        topology.core[cpu] = cpu;
+        topology.ncpus = cpu + 1;
+    }
+    for( node = 0; node < NUMA_MAX_NODES; node++ )
+    {
+        snprintf( path, sizeof(path), NUMA_SYSFS "/node/node%d/cpulist", node );
+        if ( read_cpulist( path, &set ) < 0 )
+            continue;
+        for( cpu = 0; cpu < topology.ncpus; cpu++ )
+            if ( topology.node[cpu] >= 0 && CPU_ISSET( cpu, &set ) )
+            {
+                topology.node[cpu] = node;
+                if ( node >= topology.nodes )
+                    topology.nodes = node + 1;
+            }
+    }
+    for( cpu = 0; cpu < topology.ncpus; cpu++ )
+    {
+        snprintf( path, sizeof(path), NUMA_SYSFS "/cpu/cpu%d/topology/thread_siblings_list", cpu );
+        if ( topology.node[cpu] < 0 || read_cpulist( path, &set ) < 0 )
+            continue;
+        for( sib = 0; sib < cpu && !CPU_ISSET( sib, &set ); sib++ )
+            ;
+        topology.core[cpu] = sib;
+    }
+}
+
+/* the CPUs to pin threads to, in order: round robin over the nodes, and
+ * within a node all cores before any core's second SMT thread, which are
+ * left out with 'no_smt'; returns how many
+ */
+static int topology_order( int no_smt, int *order )
+{
+    int list[ CPU_SETSIZE ], start[ NUMA_MAX_NODES ], len[ NUMA_MAX_NODES ];
+    int cpu, node, pass, r, n = 0, m = 0, more;
+
+    pthread_once( &topology_once, topology_load );
+    for( node = 0; node < topology.nodes; node++ )
+    {
+        start[node] = n;
+        for( pass = 0; pass < 2; pass++ )
+            for( cpu = 0; cpu < topology.ncpus; cpu++ )
+                if ( topology.node[cpu] == node && (pass == 0 ? topology.core[cpu] == cpu :
+                                                    topology.core[cpu] != cpu && !no_smt) )
+                    list[ n++ ] = cpu;
+        len[node] = n - start[node];
+    }
+    for( r = 0, more = 1; more; r++ )
+        for( node = 0, more = 0; node < topology.nodes; node++ )
+            if ( r < len[node] )
+            {
+                order[ m++ ] = list[ start[node] + r ];
+                more = 1;
+            }
+    return m;
+}
+
+/* the node the calling thread runs on now, -1 if unknown */
+static int topology_here( void )
+{
+    int cpu = sched_getcpu();
+
+    pthread_once( &topology_once, topology_load );
+    return cpu >= 0 && cpu < CPU_SETSIZE ? topology.node[cpu] : -1;
+}
+
+static void *pool_main( void *arg )
+{
+    struct pool_thread *th = (struct pool_thread *)arg;
+    pool_t *pool = th->pool;
+    idx_t seen = 0;
+
+    thread_node = th->node;
+    if ( pool->on_thread )
+        pool->on_thread( pool->hook_user, th->name );
+    pthread_mutex_lock( &pool->lock );
+    while ( 1 )
+    {
+        while ( !pool->quit && pool->generation == seen )
+            pthread_cond_wait( &pool->go, &pool->lock );
+        if ( pool->quit )
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock( &pool->lock );
+        pool->job( pool->arg );
+        pthread_mutex_lock( &pool->lock );
+        if ( --pool->busy == 0 )
+            pthread_cond_signal( &pool->done );
+    }
+    pthread_mutex_unlock( &pool->lock );
+    return (void *)0;
+}
+
+/* run job( arg ) on every thread of the pool and wait for all of them */
+static void pool_run( pool_t *pool, void *(*job)( void * ), void *arg )
+{
+    pthread_mutex_lock( &pool->serial );
+    if ( pool->threads > 1 )
+    {
+        pthread_mutex_lock( &pool->lock );
+        pool->job  = job;
+        pool->arg  = arg;
+        pool->busy = pool->threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast( &pool->go );
+        pthread_mutex_unlock( &pool->lock );
+    }
+    job( arg );
+    if ( pool->threads > 1 )
+    {
+        pthread_mutex_lock( &pool->lock );
+        while ( pool->busy > 0 )
+            pthread_cond_wait( &pool->done, &pool->lock );
+        pthread_mutex_unlock( &pool->lock );
+    }
+    pthread_mutex_unlock( &pool->serial );
+}
+
+static void pool_api_run( void *pool, void *(*job)( void * ), void *arg )
+{
+    pool_run( (pool_t *)pool, job, arg );
+}
+
+/* a pool of 'threads' threads, the caller included; fewer if the system
+ * will not start them all.  Worker i is pinned to cpus[ i % ncpus ] if
+ * 'ncpus' > 0; the caller is left where it is.
+ */
+static pool_t *pool_start( int threads, const int *cpus, int ncpus,
+                           void (*on_thread)( void *, const char * ), void *user )
+{
+    pool_t *pool = calloc( 1, sizeof(pool_t) );
+    pthread_attr_t attr;
+    cpu_set_t set;
+    int i, created;
+
+    if ( pool == (pool_t *)0 )
+        return pool;
+    pool->threads   = 1;
+    pool->wanted    = threads;
+    pool->on_thread = on_thread;
+    pool->hook_user = user;
+    pthread_mutex_init( &pool->lock, (pthread_mutexattr_t *)0 );
+    pthread_mutex_init( &pool->serial, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &pool->go, (pthread_condattr_t *)0 );
+    pthread_cond_init( &pool->done, (pthread_condattr_t *)0 );
+    for( i = 1; i < threads && i < MAX_THREADS; i++ )
+    {
+        struct pool_thread *th = &pool->thread[i];
+
+        th->pool = pool;
+        th->node = -1;
+        snprintf( th->name, sizeof(th->name), "worker %d", i );
+
+        /* pinned from the start, so the node is known before any job */
+        if ( ncpus > 0 && pthread_attr_init( &attr ) == 0 )
+        {
+            CPU_ZERO( &set );
+            CPU_SET( cpus[ i % ncpus ], &set );
+            if ( pthread_attr_setaffinity_np( &attr, sizeof(set), &set ) == 0 )
+                th->node = topology.node[ cpus[ i % ncpus ] ];
+            created = pthread_create( &th->tid, &attr, pool_main, th ) == 0;
+            pthread_attr_destroy( &attr );
+            if ( created )
+            {
+                pool->threads++;
+                continue;
+            }
+            /* an unpinned thread is on no node in particular */
+            th->node = -1;
+        }
+        if ( pthread_create( &th->tid, (pthread_attr_t *)0, pool_main, th ) != 0 )
+            break;
+        pool->threads++;
+    }
+    pool->api.threads = pool->threads;
+    pool->api.run     = pool_api_run;
+    pool->api.pool    = pool;
+    return pool;
+}
+
+static void pool_stop( pool_t *pool )
+{
+    int i;
+
+    if ( pool == (pool_t *)0 )
+        return;
+    pthread_mutex_lock( &pool->lock );
+    pool->quit = 1;
+    pthread_cond_broadcast( &pool->go );
+    pthread_mutex_unlock( &pool->lock );
+    for( i = 1; i < pool->threads; i++ )
+        pthread_join( pool->thread[i].tid, (void **)0 );
+    pthread_mutex_destroy( &pool->lock );
+    pthread_mutex_destroy( &pool->serial );
+    pthread_cond_destroy( &pool->go );
+    pthread_cond_destroy( &pool->done );
+    free( (void *)pool );
+}
+
+/* threads the next transpose on 'ctx' asks for */
+static int ctx_threads( ft_ctx_t *ctx )
+{
+    return ctx->opt.pool ? ctx->opt.pool->threads : ctx->tune.threads;
+}
+
+/* how the context's workers are pinned: 0 not at all, 1 over all CPUs,
+ * 2 over one CPU per core
+ */
+static int ctx_pin( ft_ctx_t *ctx )
+{
+    return ctx->opt.no_smt ? 2 : ctx->opt.numa != FT_NUMA_OFF;
+}
+
+/* start, or restart for a new thread count or pinning, the context's own
+ * pool unless the caller supplied one; returns the # of threads jobs run on
+ */
+static int ctx_pool( ft_ctx_t *ctx )
+{
+    int cpus[ CPU_SETSIZE ], ncpus = 0;
+
+    if ( ctx->opt.pool )
+        return ctx->opt.pool->threads;
+    if ( ctx->pool && (ctx->pool->wanted != ctx->tune.threads || ctx->pool->pin != ctx_pin( ctx )) )
+    {
+        pool_stop( ctx->pool );
+        ctx->pool = (pool_t *)0;
+    }
+    if ( ctx->pool == (pool_t *)0 && ctx->tune.threads > 1 )
+    {
+        if ( ctx_pin( ctx ) )
+            ncpus = topology_order( ctx->opt.no_smt, cpus );
+        ctx->pool = pool_start( ctx->tune.threads, cpus, ncpus, ctx->opt.on_thread, ctx->opt.hook_user );
+        if ( ctx->pool && ctx->pool->threads < ctx->tune.threads )
+            ft_warn( ctx, "could only start %d threads\n", ctx->pool->threads );
+        if ( ctx->pool )
+            ctx->pool->pin = ctx_pin( ctx );
+        if ( ctx->pool && ncpus > 0 && ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "pinned %d workers over %d CPUs on %d NUMA node(s)\n", ctx->pool->threads - 1,
+                    ncpus, topology.nodes );
+    }
+    return ctx->pool ? ctx->pool->threads : 1;
+}
+
+/* opt.numa: the nodes the context's threads run on, the caller's as of
+ * now, into ctx->numa; returns how many, 0 if the pool is not the
+ * context's own
+ */
+static int ctx_nodes( ft_ctx_t *ctx )
+{
+    char seen[ NUMA_MAX_NODES ];
+    int i, node;
+
+    ctx->numa.nodes = 0;
+    if ( ctx->opt.numa == FT_NUMA_OFF || ctx->opt.pool )
+        return 0;
+    memset( (void *)seen, 0, sizeof(seen) );
+    if ( (thread_node = topology_here()) >= 0 )
+        seen[ thread_node ] = 1;
+    for( i = 1; ctx->pool && i < ctx->pool->threads; i++ )
+        if ( (node = ctx->pool->thread[i].node) >= 0 )
+            seen[ node ] = 1;
+    for( node = 0; node < NUMA_MAX_NODES; node++ )
+        if ( seen[ node ] )
+            ctx->numa.id[ ctx->numa.nodes++ ] = node;
+    return ctx->numa.nodes;
+}
+
+/* index of the calling thread's node in ctx->numa, -1 if not there */
+static int ctx_node_index( ft_ctx_t *ctx )
+{
+    int j;
+
+    for( j = 0; j < ctx->numa.nodes; j++ )
+        if ( ctx->numa.id[j] == thread_node )
+            return j;
+    return -1;
+}
+
+static void ctx_run( ft_ctx_t *ctx, void *(*job)( void * ), void *arg )
+{
+    ctx_pool( ctx );
+    if ( ctx->opt.pool )
+        ctx->opt.pool->run( ctx->opt.pool->pool, job, arg );
+    else if ( ctx->pool )
+        pool_run( ctx->pool, job, arg );
+    else
+        job( arg );
+}
+
+/* room for 'n' more bytes */
+static int strpool_reserve( strpool_t *p, idx_t n )
+{
+    idx_t size = p->size ? p->size : 4096;
+    char *grown;
+
+    if ( p->len + n <= p->size )
+        return 0;
+    while ( size < p->len + n )
+        size *= 2;
+    if ( (grown = realloc( p->data, size )) == (char *)0 )
+        return -1;
+    p->data = grown;
+    p->size = size;
+    return 0;
+}
+
+static inline int strpool_putc( strpool_t *p, int c )
+{
+    if ( p->len == p->size && strpool_reserve( p, 1 ) < 0 )
+        return -1;
+    p->data[ p->len++ ] = (char)c;
+    return 0;
+}
+
+/* finish the string being added, if it is not empty or 'force' */
+static int strpool_end( strpool_t *p, int force )
+{
+    idx_t *grown;
+
+    if ( p->len == p->mark && !force )
+        return 0;
+    if ( p->count == p->max )
+    {
+        p->max = p->max ? 2 * p->max : 1024;
+        if ( (grown = realloc( p->off, p->max * sizeof(idx_t) )) == (idx_t *)0 )
+            return -1;
+        p->off = grown;
+    }
+    if ( strpool_putc( p, '\0' ) < 0 )
+        return -1;
+    if ( p->len - 1 - p->mark > p->longest )
+        p->longest = p->len - 1 - p->mark;
+    p->off[ p->count++ ] = p->mark;
+    p->mark = p->len;
+    return 0;
+}
+
+static void strpool_drop( strpool_t *p )
+{
+    p->len = p->mark;
+}
+
+static void strpool_reset( strpool_t *p )
+{
+    p->len = p->mark = p->count = p->longest = 0;
+}
+
+static void strpool_free( strpool_t *p )
+{
+    free( (void *)p->data );
+    free( (void *)p->off );
+    memset( (void *)p, 0, sizeof(*p) );
+}
+
+static inline const char *strpool_str( const strpool_t *p, idx_t i )
+{
+    return i < p->count ? &p->data[ p->off[i] ] : "";
+}
+
+/* add the strings of 'src' after those of 'dst' */
+static int strpool_append( strpool_t *dst, const strpool_t *src )
+{
+    idx_t i;
+
+    if ( strpool_reserve( dst, src->mark ) < 0 )
+        return -1;
+    for( i = 0; i < src->count; i++ )
+    {
+        const char *str = strpool_str( src, i );
+        size_t n = strlen( str );
+
+        memcpy( &dst->data[ dst->len ], str, n );
+        dst->len += n;
+        if ( strpool_end( dst, 1 ) < 0 )
+            return -1;
+    }
+    return 0;
+}
+
+/* opt.column_widths: the matrix as one array per column, with slots just
+ * wide enough for most of the fields sampled from the first rows; a field
+ * that does not fit is kept whole in an overflow table, its slot left empty
+ */
+typedef struct {
+    char  *data;           /* rows x width bytes                         */
+    idx_t  rows, cap;      /* slots filled, allocated                    */
+    int    width;
+    idx_t *over;           /* (row, string in long_fields) pairs, by row */
+    idx_t  nover, maxover;
+} column_t;
+
+typedef struct colstore_s {
+    column_t  *col;
+    idx_t      ncols, maxcols;
+    strpool_t  long_fields;
+} colstore_t;
+
+static void cs_free( colstore_t *cs )
+{
+    idx_t c;
+
+    if ( cs == (colstore_t *)0 )
+        return;
+    for( c = 0; c < cs->ncols; c++ )
+    {
+        free( (void *)cs->col[c].data );
+        free( (void *)cs->col[c].over );
+    }
+    free( (void *)cs->col );
+    strpool_free( &cs->long_fields );
+    free( (void *)cs );
+}
+
+/* bytes the column store holds */
+static idx_t cs_bytes( const colstore_t *cs )
+{
+    idx_t c, bytes = cs->long_fields.size;
+
+    for( c = 0; c < cs->ncols; c++ )
+        bytes += cs->col[c].cap * cs->col[c].width + cs->col[c].maxover * 2 * sizeof(idx_t);
+    return bytes;
+}
+
+static void free_array( array_t *a )
+{
+    if ( a == (array_t *)0 )
+        return;
+    cs_free( a->cs );
+    free( (void *)a->data );
+    free( (void *)a );
+    return;
+}
+
+/* returns -1, with the reason in the context, if there is no memory left;
+ * an array with a limit instead grows only to it, then marks itself full
+ * and takes just what finishing the current row needs
+ */
+static inline int insert_element( array_t *a, char *e )
+{
+    int new_elements = 0;
+
+    /* 'a' might not be big enough to hold this next element.
+     * If it isn't, then realloc.
+     */
+    if ( a->element_count >= a->element_capacity )
+    {
+        /* not big enough, re-allocate a huge chunk */
+        array_t b;
+
+        /* double current elements or start with a reasonable number
+         * if first time through
+         */
+        if ( (new_elements = a->element_capacity) == 0 )
+            new_elements = (a->ctx->tune.page_bytes / a->element_size);
+        if ( new_elements == 0 )
+            new_elements = 1;
+        if ( a->limit > 0 && (a->element_capacity + new_elements) * a->element_size > a->limit )
+        {
+            new_elements = a->limit / a->element_size - a->element_capacity;
+            if ( new_elements < 1 )
+                a->full = 1;
+        }
+        if ( a->full )
+            new_elements = a->cols > 0 ? a->cols : a->ctx->tune.page_bytes / a->element_size + 1;
+
+        /* if the huge chunk allocate fails this loop will cut down on the
+         * requested bytes.  Ex. Imagine you've allocated 64MB.  The next time
+         * we allocate data we'd request 128MB.  That might fail and if we
+         * only needed +1MB (65MB) then this loop will allow the program
+         * to continue */
+        while( 1 )
+        {
+            /* try for double what we already have allocated */
+            size_t size_bytes = a->element_size * (a->element_capacity + new_elements);
+
+            /* ensure we allocate an integer multiple of pages (tune.page_bytes,
+             * 4096 unless the profile says otherwise) */
+            size_bytes = (size_bytes + a->ctx->tune.page_bytes - 1) & ~(size_t)(a->ctx->tune.page_bytes - 1);
+
+            if ( a->ctx->opt.verbosity >= 3 )
+                ft_log( a->ctx, "FAILED\nattempting realloc( %ld ) .. ", size_bytes );
+
+            /* try to grab more memory */
+            b.data = (char *)realloc( (void *)a->data, size_bytes );
+
+            /* if the realloc fails, adjust the requested amount and try again */
+            if ( b.data == (char *)0 )
+            {
+                /* short of its limit, the array only has to finish the row,
+                 * leaving the rest of memory for spilling it
+                 */
+                if ( a->limit > 0 && !a->full )
+                {
+                    a->full = 1;
+                    new_elements = a->cols > 0 ? a->cols : a->ctx->tune.page_bytes / a->element_size + 1;
+                    continue;
+                }
+
+                /* each failed alloc results in a 50% reduction in extra requested
+                 * space until we hit the lower limit of 1 element.
+                 */
+                new_elements >>= 1;
+                if ( new_elements == 0 )
+                    return ft_fail( a->ctx, "failed to realloc in %s", __func__ );
+
+                /* go back to top of loop to retry the alloc with
+                 * less memory requested */
+                continue;
+            }
+
+            /* realloc successful, break out of loop */
+            a->bytes_allocated = size_bytes;
+            break;
+        }
+
+        /* indicate successful reallocation */
+        if ( a->ctx->opt.verbosity >= 3 )
+            ft_log( a->ctx, "PASSED\n" );
+
+        /* update the main array */
+        a->data = b.data;
+        a->element_capacity += new_elements;
+    }
+
+    memcpy( &(a->data[ a->pos ]), e, a->element_size );
+    a->pos += a->element_size;
+    a->element_count++;
+    return 0;
+}
+
+/* columns up to 'n', new ones with 'width' byte slots */
+static int cs_add_columns( colstore_t *cs, idx_t n, int width )
+{
+    column_t *grown;
+
+    if ( n > cs->maxcols )
+    {
+        idx_t max = cs->maxcols ? 2 * cs->maxcols : 64;
+
+        while ( max < n )
+            max *= 2;
+        if ( (grown = realloc( cs->col, max * sizeof(column_t) )) == (column_t *)0 )
+            return -1;
+        cs->col = grown;
+        cs->maxcols = max;
+    }
+    for( ; cs->ncols < n; cs->ncols++ )
+    {
+        memset( (void *)&cs->col[ cs->ncols ], 0, sizeof(column_t) );
+        cs->col[ cs->ncols ].width = width;
+    }
+    return 0;
+}
+
+/* store element 'e' of the row being parsed in column 'col' of a->cs;
+ * returns -1, with the reason in the context, if there is no memory left
+ */
+static int cs_insert( array_t *a, idx_t col, const char *e )
+{
+    colstore_t *cs = a->cs;
+    column_t *c;
+    size_t len = strnlen( e, a->element_size );
+    idx_t cap;
+    char *grown;
+    idx_t *more;
+
+    if ( col >= cs->ncols &&
+         cs_add_columns( cs, col + 1, a->element_size < COLUMN_NEW_WIDTH ? a->element_size : COLUMN_NEW_WIDTH ) < 0 )
+        return ft_fail( a->ctx, "out of memory for column %ld", col );
+    c = &cs->col[ col ];
+
+    /* empty slots for the rows this column had no field in, and this one */
+    if ( a->rows >= c->cap )
+    {
+        for( cap = c->cap ? 2 * c->cap : 1024; cap <= a->rows; cap *= 2 )
+            ;
+        if ( (grown = realloc( c->data, cap * c->width )) == (char *)0 )
+            return ft_fail( a->ctx, "out of memory for column %ld", col );
+        c->data = grown;
+        c->cap  = cap;
+    }
+    memset( &c->data[ c->rows * c->width ], 0, (a->rows + 1 - c->rows) * c->width );
+    c->rows = a->rows + 1;
+
+    if ( len <= (size_t)c->width )
+        memcpy( &c->data[ a->rows * c->width ], e, len );
+    else
+    {
+        if ( c->nover == c->maxover )
+        {
+            c->maxover = c->maxover ? 2 * c->maxover : 16;
+            if ( (more = realloc( c->over, c->maxover * 2 * sizeof(idx_t) )) == (idx_t *)0 )
+                return ft_fail( a->ctx, "out of memory for column %ld", col );
+            c->over = more;
+        }
+        if ( strpool_reserve( &cs->long_fields, len + 1 ) < 0 )
+            return ft_fail( a->ctx, "out of memory for column %ld", col );
+        memcpy( &cs->long_fields.data[ cs->long_fields.len ], e, len );
+        cs->long_fields.len += len;
+        c->over[ 2 * c->nover ] = a->rows;
+        c->over[ 2 * c->nover + 1 ] = cs->long_fields.count;
+        c->nover++;
+        if ( strpool_end( &cs->long_fields, 1 ) < 0 )
+            return ft_fail( a->ctx, "out of memory for column %ld", col );
+    }
+    a->element_count++;
+    return 0;
+}
+
+/* an input file, stream or read callback with a read buffer;
+ * buf[pos..len) is unparsed
+ */
+typedef struct {
+    int         fd;
+    ft_read_fn  rd;        /* pull input from here instead of 'fd'          */
+    void       *user;
+    off_t       base;      /* offset of the input in a regular file         */
+    int         seekable;  /* a regular file: pread() and rewind work       */
+    const char *name;
+    char       *buf;
+    size_t      pos, len;
+    idx_t       consumed;  /* bytes parsed since open/rewind                */
+    int         eof;
+    off_t       next, end; /* a part: pread() [next, end) of a regular file  */
+    int         part;      /* parsed alongside other parts                  */
+    idx_t       rows, cols;/* prescan of this input                         */
+} input_t;
+
+/* the output: a file descriptor or a write callback */
+typedef struct {
+    int         fd;
+    ft_write_fn wr;
+    void       *user;
+} output_t;
+
+/* read up to 'size' bytes, retrying on EINTR; returns 0 at EOF */
+static ssize_t read_block( ft_ctx_t *ctx, input_t *in, char *buf, size_t size )
+{
+    stamp_t t;
+    ssize_t n;
+
+    phase_begin( ctx, &t );
+    if ( in->rd )
+        n = in->rd( in->user, buf, size );
+    else if ( in->end > 0 )
+    {
+        if ( (off_t)size > in->end - in->next )
+            size = in->end - in->next;
+        while ( (n = pread( in->fd, buf, size, in->next )) < 0 && errno == EINTR )
+            ;
+        if ( n > 0 )
+            in->next += n;
+    }
+    else
+        while ( (n = read( in->fd, buf, size )) < 0 && errno == EINTR )
+            ;
+    phase_end( ctx, FT_PHASE_READ, &t, n > 0 ? n : 0 );
+    return n;
+}
+
+/* pread() 'size' bytes at 'off' (fewer only at EOF), charged to 'phase' */
+static ssize_t read_at( ft_ctx_t *ctx, int fd, char *buf, size_t size, off_t off, int phase )
+{
+    stamp_t t;
+    size_t  done = 0;
+    ssize_t n = 0;
+
+    phase_begin( ctx, &t );
+    while ( done < size )
+    {
+        if ( (n = pread( fd, buf + done, size - done, off + done )) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            break;
+        }
+        if ( n == 0 )
+            break;
+        done += n;
+    }
+    phase_end( ctx, phase, &t, done );
+    return n < 0 ? -1 : (ssize_t)done;
+}
+
+/* write all 'size' bytes, retrying on short writes */
+static int write_block( ft_ctx_t *ctx, output_t *out, const char *buf, size_t size )
+{
+    stamp_t t;
+    size_t  done = 0;
+    ssize_t n;
+
+    phase_begin( ctx, &t );
+    if ( out->wr )
+        done = out->wr( out->user, buf, size ) == 0 ? size : 0;
+    else
+        while ( done < size )
+        {
+            if ( (n = write( out->fd, buf + done, size - done )) < 0 )
+            {
+                if ( errno == EINTR )
+                    continue;
+                break;
+            }
+            done += n;
+        }
+    phase_end( ctx, FT_PHASE_WRITE, &t, done );
+    if ( done == size )
+        return 0;
+    return ft_fail_errno( ctx, ctx->opt.output_name );
+}
+
+/* pwrite() all 'size' bytes at 'off' to a spill file */
+static int write_at( ft_ctx_t *ctx, int fd, const char *buf, size_t size, off_t off )
+{
+    stamp_t t;
+    size_t  done = 0;
+    ssize_t n;
+
+    phase_begin( ctx, &t );
+    while ( done < size )
+    {
+        if ( (n = pwrite( fd, buf + done, size - done, off + done )) < 0 )
+        {
+            if ( errno == EINTR )
+                continue;
+            break;
+        }
+        done += n;
+    }
+    phase_end( ctx, FT_PHASE_SPILL_WRITE, &t, done );
+    return done == size ? 0 : -1;
+}
+
+static array_t *new_array( ft_ctx_t *ctx, int element_size )
+{
+    array_t *a = calloc( 1, sizeof(array_t) );
+
+    if ( a != (array_t *)0 )
+    {
+        a->element_size = element_size;
+        a->ctx = ctx;
+    }
+    return a;
+}
+
+/* empty 'a' but keep its buffer for the next band or pass */
+static void reset_array( array_t *a )
+{
+    a->rows = a->cols = 0;
+    a->chunks = a->node_bytes = 0;
+    a->element_count = 0;
+    a->pos = 0;
+    a->limit = 0;
+    a->full = 0;
+}
+
+/* grow 'a' to hold at least 'n' elements in one step, so a run whose size
+ * is known up front does not pay for (or fail in) repeated doubling;
+ * returns -1 and leaves 'a' alone if the memory is not there
+ */
+static int reserve_elements( array_t *a, idx_t n )
+{
+    idx_t page = a->ctx->tune.page_bytes;
+    size_t size_bytes;
+    char *data;
+
+    if ( n <= a->element_capacity )
+        return 0;
+    size_bytes = ((size_t)n * a->element_size + page - 1) & ~(size_t)(page - 1);
+    if ( (data = (char *)realloc( (void *)a->data, size_bytes )) == (char *)0 )
+        return -1;
+    a->data = data;
+    a->element_capacity = size_bytes / a->element_size;
+    a->bytes_allocated = size_bytes;
+    return 0;
+}
+
+/* opt.numa: the node (index in ctx->numa) that byte 'off' of 'a' is
+ * placed on: a band of node_bytes each for FT_NUMA_LOCAL, otherwise chunks
+ * round robin
+ */
+static inline int place_node( ft_ctx_t *ctx, const array_t *a, idx_t off )
+{
+    idx_t j;
+
+    if ( ctx->opt.numa == FT_NUMA_LOCAL )
+        return (j = off / a->node_bytes) < ctx->numa.nodes ? (int)j : ctx->numa.nodes - 1;
+    return (int)(off / NUMA_CHUNK % ctx->numa.nodes);
+}
+
+/* one numa_place() call, shared by the pool: each thread writes the first
+ * byte of every page of the chunks its node gets, so that the kernel puts
+ * them there; threads of one node share its chunks
+ */
+typedef struct {
+    array_t *a;
+    idx_t    bytes;
+    idx_t    next[ NUMA_MAX_NODES ];  /* per node: chunks scanned so far */
+} place_t;
+
+static void *place_pages( void *arg )
+{
+    place_t *pl = (place_t *)arg;
+    ft_ctx_t *ctx = pl->a->ctx;
+    idx_t c, off, end;
+    int j = ctx_node_index( ctx );
+
+    if ( j < 0 )
+        return (void *)0;
+    while ( (c = __atomic_fetch_add( &pl->next[j], 1, __ATOMIC_RELAXED )) < pl->a->chunks )
+    {
+        if ( place_node( ctx, pl->a, c * NUMA_CHUNK ) != j )
+            continue;
+        end = (c + 1) * NUMA_CHUNK < pl->bytes ? (c + 1) * NUMA_CHUNK : pl->bytes;
+        for( off = c * NUMA_CHUNK; off < end; off += PAGE_BYTES )
+            pl->a->data[ off ] = 0;
+    }
+    return (void *)0;
+}
+
+/* opt.numa: spread the first 'bytes' of the freshly reserved 'a' over the
+ * nodes of the context's threads by touching each page first from the
+ * node it belongs to; pages already touched by an earlier call stay
+ * where they are
+ */
+static void numa_place( ft_ctx_t *ctx, array_t *a, idx_t bytes )
+{
+    place_t pl;
+
+    a->chunks = a->node_bytes = 0;
+    if ( ctx_pool( ctx ) < 2 || ctx_nodes( ctx ) < 2 )
+        return;
+    memset( (void *)&pl, 0, sizeof(pl) );
+    pl.a     = a;
+    pl.bytes = bytes < a->bytes_allocated ? bytes : a->bytes_allocated;
+    a->chunks = (pl.bytes + NUMA_CHUNK - 1) / NUMA_CHUNK;
+    if ( ctx->opt.numa == FT_NUMA_LOCAL )
+        a->node_bytes = (pl.bytes + ctx->numa.nodes - 1) / ctx->numa.nodes;
+    ctx_run( ctx, place_pages, &pl );
+    ctx->stats.numa_nodes = ctx->numa.nodes;
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "(%ld bytes placed over %d NUMA nodes, %s) ", pl.bytes, ctx->numa.nodes,
+                ft_numa_name( ctx->opt.numa ) );
+}
+
+/* the matrix buffer for a transpose: the one kept from the last call on
+ * this context if there is one, so a batch of small inputs does not grow
+ * a new buffer from a page each time
+ */
+static array_t *ctx_array( ft_ctx_t *ctx )
+{
+    array_t *a = ctx->arena;
+
+    if ( a == (array_t *)0 )
+        return new_array( ctx, ctx->opt.element_size );
+    ctx->arena = (array_t *)0;
+    reset_array( a );
+    a->element_size = ctx->opt.element_size;
+    a->element_capacity = a->bytes_allocated / a->element_size;
+    return a;
+}
+
+/* keep 'a' for the next call if it is within opt.keep_bytes */
+static void ctx_release( ft_ctx_t *ctx, array_t *a )
+{
+    if ( a == (array_t *)0 )
+        return;
+    cs_free( a->cs );
+    a->cs = (colstore_t *)0;
+    if ( a->bytes_allocated <= (idx_t)ctx->opt.keep_bytes && ctx->arena == (array_t *)0 )
+        ctx->arena = a;
+    else
+        free_array( a );
+}
+
+/* read from 'fd' (if 'rd' is null) or from rd( user, ... ); a regular file
+ * is read from its current offset on
+ */
+static int open_input( ft_ctx_t *ctx, input_t *in, int fd, ft_read_fn rd, void *user )
+{
+    struct stat st;
+
+    memset( (void *)in, 0, sizeof(input_t) );
+    in->fd   = fd;
+    in->rd   = rd;
+    in->user = user;
+    in->name = ctx->opt.input_name;
+    if ( ctx->io_buf_size != (size_t)ctx->tune.io_block )
+    {
+        free( (void *)ctx->io_buf );
+        ctx->io_buf_size = 0;
+        if ( (ctx->io_buf = malloc( ctx->tune.io_block )) == (char *)0 )
+            return ft_fail( ctx, "%s: out of memory", in->name );
+        ctx->io_buf_size = ctx->tune.io_block;
+    }
+    in->buf = ctx->io_buf;
+    if ( rd == (ft_read_fn)0 && fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) &&
+         (in->base = lseek( fd, 0, SEEK_CUR )) >= 0 )
+    {
+        in->seekable = 1;
+        ATOMIC_SET( ctx->progress.bytes_total, (int64_t)(st.st_size - in->base) );
+    }
+    return 0;
+}
+
+/* the descriptor belongs to the caller and the buffer to the context */
+static void close_input( input_t *in )
+{
+    in->buf = (char *)0;
+}
+
+/* start over at the beginning of a regular file */
+static int rewind_input( input_t *in )
+{
+    in->pos = in->len = 0;
+    in->consumed = 0;
+    in->eof = 0;
+    return lseek( in->fd, in->base, SEEK_SET ) == in->base ? 0 : -1;
+}
+
+static inline uint64_t key_hash( const char *k, size_t n )
+{
+    uint64_t h = 14695981039346656037ULL;    /* FNV-1a */
+
+    while ( n-- > 0 )
+        h = (h ^ (unsigned char)*k++) * 1099511628211ULL;
+    return h;
+}
+
+static int keyset_has( const keyset_t *ks, const char *k, size_t n )
+{
+    uint64_t h = key_hash( k, n ), i;
+
+    for( i = h & ks->mask; ks->slot[i].len > 0; i = (i + 1) & ks->mask )
+        if ( ks->slot[i].hash == h && ks->slot[i].len == n && memcmp( &ks->pool[ ks->slot[i].off ], k, n ) == 0 )
+            return 1;
+    return 0;
+}
+
+static void keyset_free( keyset_t *ks )
+{
+    if ( ks == (keyset_t *)0 )
+        return;
+    free( (void *)ks->pool );
+    free( (void *)ks->slot );
+    free( (void *)ks );
+}
+
+/* load a file of keys, one per line; blank lines are skipped */
+static keyset_t *keyset_load( ft_ctx_t *ctx, const char *path )
+{
+    keyset_t *ks = calloc( 1, sizeof(keyset_t) );
+    struct stat st;
+    char *p, *end, *nl;
+    uint64_t slots = 16, h, i;
+    idx_t line = 0;
+    size_t n;
+    int fd;
+
+    if ( ks == (keyset_t *)0 )
+    {
+        ft_fail( ctx, "%s: out of memory", path );
+        return ks;
+    }
+    if ( (fd = open( path, O_RDONLY | O_CLOEXEC )) < 0 || fstat( fd, &st ) < 0 )
+    {
+        ft_fail_errno( ctx, path );
+        if ( fd >= 0 )
+            close( fd );
+        free( (void *)ks );
+        return (keyset_t *)0;
+    }
+    if ( st.st_size >= UINT32_MAX )
+    {
+        ft_fail( ctx, "%s: too large for a key list", path );
+        close( fd );
+        free( (void *)ks );
+        return (keyset_t *)0;
+    }
+    ks->pool = malloc( st.st_size + 1 );
+    if ( ks->pool && read_at( ctx, fd, ks->pool, st.st_size, 0, FT_PHASE_READ ) != st.st_size )
+    {
+        ft_fail_errno( ctx, path );
+        close( fd );
+        keyset_free( ks );
+        return (keyset_t *)0;
+    }
+    close( fd );
+    if ( ks->pool )
+        ks->pool[ st.st_size ] = '\n';
+
+    /* room for twice the lines keeps the probe sequences short */
+    for( p = ks->pool, end = p + st.st_size; p && p < end; p = nl + 1, line++ )
+        nl = memchr( p, '\n', end - p + 1 );
+    while ( slots < 2 * (uint64_t)line )
+        slots *= 2;
+    ks->mask = slots - 1;
+    if ( ks->pool == (char *)0 || (ks->slot = calloc( slots, sizeof(struct keyslot) )) == (struct keyslot *)0 )
+    {
+        ft_fail( ctx, "%s: out of memory", path );
+        keyset_free( ks );
+        return (keyset_t *)0;
+    }
+
+    for( p = ks->pool, line = 1; p < end; p = nl + 1, line++ )
+    {
+        nl = memchr( p, '\n', end - p + 1 );
+        n  = nl - p;
+        if ( n == 0 || keyset_has( ks, p, n ) )
+            continue;
+        if ( n > KEY_MAX )
+        {
+            ft_fail( ctx, "%s: line %ld: keys are at most %d bytes", path, line, KEY_MAX );
+            keyset_free( ks );
+            return (keyset_t *)0;
+        }
+        h = key_hash( p, n );
+        for( i = h & ks->mask; ks->slot[i].len > 0; i = (i + 1) & ks->mask )
+            ;
+        ks->slot[i].hash = h;
+        ks->slot[i].off  = (uint32_t)(p - ks->pool);
+        ks->slot[i].len  = (uint32_t)n;
+        ks->count++;
+    }
+    return ks;
+}
+
+/* tokenizer state, carried across input blocks and bands */
+typedef struct {
+    char  delim;
+    int   i;               /* # chars in the current element                */
+    int   skip;            /* skipping the rest of an overlong element      */
+    idx_t col;             /* column of the current element in its row      */
+    idx_t col_lo, col_hi;  /* only columns in [col_lo, col_hi) are stored   */
+    idx_t row0;            /* rows parsed before the current array          */
+    int   c;               /* last byte parsed, EOF if none                 */
+    int   error;           /* an element could not be stored                */
+    char *e;               /* current element, element_size + 1 bytes       */
+    const keyset_t *keep;  /* keep only rows whose first field is in here   */
+    int   drop;            /* skipping the rest of a row not kept           */
+    int   klen;            /* bytes of the current row's key, KEY_MAX + 1 if longer */
+    idx_t dropped;         /* rows skipped, not yet published               */
+    char  key[ KEY_MAX + 1 ];
+    text_t    *text;       /* where the header and labels go                */
+    int        in_header;  /* parsing the header row                        */
+    int        labels;     /* the first field of each row is its label      */
+    strpool_t *cur;        /* the text field being parsed goes here, or NULL */
+} parser_t;
+
+/* 'flags' (TEXT_*) say which fields go to 'text' instead of the matrix */
+static void parser_init( parser_t *ps, char delim, int element_size, idx_t col_lo, idx_t col_hi,
+                         const keyset_t *keep, text_t *text, int flags )
+{
+    memset( (void *)ps, 0, sizeof(parser_t) );
+    ps->delim  = delim;
+    ps->col_lo = col_lo;
+    ps->col_hi = col_hi;
+    ps->keep   = keep;
+    ps->text   = text;
+    ps->in_header = (flags & TEXT_HEADER) != 0;
+    ps->labels = (flags & TEXT_LABELS) != 0;
+    ps->cur    = ps->in_header ? &text->header : ps->labels ? &text->labels : (strpool_t *)0;
+    ps->c      = EOF;
+    ps->e      = calloc( 1, element_size + 1 );
+}
+
+static void parser_free( parser_t *ps )
+{
+    free( (void *)ps->e );
+    ps->e = (char *)0;
+}
+
+static inline void parse_end_row( parser_t *ps, array_t *a )
+{
+    idx_t stored = (ps->col < ps->col_hi ? ps->col : ps->col_hi) - ps->col_lo;
+
+    a->rows++;
+
+    /* adjust maximum row length */
+    if ( stored > a->cols )
+        a->cols = stored;
+
+    /* reset column counter */
+    ps->col = 0;
+    if ( ps->labels )
+        ps->cur = &ps->text->labels;
+}
+
+/* test the key just ended; a row not kept is forgotten */
+static inline int parse_keep_row( parser_t *ps )
+{
+    int keep = ps->klen <= KEY_MAX && keyset_has( ps->keep, ps->key, ps->klen );
+
+    ps->klen = 0;
+    if ( !keep )
+    {
+        ps->i = 0;
+        ps->skip = 0;
+        ps->dropped++;
+    }
+    return keep;
+}
+
+/* a delimiter or newline 'c' ends the text field being parsed, if it has
+ * begun; returns 0 if 'c' still ends a data row, after its label, 1 if
+ * not, -1 out of memory
+ */
+static int parse_text_end( parser_t *ps, int c )
+{
+    strpool_t *p = ps->cur;
+
+    if ( ps->in_header )
+    {
+        if ( strpool_end( p, 0 ) < 0 )
+            return -1;
+        if ( c == '\n' )
+        {
+            ps->in_header = 0;
+            ps->cur = ps->labels ? &ps->text->labels : (strpool_t *)0;
+        }
+        return 1;
+    }
+
+    /* a label, or an empty field before it */
+    if ( p->len == p->mark && c != '\n' )
+        return 1;
+    if ( ps->keep && !(p->len > p->mark && p->len - p->mark <= KEY_MAX &&
+                       keyset_has( ps->keep, &p->data[ p->mark ], p->len - p->mark )) )
+    {
+        strpool_drop( p );
+        ps->dropped++;
+        ps->drop = c != '\n';
+        return 1;
+    }
+    if ( strpool_end( p, 1 ) < 0 )
+        return -1;
+    ps->cur = (strpool_t *)0;
+    return c != '\n';
+}
+
+/* parse 'n' bytes at 'buf' into 'a', stopping early once 'a' holds
+ * 'max_rows' rows or is full, or an element cannot be stored; returns the
+ * # of bytes consumed
+ */
+static size_t parse_block( parser_t *ps, array_t *a, const char *buf, size_t n, idx_t max_rows )
+{
+    const char *p = buf, *end = buf + n;
+    int es = a->element_size;
+    int c;
+
+    while ( p < end )
+    {
+        /* a row that is not kept goes unparsed */
+        if ( ps->drop )
+        {
+            const char *nl = memchr( p, '\n', end - p );
+
+            if ( nl == (const char *)0 )
+            {
+                p = end;
+                break;
+            }
+            p = nl + 1;
+            ps->drop = 0;
+            if ( ps->labels )
+                ps->cur = &ps->text->labels;
+            continue;
+        }
+
+        c = (unsigned char)*p++;
+
+        /* header fields and row labels go whole to the text pools */
+        if ( ps->cur )
+        {
+            int r = 1;
+
+            if ( c != ps->delim && c != '\n' ? strpool_putc( ps->cur, c ) < 0 : (r = parse_text_end( ps, c )) < 0 )
+            {
+                ft_fail( a->ctx, "out of memory for the header and labels" );
+                ps->error = 1;
+                break;
+            }
+            if ( r > 0 )
+                continue;
+        }
+
+        /* the first field is the row's key, unless it is a label */
+        if ( ps->keep && !ps->labels && ps->col == 0 && c != ps->delim && c != '\n' && ps->klen <= KEY_MAX )
+            ps->key[ ps->klen++ ] = c;
+
+        /* end of a data element */
+        if ( (c == ps->delim) || (c == '\n') )
+        {
+            if ( ps->i > 0 && ps->col == 0 && ps->keep && !ps->labels && !parse_keep_row( ps ) )
+            {
+                ps->drop = c != '\n';
+                continue;
+            }
+            if ( ps->i > 0 )
+            {
+                if ( ps->col >= ps->col_lo )
+                {
+                    ps->e[ ps->i ] = '\0';
+
+                    /* insert element into array */
+                    if ( (a->cs ? cs_insert( a, ps->col - ps->col_lo, ps->e ) : insert_element( a, ps->e )) < 0 )
+                    {
+                        ps->error = 1;
+                        break;
+                    }
+                }
+                ps->col++;
+            }
+
+            /* reset data element char index */
+            ps->i = 0;
+            ps->skip = 0;
+
+            /* end of a row */
+            if ( c == '\n' )
+            {
+                parse_end_row( ps, a );
+                if ( a->rows >= max_rows || a->full )
+                    break;
+            }
+        }
+        /* the rest of the row is right of the column window */
+        else if ( ps->col >= ps->col_hi )
+        {
+            const char *nl = memchr( p, '\n', end - p );
+            p = nl ? nl : end;
+        }
+        /* left of the column window: only note the element is not empty */
+        else if ( ps->col < ps->col_lo )
+            ps->i = 1;
+        /* seek to end of field if reached size limit */
+        else if ( ps->skip )
+            continue;
+        else if ( ps->i >= es )
+        {
+            ft_warn( a->ctx, "element @[%ld,%ld] size exceeded\n", ps->row0 + a->rows, ps->col);
+            ps->i = es - 1;
+            ps->skip = 1;
+        }
+        /* write to buffer */
+        else ps->e[ ps->i++ ] = c;
+    }
+    if ( p > buf )
+        ps->c = (unsigned char)p[-1];
+    return p - buf;
+}
+
+/* the last row may not be newline terminated */
+static void parse_finish( parser_t *ps, array_t *a )
+{
+    if ( ps->cur && !ps->drop && (ps->in_header || ps->cur->len > ps->cur->mark) && parse_text_end( ps, '\n' ) < 0 )
+    {
+        ft_fail( a->ctx, "out of memory for the header and labels" );
+        ps->error = 1;
+    }
+    if ( ps->i > 0 && ps->col == 0 && ps->keep && !ps->labels )
+        parse_keep_row( ps );
+    ps->drop = 0;
+    /* a row with a label has no fields left to parse */
+    if ( ps->i > 0 || (ps->c != '\n' && ps->col > 0) || (ps->labels && ps->cur == (strpool_t *)0) )
+    {
+        if ( ps->i > 0 )
+        {
+            if ( ps->col >= ps->col_lo )
+            {
+                ps->e[ ps->i ] = '\0';
+                if ( (a->cs ? cs_insert( a, ps->col - ps->col_lo, ps->e ) : insert_element( a, ps->e )) < 0 )
+                    ps->error = 1;
+            }
+            ps->col++;
+        }
+        parse_end_row( ps, a );
+    }
+    ps->i = 0;
+    ps->skip = 0;
+    ps->c = '\n';
+}
+
+/* read and parse 'in' into 'a' until 'a' holds 'max_rows' rows, is full
+ * or the input ends; returns 1 if input remains, 0 at its end, -1 on errors
+ */
+static int parse_rows( ft_ctx_t *ctx, input_t *in, parser_t *ps, array_t *a, idx_t max_rows )
+{
+    stamp_t t;
+    ssize_t n;
+    size_t used;
+
+    /* a full array stops at the end of a row, which may be blocks on */
+    while ( a->rows < max_rows && !(a->full && ps->c == '\n') && !ps->error )
+    {
+        if ( in->pos == in->len )
+        {
+            if ( in->eof )
+                break;
+            if ( (n = read_block( ctx, in, in->buf, ctx->tune.io_block )) <= 0 )
+            {
+                if ( n < 0 )
+                    return ft_fail_errno( ctx, in->name );
+                in->eof = 1;
+                parse_finish( ps, a );
+                break;
+            }
+            in->pos = 0;
+            in->len = n;
+        }
+        phase_begin( ctx, &t );
+        used = parse_block( ps, a, in->buf + in->pos, in->len - in->pos, max_rows );
+        phase_end( ctx, FT_PHASE_PARSE, &t, used );
+        in->pos += used;
+        in->consumed += used;
+
+        if ( ps->dropped > 0 )
+        {
+            __atomic_fetch_add( &ctx->stats.rows_skipped, (int64_t)ps->dropped, __ATOMIC_RELAXED );
+            ps->dropped = 0;
+        }
+
+        /* publish progress once per block; parts add to a shared total */
+        if ( in->part )
+            __atomic_fetch_add( &ctx->progress.bytes_in, (int64_t)used, __ATOMIC_RELAXED );
+        else
+        {
+            ATOMIC_SET( ctx->progress.bytes_in, in->consumed );
+            ATOMIC_SET( ctx->progress.rows_in, ps->row0 + a->rows );
+        }
+    }
+    if ( ps->error )
+        return -1;
+    return (in->eof && in->pos == in->len) ? 0 : 1;
+}
+
+/* TEXT_* flags for the parsers of a transpose on 'ctx' */
+static int ctx_text_flags( ft_ctx_t *ctx )
+{
+    return (ctx->opt.header ? TEXT_HEADER : 0) | (ctx->opt.labels ? TEXT_LABELS : 0);
+}
+
+static const text_t *ctx_text( ft_ctx_t *ctx )
+{
+    return ctx_text_flags( ctx ) ? &ctx->text : (const text_t *)0;
+}
+
+/* the smallest power of two slot width, up to the element size, that
+ * leaves at most COLUMN_OVERFLOW_SHARE of each column's sampled fields
+ * to the overflow table; then the sampled rows move to the column store
+ * and the parser fills it from there on.  A ragged sample is left alone.
+ */
+static int cs_from_sample( array_t *a )
+{
+    idx_t r, c, n, rows = a->rows;
+    idx_t count[ 64 ];
+    size_t es = a->element_size;
+    int k, width;
+
+    if ( rows == 0 || a->element_count != rows * a->cols )
+        return 0;
+    if ( (a->cs = calloc( 1, sizeof(colstore_t) )) == (colstore_t *)0 || cs_add_columns( a->cs, a->cols, 1 ) < 0 )
+        return ft_fail( a->ctx, "out of memory for the column store" );
+
+    for( c = 0; c < a->cols; c++ )
+    {
+        /* fields by the smallest power of two holding them */
+        memset( (void *)count, 0, sizeof(count) );
+        for( r = 0; r < rows; r++ )
+        {
+            size_t len = strnlen( &a->data[ (r * a->cols + c) * es ], es );
+            for( k = 0; ((size_t)1 << k) < len; k++ )
+                ;
+            count[k]++;
+        }
+        for( k = 0, n = rows - count[0]; n > rows * COLUMN_OVERFLOW_SHARE && ((size_t)1 << k) < es; n -= count[ ++k ] )
+            ;
+        width = ((size_t)1 << k) < es ? 1 << k : (int)es;
+        a->cs->col[c].width = width;
+    }
+
+    /* the sample, row by row, as if parsed into the store */
+    n = a->element_count;
+    a->element_count = 0;
+    a->rows = 0;
+    for( r = 0; r < rows; r++, a->rows++ )
+        for( c = 0; c < a->cols; c++ )
+            if ( cs_insert( a, c, &a->data[ (r * a->cols + c) * es ] ) < 0 )
+                return -1;
+    /* the row-major buffer is not needed again */
+    free( (void *)a->data );
+    a->data = (char *)0;
+    a->element_capacity = a->bytes_allocated = a->pos = 0;
+    return 0;
+}
+
+/* parse all of 'in' into an array with 'ps', which the caller frees; the
+ * plain layout stops growing at plan.matrix_limit, and the array comes
+ * back marked full, with input left, at the end of the row that reached it
+ */
+static array_t *read_array( ft_ctx_t *ctx, input_t *in, parser_t *ps )
+{
+    array_t *a = (array_t *)0;
+    double started = clock_seconds( CLOCK_MONOTONIC );
+    int rc;
+
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "reading array ... " );
+    progress_stage( ctx, FT_STAGE_READ );
+
+    if ( (a = ctx_array( ctx )) == (array_t *)0 )
+    {
+        ft_fail( ctx, "%s: out of memory", in->name );
+        return a;
+    }
+    if ( !ctx->opt.column_widths )
+        a->limit = ctx->plan.matrix_limit;
+    if ( ctx->plan.reserve > 0 && !ctx->opt.column_widths &&
+         (a->limit == 0 || ctx->plan.reserve * a->element_size <= a->limit) )
+    {
+        if ( reserve_elements( a, ctx->plan.reserve ) < 0 )
+        {
+            if ( ctx->opt.verbosity >= 1 )
+                ft_log( ctx, "(could not reserve %ld elements up front) ", ctx->plan.reserve );
+        }
+        else if ( ctx->opt.numa != FT_NUMA_OFF )
+            numa_place( ctx, a, ctx->plan.reserve * a->element_size );
+    }
+    parser_init( ps, ctx->opt.in_delim, ctx->opt.element_size, 0, ALL_COLUMNS, ctx->keep, &ctx->text,
+                 ctx_text_flags( ctx ) );
+
+    /* sized columns: a sample of rows at full width sizes the slots */
+    rc = 1;
+    if ( ctx->opt.column_widths )
+    {
+        idx_t sample = COLUMN_SAMPLE_BYTES / ((ctx->plan.cols > 0 ? ctx->plan.cols : 1) * ctx->opt.element_size);
+
+        sample = sample < 64 ? 64 : sample > COLUMN_SAMPLE_ROWS ? COLUMN_SAMPLE_ROWS : sample;
+        if ( (rc = parse_rows( ctx, in, ps, a, sample )) > 0 && cs_from_sample( a ) < 0 )
+            rc = -1;
+    }
+    if ( rc > 0 )
+        rc = parse_rows( ctx, in, ps, a, ALL_COLUMNS );
+    if ( rc < 0 )
+    {
+        parser_free( ps );
+        ctx_release( ctx, a );
+        return (array_t *)0;
+    }
+    a->full = rc > 0;
+
+    if ( ctx->opt.verbosity >= 1 && a->full )
+        ft_log( ctx, "FULL\nread in %ld elements (r=%ld, c=%ld) into %ld bytes, limit %ld\n",
+                a->element_count, a->rows, a->cols, a->bytes_allocated, a->limit );
+    else if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "DONE\nread in %ld elements (r=%ld, c=%ld)\n", a->element_count, a->rows, a->cols );
+    if ( a->cs && ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "column slots: %ld bytes instead of %ld, %ld fields in the overflow table\n", cs_bytes( a->cs ),
+                a->element_count * a->element_size, a->cs->long_fields.count );
+
+    trace_end( ctx, "read_array", started, ctx->stats.phase[ FT_PHASE_PARSE ].bytes );
+
+    return a;
+}
+
+/* one read_parts() call, shared by the pool: each part is a byte range of
+ * one input, cut at a line boundary, parsed into an array of its own by
+ * whichever thread claims it
+ */
+typedef struct {
+    ft_ctx_t  *ctx;
+    input_t   *parts;
+    array_t  **arrays;
+    text_t    *texts;          /* header and labels of each part         */
+    int        nparts;
+    int        next;           /* next part to claim                     */
+    int        rc;
+} part_job_t;
+
+static void *parse_parts( void *arg )
+{
+    part_job_t *pj = (part_job_t *)arg;
+    ft_ctx_t *ctx = pj->ctx;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    parser_t ps;
+    int i, flags;
+
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    while ( (i = __atomic_fetch_add( &pj->next, 1, __ATOMIC_RELAXED )) < pj->nparts &&
+            ATOMIC_GET( pj->rc ) == 0 )
+    {
+        /* only the part that starts an input has its header row */
+        flags = ctx_text_flags( ctx );
+        if ( pj->parts[i].end > 0 && pj->parts[i].next > pj->parts[i].base )
+            flags &= ~TEXT_HEADER;
+        parser_init( &ps, ctx->opt.in_delim, ctx->opt.element_size, 0, ALL_COLUMNS, ctx->keep, &pj->texts[i], flags );
+        if ( parse_rows( ctx, &pj->parts[i], &ps, pj->arrays[i], ALL_COLUMNS ) < 0 )
+            ATOMIC_SET( pj->rc, -1 );
+        parser_free( &ps );
+        __atomic_fetch_add( &ctx->progress.rows_in, (int64_t)pj->arrays[i]->rows, __ATOMIC_RELAXED );
+    }
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* the offset of the first line that starts at or after 'off' (> 0) */
+static off_t line_after( int fd, off_t off, off_t end )
+{
+    char buf[ 4096 ];
+    const char *nl;
+    ssize_t n;
+
+    for( off--; off < end; off += n )
+    {
+        while ( (n = pread( fd, buf, end - off < (off_t)sizeof(buf) ? (size_t)(end - off) : sizeof(buf), off )) < 0 &&
+                errno == EINTR )
+            ;
+        if ( n <= 0 )
+            break;
+        if ( (nl = memchr( buf, '\n', n )) != (char *)0 )
+            return off + (nl - buf) + 1;
+    }
+    return end;
+}
+
+/* read 'nin' inputs, whose rows are stacked in order, in parallel: regular
+ * files are cut into parts at line boundaries so every thread has work,
+ * other inputs are one part each.  Returns the arrays, in row order, and
+ * their # in '*nparts'.
+ */
+static array_t **read_parts( ft_ctx_t *ctx, input_t *in, int nin, int *nparts )
+{
+    part_job_t pj;
+    struct stat st;
+    idx_t total = 0, part_bytes, size, rows, cols;
+    off_t lo, hi, *ends;
+    int i, k, n;
+    double started = clock_seconds( CLOCK_MONOTONIC );
+
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "reading array from %d inputs ... ", nin );
+    progress_stage( ctx, FT_STAGE_READ );
+
+    /* how many parts: PARTS_PER_THREAD per thread over all the files */
+    ends = calloc( nin, sizeof(off_t) );
+    if ( ends == (off_t *)0 )
+    {
+        ft_fail( ctx, "%s: out of memory", ctx->opt.input_name );
+        return (array_t **)0;
+    }
+    for( i = 0; i < nin; i++ )
+        if ( in[i].seekable && fstat( in[i].fd, &st ) == 0 && st.st_size > in[i].base )
+        {
+            ends[i] = st.st_size;
+            total += st.st_size - in[i].base;
+        }
+    part_bytes = total / (PARTS_PER_THREAD * ctx_threads( ctx ));
+    if ( part_bytes < PART_MIN_BYTES )
+        part_bytes = PART_MIN_BYTES;
+    for( i = n = 0; i < nin; i++ )
+        n += ends[i] > 0 ? (int)((ends[i] - in[i].base + part_bytes - 1) / part_bytes) : 1;
+
+    memset( (void *)&pj, 0, sizeof(pj) );
+    pj.ctx    = ctx;
+    pj.parts  = calloc( n, sizeof(input_t) );
+    pj.arrays = calloc( n, sizeof(array_t *) );
+    pj.texts  = calloc( n, sizeof(text_t) );
+    if ( pj.parts == (input_t *)0 || pj.arrays == (array_t **)0 || pj.texts == (text_t *)0 )
+        pj.rc = ft_fail( ctx, "%s: out of memory", ctx->opt.input_name );
+
+    /* cut the files, and give each part a read buffer and an array */
+    for( i = 0; i < nin && pj.rc == 0; i++ )
+    {
+        size = ends[i] > 0 ? ends[i] - in[i].base : 0;
+        k = size > 0 ? (int)((size + part_bytes - 1) / part_bytes) : 1;
+        for( lo = in[i].base; k > 0 && pj.rc == 0; k--, lo = hi )
+        {
+            input_t *p = &pj.parts[ pj.nparts ];
+
+            *p = in[i];
+            p->part = 1;
+            hi = lo;
+            if ( ends[i] > 0 )
+            {
+                hi = k == 1 ? ends[i] : line_after( in[i].fd, lo + (ends[i] - lo) / k, ends[i] );
+                p->next = lo;
+                p->end  = hi;
+            }
+            p->buf = malloc( ctx->tune.io_block );
+            pj.arrays[ pj.nparts ] = pj.nparts == 0 ? ctx_array( ctx ) : new_array( ctx, ctx->opt.element_size );
+            if ( p->buf == (char *)0 || pj.arrays[ pj.nparts++ ] == (array_t *)0 )
+            {
+                pj.rc = ft_fail( ctx, "%s: out of memory", in[i].name );
+                break;
+            }
+
+            /* the prescan says roughly how many elements the part holds */
+            rows = size > 0 ? (idx_t)((double)in[i].rows * (hi - lo) / size) : 0;
+            reserve_elements( pj.arrays[ pj.nparts - 1 ], (idx_t)(rows * (double)in[i].cols * 1.02) );
+        }
+    }
+    free( (void *)ends );
+
+    if ( pj.rc == 0 )
+    {
+        if ( ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "(%d parts) ", pj.nparts );
+        ctx_run( ctx, parse_parts, &pj );
+    }
+
+    /* the parts must agree on the # of columns to be stacked */
+    for( i = 0, cols = -1, k = 0; i < pj.nparts && pj.rc == 0; i++ )
+    {
+        if ( pj.arrays[i]->rows == 0 )
+            continue;
+        if ( cols < 0 )
+        {
+            cols = pj.arrays[i]->cols;
+            k = i;
+        }
+        else if ( pj.arrays[i]->cols != cols )
+            pj.rc = ft_fail( ctx, "%s: %ld columns, but %s has %ld", pj.parts[i].name, pj.arrays[i]->cols,
+                             pj.parts[k].name, cols );
+    }
+
+    /* the header of the first input, then the labels in row order */
+    for( i = 0; pj.rc == 0 && i < pj.nparts; i++ )
+        if ( (i == 0 && strpool_append( &ctx->text.header, &pj.texts[i].header ) < 0) ||
+             strpool_append( &ctx->text.labels, &pj.texts[i].labels ) < 0 )
+            pj.rc = ft_fail( ctx, "out of memory for the header and labels" );
+    for( i = 0; pj.texts != (text_t *)0 && i < pj.nparts; i++ )
+    {
+        strpool_free( &pj.texts[i].header );
+        strpool_free( &pj.texts[i].labels );
+    }
+    free( (void *)pj.texts );
+
+    for( i = 0; pj.parts != (input_t *)0 && i < pj.nparts; i++ )
+        free( (void *)pj.parts[i].buf );
+    free( (void *)pj.parts );
+    if ( pj.rc < 0 )
+    {
+        for( i = 0; pj.arrays != (array_t **)0 && i < pj.nparts; i++ )
+            if ( i == 0 )
+                ctx_release( ctx, pj.arrays[i] );
+            else
+                free_array( pj.arrays[i] );
+        free( (void *)pj.arrays );
+        return (array_t **)0;
+    }
+
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "DONE\nread in %ld rows (c=%ld)\n", ATOMIC_GET( ctx->progress.rows_in ), cols );
+    trace_end( ctx, "read_parts", started, ctx->stats.phase[ FT_PHASE_PARSE ].bytes );
+    *nparts = pj.nparts;
+    return pj.arrays;
+}
+
+/* pick a tile of about tune.tile_bytes from a rows x cols matrix.  Short
+ * columns are gathered several at a time so that each matrix row is read
+ * in one contiguous run; long columns are split into row blocks.
+ */
+static void tile_shape( ft_ctx_t *ctx, idx_t rows, idx_t cols, size_t es, idx_t *tile_rows, idx_t *tile_cols )
+{
+    idx_t tr = rows, tc = 1, tile_bytes = ctx->tune.tile_bytes;
+
+    if ( tr * (idx_t)es > tile_bytes )
+        tr = tile_bytes / es;
+    if ( tr < 1 )
+        tr = 1;
+    if ( tr == rows )
+        tc = tile_bytes / (tr * es);
+    if ( tc > cols )
+        tc = cols;
+    if ( tc < 1 )
+        tc = 1;
+    *tile_rows = tr;
+    *tile_cols = tc;
+}
+
+/* tile[c * stride + r] = data[row + r][col + c] */
+static inline void gather_rows( array_t *a, idx_t row, idx_t col, idx_t nr, idx_t nc, char *tile, idx_t stride )
+{
+    size_t es = a->element_size;
+    idx_t r, c;
+
+    for( r = 0; r < nr; r++ )
+    {
+        const char *src = &(a->data[ ((row + r) * a->cols + col) * es ]);
+        for( c = 0; c < nc; c++ )
+            memcpy( &tile[ (c * stride + r) * es ], &src[ c * es ], es );
+    }
+}
+
+/* transpose: tile[c][r] = data[row + r][col + c] */
+static void gather_tile( array_t *a, idx_t row, idx_t col, idx_t nr, idx_t nc, char *tile )
+{
+    stamp_t t;
+
+    phase_begin( a->ctx, &t );
+    gather_rows( a, row, col, nr, nc, tile, nr );
+    phase_end( a->ctx, FT_PHASE_TRANSPOSE, &t, nr * nc * a->element_size );
+}
+
+/* append 'n' elements stored back to back at 'src' as delimited text; the
+ * last one is followed by a newline if 'eol', otherwise by the delimiter
+ */
+static inline char *format_fields( char *o, const char *src, idx_t n, size_t es, char delim, int eol )
+{
+    idx_t r;
+
+    for( r = 0; r < n; r++ )
+    {
+        const char *field = &src[ r * es ];
+        size_t len = strnlen( field, es );
+        memcpy( o, field, len );
+        o += len;
+        *o++ = delim;
+    }
+    if ( n > 0 && eol )
+        o[-1] = '\n';
+    return o;
+}
+
+/* FT_NUMA_LOCAL: a row tile's formatted part of each line of its column
+ * block, kept until the block's last row tile puts the lines together;
+ * there is one per row tile, taken by that row tile of each block in turn
+ */
+typedef struct {
+    char  *buf;
+    idx_t *ends;                   /* end of each line's part in buf         */
+    idx_t  block;                  /* column block that may fill it next     */
+} emit_part_t;
+
+/* one emit_stacked() call, shared by the pool: tiles are numbered column
+ * block by column block, claimed in that order and written strictly in that
+ * order, so the output is the same for any # of threads.  The matrix is the
+ * rows of parts[0], then those of parts[1], ...
+ */
+typedef struct {
+    ft_ctx_t       *ctx;
+    array_t *const *parts;
+    int             nparts;
+    idx_t           rows, cols;
+    size_t          es;
+    output_t       *out;
+    char            delim;
+    idx_t           first_line;
+    const char     *prefix;        /* written at the start of each line      */
+    size_t          prefix_len;
+    const strpool_t *heads;        /* then heads[ head0 + line ], if set     */
+    idx_t           head0;
+    idx_t           tile_rows, tile_cols;
+    idx_t           row_tiles;     /* tiles per column block                 */
+    idx_t           tiles;
+    idx_t           next;          /* next tile to claim                     */
+    idx_t           turn;          /* next tile to write                     */
+    int             nodes;         /* FT_NUMA_LOCAL: tiles claimed per node, */
+    idx_t           node_lo[ NUMA_MAX_NODES ]; /* each node's row tiles of   */
+    idx_t           node_hi[ NUMA_MAX_NODES ]; /* every column block, and    */
+    idx_t           node_next[ NUMA_MAX_NODES ]; /* how many it claimed      */
+    emit_part_t    *part;          /* em->nodes: one per row tile            */
+    char           *joined;        /* its lines, put together                */
+    size_t          joined_size;
+    int             rc;
+    pthread_mutex_t lock;
+    pthread_cond_t  turned;
+} emit_t;
+
+/* gather_tile() over the parts that rows [row, row + nr) fall in */
+static void gather_stacked( emit_t *em, idx_t row, idx_t col, idx_t nr, idx_t nc, char *tile )
+{
+    stamp_t t;
+    idx_t start = 0, r = 0, lo, n;
+    int i;
+
+    if ( em->nparts == 1 )
+    {
+        gather_tile( em->parts[0], row, col, nr, nc, tile );
+        return;
+    }
+    phase_begin( em->ctx, &t );
+    for( i = 0; i < em->nparts && r < nr; start += em->parts[i]->rows, i++ )
+    {
+        if ( row + r >= start + em->parts[i]->rows )
+            continue;
+        lo = row + r - start;
+        n = em->parts[i]->rows - lo < nr - r ? em->parts[i]->rows - lo : nr - r;
+        gather_rows( em->parts[i], lo, col, n, nc, &tile[ r * em->es ], nr );
+        r += n;
+    }
+    phase_end( em->ctx, FT_PHASE_TRANSPOSE, &t, nr * nc * em->es );
+}
+
+/* the next tile for the calling thread, em->tiles when there is none:
+ * with em->nodes, the next of the row tiles placed on its node, so tiles
+ * are still claimed, per node, in the order they are written
+ */
+static inline idx_t emit_claim( emit_t *em, int j )
+{
+    idx_t i, m;
+
+    if ( j < 0 )
+        return __atomic_fetch_add( &em->next, 1, __ATOMIC_RELAXED );
+    if ( (m = em->node_hi[j] - em->node_lo[j]) == 0 )
+        return em->tiles;
+    i = __atomic_fetch_add( &em->node_next[j], 1, __ATOMIC_RELAXED );
+    if ( i / m * em->row_tiles >= em->tiles )
+        return em->tiles;
+    return i / m * em->row_tiles + em->node_lo[j] + i % m;
+}
+
+/* em->nodes, called in row tile k's turn: its part of the lines of its
+ * column block, which has 'nc' lines, stays in em->part; the block's last
+ * row tile writes them, each put together from every row tile's part, and
+ * hands the parts on to the next block
+ */
+static int emit_join( emit_t *em, idx_t k, idx_t nc )
+{
+    idx_t r = k % em->row_tiles, c, start, size = 0;
+    char *o, *joined;
+    int rc = em->rc;
+
+    if ( r < em->row_tiles - 1 )
+        return rc;
+    for( r = 0; rc == 0 && r < em->row_tiles; r++ )
+        size += em->part[r].ends[ nc - 1 ];
+    if ( rc == 0 && (size_t)size > em->joined_size )
+    {
+        if ( (joined = realloc( (void *)em->joined, size )) == (char *)0 )
+            rc = ft_fail( em->ctx, "out of memory for output lines" );
+        else
+        {
+            em->joined = joined;
+            em->joined_size = size;
+        }
+    }
+    o = em->joined;
+    for( c = 0; rc == 0 && c < nc; c++ )
+        for( r = 0; r < em->row_tiles; r++ )
+        {
+            start = c > 0 ? em->part[r].ends[ c - 1 ] : 0;
+            memcpy( o, em->part[r].buf + start, em->part[r].ends[c] - start );
+            o += em->part[r].ends[c] - start;
+        }
+    if ( rc == 0 )
+        rc = write_block( em->ctx, em->out, em->joined, o - em->joined );
+    for( r = 0; r < em->row_tiles; r++ )
+        em->part[r].block++;
+    return rc;
+}
+
+static void *emit_tiles( void *arg )
+{
+    emit_t *em = (emit_t *)arg;
+    ft_ctx_t *ctx = em->ctx;
+    size_t es = em->es, buf_size;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    idx_t k, row, col, nr, nc, c;
+    char *tile, *buf = (char *)0, *o;
+    emit_part_t *mine = (emit_part_t *)0;
+    stamp_t t;
+    int j = -1;
+
+    /* a thread on no node of the placement helps the first */
+    if ( em->nodes > 1 && (j = ctx_node_index( ctx )) < 0 )
+        j = 0;
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    buf_size = em->tile_rows * em->tile_cols * (es + 1) +
+               em->tile_cols * (em->prefix_len + (em->heads ? em->heads->longest + 1 : 0));
+    tile = malloc( em->tile_rows * em->tile_cols * es );
+    /* with nodes, each row tile is formatted into its part instead */
+    if ( em->nodes <= 1 )
+        buf = malloc( buf_size );
+    if ( tile == (char *)0 || (em->nodes <= 1 && buf == (char *)0) )
+    {
+        ft_fail( ctx, "out of memory for output tiles" );
+        ATOMIC_SET( em->rc, -1 );
+    }
+
+    while ( (k = emit_claim( em, j )) < em->tiles )
+    {
+        col = k / em->row_tiles * em->tile_cols;
+        row = k % em->row_tiles * em->tile_rows;
+        nc = (em->cols - col < em->tile_cols) ? em->cols - col : em->tile_cols;
+        nr = (em->rows - row < em->tile_rows) ? em->rows - row : em->tile_rows;
+        if ( em->nodes > 1 )
+        {
+            /* free once the previous block, written earlier, is joined */
+            mine = &em->part[ k % em->row_tiles ];
+            pthread_mutex_lock( &em->lock );
+            while ( mine->block != k / em->row_tiles )
+                pthread_cond_wait( &em->turned, &em->lock );
+            pthread_mutex_unlock( &em->lock );
+            if ( mine->buf == (char *)0 &&
+                 ((mine->buf = malloc( buf_size )) == (char *)0 ||
+                  (mine->ends = malloc( em->tile_cols * sizeof(idx_t) )) == (idx_t *)0) )
+            {
+                ft_fail( ctx, "out of memory for output tiles" );
+                ATOMIC_SET( em->rc, -1 );
+            }
+            buf = mine->buf;
+        }
+        o = buf;
+        if ( ATOMIC_GET( em->rc ) == 0 )
+        {
+            gather_stacked( em, row, col, nr, nc, tile );
+
+            /* format: one (partial) output line per tile column */
+            phase_begin( ctx, &t );
+            for( c = 0; c < nc; c++ )
+            {
+                if ( row == 0 && em->prefix_len > 0 )
+                {
+                    memcpy( o, em->prefix, em->prefix_len );
+                    o += em->prefix_len;
+                }
+                if ( row == 0 && em->heads )
+                {
+                    const char *head = strpool_str( em->heads, em->head0 + col + c );
+                    size_t len = strlen( head );
+
+                    memcpy( o, head, len );
+                    o += len;
+                    *o++ = em->delim;
+                }
+                o = format_fields( o, &tile[ c * nr * es ], nr, es, em->delim, row + nr == em->rows );
+                if ( mine )
+                    mine->ends[c] = o - buf;
+            }
+            phase_end( ctx, FT_PHASE_FORMAT, &t, o - buf );
+        }
+
+        /* wait for the tiles before this one to be written */
+        pthread_mutex_lock( &em->lock );
+        while ( em->turn != k )
+            pthread_cond_wait( &em->turned, &em->lock );
+        if ( mine ? emit_join( em, k, nc ) < 0 && em->rc == 0 :
+                    em->rc == 0 && write_block( ctx, em->out, buf, o - buf ) < 0 )
+            ATOMIC_SET( em->rc, -1 );
+        em->turn++;
+
+        /* publish progress once per tile column block */
+        ATOMIC_SET( ctx->progress.bytes_out, ctx->progress.bytes_out + (o - buf) );
+        if ( row + nr == em->rows )
+            ATOMIC_SET( ctx->progress.lines_out, em->first_line + col + nc );
+        pthread_cond_broadcast( &em->turned );
+        pthread_mutex_unlock( &em->lock );
+    }
+    free( (void *)tile );
+    if ( em->nodes <= 1 )
+        free( (void *)buf );
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* FT_NUMA_LOCAL: if the threads still run on the nodes 'a' was placed
+ * over, tiles no taller than a node's band of rows, and each node claims
+ * the row tiles that start in its band; returns 0 if it does not apply
+ */
+static int emit_nodes( emit_t *em, const array_t *a )
+{
+    ft_ctx_t *ctx = em->ctx;
+    int id[ NUMA_MAX_NODES ], n = ctx->numa.nodes, j;
+    idx_t r, line = a->cols * (idx_t)em->es;
+
+    memcpy( (void *)id, (void *)ctx->numa.id, n * sizeof(int) );
+    if ( line == 0 || ctx_nodes( ctx ) != n || memcmp( (void *)id, (void *)ctx->numa.id, n * sizeof(int) ) != 0 )
+        return 0;
+    tile_shape( ctx, (a->node_bytes + line - 1) / line, em->cols, em->es, &em->tile_rows, &em->tile_cols );
+    em->row_tiles = (em->rows + em->tile_rows - 1) / em->tile_rows;
+    if ( em->row_tiles < 2 || (em->part = calloc( em->row_tiles, sizeof(emit_part_t) )) == (emit_part_t *)0 )
+        return 0;
+
+    /* place_node() grows with the offset, so each node's tiles are a run */
+    for( j = 0; j < n; j++ )
+        em->node_lo[j] = em->node_hi[j] = 0;
+    for( r = 0; r < em->row_tiles; r++ )
+    {
+        j = place_node( ctx, a, r * em->tile_rows * line );
+        if ( em->node_lo[j] == em->node_hi[j] )
+            em->node_lo[j] = r;
+        em->node_hi[j] = r + 1;
+    }
+    em->nodes = n;
+    return 1;
+}
+
+/* write the columns of the 'nparts' matrices stacked as rows as output
+ * lines first_line, first_line + 1, ..., each starting with 'prefix' if not
+ * NULL, then with its header field if 'text' holds a header row; the
+ * matrix columns are columns first_col, ... of that row.  All parts have
+ * the same columns.
+ */
+static int emit_stacked( array_t *const *parts, int nparts, output_t *out, char delim, idx_t first_line,
+                         const char *prefix, const text_t *text, idx_t first_col )
+{
+    emit_t em;
+    int i;
+
+    memset( (void *)&em, 0, sizeof(em) );
+    em.ctx        = parts[0]->ctx;
+    em.parts      = parts;
+    em.nparts     = nparts;
+    em.es         = parts[0]->element_size;
+    em.out        = out;
+    em.delim      = delim;
+    em.first_line = first_line;
+    em.prefix     = prefix;
+    em.prefix_len = prefix ? strlen( prefix ) : 0;
+    if ( text && em.ctx->opt.header )
+    {
+        em.heads = &text->header;
+        em.head0 = first_col + (em.ctx->opt.labels ? 1 : 0);
+    }
+    for( i = 0; i < nparts; i++ )
+    {
+        em.rows += parts[i]->rows;
+        if ( parts[i]->cols > em.cols )
+            em.cols = parts[i]->cols;
+    }
+    if ( nparts > 1 || parts[0]->node_bytes == 0 || !emit_nodes( &em, parts[0] ) )
+    {
+        tile_shape( em.ctx, em.rows, em.cols, em.es, &em.tile_rows, &em.tile_cols );
+        em.row_tiles = (em.rows + em.tile_rows - 1) / em.tile_rows;
+    }
+    em.tiles      = em.row_tiles * ((em.cols + em.tile_cols - 1) / em.tile_cols);
+    pthread_mutex_init( &em.lock, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &em.turned, (pthread_condattr_t *)0 );
+
+    ctx_run( em.ctx, emit_tiles, &em );
+
+    pthread_mutex_destroy( &em.lock );
+    pthread_cond_destroy( &em.turned );
+    for( i = 0; em.part && i < em.row_tiles; i++ )
+    {
+        free( (void *)em.part[i].buf );
+        free( (void *)em.part[i].ends );
+    }
+    free( (void *)em.part );
+    free( (void *)em.joined );
+    return em.rc;
+}
+
+/* opt.labels: the line the labels become, after the corner field of the
+ * header row if there is one
+ */
+static int emit_labels( ft_ctx_t *ctx, output_t *out, const char *prefix )
+{
+    const strpool_t *lab = &ctx->text.labels;
+    const char *corner = ctx->opt.header && ctx->text.header.count > 0 ? strpool_str( &ctx->text.header, 0 ) : "";
+    size_t plen = prefix ? strlen( prefix ) : 0, clen = ctx->opt.header ? strlen( corner ) + 1 : 0;
+    char *line, *o;
+    idx_t i;
+    int rc;
+
+    if ( !ctx->opt.labels || (lab->count == 0 && clen == 0) )
+        return 0;
+    if ( (line = malloc( plen + clen + lab->len + 1 )) == (char *)0 )
+        return ft_fail( ctx, "out of memory for the labels" );
+    if ( plen > 0 )
+        memcpy( line, prefix, plen );
+    o = line + plen;
+    memcpy( o, corner, clen );
+    o += clen;
+    if ( clen > 0 )
+        o[-1] = ctx->opt.out_delim;
+    if ( lab->len > 0 )
+        memcpy( o, lab->data, lab->len );
+    for( i = 0; i < lab->count; i++ )
+        o[ lab->off[i] + strlen( strpool_str( lab, i ) ) ] = ctx->opt.out_delim;
+    o += lab->len;
+    o[-1] = '\n';
+    rc = write_block( ctx, out, line, o - line );
+    free( (void *)line );
+    return rc;
+}
+
+/* write the columns of 'a' as output lines first_line, first_line + 1, ... */
+static int emit_transposed( array_t *a, output_t *out, char delim, idx_t first_line )
+{
+    return emit_stacked( &a, 1, out, delim, first_line, (const char *)0, (const text_t *)0, 0 );
+}
+
+static int write_array_transposed( array_t *const *parts, int nparts, output_t *out )
+{
+    ft_ctx_t *ctx = parts[0]->ctx;
+    double started = clock_seconds( CLOCK_MONOTONIC );
+    int rc;
+
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "writing array transposed ... " );
+    ATOMIC_SET( ctx->progress.lines_total, parts[0]->cols );
+    progress_stage( ctx, FT_STAGE_WRITE );
+
+    rc = emit_stacked( parts, nparts, out, ctx->opt.out_delim, 0, (const char *)0, ctx_text( ctx ), 0 );
+
+    if ( rc == 0 && ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "DONE\n" );
+    trace_end( ctx, "write_array_transposed", started, ctx->stats.phase[ FT_PHASE_WRITE ].bytes );
+    return rc;
+}
+
+/* opt.column_widths: each output line is one column of the store, whole,
+ * so there is nothing to gather; threads format blocks of lines and write
+ * them in order, as emit_tiles() does
+ */
+typedef struct {
+    ft_ctx_t        *ctx;
+    array_t         *a;
+    output_t        *out;
+    const strpool_t *heads;        /* header fields, as in emit_t            */
+    idx_t            head0;
+    idx_t            block;        /* lines per claim                        */
+    idx_t            next, turn;
+    int              rc;
+    pthread_mutex_t  lock;
+    pthread_cond_t   turned;
+} column_emit_t;
+
+static void *emit_columns( void *arg )
+{
+    column_emit_t *ce = (column_emit_t *)arg;
+    ft_ctx_t *ctx = ce->ctx;
+    colstore_t *cs = ce->a->cs;
+    idx_t rows = ce->a->rows, cols = ce->a->cols, line_max, k, c, r, ov;
+    char delim = ctx->opt.out_delim, *buf, *o;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    stamp_t t;
+
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    line_max = rows * (ce->a->element_size + 1) + (ce->heads ? ce->heads->longest + 1 : 0) + 1;
+    if ( (buf = malloc( ce->block * line_max )) == (char *)0 )
+        ATOMIC_SET( ce->rc, ft_fail( ctx, "out of memory for output lines" ) );
+
+    while ( (k = __atomic_fetch_add( &ce->next, ce->block, __ATOMIC_RELAXED )) < cols )
+    {
+        o = buf;
+        if ( ATOMIC_GET( ce->rc ) == 0 )
+        {
+            phase_begin( ctx, &t );
+            for( c = k; c < k + ce->block && c < cols; c++ )
+            {
+                const column_t *col = c < cs->ncols ? &cs->col[c] : (const column_t *)0;
+                const char *field;
+                size_t len;
+
+                if ( ce->heads )
+                {
+                    field = strpool_str( ce->heads, ce->head0 + c );
+                    len = strlen( field );
+                    memcpy( o, field, len );
+                    o += len;
+                    *o++ = delim;
+                }
+                for( r = ov = 0; r < rows; r++ )
+                {
+                    if ( col && ov < col->nover && col->over[ 2 * ov ] == r )
+                    {
+                        field = strpool_str( &cs->long_fields, col->over[ 2 * ov++ + 1 ] );
+                        len = strlen( field );
+                    }
+                    else if ( col && r < col->rows )
+                    {
+                        field = &col->data[ r * col->width ];
+                        len = strnlen( field, col->width );
+                    }
+                    else
+                    {
+                        field = "";
+                        len = 0;
+                    }
+                    memcpy( o, field, len );
+                    o += len;
+                    *o++ = delim;
+                }
+                if ( rows > 0 )
+                    o[-1] = '\n';
+            }
+            phase_end( ctx, FT_PHASE_FORMAT, &t, o - buf );
+        }
+
+        /* wait for the lines before these to be written */
+        pthread_mutex_lock( &ce->lock );
+        while ( ce->turn != k )
+            pthread_cond_wait( &ce->turned, &ce->lock );
+        if ( ce->rc == 0 && write_block( ctx, ce->out, buf, o - buf ) < 0 )
+            ATOMIC_SET( ce->rc, -1 );
+        ce->turn += ce->block;
+        ATOMIC_SET( ctx->progress.bytes_out, ctx->progress.bytes_out + (o - buf) );
+        ATOMIC_SET( ctx->progress.lines_out, k + ce->block < cols ? k + ce->block : cols );
+        pthread_cond_broadcast( &ce->turned );
+        pthread_mutex_unlock( &ce->lock );
+    }
+    free( (void *)buf );
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+static int write_columns( array_t *a, output_t *out )
+{
+    ft_ctx_t *ctx = a->ctx;
+    double started = clock_seconds( CLOCK_MONOTONIC );
+    column_emit_t ce;
+
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "writing columns ... " );
+    ATOMIC_SET( ctx->progress.lines_total, a->cols );
+    progress_stage( ctx, FT_STAGE_WRITE );
+
+    memset( (void *)&ce, 0, sizeof(ce) );
+    ce.ctx   = ctx;
+    ce.a     = a;
+    ce.out   = out;
+    ce.block = ctx->tune.tile_bytes / (a->rows * (a->element_size + 1) + 1);
+    if ( ce.block < 1 )
+        ce.block = 1;
+    if ( ctx->opt.header )
+    {
+        ce.heads = &ctx->text.header;
+        ce.head0 = ctx->opt.labels ? 1 : 0;
+    }
+    pthread_mutex_init( &ce.lock, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &ce.turned, (pthread_condattr_t *)0 );
+
+    ctx_run( ctx, emit_columns, &ce );
+
+    pthread_mutex_destroy( &ce.lock );
+    pthread_cond_destroy( &ce.turned );
+    if ( ce.rc == 0 && ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "DONE\n" );
+    trace_end( ctx, "write_columns", started, ctx->stats.phase[ FT_PHASE_WRITE ].bytes );
+    return ce.rc;
+}
+
+/* memory engine: the whole matrix in RAM; several inputs are stacked.  A
+ * single input that outgrows plan.matrix_limit is handed back as *full,
+ * with 'ps' where it stopped, for the external engine to finish
+ */
+static int run_memory( ft_ctx_t *ctx, input_t *in, int nin, output_t *out, array_t **full, parser_t *ps )
+{
+    array_t *a, **parts = &a;
+    int nparts = 1, i, rc;
+
+    if ( nin == 1 && (a = read_array( ctx, in, ps )) == (array_t *)0 )
+        return -1;
+    if ( nin == 1 )
+    {
+        /* nothing is written: run_external() takes the array and the parser */
+        if ( a->full )
+        {
+            *full = a;
+            return 0;
+        }
+        parser_free( ps );
+    }
+    if ( nin > 1 && (parts = read_parts( ctx, in, nin, &nparts )) == (array_t **)0 )
+        return -1;
+    if ( (rc = emit_labels( ctx, out, (const char *)0 )) == 0 )
+        rc = a->cs && nin == 1 ? write_columns( a, out ) : write_array_transposed( parts, nparts, out );
+    for( i = 0; i < nparts; i++ )
+    {
+        ctx->stats.rows += parts[i]->rows;
+        if ( parts[i]->cols > ctx->stats.cols )
+            ctx->stats.cols = parts[i]->cols;
+        ctx->stats.elements += parts[i]->element_count;
+        ctx->stats.matrix_bytes += parts[i]->cs ? cs_bytes( parts[i]->cs ) : parts[i]->bytes_allocated;
+        if ( i == 0 )
+            ctx_release( ctx, parts[i] );
+        else
+            free_array( parts[i] );
+    }
+    if ( parts != &a )
+        free( (void *)parts );
+    return rc;
+}
+
+/* opt.window_rows: transpose every window_rows input rows as a block of
+ * their own as soon as they are parsed, so an unbounded stream runs in the
+ * memory of one block and the output starts long before the input ends
+ */
+static int run_window( ft_ctx_t *ctx, input_t *in, output_t *out )
+{
+    parser_t ps;
+    array_t *a;
+    char prefix[ 32 ];
+    idx_t lines = 0;
+    int more = 1, rc = 0;
+
+    if ( (a = ctx_array( ctx )) == (array_t *)0 )
+        return ft_fail( ctx, "%s: out of memory", in->name );
+    if ( ctx->plan.cols > 0 )
+        reserve_elements( a, ctx->opt.window_rows * ctx->plan.cols );
+    parser_init( &ps, ctx->opt.in_delim, ctx->opt.element_size, 0, ALL_COLUMNS, ctx->keep, &ctx->text,
+                 ctx_text_flags( ctx ) );
+
+    while ( more > 0 && rc == 0 )
+    {
+        reset_array( a );
+        strpool_reset( &ctx->text.labels );
+        progress_stage( ctx, FT_STAGE_READ );
+        if ( (more = parse_rows( ctx, in, &ps, a, ctx->opt.window_rows )) < 0 || a->rows == 0 )
+            break;
+
+        if ( ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "block %ld: rows %ld-%ld\n", (idx_t)ctx->stats.windows, ps.row0, ps.row0 + a->rows - 1 );
+        progress_stage( ctx, FT_STAGE_WRITE );
+        ATOMIC_SET( ctx->progress.lines_total, lines + a->cols );
+        snprintf( prefix, sizeof(prefix), "%ld%c", (idx_t)ctx->stats.windows, ctx->opt.out_delim );
+        rc = emit_labels( ctx, out, ctx->opt.window_index ? prefix : (const char *)0 );
+        if ( rc == 0 )
+            rc = emit_stacked( &a, 1, out, ctx->opt.out_delim, lines, ctx->opt.window_index ? prefix : (const char *)0,
+                               ctx_text( ctx ), 0 );
+        if ( rc == 0 && ctx->opt.window_separator != (const char *)0 &&
+             (write_block( ctx, out, ctx->opt.window_separator, strlen( ctx->opt.window_separator ) ) < 0 ||
+              write_block( ctx, out, "\n", 1 ) < 0) )
+            rc = -1;
+
+        ctx->stats.windows++;
+        ctx->stats.rows += a->rows;
+        if ( a->cols > ctx->stats.cols )
+            ctx->stats.cols = a->cols;
+        ctx->stats.elements += a->element_count;
+        ps.row0 += a->rows;
+        lines += a->cols;
+    }
+    if ( more < 0 )
+        rc = -1;
+
+    ctx->stats.matrix_bytes = a->bytes_allocated;
+    ctx_release( ctx, a );
+    parser_free( &ps );
+    return rc;
+}
+
+/* multipass engine: re-read a regular file once per window of columns and
+ * keep only that window in memory
+ */
+static int run_multipass( ft_ctx_t *ctx, input_t *in, output_t *out )
+{
+    parser_t ps;
+    array_t *a;
+    idx_t lo, width = ctx->plan.window_cols > 0 ? ctx->plan.window_cols : 1;
+    int rc = 0;
+
+    if ( (a = ctx_array( ctx )) == (array_t *)0 )
+        return ft_fail( ctx, "%s: out of memory", in->name );
+    reserve_elements( a, ctx->plan.reserve );
+    ATOMIC_SET( ctx->progress.lines_total, ctx->plan.cols );
+
+    for( lo = 0; rc == 0; lo += width )
+    {
+        if ( ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "pass %ld: columns %ld-%ld ... ", ctx->stats.passes + 1, lo, lo + width - 1 );
+        if ( rewind_input( in ) < 0 )
+        {
+            rc = ft_fail_errno( ctx, in->name );
+            break;
+        }
+        reset_array( a );
+        strpool_reset( &ctx->text.header );
+        strpool_reset( &ctx->text.labels );
+        progress_stage( ctx, FT_STAGE_READ );
+        parser_init( &ps, ctx->opt.in_delim, ctx->opt.element_size, lo, lo + width, ctx->keep, &ctx->text,
+                     ctx_text_flags( ctx ) );
+        if ( parse_rows( ctx, in, &ps, a, ALL_COLUMNS ) < 0 )
+            rc = -1;
+        parser_free( &ps );
+        if ( rc < 0 || a->cols == 0 )
+            break;
+
+        ctx->stats.passes++;
+        ctx->stats.rows = a->rows;
+        ctx->stats.cols = lo + a->cols;
+        ctx->stats.elements += a->element_count;
+        progress_stage( ctx, FT_STAGE_WRITE );
+        if ( lo == 0 )
+            rc = emit_labels( ctx, out, (const char *)0 );
+        if ( rc == 0 )
+            rc = emit_stacked( &a, 1, out, ctx->opt.out_delim, lo, (const char *)0, ctx_text( ctx ), lo );
+        if ( rc == 0 && ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "DONE\n" );
+
+        /* no row reached the end of this window: no columns are left */
+        if ( a->cols < width )
+            break;
+    }
+
+    ctx->stats.matrix_bytes = a->bytes_allocated;
+    ctx_release( ctx, a );
+    return rc;
+}
+
+/* external engine: bands of rows are spilled column-major, one after the
+ * other, to a single temp file; element (r, c) of a band starting at 'base'
+ * lands at base + (c * rows + r) * element_size.  A compressed band holds
+ * the same bytes cut into SPILL_FRAME frames, each compressed on its own
+ * and stored one after the other from 'base'.
+ */
+typedef struct {
+    int    fd;             /* file holding the band                         */
+    int    dfd;            /* the same file opened O_DIRECT, -1 = none      */
+    off_t  base;           /* offset of the band in it                      */
+    idx_t  rows;           /* rows in the band                              */
+    idx_t  bytes;          /* compressed: the band's bytes before           */
+    off_t *zoff;           /* compressed: where each frame starts past
+                            * 'base', and where the last ends; NULL = none  */
+    idx_t  nframes;
+    uint64_t sum;          /* checksum of the bytes stored                  */
+    idx_t  in_end;         /* checkpoint: input bytes parsed through it     */
+} band_t;
+
+/* the bands spilled from one input, and where each goes: place() sets the
+ * fd and base of a band of 'bytes' bytes, and done(), if set, is told once
+ * the band is written
+ */
+typedef struct {
+    band_t *bands;
+    int     nbands, max_bands;
+    idx_t   rows;
+    idx_t   cols;          /* -1 until the first band, unless preset        */
+    int   (*place)( ft_ctx_t *ctx, void *user, band_t *b, idx_t bytes );
+    int   (*done)( ft_ctx_t *ctx, void *user, band_t *b );
+    void   *user;
+    int    *codec;         /* FT_CODEC_*, AUTO until the first band's sample
+                            * decides; NULL = bands are stored as is        */
+    struct journal *journal; /* each band is recorded here once on disk   */
+    array_t  *loaded;      /* the memory engine's full array, the first band */
+    parser_t *ps;          /* and the parser to go on with; both taken over */
+} spill_t;
+
+/* with opt.direct_io, open spill file 'path' O_DIRECT as well; -1 if its
+ * file system will not
+ */
+static int spill_direct( ft_ctx_t *ctx, const char *path )
+{
+    int dfd = -1;
+
+#ifdef O_DIRECT
+    if ( ctx->opt.direct_io && (dfd = open( path, O_RDWR | O_DIRECT | O_CLOEXEC )) < 0 )
+        ft_warn( ctx, "warning: no O_DIRECT for %s: %s\n", path, strerror( errno ) );
+#else
+    (void)ctx;
+    (void)path;
+#endif
+    return dfd;
+}
+
+/* create an anonymous temp file in the next scratch directory, round
+ * robin; with 'dfd', also open it O_DIRECT into *dfd if asked.  With
+ * 'keep', the file keeps its name, which goes there (SPILL_PATH_LEN).
+ */
+static int spill_open( ft_ctx_t *ctx, int *dfd, char *keep )
+{
+    char path[ SPILL_PATH_LEN ];
+    int fd, i = __atomic_fetch_add( &ctx->scratch_next, 1, __ATOMIC_RELAXED ) % ctx->nscratch;
+
+    snprintf( path, sizeof(path), "%s/ftranspose.XXXXXX", ctx->scratch[i] );
+    if ( (fd = mkstemp( path )) < 0 )
+        return ft_fail_errno( ctx, path );
+    if ( dfd )
+        *dfd = spill_direct( ctx, path );
+    if ( keep )
+        memcpy( keep, path, sizeof(path) );
+    else
+        unlink( path );
+    return fd;
+}
+
+/* O_DIRECT spill writes: bytes go through an aligned buffer and out in
+ * whole SPILL_ALIGN blocks, one after the other from 'off'
+ */
+typedef struct {
+    ft_ctx_t *ctx;
+    int       fd;
+    char     *buf;         /* SPILL_STAGE bytes                             */
+    size_t    len;
+    off_t     off;
+} stage_t;
+
+static int stage_put( stage_t *sg, const char *p, size_t n )
+{
+    size_t m;
+
+    for( ; n > 0; p += m, n -= m )
+    {
+        m = SPILL_STAGE - sg->len < n ? SPILL_STAGE - sg->len : n;
+        memcpy( sg->buf + sg->len, p, m );
+        if ( (sg->len += m) == SPILL_STAGE )
+        {
+            if ( write_at( sg->ctx, sg->fd, sg->buf, SPILL_STAGE, sg->off ) < 0 )
+                return -1;
+            sg->off += SPILL_STAGE;
+            sg->len  = 0;
+        }
+    }
+    return 0;
+}
+
+/* write what is left, padded to a whole block */
+static int stage_flush( stage_t *sg )
+{
+    size_t n = (sg->len + SPILL_ALIGN - 1) & ~(size_t)(SPILL_ALIGN - 1);
+
+    memset( sg->buf + sg->len, 0, n - sg->len );
+    return n == 0 ? 0 : write_at( sg->ctx, sg->fd, sg->buf, n, sg->off );
+}
+
+/* spill compression: an LZ4-style block format.  A frame is a run of
+ * sequences, each a token (literal length in the high nibble, match length
+ * less 4 in the low one; 15 = more length bytes follow, added up until one
+ * is not 255), the literals, and the 2-byte little-endian distance back to
+ * the match.  The last sequence has literals only.
+ */
+static inline uint32_t lz_read32( const unsigned char *p )
+{
+    uint32_t v;
+
+    memcpy( (void *)&v, p, 4 );
+    return v;
+}
+
+static unsigned char *lz_length( unsigned char *op, size_t n )
+{
+    for( ; n >= 255; n -= 255 )
+        *op++ = 255;
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+/* compress 'n' bytes at 'src' into 'dst' greedily, taking the last place
+ * each 4-byte sequence was seen as the match, and striding faster through
+ * bytes that do not repeat; returns the compressed size, or 0 if that
+ * would not be less than 'n'
+ */
+static size_t lz_compress( const char *src, size_t n, char *dst )
+{
+    uint32_t table[ 1 << LZ_HASH_BITS ];
+    const unsigned char *in = (const unsigned char *)src, *ip = in, *anchor = in, *end = in + n, *ref, *m;
+    unsigned char *op = (unsigned char *)dst, *oend = op + n, *token;
+    size_t lit, len;
+    unsigned h;
+
+    memset( (void *)table, 0, sizeof(table) );
+    while ( n > 12 && ip < end - 12 )
+    {
+        h = (lz_read32( ip ) * 2654435761u) >> (32 - LZ_HASH_BITS);
+        ref = in + table[h];
+        table[h] = (uint32_t)(ip - in);
+        if ( ref >= ip || ip - ref > 65535 || lz_read32( ref ) != lz_read32( ip ) )
+        {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        /* the last 5 bytes are always literals */
+        for( m = ip + 4, ref += 4; m < end - 5 && *m == *ref; m++, ref++ )
+            ;
+        lit = ip - anchor;
+        len = m - ip - 4;
+        if ( (size_t)(oend - op) < lit + lit / 255 + len / 255 + 5 )
+            return 0;
+        token = op++;
+        *token = (unsigned char)((lit < 15 ? lit : 15) << 4 | (len < 15 ? len : 15));
+        if ( lit >= 15 )
+            op = lz_length( op, lit - 15 );
+        memcpy( op, anchor, lit );
+        op += lit;
+        *op++ = (unsigned char)((m - ref) & 255);
+        *op++ = (unsigned char)((m - ref) >> 8);
+        if ( len >= 15 )
+            op = lz_length( op, len - 15 );
+        ip = anchor = m;
+    }
+    lit = end - anchor;
+    if ( (size_t)(oend - op) <= lit + lit / 255 + 2 )
+        return 0;
+    *op++ = (unsigned char)((lit < 15 ? lit : 15) << 4);
+    if ( lit >= 15 )
+        op = lz_length( op, lit - 15 );
+    memcpy( op, anchor, lit );
+    op += lit;
+    return op - (unsigned char *)dst;
+}
+
+/* expand the 'n' bytes of a frame at 'src' into 'size' bytes at 'dst';
+ * -1 if they do not decode to exactly that many
+ */
+static int lz_decompress( const char *src, size_t n, char *dst, size_t size )
+{
+    const unsigned char *ip = (const unsigned char *)src, *iend = ip + n;
+    unsigned char *op = (unsigned char *)dst, *oend = op + size;
+    size_t len, dist, k;
+    unsigned token, b;
+
+    while ( ip < iend )
+    {
+        token = *ip++;
+        if ( (len = token >> 4) == 15 )
+            do
+            {
+                if ( ip == iend )
+                    return -1;
+                len += (b = *ip++);
+            } while ( b == 255 );
+        if ( len > (size_t)(iend - ip) || len > (size_t)(oend - op) )
+            return -1;
+        memcpy( op, ip, len );
+        op += len;
+        ip += len;
+        if ( ip == iend )
+            break;
+
+        if ( iend - ip < 2 )
+            return -1;
+        dist = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if ( (len = token & 15) == 15 )
+            do
+            {
+                if ( ip == iend )
+                    return -1;
+                len += (b = *ip++);
+            } while ( b == 255 );
+        len += 4;
+        if ( dist == 0 || dist > (size_t)(op - (unsigned char *)dst) || len > (size_t)(oend - op) )
+            return -1;
+        if ( dist >= len )
+            memcpy( op, op - dist, len );
+        else
+            for( k = 0; k < len; k++ )
+                op[k] = op[ (idx_t)k - (idx_t)dist ];
+        op += len;
+    }
+    return op == oend ? 0 : -1;
+}
+
+/* per-thread buffers for reading bands back */
+typedef struct {
+    char *bounce;          /* O_DIRECT: aligned, SPILL_STAGE bytes          */
+    char *z, *frame;       /* compressed: SPILL_FRAME bytes each            */
+} spill_buf_t;
+
+/* read 'size' bytes at file offset 'off' of band 'b'; with O_DIRECT, whole
+ * blocks at a time through the bounce buffer
+ */
+static int spill_pread( ft_ctx_t *ctx, const band_t *b, char *buf, size_t size, off_t off, char *bounce )
+{
+    off_t lo, hi;
+    size_t skip, n;
+
+    if ( b->dfd < 0 || bounce == (char *)0 )
+        return read_at( ctx, b->fd, buf, size, off, FT_PHASE_SPILL_READ ) == (ssize_t)size ? 0 : -1;
+    for( ; size > 0; buf += n, off += n, size -= n )
+    {
+        lo = off & ~(off_t)(SPILL_ALIGN - 1);
+        hi = (off + size + SPILL_ALIGN - 1) & ~(off_t)(SPILL_ALIGN - 1);
+        if ( hi - lo > SPILL_STAGE )
+            hi = lo + SPILL_STAGE;
+        skip = off - lo;
+        n = (size_t)(hi - lo) - skip < size ? (size_t)(hi - lo) - skip : size;
+        if ( read_at( ctx, b->dfd, bounce, hi - lo, lo, FT_PHASE_SPILL_READ ) < (ssize_t)(skip + n) )
+            return -1;
+        memcpy( buf, bounce + skip, n );
+    }
+    return 0;
+}
+
+/* read 'size' bytes at 'off' of band 'b', as laid out before compression:
+ * the frames they span are read and expanded, straight into 'buf' when
+ * they fall wholly inside it.  A frame that fails to expand is EIO.
+ */
+static int spill_read( ft_ctx_t *ctx, const band_t *b, char *buf, size_t size, off_t off, const spill_buf_t *sb )
+{
+    idx_t i, rel = off - b->base;
+    size_t skip, raw, zlen, n;
+    char *dst;
+    stamp_t t;
+    int rc;
+
+    if ( b->zoff == (off_t *)0 )
+        return spill_pread( ctx, b, buf, size, off, sb ? sb->bounce : (char *)0 );
+    for( ; size > 0; buf += n, rel += n, size -= n )
+    {
+        if ( (i = rel / SPILL_FRAME) >= b->nframes )
+        {
+            errno = EIO;
+            return -1;
+        }
+        skip = rel - i * SPILL_FRAME;
+        raw  = b->bytes - i * SPILL_FRAME < SPILL_FRAME ? b->bytes - i * SPILL_FRAME : SPILL_FRAME;
+        n    = raw - skip < size ? raw - skip : size;
+        zlen = b->zoff[ i + 1 ] - b->zoff[i];
+        if ( zlen == raw )
+        {
+            if ( spill_pread( ctx, b, buf, n, b->base + b->zoff[i] + skip, sb->bounce ) < 0 )
+                return -1;
+            continue;
+        }
+        if ( spill_pread( ctx, b, sb->z, zlen, b->base + b->zoff[i], sb->bounce ) < 0 )
+            return -1;
+        dst = (skip == 0 && n == raw) ? buf : sb->frame;
+        phase_begin( ctx, &t );
+        rc = lz_decompress( sb->z, zlen, dst, raw );
+        phase_end( ctx, FT_PHASE_SPILL_READ, &t, 0 );
+        if ( rc < 0 )
+        {
+            errno = EIO;
+            return -1;
+        }
+        if ( dst != buf )
+            memcpy( buf, sb->frame + skip, n );
+    }
+    return 0;
+}
+
+/* band checksums: FNV-1a over 8-byte words, a short last word padded with
+ * zeros, fed in pieces of any size
+ */
+typedef struct {
+    uint64_t h, w;
+    int      n;            /* bytes in 'w'                                  */
+} csum_t;
+
+#define CSUM_INIT    { 14695981039346656037ULL, 0, 0 }
+#define CSUM_PRIME   1099511628211ULL
+
+static void csum_add( csum_t *cs, const char *p, size_t n )
+{
+    uint64_t w;
+
+    for( ; n > 0 && cs->n > 0; p++, n-- )
+    {
+        cs->w |= (uint64_t)(unsigned char)*p << (8 * cs->n);
+        if ( ++cs->n == 8 )
+        {
+            cs->h = (cs->h ^ cs->w) * CSUM_PRIME;
+            cs->w = 0;
+            cs->n = 0;
+        }
+    }
+    for( ; n >= 8; p += 8, n -= 8 )
+    {
+        memcpy( (void *)&w, p, 8 );
+        cs->h = (cs->h ^ w) * CSUM_PRIME;
+    }
+    for( ; n > 0; p++, n-- )
+        cs->w |= (uint64_t)(unsigned char)*p << (8 * cs->n++);
+}
+
+static uint64_t csum_end( csum_t *cs )
+{
+    return cs->n > 0 ? (cs->h ^ cs->w) * CSUM_PRIME : cs->h;
+}
+
+/* a band's bytes, in file order, on their way out: through the O_DIRECT
+ * stage if there is one, and a frame at a time if the band is compressed
+ */
+typedef struct {
+    ft_ctx_t *ctx;
+    band_t   *b;
+    int      *codec;       /* FT_CODEC_AUTO until the sample decides        */
+    stage_t   sg;          /* O_DIRECT, if sg.buf                           */
+    off_t     off;         /* otherwise where the next bytes go             */
+    char     *frame, *z;   /* compressed: SPILL_FRAME bytes each            */
+    size_t    len;         /* bytes in 'frame'                              */
+    idx_t     tried, kept; /* FT_CODEC_AUTO: sample bytes, and compressed   */
+    csum_t    sum;
+} sink_t;
+
+static int sink_write( sink_t *sk, const char *p, size_t n )
+{
+    csum_add( &sk->sum, p, n );
+    if ( sk->sg.buf )
+        return stage_put( &sk->sg, p, n );
+    sk->off += n;
+    return write_at( sk->ctx, sk->b->fd, p, n, sk->off - n );
+}
+
+/* FT_CODEC_AUTO: settle on compressing if the sample shrank enough */
+static void sink_decide( sink_t *sk )
+{
+    *sk->codec = sk->kept <= SPILL_GAIN * sk->tried ? FT_CODEC_LZ : FT_CODEC_NONE;
+    if ( sk->ctx->opt.verbosity >= 1 )
+        ft_log( sk->ctx, "spill frames sampled at %.0f%% of their size: %s\n",
+                100.0 * sk->kept / sk->tried, codec_names[ *sk->codec ] );
+}
+
+/* write out the frame, compressed unless that is decided against or it
+ * does not shrink; a frame's stored size tells which
+ */
+static int sink_frame( sink_t *sk )
+{
+    band_t *b = sk->b;
+    size_t z = 0;
+    stamp_t t;
+    int rc;
+
+    if ( sk->len == 0 )
+        return 0;
+    if ( *sk->codec != FT_CODEC_NONE )
+    {
+        phase_begin( sk->ctx, &t );
+        z = lz_compress( sk->frame, sk->len, sk->z );
+        phase_end( sk->ctx, FT_PHASE_SPILL_WRITE, &t, 0 );
+        if ( *sk->codec == FT_CODEC_AUTO )
+        {
+            sk->tried += sk->len;
+            sk->kept  += z > 0 ? z : sk->len;
+            if ( sk->tried >= SPILL_SAMPLE * SPILL_FRAME )
+                sink_decide( sk );
+        }
+    }
+    b->zoff[ b->nframes + 1 ] = b->zoff[ b->nframes ] + (z > 0 ? z : sk->len);
+    b->nframes++;
+    rc = z > 0 ? sink_write( sk, sk->z, z ) : sink_write( sk, sk->frame, sk->len );
+    sk->len = 0;
+    return rc;
+}
+
+static int sink_put( sink_t *sk, const char *p, size_t n )
+{
+    size_t m;
+
+    if ( sk->frame == (char *)0 )
+        return sink_write( sk, p, n );
+    for( ; n > 0; p += m, n -= m )
+    {
+        m = SPILL_FRAME - sk->len < n ? SPILL_FRAME - sk->len : n;
+        memcpy( sk->frame + sk->len, p, m );
+        if ( (sk->len += m) == SPILL_FRAME && sink_frame( sk ) < 0 )
+            return -1;
+    }
+    return 0;
+}
+
+/* spill a band in column order; compressed per 'codec' (NULL = as is) */
+static int spill_band( array_t *a, band_t *b, int *codec )
+{
+    ft_ctx_t *ctx = a->ctx;
+    idx_t row, col, tile_rows, tile_cols, nr, nc;
+    size_t es = a->element_size;
+    sink_t sk;
+    csum_t sum = CSUM_INIT;
+    char *tile;
+    int rc = 0;
+
+    tile_shape( ctx, a->rows, a->cols, es, &tile_rows, &tile_cols );
+    memset( (void *)&sk, 0, sizeof(sk) );
+    sk.sum   = sum;
+    sk.ctx   = ctx;
+    sk.b     = b;
+    sk.codec = codec;
+    sk.off   = b->base;
+    b->bytes   = a->rows * a->cols * es;
+    b->zoff    = (off_t *)0;
+    b->nframes = 0;
+    if ( codec && *codec != FT_CODEC_NONE &&
+         ((b->zoff = calloc( b->bytes / SPILL_FRAME + 2, sizeof(off_t) )) == (off_t *)0 ||
+          (sk.frame = malloc( SPILL_FRAME )) == (char *)0 || (sk.z = malloc( SPILL_FRAME )) == (char *)0) )
+        rc = -1;
+    if ( (tile = malloc( tile_rows * tile_cols * es )) == (char *)0 )
+        rc = -1;
+
+    /* tiles span whole columns, or rows of one column: either way they
+     * come in file order, staged for O_DIRECT
+     */
+    if ( rc == 0 && b->dfd >= 0 && posix_memalign( (void **)&sk.sg.buf, SPILL_ALIGN, SPILL_STAGE ) == 0 )
+    {
+        sk.sg.ctx = ctx;
+        sk.sg.fd  = b->dfd;
+        sk.sg.off = b->base;
+    }
+    for( col = 0; col < a->cols && rc == 0; col += tile_cols )
+    {
+        nc = (a->cols - col < tile_cols) ? a->cols - col : tile_cols;
+        for( row = 0; row < a->rows && rc == 0; row += tile_rows )
+        {
+            nr = (a->rows - row < tile_rows) ? a->rows - row : tile_rows;
+            gather_tile( a, row, col, nr, nc, tile );
+            rc = sink_put( &sk, tile, nr * nc * es );
+        }
+    }
+    if ( sk.frame && rc == 0 )
+    {
+        rc = sink_frame( &sk );
+        if ( *codec == FT_CODEC_AUTO && sk.tried > 0 )
+            sink_decide( &sk );
+    }
+    if ( sk.sg.buf && rc == 0 )
+        rc = stage_flush( &sk.sg );
+    b->sum = csum_end( &sk.sum );
+    free( (void *)sk.sg.buf );
+    free( (void *)sk.frame );
+    free( (void *)sk.z );
+    free( (void *)tile );
+    return rc;
+}
+
+static inline char *merge_head( char *o, const char *head, char delim )
+{
+    size_t len = strlen( head );
+
+    memcpy( o, head, len );
+    o[ len ] = delim;
+    return o + len + 1;
+}
+
+/* external engine checkpoint (opt.checkpoint): the spill files keep their
+ * names, and a journal lists them, then each band once it is on disk and
+ * each block of output lines once written, one synced line at a time:
+ *
+ *     ftranspose-journal 1
+ *     input 48748019 1760680000 123456789 1234567 0
+ *     options 20 9 9 0
+ *     file /tmp/ftranspose.Ab12Cd
+ *     band 0 0 3000 812345 180000000 5f0c2d0e41b7a903 lz 2747 40000 81234 ...
+ *     spilled
+ *     merged 300 1234567
+ *
+ * 'input' is the input's size, mtime, inode and start offset, 'options'
+ * the field width, delimiters and rows kept by key.  A band line gives its
+ * file (by #), base, rows, the input bytes parsed through it, its bytes
+ * before compression, the checksum of what is stored, the codec so far
+ * and its frame ends, if any; 'merged' counts output lines and bytes.
+ * opt.resume reads the journal back and carries on after the last band
+ * that matches its checksum, and the last block of output lines.
+ */
+struct journal {
+    FILE  *fp;             /* appended to                                   */
+    int    nfiles;
+    int    fd[ SCRATCH_MAX ];
+    char  *path[ SCRATCH_MAX ];
+    char   input[ 128 ], options[ 64 ];
+    int    out_seekable;   /* output lines can be taken up where they stopped */
+    off_t  out_base;
+    int    spilled;        /* every band is on disk                         */
+    idx_t  merged_cols, merged_bytes;
+};
+typedef struct journal journal_t;
+
+static void journal_band_line( FILE *fp, const journal_t *jn, const band_t *b, int codec )
+{
+    idx_t i;
+    int f;
+
+    for( f = 0; f < jn->nfiles && jn->fd[f] != b->fd; f++ )
+        ;
+    fprintf( fp, "band %d %ld %ld %ld %ld %016llx %s %ld", f, (idx_t)b->base, b->rows, b->in_end, b->bytes,
+             (unsigned long long)b->sum, codec_names[ codec ], b->zoff ? b->nframes : 0 );
+    for( i = 1; b->zoff && i <= b->nframes; i++ )
+        fprintf( fp, " %ld", (idx_t)b->zoff[i] );
+    fputc( '\n', fp );
+}
+
+/* lines are added once what they vouch for is synced, and synced too */
+static int journal_sync( ft_ctx_t *ctx, journal_t *jn )
+{
+    if ( fflush( jn->fp ) != 0 || fdatasync( fileno( jn->fp ) ) < 0 )
+        return ft_fail_errno( ctx, ctx->opt.checkpoint );
+    return 0;
+}
+
+static int journal_band( ft_ctx_t *ctx, journal_t *jn, const band_t *b, int codec )
+{
+    if ( fdatasync( b->fd ) < 0 )
+        return ft_fail_errno( ctx, "spill file" );
+    journal_band_line( jn->fp, jn, b, codec );
+    return journal_sync( ctx, jn );
+}
+
+static int journal_merged( ft_ctx_t *ctx, journal_t *jn, output_t *out, idx_t cols, idx_t bytes )
+{
+    if ( fdatasync( out->fd ) < 0 )
+        return ft_fail_errno( ctx, ctx->opt.output_name );
+    jn->merged_cols  = cols;
+    jn->merged_bytes = bytes;
+    fprintf( jn->fp, "merged %ld %ld\n", cols, bytes );
+    return journal_sync( ctx, jn );
+}
+
+/* one block of merge_bands(), read by the pool: threads claim bands, so
+ * bands striped over several devices are read from all of them at once
+ */
+typedef struct {
+    ft_ctx_t     *ctx;
+    const band_t *bands;
+    const idx_t  *first;       /* first row of each band                  */
+    int           nbands;
+    idx_t         col, nc;
+    char         *in;          /* band k's part at nc * first[k] elements */
+    spill_buf_t  *bufs;        /* per thread                              */
+    int           next;        /* next band to read                       */
+    int           slots;       /* threads so far                          */
+    int           rc;
+} merge_read_t;
+
+static void *merge_read( void *arg )
+{
+    merge_read_t *mr = (merge_read_t *)arg;
+    ft_ctx_t *ctx = mr->ctx;
+    size_t es = ctx->opt.element_size;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    int slot = __atomic_fetch_add( &mr->slots, 1, __ATOMIC_RELAXED ), k;
+    const band_t *b;
+
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    while ( (k = __atomic_fetch_add( &mr->next, 1, __ATOMIC_RELAXED )) < mr->nbands )
+    {
+        b = &mr->bands[k];
+        if ( ATOMIC_GET( mr->rc ) == 0 &&
+             spill_read( ctx, b, mr->in + mr->nc * mr->first[k] * es, mr->nc * b->rows * es,
+                         b->base + mr->col * b->rows * es, &mr->bufs[ slot ] ) < 0 )
+            ATOMIC_SET( mr->rc, -1 );
+    }
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* build every output line from the matching column segment of each band,
+ * after its header field if 'text' holds a header row; with a journal
+ * whose output can be taken up again, from the lines it has not seen
+ * written, logging each block
+ */
+static int merge_bands( ft_ctx_t *ctx, band_t *bands, int nbands, idx_t rows, idx_t cols,
+                        const text_t *text, output_t *output, journal_t *jn )
+{
+    const strpool_t *heads = text && ctx->opt.header ? &text->header : (const strpool_t *)0;
+    idx_t head0 = ctx->opt.labels ? 1 : 0, head_max = heads ? heads->longest + 1 : 0;
+    size_t es = ctx->opt.element_size;
+    idx_t col_bytes = rows * es;
+    idx_t col, nc, block_cols, r0, n, c, *first;
+    idx_t col0 = jn && jn->out_seekable ? jn->merged_cols : 0, written = col0 > 0 ? jn->merged_bytes : 0;
+    char *in = (char *)0, *out = (char *)0, *o;
+    spill_buf_t *bufs;
+    merge_read_t mr;
+    stamp_t t;
+    int k, direct = 0, framed = 0, threads = ctx_pool( ctx ), rc = 0;
+
+    ATOMIC_SET( ctx->progress.lines_total, cols );
+    ATOMIC_SET( ctx->progress.lines_out, col0 );
+    progress_stage( ctx, FT_STAGE_WRITE );
+
+    /* per thread, an aligned bounce buffer if any band is read O_DIRECT,
+     * and frame buffers if any is compressed
+     */
+    first = malloc( (nbands + 1) * sizeof(idx_t) );
+    bufs  = calloc( threads, sizeof(spill_buf_t) );
+    if ( first == (idx_t *)0 || bufs == (spill_buf_t *)0 )
+    {
+        free( (void *)first );
+        free( (void *)bufs );
+        return ft_fail( ctx, "merge: out of memory" );
+    }
+    for( k = 0, first[0] = 0; k < nbands; k++ )
+    {
+        first[ k + 1 ] = first[k] + bands[k].rows;
+        direct |= bands[k].dfd >= 0;
+        framed |= bands[k].zoff != (off_t *)0;
+    }
+    for( n = 0; n < threads && rc == 0; n++ )
+        if ( (direct && posix_memalign( (void **)&bufs[n].bounce, SPILL_ALIGN, SPILL_STAGE ) != 0) ||
+             (framed && ((bufs[n].z = malloc( SPILL_FRAME )) == (char *)0 ||
+                         (bufs[n].frame = malloc( SPILL_FRAME )) == (char *)0)) )
+            rc = ft_fail( ctx, "merge: out of memory" );
+
+    if ( col_bytes <= ctx->plan.merge_bytes )
+    {
+        /* several whole columns at a time: one read per band per block */
+        block_cols = ctx->plan.merge_bytes / col_bytes;
+        if ( block_cols > cols )
+            block_cols = cols;
+        in  = malloc( block_cols * col_bytes );
+        out = malloc( block_cols * (rows * (es + 1) + head_max) );
+        if ( in == (char *)0 || out == (char *)0 )
+            rc = ft_fail( ctx, "merge: out of memory" );
+        memset( (void *)&mr, 0, sizeof(mr) );
+        mr.ctx    = ctx;
+        mr.bands  = bands;
+        mr.first  = first;
+        mr.nbands = nbands;
+        mr.in     = in;
+        mr.bufs   = bufs;
+        for( col = col0; col < cols && rc == 0; col += nc )
+        {
+            char *seg = in;
+
+            nc = (cols - col < block_cols) ? cols - col : block_cols;
+            mr.col   = col;
+            mr.nc    = nc;
+            mr.next  = mr.slots = 0;
+            if ( nbands > 1 && threads > 1 )
+                ctx_run( ctx, merge_read, &mr );
+            else
+                merge_read( &mr );
+            if ( mr.rc < 0 )
+            {
+                rc = ft_fail_errno( ctx, "spill file" );
+                break;
+            }
+
+            phase_begin( ctx, &t );
+            o = out;
+            for( c = 0; c < nc; c++ )
+            {
+                if ( heads )
+                    o = merge_head( o, strpool_str( heads, head0 + col + c ), ctx->opt.out_delim );
+                seg = in;
+                for( k = 0; k < nbands; k++ )
+                {
+                    o = format_fields( o, &seg[ c * bands[k].rows * es ], bands[k].rows, es,
+                                       ctx->opt.out_delim, k == nbands - 1 );
+                    seg += nc * bands[k].rows * es;
+                }
+            }
+            phase_end( ctx, FT_PHASE_FORMAT, &t, o - out );
+            rc = write_block( ctx, output, out, o - out );
+            written += o - out;
+            if ( rc == 0 && jn && jn->out_seekable )
+                rc = journal_merged( ctx, jn, output, col + nc, written );
+
+            ATOMIC_SET( ctx->progress.lines_out, col + nc );
+            ATOMIC_SET( ctx->progress.bytes_out, ctx->stats.phase[ FT_PHASE_WRITE ].bytes );
+        }
+    }
+    else
+    {
+        /* one column is bigger than the merge buffer: stream it in chunks */
+        idx_t chunk_rows = ctx->plan.merge_bytes / es;
+
+        if ( chunk_rows < 1 )
+            chunk_rows = 1;
+        in  = malloc( chunk_rows * es );
+        out = malloc( chunk_rows * (es + 1) + head_max );
+        if ( in == (char *)0 || out == (char *)0 )
+            rc = ft_fail( ctx, "merge: out of memory" );
+        for( col = col0; col < cols && rc == 0; col++ )
+        {
+            for( k = 0; k < nbands && rc == 0; k++ )
+            {
+                for( r0 = 0; r0 < bands[k].rows && rc == 0; r0 += n )
+                {
+                    n = (bands[k].rows - r0 < chunk_rows) ? bands[k].rows - r0 : chunk_rows;
+                    if ( spill_read( ctx, &bands[k], in, n * es, bands[k].base + (col * bands[k].rows + r0) * es,
+                                     &bufs[0] ) < 0 )
+                    {
+                        rc = ft_fail_errno( ctx, "spill file" );
+                        break;
+                    }
+                    phase_begin( ctx, &t );
+                    o = out;
+                    if ( heads && k == 0 && r0 == 0 )
+                        o = merge_head( o, strpool_str( heads, head0 + col ), ctx->opt.out_delim );
+                    o = format_fields( o, in, n, es, ctx->opt.out_delim,
+                                       k == nbands - 1 && r0 + n == bands[k].rows );
+                    phase_end( ctx, FT_PHASE_FORMAT, &t, o - out );
+                    rc = write_block( ctx, output, out, o - out );
+                    written += o - out;
+                }
+            }
+            if ( rc == 0 && jn && jn->out_seekable )
+                rc = journal_merged( ctx, jn, output, col + 1, written );
+            ATOMIC_SET( ctx->progress.lines_out, col + 1 );
+            ATOMIC_SET( ctx->progress.bytes_out, ctx->stats.phase[ FT_PHASE_WRITE ].bytes );
+        }
+    }
+    for( n = 0; n < threads; n++ )
+    {
+        free( (void *)bufs[n].bounce );
+        free( (void *)bufs[n].z );
+        free( (void *)bufs[n].frame );
+    }
+    free( (void *)bufs );
+    free( (void *)first );
+    free( (void *)in );
+    free( (void *)out );
+    return rc;
+}
+
+/* parse 'in' a band of ctx->plan.band_rows rows at a time (sized from the
+ * first row if 0, or like the bands already in 'sp' when resuming) and
+ * spill each band column-major where sp->place() says; sp->loaded, if
+ * set, is spilled first and its parser goes on from where it stopped
+ */
+static int spill_input( ft_ctx_t *ctx, input_t *in, spill_t *sp )
+{
+    parser_t ps;
+    array_t *a = sp->loaded;
+    band_t *grown, *b;
+    idx_t band_rows = sp->nbands > 0 ? sp->bands[0].rows : ctx->plan.band_rows;
+    int more = 1, rc = 0;
+
+    if ( a == (array_t *)0 && (a = ctx_array( ctx )) == (array_t *)0 )
+        return ft_fail( ctx, "%s: out of memory", in->name );
+    if ( sp->loaded )
+        ps = *sp->ps;
+    else
+        parser_init( &ps, ctx->opt.in_delim, ctx->opt.element_size, 0, ALL_COLUMNS, ctx->keep, &ctx->text,
+                     ctx_text_flags( ctx ) );
+    progress_stage( ctx, FT_STAGE_READ );
+
+    while ( more > 0 )
+    {
+        /* the rows the memory engine holds are parsed already */
+        if ( a->full )
+            a->full = 0;
+        else
+        {
+            reset_array( a );
+            ps.row0 = sp->rows;
+
+            /* without a prescan, size the bands from the first row */
+            if ( band_rows == 0 )
+            {
+                if ( (more = parse_rows( ctx, in, &ps, a, 1 )) < 0 )
+                    break;
+                band_rows = ctx->plan.band_bytes / ((a->cols > 0 ? a->cols : 1) * ctx->opt.element_size);
+                if ( band_rows < 1 )
+                    band_rows = 1;
+            }
+            reserve_elements( a, band_rows * (sp->cols > 0 ? sp->cols : (a->cols > 0 ? a->cols : 1)) );
+            if ( more > 0 && (more = parse_rows( ctx, in, &ps, a, band_rows )) < 0 )
+                break;
+        }
+        if ( a->rows == 0 )
+            break;
+
+        if ( a->element_count != a->rows * a->cols || (sp->cols >= 0 && a->cols != sp->cols) )
+        {
+            rc = ft_fail( ctx, "%s: rows %ld-%ld do not all have %ld columns", in->name,
+                          sp->rows, sp->rows + a->rows - 1, sp->cols >= 0 ? sp->cols : a->cols );
+            break;
+        }
+        sp->cols = a->cols;
+
+        if ( sp->nbands == sp->max_bands )
+        {
+            sp->max_bands = sp->max_bands ? 2 * sp->max_bands : 16;
+            if ( (grown = realloc( sp->bands, sp->max_bands * sizeof(band_t) )) == (band_t *)0 )
+            {
+                rc = ft_fail( ctx, "%s: out of memory", in->name );
+                break;
+            }
+            sp->bands = grown;
+        }
+        b = &sp->bands[ sp->nbands ];
+        b->rows = a->rows;
+        if ( sp->place( ctx, sp->user, b, a->rows * a->cols * ctx->opt.element_size ) < 0 )
+        {
+            rc = -1;
+            break;
+        }
+        sp->nbands++;
+        if ( ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "spilling band %d: rows %ld-%ld\n", sp->nbands - 1, sp->rows, sp->rows + a->rows - 1 );
+        if ( spill_band( a, b, sp->codec ) < 0 )
+        {
+            rc = ft_fail_errno( ctx, "spill file" );
+            break;
+        }
+        b->in_end = in->consumed;
+        if ( sp->journal && (rc = journal_band( ctx, sp->journal, b, *sp->codec )) < 0 )
+            break;
+        if ( sp->done && (rc = sp->done( ctx, sp->user, b )) < 0 )
+            break;
+        sp->rows += a->rows;
+
+        /* the memory engine's buffer is given back for bands of band_rows */
+        if ( a->limit > 0 )
+        {
+            free( (void *)a->data );
+            a->data = (char *)0;
+            a->element_capacity = a->bytes_allocated = a->pos = 0;
+        }
+    }
+    if ( more < 0 )
+        rc = -1;
+
+    ctx->stats.matrix_bytes = a->bytes_allocated;
+    ctx_release( ctx, a );
+    parser_free( &ps );
+    return rc;
+}
+
+/* the external engine's bands go round robin over one temp file per
+ * scratch directory, one after the other in each; at block boundaries
+ * where the file is open O_DIRECT
+ */
+typedef struct {
+    int   n;
+    int   turn;
+    struct {
+        int   fd, dfd;
+        off_t next;        /* where the next band starts                    */
+    }     file[ SCRATCH_MAX ];
+} spill_file_t;
+
+static int spill_place( ft_ctx_t *ctx, void *user, band_t *b, idx_t bytes )
+{
+    spill_file_t *sf = (spill_file_t *)user;
+    int i = sf->turn++ % sf->n;
+
+    (void)ctx;
+    b->fd   = sf->file[i].fd;
+    b->dfd  = sf->file[i].dfd;
+    b->base = sf->file[i].next;
+    if ( b->dfd >= 0 )
+        b->base = (b->base + SPILL_ALIGN - 1) & ~(off_t)(SPILL_ALIGN - 1);
+    sf->file[i].next = b->base + bytes;
+    return 0;
+}
+
+/* a checkpoint has to find its place in the input again */
+static const char *journal_unfit( ft_ctx_t *ctx, const input_t *in )
+{
+    if ( in->rd || !in->seekable || in->end > 0 )
+        return "the input is not a regular file";
+    if ( ctx->opt.header || ctx->opt.labels )
+        return "--header and --labels are only kept in memory";
+    return (const char *)0;
+}
+
+/* is band 'b' still what was spilled? */
+static int journal_check( ft_ctx_t *ctx, const band_t *b, char *buf )
+{
+    csum_t sum = CSUM_INIT;
+    idx_t left = b->zoff ? b->zoff[ b->nframes ] : b->bytes, n;
+    off_t off = b->base;
+
+    for( ; left > 0; left -= n, off += n )
+    {
+        n = left < SPILL_STAGE ? left : SPILL_STAGE;
+        if ( read_at( ctx, b->fd, buf, n, off, FT_PHASE_SPILL_READ ) != n )
+            return -1;
+        csum_add( &sum, buf, n );
+    }
+    return csum_end( &sum ) == b->sum ? 0 : -1;
+}
+
+/* add a band line's band to 'sp' if it is whole and still on disk */
+static int journal_take( ft_ctx_t *ctx, journal_t *jn, spill_t *sp, const char *line, int *codec, char *buf )
+{
+    idx_t es = ctx->opt.element_size;
+    char name[ 16 ], *p, *end;
+    unsigned long long sum;
+    idx_t base, i;
+    band_t b, *grown;
+    int f, n, c;
+
+    memset( (void *)&b, 0, sizeof(b) );
+    if ( sscanf( line, "band %d %ld %ld %ld %ld %llx %15s %ld%n", &f, &base, &b.rows, &b.in_end, &b.bytes, &sum,
+                 name, &b.nframes, &n ) != 8 || f < 0 || f >= jn->nfiles || jn->fd[f] < 0 || base < 0 || b.rows < 1 ||
+         b.bytes < 1 || b.bytes % (b.rows * es) != 0 || b.nframes < 0 ||
+         (sp->cols >= 0 && b.bytes / (b.rows * es) != sp->cols) )
+        return -1;
+    for( c = 0; c < FT_N_CODECS && strcmp( name, codec_names[c] ) != 0; c++ )
+        ;
+    if ( c == FT_N_CODECS )
+        return -1;
+    if ( b.nframes > 0 )
+    {
+        if ( b.nframes != (b.bytes + SPILL_FRAME - 1) / SPILL_FRAME ||
+             (b.zoff = calloc( b.nframes + 1, sizeof(off_t) )) == (off_t *)0 )
+            return -1;
+        for( p = (char *)line + n, i = 1; i <= b.nframes; i++, p = end )
+            if ( (b.zoff[i] = strtol( p, &end, 10 )) <= b.zoff[ i - 1 ] || end == p )
+                break;
+    }
+    b.fd   = jn->fd[f];
+    b.dfd  = -1;
+    b.base = base;
+    b.sum  = sum;
+    if ( (b.nframes > 0 && i <= b.nframes) || journal_check( ctx, &b, buf ) < 0 )
+    {
+        free( (void *)b.zoff );
+        return -1;
+    }
+
+    if ( sp->nbands == sp->max_bands )
+    {
+        sp->max_bands = sp->max_bands ? 2 * sp->max_bands : 16;
+        if ( (grown = realloc( sp->bands, sp->max_bands * sizeof(band_t) )) == (band_t *)0 )
+        {
+            free( (void *)b.zoff );
+            return ft_fail( ctx, "%s: out of memory", ctx->opt.checkpoint );
+        }
+        sp->bands = grown;
+    }
+    sp->bands[ sp->nbands++ ] = b;
+    sp->rows += b.rows;
+    sp->cols  = b.bytes / (b.rows * es);
+    *codec = c;
+    return 0;
+}
+
+/* read a journal back: reopen its files (made anew, empty, if they are
+ * gone) and take its bands up to the first that does not check out.
+ * Returns 1 if it is for this input and these options, 0 if there is no
+ * journal or it is not (any files it lists are then in 'jn', to be
+ * removed), -1 on errors.
+ */
+static int journal_load( ft_ctx_t *ctx, journal_t *jn, spill_t *sp, int *codec )
+{
+    const char *path = ctx->opt.checkpoint;
+    char *line = (char *)0, *buf = (char *)0;
+    size_t cap = 0;
+    ssize_t len;
+    idx_t cols, bytes;
+    FILE *fp;
+    int good = 1, same = 1, rc = 0;
+
+    if ( (fp = fopen( path, "r" )) == (FILE *)0 )
+        return errno == ENOENT ? 0 : ft_fail_errno( ctx, path );
+    if ( (len = getline( &line, &cap, fp )) < 0 || strcmp( line, JOURNAL_MAGIC "\n" ) != 0 )
+        rc = ft_fail( ctx, "%s: not an ftranspose journal", path );
+    else if ( (buf = malloc( SPILL_STAGE )) == (char *)0 )
+        rc = ft_fail( ctx, "%s: out of memory", path );
+
+    /* a line cut short by a crash ends it */
+    while ( rc == 0 && (len = getline( &line, &cap, fp )) > 0 && line[ len - 1 ] == '\n' )
+    {
+        line[ len - 1 ] = '\0';
+        if ( strncmp( line, "input ", 6 ) == 0 )
+            same &= strcmp( line, jn->input ) == 0;
+        else if ( strncmp( line, "options ", 8 ) == 0 )
+            same &= strcmp( line, jn->options ) == 0;
+        else if ( strncmp( line, "file ", 5 ) == 0 && jn->nfiles < SCRATCH_MAX )
+        {
+            jn->fd[ jn->nfiles ] = -1;
+            if ( (jn->path[ jn->nfiles ] = strdup( line + 5 )) == (char *)0 )
+                rc = ft_fail( ctx, "%s: out of memory", path );
+            else if ( same && ctx->opt.resume && (jn->fd[ jn->nfiles ] = open( line + 5, O_RDWR | O_CREAT | O_CLOEXEC, 0600 )) < 0 )
+                rc = ft_fail_errno( ctx, line + 5 );
+            jn->nfiles++;
+        }
+        else if ( strncmp( line, "band ", 5 ) == 0 )
+        {
+            if ( !same || !good || !ctx->opt.resume )
+                continue;
+            good = journal_take( ctx, jn, sp, line, codec, buf ) == 0;
+            if ( !good )
+                ft_warn( ctx, "warning: checkpoint band %d is not as journaled; spilling again from there\n",
+                         sp->nbands );
+        }
+        else if ( strcmp( line, "spilled" ) == 0 )
+            jn->spilled = good;
+        else if ( sscanf( line, "merged %ld %ld", &cols, &bytes ) == 2 )
+        {
+            if ( good && jn->spilled )
+            {
+                jn->merged_cols  = cols;
+                jn->merged_bytes = bytes;
+            }
+        }
+        else
+            rc = ft_fail( ctx, "%s: bad line: %s", path, line );
+    }
+    fclose( fp );
+    free( (void *)line );
+    free( (void *)buf );
+    return rc < 0 ? -1 : same;
+}
+
+/* write the journal anew from what 'jn' and 'sp' hold, in place of the
+ * old by rename(), and open it to append to
+ */
+static int journal_write( ft_ctx_t *ctx, journal_t *jn, const spill_t *sp, int codec )
+{
+    const char *path = ctx->opt.checkpoint;
+    char tmp[ ARG_STR_LEN + 8 ];
+    FILE *fp;
+    int i, rc = 0;
+
+    snprintf( tmp, sizeof(tmp), "%s.new", path );
+    if ( (fp = fopen( tmp, "w" )) == (FILE *)0 )
+        return ft_fail_errno( ctx, tmp );
+    fprintf( fp, JOURNAL_MAGIC "\n%s\n%s\n", jn->input, jn->options );
+    for( i = 0; i < jn->nfiles; i++ )
+        fprintf( fp, "file %s\n", jn->path[i] );
+    for( i = 0; i < sp->nbands; i++ )
+        journal_band_line( fp, jn, &sp->bands[i], codec );
+    if ( jn->spilled )
+        fprintf( fp, "spilled\n" );
+    if ( jn->merged_cols > 0 )
+        fprintf( fp, "merged %ld %ld\n", jn->merged_cols, jn->merged_bytes );
+    if ( fflush( fp ) != 0 || fsync( fileno( fp ) ) < 0 )
+        rc = ft_fail_errno( ctx, tmp );
+    if ( fclose( fp ) != 0 && rc == 0 )
+        rc = ft_fail_errno( ctx, tmp );
+    if ( rc == 0 && rename( tmp, path ) < 0 )
+        rc = ft_fail_errno( ctx, path );
+    if ( rc == 0 && (jn->fp = fopen( path, "a" )) == (FILE *)0 )
+        rc = ft_fail_errno( ctx, path );
+    return rc;
+}
+
+/* forget the files a journal lists, removing them if 'unlink_files' */
+static void journal_files_free( journal_t *jn, int unlink_files )
+{
+    int i;
+
+    for( i = 0; i < jn->nfiles; i++ )
+    {
+        if ( unlink_files )
+            unlink( jn->path[i] );
+        free( (void *)jn->path[i] );
+    }
+    jn->nfiles = 0;
+}
+
+/* start the checkpoint of a transpose: with opt.resume, take up the run
+ * journaled for this input, if any; otherwise remove what a journal
+ * lists and start one with new named spill files.  The files go to 'sf',
+ * and the input is moved past the bands already spilled.
+ */
+static int journal_open( ft_ctx_t *ctx, journal_t *jn, input_t *in, output_t *out, spill_file_t *sf,
+                         spill_t *sp, int *codec )
+{
+    char path[ SPILL_PATH_LEN ];
+    struct stat st;
+    const band_t *b;
+    idx_t in_off = 0;
+    int i, f, fd, dfd, same;
+
+    if ( fstat( in->fd, &st ) < 0 )
+        return ft_fail_errno( ctx, in->name );
+    snprintf( jn->input, sizeof(jn->input), "input %ld %ld %ld %ld %ld", (idx_t)st.st_size,
+              (idx_t)st.st_mtim.tv_sec, (idx_t)st.st_mtim.tv_nsec, (idx_t)st.st_ino, (idx_t)in->base );
+    snprintf( jn->options, sizeof(jn->options), "options %d %d %d %ld", ctx->opt.element_size,
+              ctx->opt.in_delim, ctx->opt.out_delim, ctx->keep ? (idx_t)ctx->keep->count : 0 );
+    jn->out_seekable = !out->wr && fstat( out->fd, &st ) == 0 && S_ISREG( st.st_mode ) &&
+                       (jn->out_base = lseek( out->fd, 0, SEEK_CUR )) >= 0;
+
+    if ( (same = journal_load( ctx, jn, sp, codec )) < 0 )
+        return -1;
+    if ( same && ctx->opt.resume )
+    {
+        /* the files take the next bands where the journaled ones end */
+        for( sf->n = 0; sf->n < jn->nfiles; sf->n++ )
+        {
+            sf->file[ sf->n ].fd  = jn->fd[ sf->n ];
+            sf->file[ sf->n ].dfd = spill_direct( ctx, jn->path[ sf->n ] );
+        }
+        for( i = 0; i < sp->nbands; i++ )
+        {
+            b = &sp->bands[i];
+            for( f = 0; jn->fd[f] != b->fd; f++ )
+                ;
+            sp->bands[i].dfd = sf->file[f].dfd;
+            if ( sf->file[f].next < b->base + b->bytes )
+                sf->file[f].next = b->base + b->bytes;
+            in_off = b->in_end;
+        }
+        sf->turn = sp->nbands;
+        if ( in_off > 0 && lseek( in->fd, in->base + in_off, SEEK_SET ) != in->base + in_off )
+            return ft_fail_errno( ctx, in->name );
+        in->pos = in->len = 0;
+        in->consumed = in_off;
+        if ( ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "checkpoint: resuming after %d bands (%ld rows) and %ld output lines\n",
+                    sp->nbands, sp->rows, jn->out_seekable ? jn->merged_cols : 0 );
+    }
+    else
+    {
+        if ( same == 0 && ctx->opt.resume && jn->nfiles > 0 )
+            ft_warn( ctx, "warning: %s is for another input or other options; starting over\n",
+                     ctx->opt.checkpoint );
+        for( i = 0; i < jn->nfiles; i++ )
+            if ( jn->fd[i] >= 0 )
+                close( jn->fd[i] );
+        for( i = 0; i < sp->nbands; i++ )
+            free( (void *)sp->bands[i].zoff );
+        journal_files_free( jn, 1 );
+        sp->nbands = 0;
+        sp->rows   = 0;
+        sp->cols   = -1;
+        *codec     = ctx->opt.spill_codec;
+        jn->spilled = 0;
+        jn->merged_cols = jn->merged_bytes = 0;
+
+        /* recorded as absolute paths, for a --resume from another directory */
+        for( sf->n = 0; sf->n < ctx->nscratch; sf->n++ )
+        {
+            if ( (fd = spill_open( ctx, &dfd, path )) >= 0 && (jn->path[ sf->n ] = realpath( path, (char *)0 )) == (char *)0 )
+            {
+                close( fd );
+                if ( dfd >= 0 )
+                    close( dfd );
+                unlink( path );
+                fd = ft_fail_errno( ctx, path );
+            }
+            if ( fd < 0 )
+            {
+                journal_files_free( jn, 1 );
+                return -1;
+            }
+            sf->file[ sf->n ].fd  = jn->fd[ sf->n ] = fd;
+            sf->file[ sf->n ].dfd = dfd;
+            jn->nfiles++;
+        }
+        if ( journal_write( ctx, jn, sp, *codec ) < 0 )
+        {
+            journal_files_free( jn, 1 );
+            return -1;
+        }
+        return 0;
+    }
+    return journal_write( ctx, jn, sp, *codec );
+}
+
+/* opt.resume opens the output as it was, for the journal to cut back; a
+ * run that takes up no journal starts it over from where it is positioned
+ */
+static int output_restart( ft_ctx_t *ctx, output_t *out )
+{
+    struct stat st;
+    off_t at;
+
+    if ( !ctx->opt.resume || out->wr || fstat( out->fd, &st ) < 0 || !S_ISREG( st.st_mode ) )
+        return 0;
+    if ( (at = lseek( out->fd, 0, SEEK_CUR )) < 0 || ftruncate( out->fd, at ) < 0 )
+        return ft_fail_errno( ctx, ctx->opt.output_name );
+    return 0;
+}
+
+/* done with the checkpoint: once the output is whole, nothing is kept */
+static void journal_close( journal_t *jn, const char *path, int done )
+{
+    if ( jn->fp )
+        fclose( jn->fp );
+    jn->fp = (FILE *)0;
+    if ( done )
+        unlink( path );
+    journal_files_free( jn, done );
+}
+
+/* external engine; 'loaded', if not NULL, is the memory engine's array
+ * that outgrew its limit, spilled as the first band before 'ps' parses on
+ */
+static int run_external( ft_ctx_t *ctx, input_t *in, output_t *out, array_t *loaded, parser_t *ps )
+{
+    spill_t sp;
+    spill_file_t sf;
+    journal_t jn;
+    const char *why = (const char *)0;
+    int i, codec = ctx->opt.spill_codec, rc = 0;
+
+    memset( (void *)&sf, 0, sizeof(sf) );
+    memset( (void *)&sp, 0, sizeof(sp) );
+    memset( (void *)&jn, 0, sizeof(jn) );
+    sp.cols  = -1;
+    sp.place = spill_place;
+    sp.user  = &sf;
+    sp.codec = &codec;
+    sp.loaded = loaded;
+    sp.ps = ps;
+
+    /* memory ran out short of the limit: the bands and the merge buffer
+     * share what the array did get, as they would a budget
+     */
+    if ( loaded && loaded->bytes_allocated < loaded->limit )
+    {
+        ctx->plan.band_bytes  = loaded->bytes_allocated / 2;
+        ctx->plan.merge_bytes = loaded->bytes_allocated / 4 > ctx->tune.tile_bytes ? loaded->bytes_allocated / 4 :
+                                ctx->tune.tile_bytes;
+        ctx->plan.band_rows   = ctx->plan.band_bytes / (loaded->cols > 0 ? loaded->cols * loaded->element_size : 1);
+        if ( ctx->plan.band_rows < 1 )
+            ctx->plan.band_rows = 1;
+    }
+
+    if ( ctx->opt.checkpoint &&
+         (why = loaded ? "the memory engine has parsed the first rows" : journal_unfit( ctx, in )) != (const char *)0 )
+        ft_warn( ctx, "warning: no checkpoint: %s\n", why );
+    if ( ctx->opt.checkpoint && why == (const char *)0 )
+    {
+        rc = journal_open( ctx, &jn, in, out, &sf, &sp, &codec );
+        sp.journal = &jn;
+    }
+    else
+    {
+        rc = output_restart( ctx, out );
+        for( sf.n = 0; rc == 0 && sf.n < ctx->nscratch; sf.n++ )
+            if ( (sf.file[ sf.n ].fd = spill_open( ctx, &sf.file[ sf.n ].dfd, (char *)0 )) < 0 )
+            {
+                rc = -1;
+                break;
+            }
+    }
+    if ( rc == 0 && ctx->opt.verbosity >= 1 && sf.n > 1 )
+        ft_log( ctx, "striping bands over %d scratch directories\n", sf.n );
+
+    if ( rc == 0 && !jn.spilled )
+    {
+        rc = spill_input( ctx, in, &sp );
+        if ( rc == 0 && jn.fp )
+        {
+            jn.spilled = 1;
+            fprintf( jn.fp, "spilled\n" );
+            rc = journal_sync( ctx, &jn );
+        }
+    }
+    ctx->stats.bands = sp.nbands;
+    ctx->stats.rows = sp.rows;
+    ctx->stats.cols = sp.cols > 0 ? sp.cols : 0;
+    ctx->stats.elements = ctx->stats.rows * ctx->stats.cols;
+    ctx->stats.spill_codec = codec_names[ codec ];
+    for( i = 0; i < sp.nbands; i++ )
+        ctx->stats.spill_raw += sp.bands[i].bytes;
+
+    /* the output is cut back to the last block of lines journaled */
+    if ( rc == 0 && jn.fp && jn.out_seekable &&
+         (ftruncate( out->fd, jn.out_base + jn.merged_bytes ) < 0 ||
+          lseek( out->fd, jn.out_base + jn.merged_bytes, SEEK_SET ) < 0) )
+        rc = ft_fail_errno( ctx, ctx->opt.output_name );
+    if ( rc == 0 && sp.nbands > 0 )
+    {
+        if ( ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "merging %d bands ... ", sp.nbands );
+        if ( (rc = emit_labels( ctx, out, (const char *)0 )) == 0 &&
+             (rc = merge_bands( ctx, sp.bands, sp.nbands, sp.rows, sp.cols, ctx_text( ctx ), out,
+                                jn.fp ? &jn : (journal_t *)0 )) == 0 &&
+             ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "DONE\n" );
+    }
+    for( i = 0; i < sf.n; i++ )
+    {
+        close( sf.file[i].fd );
+        if ( sf.file[i].dfd >= 0 )
+            close( sf.file[i].dfd );
+    }
+    if ( ctx->opt.checkpoint && why == (const char *)0 )
+        journal_close( &jn, ctx->opt.checkpoint, rc == 0 );
+    for( i = 0; i < sp.nbands; i++ )
+        free( (void *)sp.bands[i].zoff );
+    free( (void *)sp.bands );
+    return rc;
+}
+
+/* cursor engine: one read cursor per input row, all advanced in lockstep
+ * so that each output line takes the next field of every row
+ */
+typedef struct {
+    off_t  off;            /* file offset of the next byte to buffer        */
+    off_t  end;            /* file offset just past the row                 */
+    char  *buf;
+    int    pos, len;
+    int    done;           /* no fields left in the row                     */
+} cursor_t;
+
+/* find where every row of a regular file starts; (*starts)[rows] is the
+ * end of the input.  Returns the # of rows, or -1 on errors.
+ */
+static idx_t scan_rows( ft_ctx_t *ctx, input_t *in, off_t **starts )
+{
+    idx_t n = 0, cap = 1024;
+    off_t *s = malloc( cap * sizeof(off_t) ), *grown, off = in->base;
+    const char *p, *nl, *end;
+    int last = '\n';
+    ssize_t got;
+    stamp_t t;
+
+    if ( s == (off_t *)0 )
+        return ft_fail( ctx, "%s: out of memory", in->name );
+    s[ n++ ] = off;
+    while ( (got = read_block( ctx, in, in->buf, ctx->tune.io_block )) > 0 )
+    {
+        phase_begin( ctx, &t );
+        for( p = in->buf, end = in->buf + got; (nl = memchr( p, '\n', end - p )) != (char *)0; p = nl + 1 )
+        {
+            if ( n == cap )
+            {
+                if ( (grown = realloc( s, (cap * 2) * sizeof(off_t) )) == (off_t *)0 )
+                {
+                    free( (void *)s );
+                    return ft_fail( ctx, "%s: out of memory", in->name );
+                }
+                s = grown;
+                cap *= 2;
+            }
+            s[ n++ ] = off + (nl - in->buf) + 1;
+        }
+        last = (unsigned char)in->buf[ got - 1 ];
+        off += got;
+        phase_end( ctx, FT_PHASE_PARSE, &t, got );
+        ATOMIC_SET( ctx->progress.bytes_in, (int64_t)(off - in->base) );
+        ATOMIC_SET( ctx->progress.rows_in, n - 1 );
+    }
+    if ( got < 0 )
+    {
+        free( (void *)s );
+        return ft_fail_errno( ctx, in->name );
+    }
+
+    /* a final row without a newline ends at EOF */
+    if ( last != '\n' )
+    {
+        if ( n == cap && (s = realloc( s, (cap + 1) * sizeof(off_t) )) == (off_t *)0 )
+            return ft_fail( ctx, "%s: out of memory", in->name );
+        s[ n++ ] = off;
+    }
+    *starts = s;
+    return n - 1;
+}
+
+static int cursor_fill( ft_ctx_t *ctx, cursor_t *cu, int fd, size_t size )
+{
+    ssize_t n;
+
+    if ( (off_t)size > cu->end - cu->off )
+        size = cu->end - cu->off;
+    if ( size == 0 )
+        return 0;
+    while ( (n = pread( fd, cu->buf, size, cu->off )) < 0 && errno == EINTR )
+        ;
+    if ( n <= 0 )
+        return -1;
+    cu->off += n;
+    cu->pos = 0;
+    cu->len = n;
+    ctx->stats.phase[ FT_PHASE_READ ].bytes += n;
+    return 1;
+}
+
+/* copy the next non-empty field of a cursor's row to 'dst' the way the
+ * parser would store and print it; returns the # of chars to print, or
+ * -1 once the row has no fields left
+ */
+static int cursor_field( ft_ctx_t *ctx, cursor_t *cu, int fd, size_t bufsize, char *dst, int es,
+                         char delim, idx_t row, idx_t col )
+{
+    int i = 0, skip = 0, c;
+
+    if ( cu->done )
+        return -1;
+    while ( 1 )
+    {
+        if ( cu->pos == cu->len && cursor_fill( ctx, cu, fd, bufsize ) <= 0 )
+            c = '\n';
+        else
+            c = (unsigned char)cu->buf[ cu->pos++ ];
+
+        if ( (c == delim) || (c == '\n') )
+        {
+            if ( c == '\n' )
+                cu->done = 1;
+            if ( i > 0 )
+                return i;
+            if ( cu->done )
+                return -1;
+        }
+        else if ( skip )
+            continue;
+        else if ( i >= es )
+        {
+            ft_warn( ctx, "element @[%ld,%ld] size exceeded\n", row, col );
+            i = es - 1;
+            skip = 1;
+        }
+        else dst[ i++ ] = c;
+    }
+}
+
+static int run_cursor( ft_ctx_t *ctx, input_t *in, output_t *output )
+{
+    off_t *starts = (off_t *)0;
+    cursor_t *cu;
+    char *bufs, *out, *o, *line;
+    size_t es = ctx->opt.element_size, bufsize = ctx->plan.cursor_buf;
+    idx_t rows, r, col;
+    stamp_t t;
+    int len, any, rc = 0;
+
+    progress_stage( ctx, FT_STAGE_READ );
+    if ( (rows = scan_rows( ctx, in, &starts )) < 0 )
+        return -1;
+
+    cu   = calloc( rows > 0 ? rows : 1, sizeof(cursor_t) );
+    bufs = malloc( (rows > 0 ? rows : 1) * bufsize );
+    out  = malloc( ctx->tune.io_block + rows * (es + 1) );
+    if ( cu == (cursor_t *)0 || bufs == (char *)0 || out == (char *)0 )
+    {
+        rc = ft_fail( ctx, "cursor engine: out of memory for %ld cursors", rows );
+        rows = 0;
+    }
+    for( r = 0; r < rows; r++ )
+    {
+        cu[r].off = starts[r];
+        cu[r].end = starts[ r + 1 ];
+        cu[r].buf = bufs + r * bufsize;
+    }
+    ctx->stats.matrix_bytes = rows * (bufsize + sizeof(cursor_t) + sizeof(off_t));
+
+    ATOMIC_SET( ctx->progress.lines_total, ctx->plan.cols );
+    progress_stage( ctx, FT_STAGE_WRITE );
+    o = out;
+    phase_begin( ctx, &t );
+    for( col = 0; rows > 0; col++ )
+    {
+        line = o;
+        any = 0;
+        for( r = 0; r < rows; r++ )
+        {
+            if ( (len = cursor_field( ctx, &cu[r], in->fd, bufsize, o, es, ctx->opt.in_delim, r, col )) > 0 )
+            {
+                o += len;
+                any = 1;
+                ctx->stats.elements++;
+            }
+            *o++ = ctx->opt.out_delim;
+        }
+        if ( !any )
+        {
+            o = line;
+            break;
+        }
+        o[-1] = '\n';
+
+        if ( o - out >= ctx->tune.io_block )
+        {
+            phase_end( ctx, FT_PHASE_TRANSPOSE, &t, o - out );
+            if ( (rc = write_block( ctx, output, out, o - out )) < 0 )
+                break;
+            o = out;
+            ATOMIC_SET( ctx->progress.lines_out, col + 1 );
+            ATOMIC_SET( ctx->progress.bytes_out, ctx->stats.phase[ FT_PHASE_WRITE ].bytes );
+            phase_begin( ctx, &t );
+        }
+    }
+    if ( rc == 0 )
+    {
+        phase_end( ctx, FT_PHASE_TRANSPOSE, &t, o - out );
+        rc = write_block( ctx, output, out, o - out );
+    }
+
+    ctx->stats.rows = rows;
+    ctx->stats.cols = col;
+    free( (void *)cu );
+    free( (void *)bufs );
+    free( (void *)out );
+    free( (void *)starts );
+    return rc;
+}
+
+static char *format_bytes( char *s, size_t size, double bytes )
+{
+    const char *units[] = { "B", "KB", "MB", "GB", "TB", "PB" };
+    int u = 0;
+
+    while ( bytes >= 1024.0 && u < 5 )
+    {
+        bytes /= 1024.0;
+        u++;
+    }
+    snprintf( s, size, u ? "%.1f %s" : "%.0f %s", bytes, units[u] );
+    return s;
+}
+
+/* first number in a small text file, -1 if missing or "max" */
+static idx_t read_number( const char *path )
+{
+    char line[ 64 ];
+    FILE *fp;
+    idx_t v = -1;
+
+    if ( (fp = fopen( path, "r" )) == (FILE *)0 )
+        return -1;
+    if ( fgets( line, sizeof(line), fp ) && line[0] >= '0' && line[0] <= '9' )
+        v = strtoll( line, (char **)0, 10 );
+    fclose( fp );
+    return v;
+}
+
+/* MemAvailable from /proc/meminfo, -1 if unknown */
+static idx_t mem_available( void )
+{
+    char line[ 256 ];
+    FILE *fp;
+    idx_t kb = -1;
+
+    if ( (fp = fopen( "/proc/meminfo", "r" )) == (FILE *)0 )
+        return -1;
+    while ( fgets( line, sizeof(line), fp ) )
+        if ( sscanf( line, "MemAvailable: %ld kB", &kb ) == 1 )
+            break;
+    fclose( fp );
+    return kb < 0 ? -1 : kb * 1024;
+}
+
+/* memory left under this process's cgroup limit (v2, then v1), -1 if
+ * there is no limit
+ */
+static idx_t cgroup_memory_free( void )
+{
+    char line[ ARG_STR_LEN ], path[ 2 * ARG_STR_LEN ];
+    idx_t limit = -1, usage = 0;
+    FILE *fp;
+
+    if ( (fp = fopen( "/proc/self/cgroup", "r" )) != (FILE *)0 )
+    {
+        while ( fgets( line, sizeof(line), fp ) )
+        {
+            line[ strcspn( line, "\n" ) ] = '\0';
+            if ( strncmp( line, "0::", 3 ) == 0 )
+            {
+                snprintf( path, sizeof(path), "/sys/fs/cgroup%s/memory.max", line + 3 );
+                if ( (limit = read_number( path )) >= 0 )
+                {
+                    snprintf( path, sizeof(path), "/sys/fs/cgroup%s/memory.current", line + 3 );
+                    usage = read_number( path );
+                }
+            }
+        }
+        fclose( fp );
+    }
+    if ( limit < 0 && (limit = read_number( "/sys/fs/cgroup/memory.max" )) >= 0 )
+        usage = read_number( "/sys/fs/cgroup/memory.current" );
+    if ( limit < 0 && (limit = read_number( "/sys/fs/cgroup/memory/memory.limit_in_bytes" )) >= 0 )
+        usage = read_number( "/sys/fs/cgroup/memory/memory.usage_in_bytes" );
+
+    /* v1 reports "no limit" as a huge number */
+    if ( limit < 0 || limit >= ((idx_t)1 << 60) )
+        return -1;
+    if ( usage < 0 )
+        usage = 0;
+    return limit > usage ? limit - usage : 0;
+}
+
+/* count newlines 16 bytes at a time */
+static idx_t count_newlines( const char *p, size_t n )
+{
+    idx_t count = 0;
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8( '\n' );
+
+    for( ; n >= 16; p += 16, n -= 16 )
+        count += __builtin_popcount( _mm_movemask_epi8(
+                     _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i *)p ), nl ) ) );
+#endif
+    for( ; n > 0; p++, n-- )
+        count += (*p == '\n');
+    return count;
+}
+
+/* field width statistics over sampled lines */
+typedef struct {
+    idx_t lines;           /* complete lines seen                          */
+    idx_t fields;          /* non-empty fields seen                        */
+    idx_t chars;           /* chars in those fields                        */
+    idx_t row_fields;      /* fields so far on the current line            */
+    int   len;             /* chars so far in the current field            */
+} sample_t;
+
+static void sample_fields( plan_t *plan, sample_t *sm, const char *p, size_t n, char delim )
+{
+    for( ; n > 0; p++, n-- )
+    {
+        if ( *p == delim || *p == '\n' )
+        {
+            if ( sm->len > 0 )
+            {
+                sm->fields++;
+                sm->chars += sm->len;
+                sm->row_fields++;
+                if ( sm->len > plan->field_max )
+                    plan->field_max = sm->len;
+            }
+            sm->len = 0;
+            if ( *p == '\n' )
+            {
+                if ( sm->row_fields > plan->cols )
+                    plan->cols = sm->row_fields;
+                sm->row_fields = 0;
+                sm->lines++;
+            }
+        }
+        else
+            sm->len++;
+    }
+}
+
+/* prescan 'size' bytes of a regular file from 'base': count every newline
+ * in small files, otherwise sample PLAN_SAMPLES chunks spread over the
+ * file; field widths and the column count come from the same bytes
+ */
+static void plan_prescan( ft_ctx_t *ctx, int fd, off_t base, idx_t size )
+{
+    char *buf = malloc( PLAN_SAMPLE_SIZE );
+    idx_t chunks, i, newlines = 0, sampled = 0;
+    off_t off;
+    sample_t sm;
+    ssize_t n;
+    char last = '\n';
+
+    if ( buf == (char *)0 )
+        return;
+    memset( (void *)&sm, 0, sizeof(sm) );
+    ctx->plan.exact = (size <= PLAN_FULL_SCAN);
+    chunks = ctx->plan.exact ? (size + PLAN_SAMPLE_SIZE - 1) / PLAN_SAMPLE_SIZE : PLAN_SAMPLES;
+
+    for( i = 0; i < chunks; i++ )
+    {
+        const char *p;
+
+        off = ctx->plan.exact ? i * PLAN_SAMPLE_SIZE :
+                           (off_t)(i * (double)(size - PLAN_SAMPLE_SIZE) / (PLAN_SAMPLES - 1));
+        while ( (n = pread( fd, buf, PLAN_SAMPLE_SIZE, base + off )) < 0 && errno == EINTR )
+            ;
+        if ( n <= 0 )
+            break;
+        newlines += count_newlines( buf, n );
+        sampled += n;
+        p = buf;
+
+        /* a sample from the middle of the file starts mid-line */
+        if ( !ctx->plan.exact && off > 0 )
+        {
+            const char *nl = memchr( buf, '\n', n );
+            p = nl ? nl + 1 : buf + n;
+            sm.len = 0;
+            sm.row_fields = 0;
+        }
+        sample_fields( &ctx->plan, &sm, p, buf + n - p, ctx->opt.in_delim );
+        if ( off + n == size )
+            last = buf[ n - 1 ];
+    }
+    if ( ctx->plan.exact && last != '\n' )
+        sample_fields( &ctx->plan, &sm, "\n", 1, ctx->opt.in_delim );
+
+    if ( ctx->plan.exact )
+        ctx->plan.rows = newlines + (size > 0 && last != '\n');
+    else if ( sampled > 0 )
+        ctx->plan.rows = (idx_t)((double)newlines * size / sampled);
+    ctx->plan.field_mean = sm.fields ? (double)sm.chars / sm.fields : 0.0;
+    free( (void *)buf );
+}
+
+/* fill in the predicted memory, scratch and time of every engine */
+static void plan_estimate( ft_ctx_t *ctx )
+{
+    size_t es = ctx->opt.element_size;
+    double in = ctx->plan.input_bytes, matrix, out, mb = 1e6;
+    idx_t overhead = 2 * ctx->tune.io_block + (1 + 2 * ctx_threads( ctx )) * ctx->tune.tile_bytes;
+    idx_t room, col_bytes, row_bytes;
+    estimate_t *e;
+
+    matrix = (double)ctx->plan.rows * ctx->plan.cols * es;
+    out = (double)ctx->plan.rows * ctx->plan.cols * (ctx->plan.field_mean + 1.0);
+    col_bytes = ctx->plan.rows * es;
+    row_bytes = ctx->plan.cols * es;
+    /* many threads on a tight budget: their buffers get at most half of it */
+    if ( overhead > ctx->plan.budget / 2 )
+        overhead = ctx->plan.budget / 2;
+    room = ctx->plan.budget - overhead;
+    if ( room < 0 )
+        room = 0;
+
+    /* memory: everything in RAM, reserved in one step from the prescan;
+     * a matrix that outgrows the room left goes on as the external engine
+     */
+    e = &ctx->plan.est[ FT_ENGINE_MEMORY ];
+    ctx->plan.matrix_limit = room > ctx->tune.page_bytes ? room : ctx->tune.page_bytes;
+    e->memory  = (idx_t)(matrix * 1.05) + overhead;
+    e->seconds = in / mb / PLAN_PARSE_MBPS + out / mb / PLAN_EMIT_MBPS;
+    e->feasible = 1;
+    if ( e->memory > ctx->plan.budget )
+    {
+        e->feasible = 0;
+        e->why = "matrix exceeds the memory budget";
+    }
+
+    /* multipass: as many columns per pass as fit */
+    e = &ctx->plan.est[ FT_ENGINE_MULTIPASS ];
+    ctx->plan.window_cols = col_bytes > 0 ? (idx_t)(room / 1.05) / col_bytes : ctx->plan.cols;
+    if ( ctx->plan.window_cols > ctx->plan.cols )
+        ctx->plan.window_cols = ctx->plan.cols;
+    if ( !ctx->plan.seekable )
+        e->why = "input is not a regular file";
+    else if ( ctx->plan.window_cols < 1 )
+        e->why = "one column exceeds the memory budget";
+    else
+    {
+        ctx->plan.passes = (ctx->plan.cols + ctx->plan.window_cols - 1) / ctx->plan.window_cols;
+        e->feasible = 1;
+        e->memory   = (idx_t)(ctx->plan.window_cols * col_bytes * 1.05) + overhead;
+        e->seconds  = in / mb / PLAN_PARSE_MBPS + (ctx->plan.passes - 1) * in / mb / PLAN_SCAN_MBPS +
+                      out / mb / PLAN_EMIT_MBPS;
+    }
+
+    /* external: half the budget holds a band, a quarter the merge buffer */
+    e = &ctx->plan.est[ FT_ENGINE_EXTERNAL ];
+    ctx->plan.band_bytes  = room / 2;
+    ctx->plan.merge_bytes = room / 4 > ctx->tune.tile_bytes ? room / 4 : ctx->tune.tile_bytes;
+    ctx->plan.band_rows   = row_bytes > 0 ? ctx->plan.band_bytes / row_bytes : 0;
+    e->scratch = (idx_t)matrix;
+    if ( row_bytes > 0 && ctx->plan.band_rows < 1 )
+        e->why = "one row exceeds the memory budget";
+    else if ( ctx->plan.scratch_free >= 0 && e->scratch > ctx->plan.scratch_free )
+        e->why = "not enough free space in --tmpdir";
+    else
+    {
+        double band = matrix < ctx->plan.band_bytes ? matrix : ctx->plan.band_bytes;
+        double merge = matrix < ctx->plan.merge_bytes ? matrix : ctx->plan.merge_bytes;
+        int readers = ctx->plan.scratch_devices < ctx_threads( ctx ) ? ctx->plan.scratch_devices : ctx_threads( ctx );
+
+        /* bands are written one at a time, but read back from every device */
+        e->feasible = 1;
+        e->memory   = (idx_t)(band + 2 * merge) + overhead;
+        e->seconds  = in / mb / PLAN_PARSE_MBPS + matrix / mb / PLAN_DISK_MBPS +
+                      matrix / mb / PLAN_DISK_MBPS / (readers > 1 ? readers : 1) + out / mb / PLAN_EMIT_MBPS;
+        if ( e->memory > ctx->plan.budget )
+        {
+            e->feasible = 0;
+            e->why = "bands and merge buffers exceed the memory budget";
+        }
+    }
+
+    /* cursor: one read buffer per input row */
+    e = &ctx->plan.est[ FT_ENGINE_CURSOR ];
+    ctx->plan.cursor_buf = ctx->plan.rows > 0 ? (room - ctx->plan.rows * (idx_t)(es + 1 + sizeof(cursor_t))) / ctx->plan.rows : 0;
+    /* no point buffering more than a row, rounded up to a page */
+    row_bytes = ctx->plan.rows > 0 ? ((idx_t)(in / ctx->plan.rows) + CURSOR_MIN_BUF) & ~(idx_t)(CURSOR_MIN_BUF - 1) : 0;
+    if ( ctx->plan.cursor_buf > row_bytes && row_bytes > 0 )
+        ctx->plan.cursor_buf = row_bytes;
+    if ( ctx->plan.cursor_buf > CURSOR_MAX_BUF )
+        ctx->plan.cursor_buf = CURSOR_MAX_BUF;
+    if ( !ctx->plan.seekable )
+        e->why = "input is not a regular file";
+    else if ( ctx->plan.cursor_buf < CURSOR_MIN_BUF )
+        e->why = "too many rows for one cursor each";
+    else
+    {
+        e->feasible = 1;
+        e->memory   = ctx->plan.rows * (ctx->plan.cursor_buf + (idx_t)(es + 1 + sizeof(cursor_t))) + overhead;
+        e->seconds  = in / mb / PLAN_SCAN_MBPS + in / mb / PLAN_PARSE_MBPS +
+                      out / mb / PLAN_EMIT_MBPS + (in / ctx->plan.cursor_buf) * PLAN_SEEK_SECONDS;
+    }
+    if ( ctx->plan.cursor_buf < CURSOR_MIN_BUF )
+        ctx->plan.cursor_buf = CURSOR_MIN_BUF;
+}
+
+/* start a plan: the memory budget and the scratch space */
+static void plan_budget( ft_ctx_t *ctx )
+{
+    struct statvfs vfs;
+    struct stat st, seen;
+    idx_t avail, cgroup;
+    int i, j;
+
+    memset( (void *)&ctx->plan, 0, sizeof(plan_t) );
+    ctx->plan.engine = ctx->opt.engine;
+    ctx->plan.scratch_free = -1;
+    for( i = 0; i < ctx->nscratch; i++ )
+    {
+        /* free space counted once per file system */
+        if ( stat( ctx->scratch[i], &st ) < 0 || statvfs( ctx->scratch[i], &vfs ) < 0 )
+            continue;
+        for( j = 0; j < i && (stat( ctx->scratch[j], &seen ) < 0 || seen.st_dev != st.st_dev); j++ )
+            ;
+        if ( j < i )
+            continue;
+        ctx->plan.scratch_free = (ctx->plan.scratch_free < 0 ? 0 : ctx->plan.scratch_free) +
+                                 (idx_t)vfs.f_bavail * vfs.f_frsize;
+        ctx->plan.scratch_devices++;
+    }
+
+    /* memory budget: -M, else a share of what the machine and cgroup allow */
+    avail  = mem_available();
+    cgroup = cgroup_memory_free();
+    ctx->plan.mem_available = avail;
+    ctx->plan.cgroup_free   = cgroup;
+    if ( ctx->opt.memory_budget > 0 )
+    {
+        ctx->plan.budget = ctx->opt.memory_budget;
+        ctx->plan.budget_source = "-M";
+    }
+    else
+    {
+        ctx->plan.budget = avail;
+        ctx->plan.budget_source = "MemAvailable";
+        if ( cgroup >= 0 && (avail < 0 || cgroup < avail) )
+        {
+            ctx->plan.budget = cgroup;
+            ctx->plan.budget_source = "cgroup limit";
+        }
+        ctx->plan.budget = ctx->plan.budget < 0 ? ((idx_t)1 << 62) : (idx_t)(ctx->plan.budget * PLAN_MEMORY_SHARE);
+    }
+}
+
+/* size up the inputs and the machine, then pick an engine for "auto";
+ * 'nin' inputs are stacked as rows and must agree on the # of columns
+ */
+static int plan_input( ft_ctx_t *ctx, input_t *in, int nin )
+{
+    struct stat st;
+    idx_t size, bytes = 0, rows = 0, cols = 0;
+    double chars = 0.0;
+    int i, best, exact = 1, first = -1;
+
+    plan_budget( ctx );
+
+    /* prescan each input, so a file of the wrong shape fails before any
+     * of them is parsed
+     */
+    ctx->plan.seekable = 1;
+    for( i = 0; i < nin; i++ )
+    {
+        if ( !in[i].seekable || fstat( in[i].fd, &st ) != 0 )
+        {
+            ctx->plan.seekable = 0;
+            continue;
+        }
+        size = st.st_size > in[i].base ? st.st_size - in[i].base : 0;
+        ctx->plan.cols = 0;
+        plan_prescan( ctx, in[i].fd, in[i].base, size );
+        in[i].rows = ctx->plan.rows;
+        in[i].cols = ctx->plan.cols;
+        if ( in[i].cols > 0 && first < 0 )
+            first = i;
+        else if ( in[i].cols > 0 && in[i].cols != in[ first ].cols )
+            return ft_fail( ctx, "%s: %ld columns, but %s has %ld", in[i].name, in[i].cols,
+                            in[ first ].name, in[ first ].cols );
+        bytes += size;
+        rows  += in[i].rows;
+        chars += ctx->plan.field_mean * size;
+        exact  = exact && ctx->plan.exact;
+        if ( in[i].cols > cols )
+            cols = in[i].cols;
+    }
+    ctx->plan.exact       = ctx->plan.seekable && exact;
+    ctx->plan.input_bytes = ctx->plan.seekable ? bytes : 0;
+    ctx->plan.rows        = rows;
+    ctx->plan.cols        = cols;
+    ctx->plan.field_mean  = bytes > 0 ? chars / bytes : 0.0;
+    plan_estimate( ctx );
+
+    /* the engines that re-read the input take a single one */
+    if ( nin > 1 )
+    {
+        if ( ctx->plan.engine == FT_ENGINE_MULTIPASS || ctx->plan.engine == FT_ENGINE_CURSOR )
+            return ft_fail( ctx, "the %s engine takes a single input", engine_names[ ctx->plan.engine ] );
+        ctx->plan.est[ FT_ENGINE_MULTIPASS ].feasible = 0;
+        ctx->plan.est[ FT_ENGINE_MULTIPASS ].why = "takes a single input";
+        ctx->plan.est[ FT_ENGINE_CURSOR ].feasible = 0;
+        ctx->plan.est[ FT_ENGINE_CURSOR ].why = "takes a single input";
+    }
+
+    /* the cursor engine reads every row it found in the prescan, as data */
+    if ( ctx->keep || ctx->opt.header || ctx->opt.labels )
+    {
+        if ( ctx->plan.engine == FT_ENGINE_CURSOR )
+            return ft_fail( ctx, "the cursor engine cannot skip rows or keep a header or labels" );
+        ctx->plan.est[ FT_ENGINE_CURSOR ].feasible = 0;
+        ctx->plan.est[ FT_ENGINE_CURSOR ].why = ctx->keep ? "cannot skip rows" : "keeps no header or labels";
+    }
+
+    /* a stream can only be parsed once and its size is unknown up front */
+    if ( !ctx->plan.seekable )
+    {
+        ctx->plan.band_rows = 0;
+        if ( ctx->plan.engine == FT_ENGINE_AUTO )
+            ctx->plan.engine = FT_ENGINE_MEMORY;
+        return 0;
+    }
+    if ( ctx->plan.engine == FT_ENGINE_MEMORY || ctx->plan.engine == FT_ENGINE_MULTIPASS )
+        ctx->plan.reserve = (idx_t)(ctx->plan.rows * (double)(ctx->plan.engine == FT_ENGINE_MEMORY ? ctx->plan.cols : ctx->plan.window_cols) * 1.02);
+    if ( ctx->plan.engine != FT_ENGINE_AUTO )
+        return 0;
+
+    /* the in-memory path when it fits, otherwise the fastest that does */
+    if ( ctx->plan.est[ FT_ENGINE_MEMORY ].feasible )
+        best = FT_ENGINE_MEMORY;
+    else
+    {
+        best = 0;
+        for( i = FT_ENGINE_MULTIPASS; i < FT_N_ENGINES; i++ )
+            if ( ctx->plan.est[i].feasible && (best == 0 || ctx->plan.est[i].seconds < ctx->plan.est[ best ].seconds) )
+                best = i;
+        if ( best == 0 )
+        {
+            ft_warn( ctx, "warning: no engine fits the memory budget, trying memory\n" );
+            best = FT_ENGINE_MEMORY;
+        }
+    }
+    ctx->plan.engine = best;
+    if ( best == FT_ENGINE_MEMORY || best == FT_ENGINE_MULTIPASS )
+        ctx->plan.reserve = (idx_t)(ctx->plan.rows * (double)(best == FT_ENGINE_MEMORY ? ctx->plan.cols : ctx->plan.window_cols) * 1.02);
+    return 0;
+}
+
+static void plan_print( ft_ctx_t *ctx, FILE *fp )
+{
+    char b1[ 32 ], b2[ 32 ], b3[ 32 ];
+    int i;
+
+    fprintf( fp, "input:    %s", ctx->opt.input_name );
+    if ( ctx->plan.seekable )
+        fprintf( fp, ", %s, %s%ld rows x %ld columns\n",
+                 format_bytes( b1, sizeof(b1), ctx->plan.input_bytes ),
+                 ctx->plan.exact ? "" : "~", ctx->plan.rows, ctx->plan.cols );
+    else
+        fprintf( fp, " (not a regular file: size unknown until read)\n" );
+    if ( ctx->plan.seekable )
+    {
+        fprintf( fp, "fields:   mean %.1f chars, longest sampled %d chars, field width -f %d\n",
+                 ctx->plan.field_mean, ctx->plan.field_max, ctx->opt.element_size );
+        if ( ctx->plan.field_max > ctx->opt.element_size )
+            fprintf( fp, "          warning: fields longer than %d chars will be truncated\n",
+                     ctx->opt.element_size );
+    }
+    fprintf( fp, "memory:   budget %s (%s", format_bytes( b1, sizeof(b1), ctx->plan.budget ), ctx->plan.budget_source );
+    if ( ctx->plan.mem_available >= 0 && ctx->plan.budget_source[0] != 'M' )
+        fprintf( fp, ", MemAvailable %s", format_bytes( b2, sizeof(b2), ctx->plan.mem_available ) );
+    if ( ctx->plan.cgroup_free >= 0 )
+        fprintf( fp, ", cgroup free %s", format_bytes( b3, sizeof(b3), ctx->plan.cgroup_free ) );
+    fprintf( fp, ")\n" );
+    fprintf( fp, "tuning:   tile %s, read block %s, page %s, %d thread%s (%s)\n",
+             format_bytes( b1, sizeof(b1), ctx->tune.tile_bytes ), format_bytes( b2, sizeof(b2), ctx->tune.io_block ),
+             format_bytes( b3, sizeof(b3), ctx->tune.page_bytes ), ctx_threads( ctx ), ctx_threads( ctx ) == 1 ? "" : "s",
+             ctx->tune_source );
+    fprintf( fp, "scratch:  %s", ctx->tmpdir );
+    if ( ctx->plan.scratch_free >= 0 )
+        fprintf( fp, ", %s free", format_bytes( b1, sizeof(b1), ctx->plan.scratch_free ) );
+    if ( ctx->plan.scratch_devices > 1 )
+        fprintf( fp, " on %d file systems", ctx->plan.scratch_devices );
+    if ( ctx->opt.direct_io )
+        fprintf( fp, ", O_DIRECT" );
+    if ( ctx->opt.spill_codec != FT_CODEC_NONE )
+        fprintf( fp, ", %s compression", ctx->opt.spill_codec == FT_CODEC_LZ ? "lz" : "sampled" );
+    fprintf( fp, "\n\n%-10s %12s %12s %10s\n", "engine", "memory", "scratch", "time" );
+
+    for( i = FT_ENGINE_MEMORY; i < FT_N_ENGINES; i++ )
+    {
+        estimate_t *e = &ctx->plan.est[i];
+
+        fprintf( fp, "%-10s ", engine_names[i] );
+        if ( !ctx->plan.seekable && (i == FT_ENGINE_MEMORY || i == FT_ENGINE_EXTERNAL) )
+            fprintf( fp, "%12s %12s %10s ", "?", "?", "?" );
+        else if ( e->memory > 0 )
+            fprintf( fp, "%12s %12s %9.1fs ", format_bytes( b1, sizeof(b1), e->memory ),
+                     format_bytes( b2, sizeof(b2), e->scratch ), e->seconds );
+        else
+            fprintf( fp, "%12s %12s %10s ", "-", "-", "-" );
+        if ( i == FT_ENGINE_MULTIPASS && e->feasible )
+            fprintf( fp, " %ld pass%s", ctx->plan.passes, ctx->plan.passes == 1 ? "" : "es" );
+        if ( i == FT_ENGINE_EXTERNAL && e->feasible && ctx->plan.band_rows > 0 )
+            fprintf( fp, " %ld rows per band", ctx->plan.band_rows );
+        if ( !e->feasible && e->why )
+            fprintf( fp, " %s", e->why );
+        if ( i == ctx->plan.engine )
+            fprintf( fp, " <- %s", ctx->opt.engine == FT_ENGINE_AUTO ? "auto" : "selected" );
+        fprintf( fp, "\n" );
+    }
+}
+
+/* ft_autotune(): time the kernels on a synthetic matrix for each element
+ * width class and save the fastest settings as this host's profile, one
+ * line per class; ft_load_profile() picks the line for the element size
+ */
+static const idx_t tune_tile_sizes[]  = { 64 << 10, 128 << 10, 256 << 10, 512 << 10, 1 << 20, 2 << 20, 4 << 20 };
+static const idx_t tune_block_sizes[] = { 64 << 10, 256 << 10, 1 << 20, 4 << 20 };
+static const idx_t tune_page_sizes[]  = { 4096, 64 << 10, 2 << 20 };
+
+#define N_CANDIDATES( x )  ( (int)(sizeof(x) / sizeof((x)[0])) )
+
+static int tune_class( int element_size )
+{
+    int i;
+
+    for( i = 0; i < N_WIDTH_CLASSES - 1; i++ )
+        if ( element_size <= width_classes[i] )
+            break;
+    return i;
+}
+
+
+/* replace the defaults with the entry for the current width in the profile
+ * at 'path'; returns 1 if there is no such file
+ */
+static int tune_load( ft_ctx_t *ctx, const char *path )
+{
+    char line[ 256 ];
+    int want = tune_class( ctx->opt.element_size );
+    FILE *fp;
+    tune_t t;
+
+    if ( (fp = fopen( path, "r" )) == (FILE *)0 )
+    {
+        if ( errno == ENOENT )
+            return 1;
+        return ft_fail_errno( ctx, path );
+    }
+    snprintf( ctx->profile, sizeof(ctx->profile), "%s", path );
+    while ( fgets( line, sizeof(line), fp ) )
+    {
+        if ( line[0] == '#' )
+            continue;
+        memset( (void *)&t, 0, sizeof(t) );
+        if ( sscanf( line, "%d %ld %ld %ld %d %lf", &t.max_width, &t.page_bytes,
+                     &t.io_block, &t.tile_bytes, &t.threads, &t.mbps ) < 5 )
+            continue;
+        if ( tune_class( t.max_width > 0 ? t.max_width : INT_MAX ) != want )
+            continue;
+        if ( t.page_bytes < 64 || (t.page_bytes & (t.page_bytes - 1)) != 0 ||
+             t.io_block < 4096 || t.tile_bytes < 4096 || t.threads < 1 || t.threads > MAX_THREADS )
+        {
+            ft_warn( ctx, "%s: ignoring bad entry: %s", path, line );
+            continue;
+        }
+        ctx->tune = t;
+        ctx->tune_source = ctx->profile;
+    }
+    fclose( fp );
+    return 0;
+}
+
+/* fill 'a' with a rows x cols matrix of random digit strings */
+static int tune_matrix( array_t *a, idx_t rows, idx_t cols, unsigned int *seed )
+{
+    size_t es = a->element_size;
+    idx_t i, n = rows * cols;
+    int len, j;
+
+    reset_array( a );
+    if ( reserve_elements( a, n ) < 0 )
+        return -1;
+    memset( (void *)a->data, 0, n * es );
+    for( i = 0; i < n; i++ )
+    {
+        char *e = &a->data[ i * es ];
+
+        len = 1 + (int)(rand_r( seed ) % es);
+        for( j = 0; j < len; j++ )
+            e[j] = '0' + rand_r( seed ) % 10;
+    }
+    a->rows = rows;
+    a->cols = cols;
+    a->element_count = n;
+    a->pos = n * es;
+    return 0;
+}
+
+/* best of TUNE_REPEATS: transpose 'a' to 'out' */
+static double tune_emit( array_t *a, output_t *out )
+{
+    double t, best = 0.0;
+    int i;
+
+    for( i = 0; i < TUNE_REPEATS; i++ )
+    {
+        t = clock_seconds( CLOCK_MONOTONIC );
+        emit_transposed( a, out, TAB, 0 );
+        t = clock_seconds( CLOCK_MONOTONIC ) - t;
+        if ( i == 0 || t < best )
+            best = t;
+    }
+    return best;
+}
+
+/* best of TUNE_REPEATS: parse the text in 'fd' into 'a' */
+static double tune_parse( ft_ctx_t *ctx, int fd, array_t *a )
+{
+    input_t in;
+    parser_t ps;
+    double t, best = 0.0;
+    int i;
+
+    if ( open_input( ctx, &in, fd, (ft_read_fn)0, (void *)0 ) < 0 )
+        return 0.0;
+    for( i = 0; i < TUNE_REPEATS; i++ )
+    {
+        reset_array( a );
+        rewind_input( &in );
+        parser_init( &ps, TAB, a->element_size, 0, ALL_COLUMNS, (const keyset_t *)0, (text_t *)0, 0 );
+        t = clock_seconds( CLOCK_MONOTONIC );
+        parse_rows( ctx, &in, &ps, a, ALL_COLUMNS );
+        t = clock_seconds( CLOCK_MONOTONIC ) - t;
+        parser_free( &ps );
+        if ( i == 0 || t < best )
+            best = t;
+    }
+    close_input( &in );
+    return best;
+}
+
+/* best of TUNE_REPEATS: grow a matrix one element at a time */
+static double tune_insert( ft_ctx_t *ctx, int es, idx_t n )
+{
+    char *e = calloc( 1, es );
+    double t, best = 0.0;
+    array_t *a;
+    idx_t j;
+    int i;
+
+    for( i = 0; i < TUNE_REPEATS && e; i++ )
+    {
+        if ( (a = new_array( ctx, es )) == (array_t *)0 )
+            break;
+        t = clock_seconds( CLOCK_MONOTONIC );
+        for( j = 0; j < n; j++ )
+            if ( insert_element( a, e ) < 0 )
+                break;
+        t = clock_seconds( CLOCK_MONOTONIC ) - t;
+        free_array( a );
+        if ( i == 0 || t < best )
+            best = t;
+    }
+    free( (void *)e );
+    return best;
+}
+
+/* mkdir -p the directories leading to 'path' */
+static void make_parents( char *path )
+{
+    char *p;
+
+    for( p = path + 1; *p; p++ )
+        if ( *p == '/' )
+        {
+            *p = '\0';
+            mkdir( path, 0755 );
+            *p = '/';
+        }
+}
+
+static int autotune( ft_ctx_t *ctx, char *path, FILE *report )
+{
+    tune_t best[ N_WIDTH_CLASSES ];
+    char host[ 256 ], b1[ 32 ], b2[ 32 ], b3[ 32 ];
+    int cls, i, es, threads, max_threads, fd_text;
+    unsigned int seed = 1;
+    idx_t n, text_bytes;
+    double t, t_best, t_emit;
+    char *text, *o;
+    output_t null;
+    array_t *a;
+    FILE *fp;
+
+    max_threads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+    if ( max_threads < 1 )
+        max_threads = 1;
+    if ( max_threads > MAX_THREADS )
+        max_threads = MAX_THREADS;
+
+    /* an unwritable profile fails now, not after the timing pass; "a"
+     * keeps the old profile until the new one is written
+     */
+    make_parents( path );
+    if ( (fp = fopen( path, "a" )) == (FILE *)0 )
+        return ft_fail_errno( ctx, path );
+    memset( (void *)&null, 0, sizeof(null) );
+    if ( (null.fd = open( "/dev/null", O_WRONLY )) < 0 )
+    {
+        fclose( fp );
+        return ft_fail_errno( ctx, "/dev/null" );
+    }
+
+    for( cls = 0; cls < N_WIDTH_CLASSES; cls++ )
+    {
+        tune_t *b = &best[ cls ];
+
+        es = width_classes[ cls ] ? width_classes[ cls ] : 2 * width_classes[ cls - 1 ];
+        ctx->tune.page_bytes = PAGE_BYTES;
+        ctx->tune.io_block   = IO_BLOCK_SIZE;
+        ctx->tune.tile_bytes = TILE_BYTES;
+        ctx->tune.threads    = 1;
+        *b = ctx->tune;
+        b->max_width = width_classes[ cls ];
+
+        /* a square matrix of TUNE_MATRIX_BYTES / 4 .. TUNE_MATRIX_BYTES */
+        for( n = 64; 4 * n * n * es <= TUNE_MATRIX_BYTES; n *= 2 )
+            ;
+        a = new_array( ctx, es );
+        if ( a == (array_t *)0 || tune_matrix( a, n, n, &seed ) < 0 )
+        {
+            free_array( a );
+            close( null.fd );
+            fclose( fp );
+            return ft_fail( ctx, "autotune: out of memory" );
+        }
+
+        /* tile size, on one thread */
+        t_best = 0.0;
+        for( i = 0; i < N_CANDIDATES( tune_tile_sizes ); i++ )
+        {
+            ctx->tune.tile_bytes = tune_tile_sizes[i];
+            t = tune_emit( a, &null );
+            if ( i == 0 || t < t_best )
+            {
+                t_best = t;
+                b->tile_bytes = ctx->tune.tile_bytes;
+            }
+        }
+        ctx->tune.tile_bytes = b->tile_bytes;
+
+        /* threads: only keep more if they are clearly faster */
+        threads = 1;
+        while ( threads < max_threads )
+        {
+            threads = 2 * threads < max_threads ? 2 * threads : max_threads;
+            ctx->tune.threads = threads;
+            t = tune_emit( a, &null );
+            if ( t < 0.95 * t_best )
+            {
+                t_best = t;
+                b->threads = threads;
+            }
+        }
+        ctx->tune.threads = 1;
+        t_emit = t_best;
+
+        /* read block size: parse the matrix back as text from a scratch file */
+        text = malloc( n * n * (es + 1) );
+        if ( text && (fd_text = spill_open( ctx, (int *)0, (char *)0 )) >= 0 )
+        {
+            o = text;
+            for( i = 0; i < n; i++ )
+                o = format_fields( o, &a->data[ i * n * es ], n, es, TAB, 1 );
+            text_bytes = o - text;
+            b->mbps = t_emit > 0.0 ? text_bytes / t_emit / 1e6 : 0.0;
+            if ( write_at( ctx, fd_text, text, text_bytes, 0 ) == 0 )
+            {
+                t_best = 0.0;
+                for( i = 0; i < N_CANDIDATES( tune_block_sizes ); i++ )
+                {
+                    ctx->tune.io_block = tune_block_sizes[i];
+                    t = tune_parse( ctx, fd_text, a );
+                    if ( i == 0 || t < t_best )
+                    {
+                        t_best = t;
+                        b->io_block = ctx->tune.io_block;
+                    }
+                }
+            }
+            close( fd_text );
+        }
+        free( (void *)text );
+        free_array( a );
+
+        /* allocation granule of a growing matrix */
+        t_best = 0.0;
+        for( i = 0; i < N_CANDIDATES( tune_page_sizes ); i++ )
+        {
+            ctx->tune.page_bytes = tune_page_sizes[i];
+            t = tune_insert( ctx, es, n * n );
+            if ( i == 0 || t < t_best )
+            {
+                t_best = t;
+                b->page_bytes = ctx->tune.page_bytes;
+            }
+        }
+
+        if ( report == (FILE *)0 )
+            continue;
+        if ( b->max_width )
+            fprintf( report, "width <= %-3d", b->max_width );
+        else
+            fprintf( report, "width >  %-3d", width_classes[ cls - 1 ] );
+        fprintf( report, " tile %s, %d thread%s, read block %s, page %s: %.0f MB/s\n",
+                 format_bytes( b1, sizeof(b1), b->tile_bytes ), b->threads, b->threads == 1 ? "" : "s",
+                 format_bytes( b2, sizeof(b2), b->io_block ),
+                 format_bytes( b3, sizeof(b3), b->page_bytes ), b->mbps );
+    }
+    close( null.fd );
+
+    if ( ftruncate( fileno( fp ), 0 ) != 0 )
+    {
+        fclose( fp );
+        return ft_fail_errno( ctx, path );
+    }
+    if ( gethostname( host, sizeof(host) ) != 0 )
+        strcpy( host, "?" );
+    host[ sizeof(host) - 1 ] = '\0';
+    fprintf( fp, "# ftranspose %s autotune profile for %s, %d cpus\n", FT_VERSION, host, max_threads );
+    fprintf( fp, "# max_width page_bytes io_block tile_bytes threads mb_per_second\n" );
+    for( cls = 0; cls < N_WIDTH_CLASSES; cls++ )
+        fprintf( fp, "%d %ld %ld %ld %d %.1f\n", best[ cls ].max_width, best[ cls ].page_bytes,
+                 best[ cls ].io_block, best[ cls ].tile_bytes, best[ cls ].threads, best[ cls ].mbps );
+    if ( fclose( fp ) != 0 )
+        return ft_fail_errno( ctx, path );
+    if ( report )
+        fprintf( report, "profile saved to %s\n", path );
+    return 0;
+}
+
+/* joining single-column files: ft_join_files() writes each file as one
+ * output line (FT_JOIN_ROWS) or as one output column (FT_JOIN_COLUMNS,
+ * like paste(1)).  Each line of a file is one field, empty lines included,
+ * so the fields of every file stay aligned.
+ */
+typedef struct {
+    int    fd;
+    int    width;          /* fields per line: 1, or the files of a group   */
+    int    phase;          /* FT_PHASE_READ or FT_PHASE_SPILL_READ          */
+    off_t  off;
+    char  *buf;
+    size_t pos, len, size;
+    int    eof;
+} join_src_t;
+
+/* output staged in a block, to the output or a spill file */
+typedef struct {
+    output_t *out;         /* NULL: pwrite() to 'spill' at 'off'            */
+    int       spill;
+    off_t     off;
+    char     *buf;
+    size_t    len, size;
+} join_out_t;
+
+typedef struct {
+    ft_ctx_t           *ctx;
+    const char *const  *paths;
+    idx_t               count;
+    const idx_t        *widths;    /* fields per line of each file, NULL = 1 */
+    int                 mode;
+    output_t           *out;
+    idx_t               group;     /* FT_JOIN_COLUMNS: files per group       */
+    idx_t               groups;
+    int                *spill;     /* one spill file per group               */
+    char              (*names)[ SPILL_PATH_LEN ]; /* or, if set, a named one,
+                                    * closed once the group is written      */
+    size_t              src_buf;   /* read buffer per file                   */
+    int                 workers;   /* threads that took part so far          */
+    int                 max_workers; /* threads the descriptors allow        */
+    idx_t               next;      /* next file or group to take             */
+    idx_t               turn;      /* FT_JOIN_ROWS: next file to write       */
+    idx_t               lines;     /* output lines of the widest file/group  */
+    int                 rc;
+    pthread_mutex_t     lock;
+    pthread_cond_t      turned;
+} join_t;
+
+static int join_flush( ft_ctx_t *ctx, join_out_t *o )
+{
+    int rc;
+
+    if ( o->out )
+        rc = write_block( ctx, o->out, o->buf, o->len );
+    else if ( (rc = write_at( ctx, o->spill, o->buf, o->len, o->off )) < 0 )
+        ft_fail_errno( ctx, "spill file" );
+    o->off += o->len;
+    o->len = 0;
+    return rc;
+}
+
+static int join_put( ft_ctx_t *ctx, join_out_t *o, const char *p, size_t n )
+{
+    size_t k;
+
+    while ( n > 0 )
+    {
+        if ( o->len == o->size && join_flush( ctx, o ) < 0 )
+            return -1;
+        k = o->size - o->len < n ? o->size - o->len : n;
+        memcpy( o->buf + o->len, p, k );
+        o->len += k;
+        p += k;
+        n -= k;
+    }
+    return 0;
+}
+
+/* is there another line in 's'? */
+static int join_more( ft_ctx_t *ctx, join_src_t *s )
+{
+    ssize_t n;
+
+    if ( s->pos < s->len )
+        return 1;
+    if ( s->eof )
+        return 0;
+    if ( (n = read_at( ctx, s->fd, s->buf, s->size, s->off, s->phase )) < 0 )
+        return -1;
+    s->off += n;
+    s->pos = 0;
+    s->len = n;
+    s->eof = n == 0;
+    ATOMIC_SET( ctx->progress.bytes_in, ctx->progress.bytes_in + n );
+    return n > 0;
+}
+
+/* copy the next line of 's', without its newline */
+static int join_line( ft_ctx_t *ctx, join_src_t *s, join_out_t *o )
+{
+    const char *nl;
+    size_t n;
+    int more;
+
+    while ( (more = join_more( ctx, s )) > 0 )
+    {
+        nl = memchr( s->buf + s->pos, '\n', s->len - s->pos );
+        n = nl ? (size_t)(nl - (s->buf + s->pos)) : s->len - s->pos;
+        if ( join_put( ctx, o, s->buf + s->pos, n ) < 0 )
+            return -1;
+        s->pos += n;
+        if ( nl )
+        {
+            s->pos++;
+            return 0;
+        }
+    }
+    return more;
+}
+
+/* paste the lines of n sources side by side; a source that has run out
+ * contributes empty fields.  Returns the # of lines or -1.
+ */
+static idx_t join_paste( ft_ctx_t *ctx, join_src_t *src, int n, join_out_t *o )
+{
+    char delim = ctx->opt.out_delim;
+    idx_t lines = 0;
+    int i, k, more, any;
+
+    for( ;; )
+    {
+        for( i = 0, any = 0; i < n; i++ )
+            if ( (more = join_more( ctx, &src[i] )) < 0 )
+                return ft_fail_errno( ctx, ctx->opt.input_name );
+            else
+                any |= more;
+        if ( !any )
+            break;
+        for( i = 0; i < n; i++ )
+        {
+            if ( i > 0 && join_put( ctx, o, &delim, 1 ) < 0 )
+                return -1;
+            if ( src[i].pos < src[i].len )
+            {
+                if ( join_line( ctx, &src[i], o ) < 0 )
+                    return -1;
+            }
+            else
+                for( k = 1; k < src[i].width; k++ )
+                    if ( join_put( ctx, o, &delim, 1 ) < 0 )
+                        return -1;
+        }
+        if ( join_put( ctx, o, "\n", 1 ) < 0 )
+            return -1;
+        lines++;
+    }
+    return lines;
+}
+
+/* FT_JOIN_ROWS: each thread reads whole files into output lines, which are
+ * written in file order
+ */
+static void *join_rows( void *arg )
+{
+    join_t *j = (join_t *)arg;
+    ft_ctx_t *ctx = j->ctx;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    size_t block = ctx->tune.io_block, len, cap = block + 1;
+    char *line = malloc( cap ), *grown, *p, *nl;
+    idx_t k, fields;
+    ssize_t n;
+    stamp_t t;
+    int fd, last;
+
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    if ( line == (char *)0 )
+    {
+        ft_fail( ctx, "out of memory for joined lines" );
+        ATOMIC_SET( j->rc, -1 );
+    }
+
+    while ( (k = __atomic_fetch_add( &j->next, 1, __ATOMIC_RELAXED )) < j->count )
+    {
+        len = 0;
+        fields = 0;
+        last = '\n';
+        if ( ATOMIC_GET( j->rc ) == 0 )
+        {
+            if ( (fd = open( j->paths[k], O_RDONLY | O_CLOEXEC )) < 0 )
+            {
+                ft_fail_errno( ctx, j->paths[k] );
+                ATOMIC_SET( j->rc, -1 );
+            }
+            else
+            {
+                posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+                for( ;; )
+                {
+                    if ( cap - len < block + 1 )
+                    {
+                        if ( (grown = realloc( line, 2 * cap )) == (char *)0 )
+                        {
+                            ft_fail( ctx, "%s: out of memory", j->paths[k] );
+                            ATOMIC_SET( j->rc, -1 );
+                            break;
+                        }
+                        line = grown;
+                        cap *= 2;
+                    }
+                    if ( (n = read_at( ctx, fd, line + len, block, (off_t)len, FT_PHASE_READ )) <= 0 )
+                    {
+                        if ( n < 0 )
+                        {
+                            ft_fail_errno( ctx, j->paths[k] );
+                            ATOMIC_SET( j->rc, -1 );
+                        }
+                        break;
+                    }
+
+                    /* the newlines between fields become delimiters */
+                    last = (unsigned char)line[ len + n - 1 ];
+                    phase_begin( ctx, &t );
+                    for( p = line + len; (nl = memchr( p, '\n', line + len + n - p )) != (char *)0; p = nl + 1 )
+                    {
+                        *nl = ctx->opt.out_delim;
+                        fields++;
+                    }
+                    phase_end( ctx, FT_PHASE_FORMAT, &t, n );
+                    len += n;
+                    ATOMIC_SET( ctx->progress.bytes_in, ctx->progress.bytes_in + n );
+                }
+                close( fd );
+
+                /* the last field may or may not end in a newline */
+                if ( len > 0 && last == '\n' )
+                    len--;
+                else if ( len > 0 )
+                    fields++;
+                line[ len++ ] = '\n';
+            }
+        }
+
+        pthread_mutex_lock( &j->lock );
+        while ( j->turn != k )
+            pthread_cond_wait( &j->turned, &j->lock );
+        if ( j->rc == 0 && write_block( ctx, j->out, line, len ) < 0 )
+            ATOMIC_SET( j->rc, -1 );
+        if ( fields > j->lines )
+            j->lines = fields;
+        j->turn++;
+        ATOMIC_SET( ctx->progress.lines_out, j->turn );
+        ATOMIC_SET( ctx->progress.bytes_out, ctx->progress.bytes_out + (int64_t)len );
+        pthread_cond_broadcast( &j->turned );
+        pthread_mutex_unlock( &j->lock );
+    }
+    free( (void *)line );
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* FT_JOIN_COLUMNS with more files than descriptors, or threads to share
+ * them: each thread pastes whole groups of files into a spill file each
+ */
+static void *join_groups( void *arg )
+{
+    join_t *j = (join_t *)arg;
+    ft_ctx_t *ctx = j->ctx;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    join_src_t *src = calloc( j->group, sizeof(join_src_t) );
+    char *bufs = malloc( j->group * j->src_buf );
+    join_out_t o;
+    idx_t g, lo, i, n, lines;
+
+    /* each thread holds a group's descriptors: only as many as fit */
+    if ( __atomic_fetch_add( &j->workers, 1, __ATOMIC_RELAXED ) >= j->max_workers )
+    {
+        free( (void *)src );
+        free( (void *)bufs );
+        return (void *)0;
+    }
+    memset( (void *)local, 0, sizeof(local) );
+    memset( (void *)&o, 0, sizeof(o) );
+    phase_local = local;
+    o.size = ctx->tune.io_block;
+    if ( src == (join_src_t *)0 || bufs == (char *)0 || (o.buf = malloc( o.size )) == (char *)0 )
+    {
+        ft_fail( ctx, "out of memory for %ld file buffers", j->group );
+        ATOMIC_SET( j->rc, -1 );
+    }
+
+    while ( ATOMIC_GET( j->rc ) == 0 && (g = __atomic_fetch_add( &j->next, 1, __ATOMIC_RELAXED )) < j->groups )
+    {
+        lo = g * j->group;
+        n = j->count - lo < j->group ? j->count - lo : j->group;
+        for( i = 0; i < n; i++ )
+        {
+            memset( (void *)&src[i], 0, sizeof(join_src_t) );
+            src[i].width = j->widths ? (int)j->widths[ lo + i ] : 1;
+            src[i].phase = j->widths ? FT_PHASE_SPILL_READ : FT_PHASE_READ;
+            src[i].buf   = bufs + i * j->src_buf;
+            src[i].size  = j->src_buf;
+            if ( (src[i].fd = open( j->paths[ lo + i ], O_RDONLY | O_CLOEXEC )) < 0 )
+            {
+                ft_fail_errno( ctx, j->paths[ lo + i ] );
+                break;
+            }
+            posix_fadvise( src[i].fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+        }
+        o.spill = j->names ? (i < n ? -1 : spill_open( ctx, (int *)0, j->names[g] )) : j->spill[g];
+        o.off = 0;
+        lines = i < n || o.spill < 0 ? -1 : join_paste( ctx, src, n, &o );
+        if ( lines < 0 || join_flush( ctx, &o ) < 0 )
+            ATOMIC_SET( j->rc, -1 );
+        if ( j->names && o.spill >= 0 )
+            close( o.spill );
+        while ( i-- > 0 )
+            close( src[i].fd );
+
+        pthread_mutex_lock( &j->lock );
+        if ( lines > j->lines )
+            j->lines = lines;
+        pthread_mutex_unlock( &j->lock );
+    }
+    free( (void *)src );
+    free( (void *)bufs );
+    free( (void *)o.buf );
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* descriptors this process may still open: the limit less those open now
+ * and a few to spare (fewer under a low limit), or less an eighth of it if
+ * they cannot be counted
+ */
+static idx_t join_fd_limit( void )
+{
+    struct rlimit rl;
+    struct dirent *de;
+    DIR *dir;
+    idx_t reserve, spare;
+
+    if ( getrlimit( RLIMIT_NOFILE, &rl ) != 0 || rl.rlim_cur == RLIM_INFINITY )
+        return JOIN_MAX_FILES;
+    spare = (idx_t)rl.rlim_cur / 8 < JOIN_FD_SPARE ? (idx_t)rl.rlim_cur / 8 : JOIN_FD_SPARE;
+    if ( (dir = opendir( "/proc/self/fd" )) != (DIR *)0 )
+    {
+        /* the directory's own descriptor is counted, and closed */
+        for( reserve = spare - 1; (de = readdir( dir )) != (struct dirent *)0; )
+            if ( de->d_name[0] != '.' )
+                reserve++;
+        closedir( dir );
+    }
+    else
+        reserve = (idx_t)rl.rlim_cur / 8 < JOIN_FD_SPARE ? JOIN_FD_SPARE : (idx_t)rl.rlim_cur / 8;
+    if ( (idx_t)rl.rlim_cur - reserve < 2 )
+        return 2;
+    return (idx_t)rl.rlim_cur - reserve;
+}
+
+/* the memory ft_join_files() may use for read buffers */
+static idx_t join_budget( ft_ctx_t *ctx )
+{
+    idx_t budget = ctx->opt.memory_budget;
+
+    if ( budget <= 0 && (budget = (idx_t)(mem_available() * PLAN_MEMORY_SHARE)) <= 0 )
+        budget = (idx_t)1 << 30;
+    return budget;
+}
+
+/* fields per line of files [lo, lo + n) of 'j' pasted together */
+static idx_t join_width( const join_t *j, idx_t lo, idx_t n )
+{
+    idx_t i, w = 0;
+
+    if ( j->widths == (const idx_t *)0 )
+        return n;
+    for( i = 0; i < n; i++ )
+        w += j->widths[ lo + i ];
+    return w;
+}
+
+/* the files of a level join_reduce() wrote are not needed again */
+static void join_unlink( join_t *j )
+{
+    idx_t i;
+
+    if ( j->widths == (const idx_t *)0 )
+        return;
+    for( i = 0; i < j->count; i++ )
+        if ( j->paths[i][0] )
+            unlink( j->paths[i] );
+    free( (void *)j->paths );
+    free( (void *)j->widths );
+    j->paths  = (const char *const *)0;
+    j->widths = (const idx_t *)0;
+}
+
+/* FT_JOIN_COLUMNS with too many files for one level of groups held open
+ * at once: paste groups of them into named spill files, each closed once
+ * written, which then stand in for them
+ */
+static int join_reduce( ft_ctx_t *ctx, join_t *j, idx_t limit )
+{
+    join_t r = *j;
+    const char **paths;
+    idx_t *widths, g, n;
+    int threads = ctx_threads( ctx );
+
+    /* each thread holds a group and the spill file it writes */
+    while ( threads > 1 && limit / threads - 1 < JOIN_MIN_GROUP )
+        threads--;
+    if ( limit / threads - 1 < 2 )
+        return ft_fail( ctx, "%ld files need more than %ld open descriptors; raise ulimit -n", j->count, limit );
+    r.group       = limit / threads - 1;
+    r.groups      = (j->count + r.group - 1) / r.group;
+    r.spill       = (int *)0;
+    r.workers     = 0;
+    r.max_workers = threads;
+    r.next        = 0;
+    r.src_buf     = join_budget( ctx ) / 2 / (threads * r.group);
+    r.src_buf     = r.src_buf < CURSOR_MIN_BUF ? CURSOR_MIN_BUF : r.src_buf > CURSOR_MAX_BUF ? CURSOR_MAX_BUF : r.src_buf;
+
+    /* the names follow the pointers to them, in one block */
+    if ( (paths = calloc( r.groups, sizeof(char *) + SPILL_PATH_LEN )) == (const char **)0 ||
+         (widths = malloc( r.groups * sizeof(idx_t) )) == (idx_t *)0 )
+    {
+        free( (void *)paths );
+        return ft_fail( ctx, "out of memory for %ld files", j->count );
+    }
+    r.names = (char (*)[ SPILL_PATH_LEN ])(paths + r.groups);
+    for( g = 0; g < r.groups; g++ )
+    {
+        n = j->count - g * r.group < r.group ? j->count - g * r.group : r.group;
+        paths[g]  = r.names[g];
+        widths[g] = join_width( j, g * r.group, n );
+    }
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "pasting %ld files in %ld groups of %ld first\n", j->count, r.groups, r.group );
+    pthread_mutex_init( &r.lock, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &r.turned, (pthread_condattr_t *)0 );
+    progress_stage( ctx, FT_STAGE_READ );
+    ctx_run( ctx, join_groups, &r );
+    pthread_mutex_destroy( &r.lock );
+    pthread_cond_destroy( &r.turned );
+
+    join_unlink( j );
+    j->paths  = paths;
+    j->widths = widths;
+    j->count  = r.groups;
+    ctx->stats.bands += (int)r.groups;
+    return r.rc < 0 ? -1 : 0;
+}
+
+static int join_columns( ft_ctx_t *ctx, join_t *j )
+{
+    join_src_t *src = (join_src_t *)0;
+    char *bufs = (char *)0;
+    join_out_t o;
+    idx_t limit = join_fd_limit(), budget = join_budget( ctx ), i, n, lines;
+    int threads, direct;
+
+    /* every file open at once if they fit, else (or to use the threads)
+     * groups pasted into spill files and then pasted together; more
+     * levels of groups first if even that needs too many descriptors
+     */
+    for( ;; )
+    {
+        threads = ctx_threads( ctx );
+        direct = j->count <= limit && (threads == 1 || j->count < threads * JOIN_MIN_GROUP);
+        if ( direct )
+            break;
+
+        /* a group per thread if their files can all be open at once,
+         * else groups of about sqrt( count / threads ) files, which keeps
+         * the spill files plus the files open in the groups fewest; fewer
+         * threads if even that is too many
+         */
+        for( ; threads > 0; threads-- )
+        {
+            j->group = (j->count + threads - 1) / threads;
+            if ( j->group * threads + threads > limit )
+                for( j->group = 1; j->group * j->group * threads < j->count; j->group++ )
+                    ;
+            j->groups = (j->count + j->group - 1) / j->group;
+            if ( j->groups + j->group * threads <= limit )
+                break;
+        }
+        if ( threads > 0 )
+            break;
+        if ( join_reduce( ctx, j, limit ) < 0 )
+        {
+            join_unlink( j );
+            return -1;
+        }
+    }
+    if ( direct )
+    {
+        j->groups = 0;
+        n = j->count;
+    }
+    else
+    {
+        j->max_workers = threads;
+        j->src_buf = budget / 2 / (threads * j->group);
+        j->src_buf = j->src_buf < CURSOR_MIN_BUF ? CURSOR_MIN_BUF : j->src_buf > CURSOR_MAX_BUF ? CURSOR_MAX_BUF : j->src_buf;
+        n = j->groups;
+    }
+
+    memset( (void *)&o, 0, sizeof(o) );
+    o.out  = j->out;
+    o.size = ctx->tune.io_block;
+    src  = calloc( n > 0 ? n : 1, sizeof(join_src_t) );
+    o.buf = malloc( o.size );
+    if ( src == (join_src_t *)0 || o.buf == (char *)0 || (!direct && (j->spill = calloc( n, sizeof(int) )) == (int *)0) )
+    {
+        free( (void *)src );
+        free( (void *)o.buf );
+        join_unlink( j );
+        return ft_fail( ctx, "out of memory for %ld files", j->count );
+    }
+    for( i = 0; i < n; i++ )
+        src[i].fd = -1;
+
+    if ( !direct )
+    {
+        for( i = 0; i < n; i++ )
+            if ( (j->spill[i] = src[i].fd = spill_open( ctx, (int *)0, (char *)0 )) < 0 )
+                break;
+        if ( i == n )
+        {
+            progress_stage( ctx, FT_STAGE_READ );
+            ctx_run( ctx, join_groups, j );
+        }
+        else
+            j->rc = -1;
+        for( i = 0; i < n; i++ )
+        {
+            src[i].width = (int)join_width( j, i * j->group,
+                                            j->count - i * j->group < j->group ? j->count - i * j->group : j->group );
+            src[i].phase = FT_PHASE_SPILL_READ;
+        }
+    }
+    else
+        for( i = 0; i < n && j->rc == 0; i++ )
+        {
+            src[i].width = j->widths ? (int)j->widths[i] : 1;
+            src[i].phase = j->widths ? FT_PHASE_SPILL_READ : FT_PHASE_READ;
+            if ( (src[i].fd = open( j->paths[i], O_RDONLY | O_CLOEXEC )) < 0 )
+                j->rc = ft_fail_errno( ctx, j->paths[i] );
+            else
+                posix_fadvise( src[i].fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+        }
+
+    /* the final paste, with the rest of the budget shared by its sources */
+    if ( j->rc == 0 )
+    {
+        size_t size = budget / 2 / (n > 0 ? n : 1);
+
+        size = size < CURSOR_MIN_BUF ? CURSOR_MIN_BUF : size > CURSOR_MAX_BUF ? CURSOR_MAX_BUF : size;
+        if ( (bufs = malloc( (n > 0 ? n : 1) * size )) == (char *)0 )
+            j->rc = ft_fail( ctx, "out of memory for %ld file buffers", n );
+        for( i = 0; i < n && bufs; i++ )
+        {
+            src[i].buf  = bufs + i * size;
+            src[i].size = size;
+        }
+        ctx->stats.matrix_bytes = n * size + (direct ? 0 : threads * j->group * j->src_buf);
+    }
+    if ( j->rc == 0 )
+    {
+        progress_stage( ctx, FT_STAGE_WRITE );
+        if ( (lines = join_paste( ctx, src, (int)n, &o )) < 0 || join_flush( ctx, &o ) < 0 )
+            j->rc = -1;
+        else
+            j->lines = lines;
+    }
+
+    for( i = 0; i < n; i++ )
+        if ( src[i].fd >= 0 )
+            close( src[i].fd );
+    ctx->stats.bands += (int)j->groups;
+    free( (void *)src );
+    free( (void *)bufs );
+    free( (void *)o.buf );
+    free( (void *)j->spill );
+    join_unlink( j );
+    return j->rc;
+}
+
+/* plan 'in' and record the plan in the stats */
+static int plan_stats( ft_ctx_t *ctx, input_t *in, int nin )
+{
+    double started = clock_seconds( CLOCK_MONOTONIC );
+
+    memset( (void *)&ctx->stats, 0, sizeof(ft_stats_t) );
+    if ( plan_input( ctx, in, nin ) < 0 )
+        return -1;
+    ctx->stats.plan_seconds      = clock_seconds( CLOCK_MONOTONIC ) - started;
+    ctx->stats.engine            = engine_names[ ctx->plan.engine ];
+    ctx->stats.budget            = ctx->plan.budget;
+    ctx->stats.predicted_seconds = ctx->plan.est[ ctx->plan.engine ].seconds;
+    ctx->stats.predicted_memory  = ctx->plan.est[ ctx->plan.engine ].memory;
+    ctx->stats.tune_source       = ctx->tune_source;
+    ctx->stats.page_bytes        = ctx->tune.page_bytes;
+    ctx->stats.io_block          = ctx->tune.io_block;
+    ctx->stats.tile_bytes        = ctx->tune.tile_bytes;
+    return 0;
+}
+
+/* the external engine reads stacked inputs one after the other, as if
+ * they had been concatenated; an input not ending in a newline gets one
+ */
+typedef struct {
+    input_t *in;
+    int      nin, i;
+    char     last;         /* last byte passed on                    */
+    int      header;       /* drop the header row of all but the first */
+    int      skip;         /* dropping the current input's header row */
+} chain_t;
+
+static ssize_t chain_read( void *user, char *buf, size_t size )
+{
+    chain_t *ch = (chain_t *)user;
+    ssize_t n;
+
+    while ( ch->i < ch->nin )
+    {
+        while ( (n = read( ch->in[ ch->i ].fd, buf, size )) < 0 && errno == EINTR )
+            ;
+        if ( n < 0 )
+            return -1;
+        if ( n > 0 && ch->skip )
+        {
+            const char *nl = memchr( buf, '\n', n );
+
+            if ( nl == (const char *)0 )
+                continue;
+            ch->skip = 0;
+            n -= nl + 1 - buf;
+            memmove( buf, nl + 1, n );
+            if ( n == 0 )
+                continue;
+        }
+        if ( n > 0 )
+        {
+            ch->last = buf[ n - 1 ];
+            return n;
+        }
+        ch->i++;
+        ch->skip = ch->header;
+        if ( ch->last != '\n' )
+        {
+            ch->last = buf[0] = '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* plan and run one transpose from the 'nin' inputs at 'in' to 'out' */
+static int transpose( ft_ctx_t *ctx, input_t *in, int nin, output_t *out )
+{
+    input_t stacked;
+    chain_t ch;
+    array_t *full = (array_t *)0;
+    parser_t ps;
+    int rc;
+
+    memset( (void *)&ctx->progress, 0, sizeof(ft_progress_t) );
+    ctx->error[0] = '\0';
+    strpool_reset( &ctx->text.header );
+    strpool_reset( &ctx->text.labels );
+
+    if ( plan_stats( ctx, in, nin ) < 0 )
+        return -1;
+    if ( ctx->plan.seekable )
+        ATOMIC_SET( ctx->progress.bytes_total, (int64_t)ctx->plan.input_bytes );
+    if ( ctx->opt.window_rows > 0 )
+        ctx->plan.engine = FT_ENGINE_MEMORY;
+    if ( !ctx->plan.seekable && (ctx->plan.engine == FT_ENGINE_MULTIPASS || ctx->plan.engine == FT_ENGINE_CURSOR) )
+        return ft_fail( ctx, "the %s engine needs a regular file as input", engine_names[ ctx->plan.engine ] );
+    if ( ctx->opt.verbosity >= 1 && ctx->opt.log )
+    {
+        plan_print( ctx, ctx->opt.log );
+        fflush( ctx->opt.log );
+    }
+    ctx->stats.threads = ctx_pool( ctx );
+    if ( (ctx->opt.window_rows > 0 || ctx->plan.engine != FT_ENGINE_EXTERNAL) && output_restart( ctx, out ) < 0 )
+        return -1;
+
+    /* the engines that read the input once take stacked inputs in turn */
+    if ( nin > 1 )
+    {
+        memset( (void *)&ch, 0, sizeof(ch) );
+        ch.in   = in;
+        ch.nin  = nin;
+        ch.last = '\n';
+        ch.header = ctx->opt.header;
+        stacked = in[0];
+        stacked.rd   = chain_read;
+        stacked.user = &ch;
+        stacked.name = ctx->opt.input_name;
+    }
+
+    if ( ctx->opt.window_rows > 0 )
+        rc = run_window( ctx, nin > 1 ? &stacked : in, out );
+    else switch ( ctx->plan.engine )
+    {
+    case FT_ENGINE_MULTIPASS:
+        rc = run_multipass( ctx, in, out );
+        break;
+    case FT_ENGINE_EXTERNAL:
+        rc = run_external( ctx, nin > 1 ? &stacked : in, out, (array_t *)0, (parser_t *)0 );
+        break;
+    case FT_ENGINE_CURSOR:
+        rc = run_cursor( ctx, in, out );
+        break;
+    default:
+        rc = run_memory( ctx, in, nin, out, &full, &ps );
+        if ( rc == 0 && full )
+        {
+            ft_warn( ctx, "warning: %s: the matrix %s after %ld rows, going on as the external engine\n", in->name,
+                     full->bytes_allocated < full->limit ? "ran out of memory" : "outgrew the memory budget", full->rows );
+            ctx->stats.engine = engine_names[ FT_ENGINE_EXTERNAL ];
+            rc = run_external( ctx, in, out, full, &ps );
+        }
+        break;
+    }
+    progress_stage( ctx, FT_STAGE_IDLE );
+    if ( rc < 0 && !ctx->error[0] )
+        ft_fail( ctx, "%s: transpose failed", ctx->opt.input_name );
+    return rc < 0 ? -1 : 0;
+}
+
+/* a store: a directory holding a matrix already transposed, as column-major
+ * segments of fixed-width fields laid out like the external engine's bands,
+ * and a text manifest:
+ *
+ *     ftranspose-store 1
+ *     width 20
+ *     cols 3000
+ *     rows 6000
+ *     segment seg-000000.bin 3000
+ *     segment seg-000001.bin 3000
+ *
+ * An append adds segments for just the new rows; the manifest is replaced
+ * by rename() once they are on disk, so an interrupted append leaves the
+ * store as it was.  Appends lock the directory exclusively, renders shared.
+ */
+typedef struct {
+    const char *dir;
+    int         lock;          /* the directory, flock()ed               */
+    int         width;
+    idx_t       rows, cols;    /* cols = -1 while the store is empty     */
+    int         nsegs, max_segs;
+    struct store_seg {
+        char    name[ STORE_NAME_LEN ];
+        idx_t   rows;
+    }          *segs;
+} store_t;
+
+static int store_add( ft_ctx_t *ctx, store_t *st, const char *name, idx_t rows )
+{
+    struct store_seg *grown;
+
+    if ( st->nsegs == st->max_segs )
+    {
+        st->max_segs = st->max_segs ? 2 * st->max_segs : 64;
+        if ( (grown = realloc( st->segs, st->max_segs * sizeof(struct store_seg) )) == (struct store_seg *)0 )
+            return ft_fail( ctx, "%s: out of memory", st->dir );
+        st->segs = grown;
+    }
+    snprintf( st->segs[ st->nsegs ].name, STORE_NAME_LEN, "%s", name );
+    st->segs[ st->nsegs++ ].rows = rows;
+    return 0;
+}
+
+static void store_close( store_t *st )
+{
+    if ( st->lock >= 0 )
+        close( st->lock );
+    free( (void *)st->segs );
+    st->segs = (struct store_seg *)0;
+}
+
+/* lock and read the store in 'dir'; with 'create', for an append, the
+ * directory is made if need be and a missing manifest is an empty store
+ */
+static int store_open( ft_ctx_t *ctx, store_t *st, const char *dir, int create )
+{
+    char path[ ARG_STR_LEN + 16 ], line[ ARG_STR_LEN ], name[ STORE_NAME_LEN ];
+    idx_t rows, sum = 0;
+    FILE *fp;
+    int rc = 0;
+
+    memset( (void *)st, 0, sizeof(store_t) );
+    st->dir   = dir;
+    st->cols  = -1;
+    st->width = ctx->opt.element_size;
+    if ( create && mkdir( dir, 0777 ) < 0 && errno != EEXIST )
+        return ft_fail_errno( ctx, dir );
+    if ( (st->lock = open( dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC )) < 0 ||
+         flock( st->lock, create ? LOCK_EX : LOCK_SH ) < 0 )
+        return ft_fail_errno( ctx, dir );
+
+    snprintf( path, sizeof(path), "%s/" STORE_MANIFEST, dir );
+    if ( (fp = fopen( path, "r" )) == (FILE *)0 )
+        return create && errno == ENOENT ? 0 : ft_fail_errno( ctx, path );
+    if ( fgets( line, sizeof(line), fp ) == (char *)0 || strcmp( line, STORE_MAGIC "\n" ) != 0 )
+        rc = ft_fail( ctx, "%s: not an ftranspose store manifest", path );
+    while ( rc == 0 && fgets( line, sizeof(line), fp ) != (char *)0 )
+    {
+        if ( sscanf( line, "width %d", &st->width ) == 1 || sscanf( line, "cols %ld", &st->cols ) == 1 ||
+             sscanf( line, "rows %ld", &st->rows ) == 1 )
+            continue;
+        if ( sscanf( line, "segment %63s %ld", name, &rows ) == 2 )
+        {
+            rc = store_add( ctx, st, name, rows );
+            sum += rows;
+            continue;
+        }
+        line[ strcspn( line, "\n" ) ] = '\0';
+        rc = ft_fail( ctx, "%s: bad line: %s", path, line );
+    }
+    fclose( fp );
+    if ( rc == 0 && (st->width < 1 || sum != st->rows) )
+        rc = ft_fail( ctx, "%s: segments hold %ld rows, not %ld", path, sum, st->rows );
+    return rc;
+}
+
+/* replace the manifest with one describing 'st' */
+static int store_write( ft_ctx_t *ctx, store_t *st )
+{
+    char path[ ARG_STR_LEN + 16 ], tmp[ ARG_STR_LEN + 16 ];
+    FILE *fp;
+    int i, rc = 0;
+
+    snprintf( path, sizeof(path), "%s/" STORE_MANIFEST, st->dir );
+    snprintf( tmp, sizeof(tmp), "%s/" STORE_MANIFEST ".new", st->dir );
+    if ( (fp = fopen( tmp, "w" )) == (FILE *)0 )
+        return ft_fail_errno( ctx, tmp );
+    fprintf( fp, STORE_MAGIC "\nwidth %d\ncols %ld\nrows %ld\n", st->width, st->cols, st->rows );
+    for( i = 0; i < st->nsegs; i++ )
+        fprintf( fp, "segment %s %ld\n", st->segs[i].name, st->segs[i].rows );
+    if ( fflush( fp ) != 0 || fsync( fileno( fp ) ) < 0 )
+        rc = ft_fail_errno( ctx, tmp );
+    if ( fclose( fp ) != 0 && rc == 0 )
+        rc = ft_fail_errno( ctx, tmp );
+    if ( rc == 0 && rename( tmp, path ) < 0 )
+        rc = ft_fail_errno( ctx, path );
+    if ( rc == 0 )
+        fsync( st->lock );
+    return rc;
+}
+
+/* spill_input() puts each band of an append in a new segment file */
+static int store_place( ft_ctx_t *ctx, void *user, band_t *b, idx_t bytes )
+{
+    store_t *st = (store_t *)user;
+    char name[ STORE_NAME_LEN ], path[ ARG_STR_LEN + STORE_NAME_LEN ];
+
+    snprintf( name, sizeof(name), "seg-%06d.bin", st->nsegs );
+    snprintf( path, sizeof(path), "%s/%s", st->dir, name );
+    if ( (b->fd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 )) < 0 )
+        return ft_fail_errno( ctx, path );
+    b->dfd  = -1;
+    b->base = 0;
+    posix_fallocate( b->fd, 0, bytes );
+    return store_add( ctx, st, name, b->rows );
+}
+
+/* a segment is on disk once its band is written: no fd outlives its band */
+static int store_done( ft_ctx_t *ctx, void *user, band_t *b )
+{
+    store_t *st = (store_t *)user;
+    int rc = fsync( b->fd );
+
+    close( b->fd );
+    b->fd = -1;
+    return rc < 0 ? ft_fail_errno( ctx, st->segs[ st->nsegs - 1 ].name ) : 0;
+}
+
+/* a field index: for every row of a regular file, the offset of every
+ * INDEX_STRIDE'th field, so field c of a row is found by reading from the
+ * mark before it and skipping fewer than INDEX_STRIDE fields.  Saved as a
+ * sidecar: this header, then rows x marks offsets, row after row.  Fields
+ * are the non-empty runs between delimiters, as the parser counts them.
+ */
+typedef struct {
+    char    magic[ 8 ];        /* INDEX_MAGIC, written last              */
+    int64_t input_bytes;       /* size and mtime of the file indexed     */
+    int64_t input_mtime;
+    int64_t base;              /* offset of the input in the file        */
+    int64_t rows, cols;
+    int64_t stride;            /* fields per mark                        */
+    int32_t delim;
+    int32_t unused;
+} index_head_t;
+
+/* an index being built, by the pool over parts of the input cut at line
+ * boundaries, or queried, by the pool over blocks of rows
+ */
+typedef struct {
+    ft_ctx_t      *ctx;
+    int            fd;         /* the input                              */
+    const char    *name;
+    index_head_t   head;
+    idx_t          marks;      /* marks per row                          */
+    int64_t       *mark;       /* mapped: rows x marks offsets           */
+    size_t         map_bytes;
+    int            ifd;        /* building: the index file               */
+    off_t         *cut;        /* building: nparts + 1 offsets           */
+    idx_t         *first_row;  /* building: rows, then first row, of each */
+    int            nparts, next;
+    const int64_t *cols;       /* querying: this group's columns         */
+    idx_t          ncols;
+    char          *sel;        /* ncols x rows fields of element_size    */
+    idx_t          next_row;
+    int            rc;
+} index_t;
+
+/* count the rows of each part */
+static void *index_count( void *arg )
+{
+    index_t *ix = (index_t *)arg;
+    ft_ctx_t *ctx = ix->ctx;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    char *buf = malloc( ctx->tune.io_block );
+    off_t off;
+    ssize_t n = 0;
+    int k;
+
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    if ( buf == (char *)0 )
+        ATOMIC_SET( ix->rc, ft_fail( ctx, "%s: out of memory", ix->name ) );
+    while ( (k = __atomic_fetch_add( &ix->next, 1, __ATOMIC_RELAXED )) < ix->nparts && ATOMIC_GET( ix->rc ) == 0 )
+    {
+        for( off = ix->cut[k]; off < ix->cut[ k + 1 ]; off += n )
+        {
+            n = read_at( ctx, ix->fd, buf, ix->cut[ k + 1 ] - off < ctx->tune.io_block ? ix->cut[ k + 1 ] - off :
+                         ctx->tune.io_block, off, FT_PHASE_READ );
+            if ( n <= 0 )
+            {
+                ATOMIC_SET( ix->rc, n < 0 ? ft_fail_errno( ctx, ix->name ) :
+                            ft_fail( ctx, "%s: file ended early while indexing", ix->name ) );
+                break;
+            }
+            ix->first_row[k] += count_newlines( buf, n );
+        }
+        if ( ATOMIC_GET( ix->rc ) != 0 )
+            break;
+
+        /* a last row without a newline */
+        if ( k == ix->nparts - 1 && off > ix->cut[k] && n > 0 && buf[ n - 1 ] != '\n' )
+            ix->first_row[k]++;
+    }
+    free( (void *)buf );
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* write the marks of 'nrows' rows from 'row' on */
+static int index_flush( index_t *ix, int64_t *rowbuf, idx_t row, idx_t nrows )
+{
+    return write_at( ix->ctx, ix->ifd, (const char *)rowbuf, nrows * ix->marks * sizeof(int64_t),
+                     sizeof(index_head_t) + row * ix->marks * sizeof(int64_t) );
+}
+
+/* mark every stride'th field of each row of each part */
+static void *index_scan( void *arg )
+{
+    index_t *ix = (index_t *)arg;
+    ft_ctx_t *ctx = ix->ctx;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    idx_t per = INDEX_FLUSH / (ix->marks * sizeof(int64_t)), row, row0, nbuf, field;
+    char *buf = malloc( ctx->tune.io_block ), delim = (char)ix->head.delim;
+    int64_t *rowbuf;
+    off_t off, end;
+    ssize_t n, i;
+    stamp_t t;
+    int k, sep;
+
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    if ( per < 1 )
+        per = 1;
+    rowbuf = malloc( per * ix->marks * sizeof(int64_t) );
+    if ( buf == (char *)0 || rowbuf == (int64_t *)0 )
+        ATOMIC_SET( ix->rc, ft_fail( ctx, "%s: out of memory", ix->name ) );
+    while ( (k = __atomic_fetch_add( &ix->next, 1, __ATOMIC_RELAXED )) < ix->nparts && ATOMIC_GET( ix->rc ) == 0 )
+    {
+        row = row0 = ix->first_row[k];
+        nbuf = field = 0;
+        sep = 1;
+        for( off = ix->cut[k], end = ix->cut[ k + 1 ]; off <= end && ATOMIC_GET( ix->rc ) == 0; off += n )
+        {
+            n = 0;
+            if ( off < end &&
+                 (n = read_at( ctx, ix->fd, buf, end - off < ctx->tune.io_block ? end - off : ctx->tune.io_block,
+                               off, FT_PHASE_READ )) <= 0 )
+            {
+                ATOMIC_SET( ix->rc, ft_fail_errno( ctx, ix->name ) );
+                break;
+            }
+            phase_begin( ctx, &t );
+
+            /* off == end: the part's last row may lack a newline */
+            for( i = 0; i < n || (off == end && field > 0 && i == 0); i++ )
+            {
+                char c = i < n ? buf[i] : '\n';
+
+                if ( c == '\n' )
+                {
+                    if ( field != ix->head.cols )
+                    {
+                        ATOMIC_SET( ix->rc, ft_fail( ctx, "%s: row %ld has %ld fields, not %ld", ix->name,
+                                                     row, field, (idx_t)ix->head.cols ) );
+                        break;
+                    }
+                    row++;
+                    field = 0;
+                    sep = 1;
+                    if ( ++nbuf == per )
+                    {
+                        if ( index_flush( ix, rowbuf, row0, nbuf ) < 0 )
+                            ATOMIC_SET( ix->rc, ft_fail_errno( ctx, "index" ) );
+                        row0 += nbuf;
+                        nbuf = 0;
+                    }
+                }
+                else if ( c == delim )
+                    sep = 1;
+                else if ( sep )
+                {
+                    if ( field % ix->head.stride == 0 && field < ix->head.cols )
+                        rowbuf[ nbuf * ix->marks + field / ix->head.stride ] = off + i;
+                    field++;
+                    sep = 0;
+                }
+            }
+            phase_end( ctx, FT_PHASE_PARSE, &t, n );
+            __atomic_fetch_add( &ctx->progress.bytes_in, n, __ATOMIC_RELAXED );
+            if ( off == end )
+                break;
+        }
+        if ( nbuf > 0 && ATOMIC_GET( ix->rc ) == 0 && index_flush( ix, rowbuf, row0, nbuf ) < 0 )
+            ATOMIC_SET( ix->rc, ft_fail_errno( ctx, "index" ) );
+    }
+    free( (void *)buf );
+    free( (void *)rowbuf );
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* map the marks of an index file whose header is in ix->head */
+static int index_map( index_t *ix, int ifd )
+{
+    ix->marks = (ix->head.cols + ix->head.stride - 1) / ix->head.stride;
+    ix->map_bytes = sizeof(index_head_t) + ix->head.rows * ix->marks * sizeof(int64_t);
+    ix->mark = mmap( (void *)0, ix->map_bytes, PROT_READ, MAP_SHARED, ifd, 0 );
+    if ( ix->mark == (int64_t *)MAP_FAILED )
+    {
+        ix->mark = (int64_t *)0;
+        return ft_fail_errno( ix->ctx, "index" );
+    }
+    ix->mark = (int64_t *)((char *)ix->mark + sizeof(index_head_t));
+    return 0;
+}
+
+/* the header an index of ix->fd must have */
+static int index_expect( index_t *ix, index_head_t *h )
+{
+    struct stat st;
+
+    memset( (void *)h, 0, sizeof(*h) );
+    if ( fstat( ix->fd, &st ) < 0 || !S_ISREG( st.st_mode ) || (h->base = lseek( ix->fd, 0, SEEK_CUR )) < 0 )
+        return ft_fail( ix->ctx, "%s: an index needs a regular file", ix->name );
+    memcpy( h->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC) );
+    h->input_bytes = st.st_size;
+    h->input_mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    h->stride      = INDEX_STRIDE;
+    h->delim       = (unsigned char)ix->ctx->opt.in_delim;
+    return 0;
+}
+
+/* load the index at 'path'; returns 1 if there is none or it is stale */
+static int index_load( index_t *ix, const char *path )
+{
+    index_head_t want;
+    int ifd, rc = 1;
+
+    if ( index_expect( ix, &want ) < 0 )
+        return -1;
+    if ( (ifd = open( path, O_RDONLY | O_CLOEXEC )) < 0 )
+        return errno == ENOENT ? 1 : ft_fail_errno( ix->ctx, path );
+    if ( read( ifd, &ix->head, sizeof(index_head_t) ) == (ssize_t)sizeof(index_head_t) &&
+         memcmp( ix->head.magic, want.magic, sizeof(want.magic) ) == 0 &&
+         ix->head.input_bytes == want.input_bytes && ix->head.input_mtime == want.input_mtime &&
+         ix->head.base == want.base && ix->head.delim == want.delim && ix->head.stride > 0 )
+        rc = index_map( ix, ifd );
+    close( ifd );
+    return rc;
+}
+
+/* index ix->fd into 'path', or an unlinked temp file if NULL, and map it */
+static int index_build( index_t *ix, const char *path )
+{
+    ft_ctx_t *ctx = ix->ctx;
+    char *buf;
+    idx_t size, parts, rows = 0, n;
+    ssize_t got;
+    off_t off;
+    int k, sep = 1;
+    double started = clock_seconds( CLOCK_MONOTONIC );
+
+    if ( index_expect( ix, &ix->head ) < 0 )
+        return -1;
+    if ( ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "indexing %s ... ", ix->name );
+    progress_stage( ctx, FT_STAGE_READ );
+    size = ix->head.input_bytes - ix->head.base;
+    ATOMIC_SET( ctx->progress.bytes_total, (int64_t)size );
+
+    /* the first row sets the # of columns */
+    if ( (buf = malloc( ctx->tune.io_block )) == (char *)0 )
+        return ft_fail( ctx, "%s: out of memory", ix->name );
+    for( off = ix->head.base; (got = read_at( ctx, ix->fd, buf, ctx->tune.io_block, off, FT_PHASE_READ )) > 0; off += got )
+    {
+        for( n = 0; n < got && buf[n] != '\n'; n++ )
+            if ( buf[n] == ctx->opt.in_delim )
+                sep = 1;
+            else if ( sep )
+            {
+                ix->head.cols++;
+                sep = 0;
+            }
+        if ( n < got )
+            break;
+    }
+    free( (void *)buf );
+    if ( got < 0 )
+        return ft_fail_errno( ctx, ix->name );
+    if ( ix->head.cols == 0 )
+        return ft_fail( ctx, "%s: the first row has no fields", ix->name );
+    ix->marks = (ix->head.cols + ix->head.stride - 1) / ix->head.stride;
+
+    /* cut the input at line boundaries, about two parts per thread */
+    parts = size / PART_MIN_BYTES + 1;
+    if ( parts > PARTS_PER_THREAD * ctx_threads( ctx ) )
+        parts = PARTS_PER_THREAD * ctx_threads( ctx );
+    ix->nparts    = (int)parts;
+    ix->cut       = calloc( parts + 1, sizeof(off_t) );
+    ix->first_row = calloc( parts, sizeof(idx_t) );
+    if ( ix->cut == (off_t *)0 || ix->first_row == (idx_t *)0 )
+        return ft_fail( ctx, "%s: out of memory", ix->name );
+    ix->cut[0] = ix->head.base;
+    ix->cut[ parts ] = ix->head.input_bytes;
+    for( k = 1; k < parts; k++ )
+        ix->cut[k] = line_after( ix->fd, ix->head.base + (off_t)((double)size * k / parts), ix->head.input_bytes );
+
+    /* rows per part give each part's first row */
+    ix->next = 0;
+    ctx_run( ctx, index_count, ix );
+    for( k = 0; k < parts && ix->rc == 0; k++ )
+    {
+        n = ix->first_row[k];
+        ix->first_row[k] = rows;
+        rows += n;
+    }
+    ix->head.rows = rows;
+
+    if ( ix->rc == 0 )
+    {
+        ix->ifd = path ? open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 ) : spill_open( ctx, (int *)0, (char *)0 );
+        if ( ix->ifd < 0 )
+            return path ? ft_fail_errno( ctx, path ) : -1;
+        if ( ftruncate( ix->ifd, sizeof(index_head_t) + rows * ix->marks * sizeof(int64_t) ) < 0 )
+            ix->rc = ft_fail_errno( ctx, path ? path : "index" );
+    }
+    if ( ix->rc == 0 )
+    {
+        ix->next = 0;
+        ctx_run( ctx, index_scan, ix );
+    }
+
+    /* the header goes last: an interrupted build leaves no valid index */
+    if ( ix->rc == 0 && write_at( ctx, ix->ifd, (const char *)&ix->head, sizeof(index_head_t), 0 ) < 0 )
+        ix->rc = ft_fail_errno( ctx, path ? path : "index" );
+    if ( ix->rc == 0 )
+        ix->rc = index_map( ix, ix->ifd );
+    if ( ix->rc < 0 && path )
+        unlink( path );
+    if ( ix->rc == 0 && ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "DONE\n%ld rows x %ld columns, a mark every %ld fields\n", rows, (idx_t)ix->head.cols,
+                (idx_t)ix->head.stride );
+    trace_end( ctx, "index_build", started, size );
+    return ix->rc;
+}
+
+/* copy field 'col' of 'row' into 'dst', element_size bytes and cut like
+ * the parser cuts it
+ */
+static int index_field( index_t *ix, char *buf, idx_t row, idx_t col, char *dst )
+{
+    ft_ctx_t *ctx = ix->ctx;
+    int es = ctx->opt.element_size, found = 0;
+    off_t off = ix->mark[ row * ix->marks + col / ix->head.stride ];
+    idx_t skip = col % ix->head.stride, len = 0;
+    char delim = (char)ix->head.delim;
+    int in = 1;
+    ssize_t n, i;
+
+    memset( (void *)dst, 0, es );
+    while ( !found && (n = read_at( ctx, ix->fd, buf, INDEX_READ, off, FT_PHASE_READ )) > 0 )
+    {
+        for( i = 0; i < n && !found; i++ )
+        {
+            if ( buf[i] == delim || buf[i] == '\n' )
+            {
+                if ( in && skip-- == 0 )
+                    found = 1;
+                else if ( buf[i] == '\n' )
+                    return ft_fail( ctx, "%s: row %ld is shorter than the index says", ix->name, row );
+                in = 0;
+            }
+            else
+            {
+                in = 1;
+                if ( skip == 0 && len++ < es )
+                    dst[ len - 1 ] = buf[i];
+            }
+        }
+        off += n;
+    }
+    if ( !found && !(in && skip == 0) )
+        return ft_fail( ctx, "%s: row %ld is shorter than the index says", ix->name, row );
+    if ( len > es )
+        dst[ es - 1 ] = '\0';
+    return 0;
+}
+
+/* gather this group's columns from blocks of rows */
+static void *index_query( void *arg )
+{
+    index_t *ix = (index_t *)arg;
+    ft_ctx_t *ctx = ix->ctx;
+    ft_phase_stats_t local[ FT_N_PHASES ];
+    size_t es = ctx->opt.element_size;
+    char *buf = malloc( INDEX_READ );
+    idx_t r0, r, g;
+
+    memset( (void *)local, 0, sizeof(local) );
+    phase_local = local;
+    if ( buf == (char *)0 )
+        ATOMIC_SET( ix->rc, ft_fail( ctx, "%s: out of memory", ix->name ) );
+    while ( (r0 = __atomic_fetch_add( &ix->next_row, QUERY_CLAIM, __ATOMIC_RELAXED )) < ix->head.rows &&
+            ATOMIC_GET( ix->rc ) == 0 )
+        for( r = r0; r < r0 + QUERY_CLAIM && r < ix->head.rows; r++ )
+            for( g = 0; g < ix->ncols; g++ )
+                if ( index_field( ix, buf, r, ix->cols[g], &ix->sel[ (g * ix->head.rows + r) * es ] ) < 0 )
+                {
+                    ATOMIC_SET( ix->rc, -1 );
+                    r = ix->head.rows;
+                    break;
+                }
+    free( (void *)buf );
+    phase_local = (ft_phase_stats_t *)0;
+    phase_merge( ctx, local );
+    return (void *)0;
+}
+
+/* load the index at 'path' or build it, and if 'cols' write those input
+ * columns as output lines
+ */
+static int index_run( ft_ctx_t *ctx, int fd, const char *path, const int64_t *cols, idx_t n, output_t *out )
+{
+    size_t es = ctx->opt.element_size;
+    idx_t group, g, i;
+    index_t ix;
+    char *o, *text = (char *)0;
+    stamp_t t;
+    int rc;
+
+    memset( (void *)&ctx->progress, 0, sizeof(ft_progress_t) );
+    memset( (void *)&ctx->stats, 0, sizeof(ft_stats_t) );
+    ctx->error[0] = '\0';
+    memset( (void *)&ix, 0, sizeof(ix) );
+    ix.ctx  = ctx;
+    ix.fd   = fd;
+    ix.ifd  = -1;
+    ix.name = ctx->opt.input_name;
+    ctx->stats.threads = ctx_pool( ctx );
+    if ( ctx->keep || ctx->opt.header || ctx->opt.labels )
+        return ft_fail( ctx, "%s: an index covers every field; it cannot skip rows or keep a header or labels",
+                        ix.name );
+    if ( (rc = path ? index_load( &ix, path ) : 1) > 0 )
+        rc = index_build( &ix, path );
+
+    /* as many whole columns at a time as fit in QUERY_BYTES */
+    group = ix.head.rows > 0 ? (idx_t)(QUERY_BYTES / (ix.head.rows * es)) : n;
+    if ( group < 1 )
+        group = 1;
+    if ( group > n )
+        group = n;
+    for( i = 0; i < n && rc == 0; i++ )
+        if ( cols[i] < 0 || cols[i] >= ix.head.cols )
+            rc = ft_fail( ctx, "%s: column %ld asked for, it has %ld", ix.name, (idx_t)cols[i] + 1,
+                         (idx_t)ix.head.cols );
+    if ( rc == 0 && n > 0 )
+    {
+        ix.sel = malloc( group * ix.head.rows * es );
+        text   = malloc( ix.head.rows * (es + 1) + 1 );
+        if ( ix.sel == (char *)0 || text == (char *)0 )
+            rc = ft_fail( ctx, "%s: out of memory", ix.name );
+        ATOMIC_SET( ctx->progress.lines_total, n );
+        progress_stage( ctx, FT_STAGE_WRITE );
+    }
+    for( i = 0; i < n && rc == 0; i += group )
+    {
+        ix.cols     = &cols[i];
+        ix.ncols    = n - i < group ? n - i : group;
+        ix.next_row = 0;
+        ctx_run( ctx, index_query, &ix );
+        for( g = 0; g < ix.ncols && (rc = ix.rc) == 0; g++ )
+        {
+            phase_begin( ctx, &t );
+            o = format_fields( text, &ix.sel[ g * ix.head.rows * es ], ix.head.rows, es, ctx->opt.out_delim, 1 );
+            if ( ix.head.rows == 0 )
+                *o++ = '\n';
+            phase_end( ctx, FT_PHASE_FORMAT, &t, o - text );
+            rc = write_block( ctx, out, text, o - text );
+            ATOMIC_SET( ctx->progress.lines_out, i + g + 1 );
+        }
+    }
+    progress_stage( ctx, FT_STAGE_IDLE );
+    ctx->stats.rows     = ix.head.rows;
+    ctx->stats.cols     = ix.head.cols;
+    ctx->stats.elements = ix.head.rows * n;
+    if ( ix.mark )
+        munmap( (char *)ix.mark - sizeof(index_head_t), ix.map_bytes );
+    if ( ix.ifd >= 0 )
+        close( ix.ifd );
+    free( (void *)ix.cut );
+    free( (void *)ix.first_row );
+    free( (void *)ix.sel );
+    free( (void *)text );
+    return rc < 0 ? -1 : 0;
+}
+
+void ft_options_init( ft_options_t *opt )
+{
+    memset( (void *)opt, 0, sizeof(ft_options_t) );
+    opt->element_size = DEFAULT_FIELD_LENGTH;
+    opt->in_delim     = TAB;
+    opt->out_delim    = TAB;
+    opt->engine       = FT_ENGINE_AUTO;
+}
+
+static int options_valid( const ft_options_t *opt )
+{
+    if ( opt->element_size < 1 || opt->engine < 0 || opt->engine >= FT_N_ENGINES ||
+         opt->threads < 0 || opt->threads > MAX_THREADS || opt->memory_budget < 0 || opt->keep_bytes < 0 ||
+         opt->window_rows < 0 || opt->numa < 0 || opt->numa >= FT_N_NUMA_MODES ||
+         opt->spill_codec < 0 || opt->spill_codec >= FT_N_CODECS )
+    {
+        errno = EINVAL;
+        return 0;
+    }
+    return 1;
+}
+
+/* copy 'opt' into the context, filling in the defaults */
+static void ctx_options( ft_ctx_t *ctx, const ft_options_t *opt )
+{
+    const char *tmp;
+    char *next;
+
+    ctx->opt = *opt;
+    if ( ctx->opt.input_name == (const char *)0 )
+        ctx->opt.input_name = "input";
+    if ( ctx->opt.output_name == (const char *)0 )
+        ctx->opt.output_name = "output";
+
+    tmp = opt->tmpdir;
+    if ( tmp == (const char *)0 || !tmp[0] )
+        tmp = getenv( "TMPDIR" );
+    snprintf( ctx->tmpdir, sizeof(ctx->tmpdir), "%s", tmp && tmp[0] ? tmp : "/tmp" );
+    ctx->opt.tmpdir = ctx->tmpdir;
+    if ( opt->checkpoint && opt->checkpoint[0] )
+    {
+        snprintf( ctx->checkpoint, sizeof(ctx->checkpoint), "%s", opt->checkpoint );
+        ctx->opt.checkpoint = ctx->checkpoint;
+    }
+    else
+        ctx->opt.checkpoint = (const char *)0;
+
+    /* several directories, one per device, are separated by ':' */
+    memcpy( ctx->scratch_dirs, ctx->tmpdir, sizeof(ctx->scratch_dirs) );
+    ctx->nscratch = 0;
+    for( tmp = strtok_r( ctx->scratch_dirs, ":", &next ); tmp && ctx->nscratch < SCRATCH_MAX;
+         tmp = strtok_r( (char *)0, ":", &next ) )
+        ctx->scratch[ ctx->nscratch++ ] = tmp;
+    if ( ctx->nscratch == 0 )
+        ctx->scratch[ ctx->nscratch++ ] = "/tmp";
+}
+
+static void tune_defaults( ft_ctx_t *ctx )
+{
+    ctx->tune.page_bytes = PAGE_BYTES;
+    ctx->tune.io_block   = IO_BLOCK_SIZE;
+    ctx->tune.tile_bytes = TILE_BYTES;
+    ctx->tune.threads    = ctx->opt.threads > 0 ? ctx->opt.threads : 1;
+    ctx->tune_source     = "defaults";
+}
+
+ft_ctx_t *ft_create( const ft_options_t *opt )
+{
+    ft_ctx_t *ctx;
+
+    if ( !options_valid( opt ) )
+        return (ft_ctx_t *)0;
+    if ( (ctx = calloc( 1, sizeof(ft_ctx_t) )) == (ft_ctx_t *)0 )
+        return ctx;
+    ctx_options( ctx, opt );
+    tune_defaults( ctx );
+    ctx->stats.engine = engine_names[ ctx->opt.engine ];
+    pthread_mutex_init( &ctx->lock, (pthread_mutexattr_t *)0 );
+    return ctx;
+}
+
+int ft_reconfigure( ft_ctx_t *ctx, const ft_options_t *opt )
+{
+    int width_class = tune_class( ctx->opt.element_size );
+
+    if ( !options_valid( opt ) )
+        return ft_fail( ctx, "invalid options" );
+    ctx_options( ctx, opt );
+
+    /* another width class has its own line in the profile */
+    if ( tune_class( opt->element_size ) != width_class )
+    {
+        tune_defaults( ctx );
+        if ( ctx->profile[0] && tune_load( ctx, ctx->profile ) < 0 )
+            return -1;
+    }
+    if ( opt->threads > 0 )
+        ctx->tune.threads = opt->threads;
+    if ( ctx->arena && ctx->arena->bytes_allocated > (idx_t)opt->keep_bytes )
+    {
+        free_array( ctx->arena );
+        ctx->arena = (array_t *)0;
+    }
+    return 0;
+}
+
+int ft_reserve( ft_ctx_t *ctx, int64_t bytes, int huge_pages )
+{
+    array_t *a;
+    uintptr_t lo, hi;
+    idx_t i;
+
+    if ( (a = ctx_array( ctx )) == (array_t *)0 )
+        return ft_fail( ctx, "out of memory" );
+    if ( reserve_elements( a, (bytes + a->element_size - 1) / a->element_size ) < 0 )
+    {
+        ctx_release( ctx, a );
+        return ft_fail( ctx, "cannot reserve %ld bytes", (idx_t)bytes );
+    }
+#ifdef MADV_HUGEPAGE
+    /* the whole huge pages inside the buffer; realloc() keeps the advice
+     * when it moves the mapping
+     */
+    lo = ((uintptr_t)a->data + HUGE_PAGE_BYTES - 1) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+    hi = ((uintptr_t)a->data + a->bytes_allocated) & ~(uintptr_t)(HUGE_PAGE_BYTES - 1);
+    if ( huge_pages && hi > lo && madvise( (void *)lo, hi - lo, MADV_HUGEPAGE ) != 0 )
+        ft_warn( ctx, "warning: no huge pages for the matrix buffer: %s\n", strerror( errno ) );
+#else
+    (void)lo;
+    (void)hi;
+    (void)huge_pages;
+#endif
+    /* fault the pages in now rather than in the first transpose */
+    for( i = 0; i < a->bytes_allocated; i += PAGE_BYTES )
+        a->data[i] = 0;
+    if ( ctx->opt.keep_bytes < a->bytes_allocated )
+        ctx->opt.keep_bytes = a->bytes_allocated;
+    ctx_release( ctx, a );
+    return 0;
+}
+
+void ft_destroy( ft_ctx_t *ctx )
+{
+    if ( ctx == (ft_ctx_t *)0 )
+        return;
+    pool_stop( ctx->pool );
+    free_array( ctx->arena );
+    keyset_free( ctx->keep );
+    strpool_free( &ctx->text.header );
+    strpool_free( &ctx->text.labels );
+    free( (void *)ctx->io_buf );
+    pthread_mutex_destroy( &ctx->lock );
+    free( (void *)ctx );
+}
+
+int ft_keep_rows( ft_ctx_t *ctx, const char *path )
+{
+    keyset_t *ks = (keyset_t *)0;
+
+    if ( path && (ks = keyset_load( ctx, path )) == (keyset_t *)0 )
+        return -1;
+    keyset_free( ctx->keep );
+    ctx->keep = ks;
+    if ( ks && ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "keeping rows with %ld keys from %s\n", ks->count, path );
+    return 0;
+}
+
+const char *ft_error( ft_ctx_t *ctx )
+{
+    return ctx->error;
+}
+
+void ft_set_names( ft_ctx_t *ctx, const char *input_name, const char *output_name )
+{
+    ctx->opt.input_name  = input_name ? input_name : "input";
+    ctx->opt.output_name = output_name ? output_name : "output";
+}
+
+/* $XDG_CONFIG_HOME/ftranspose/HOST.profile */
+void ft_default_profile( char *path, size_t size )
+{
+    const char *config = getenv( "XDG_CONFIG_HOME" ), *home = getenv( "HOME" );
+    char host[ 256 ];
+
+    if ( gethostname( host, sizeof(host) ) != 0 )
+        strcpy( host, "localhost" );
+    host[ sizeof(host) - 1 ] = '\0';
+    if ( config && config[0] )
+        snprintf( path, size, "%s/ftranspose/%s.profile", config, host );
+    else
+        snprintf( path, size, "%s/.config/ftranspose/%s.profile", home ? home : ".", host );
+}
+
+int ft_load_profile( ft_ctx_t *ctx, const char *path )
+{
+    char def[ ARG_STR_LEN ];
+    int rc;
+
+    if ( path == (const char *)0 )
+    {
+        ft_default_profile( def, sizeof(def) );
+        path = def;
+    }
+    rc = tune_load( ctx, path );
+
+    /* an explicit thread count beats the profile's */
+    if ( ctx->opt.threads > 0 )
+        ctx->tune.threads = ctx->opt.threads;
+    return rc;
+}
+
+int ft_autotune( ft_ctx_t *ctx, const char *path, FILE *report )
+{
+    const ft_pool_t *shared = ctx->opt.pool;
+    char file[ ARG_STR_LEN ];
+    tune_t saved = ctx->tune;
+    int rc;
+
+    if ( path )
+        snprintf( file, sizeof(file), "%s", path );
+    else
+        ft_default_profile( file, sizeof(file) );
+
+    /* thread counts are timed on the context's own pool */
+    ctx->opt.pool = (const ft_pool_t *)0;
+    rc = autotune( ctx, file, report );
+    ctx->opt.pool = shared;
+    ctx->tune = saved;
+    if ( rc == 0 )
+        rc = ft_load_profile( ctx, file ) < 0 ? -1 : 0;
+    return rc;
+}
+
+int ft_transpose_fd( ft_ctx_t *ctx, int in_fd, int out_fd )
+{
+    return ft_transpose_fds( ctx, &in_fd, (const char *const *)0, 1, out_fd );
+}
+
+/* open the 'n' inputs of a stacked transpose or plan */
+static input_t *open_inputs( ft_ctx_t *ctx, const int *in_fds, const char *const *names, int n )
+{
+    input_t *in;
+    int i;
+
+    if ( n < 1 )
+    {
+        ft_fail( ctx, "no input" );
+        return (input_t *)0;
+    }
+    if ( (in = calloc( n, sizeof(input_t) )) == (input_t *)0 )
+    {
+        ft_fail( ctx, "%s: out of memory", ctx->opt.input_name );
+        return in;
+    }
+    for( i = 0; i < n; i++ )
+    {
+        if ( open_input( ctx, &in[i], in_fds[i], (ft_read_fn)0, (void *)0 ) < 0 )
+        {
+            free( (void *)in );
+            return (input_t *)0;
+        }
+        if ( names != (const char *const *)0 && names[i] != (const char *)0 )
+            in[i].name = names[i];
+    }
+    return in;
+}
+
+int ft_transpose_fds( ft_ctx_t *ctx, const int *in_fds, const char *const *names, int n, int out_fd )
+{
+    input_t *in;
+    output_t out;
+    int i, rc;
+
+    memset( (void *)&out, 0, sizeof(out) );
+    out.fd = out_fd;
+    ctx->error[0] = '\0';
+    if ( (in = open_inputs( ctx, in_fds, names, n )) == (input_t *)0 )
+        return -1;
+    rc = transpose( ctx, in, n, &out );
+    for( i = 0; i < n; i++ )
+        close_input( &in[i] );
+    free( (void *)in );
+    return rc;
+}
+
+int ft_transpose_stream( ft_ctx_t *ctx, ft_read_fn rd, void *rd_user, ft_write_fn wr, void *wr_user )
+{
+    input_t in;
+    output_t out;
+    int rc;
+
+    memset( (void *)&out, 0, sizeof(out) );
+    out.fd   = -1;
+    out.wr   = wr;
+    out.user = wr_user;
+    if ( open_input( ctx, &in, -1, rd, rd_user ) < 0 )
+        return -1;
+    rc = transpose( ctx, &in, 1, &out );
+    close_input( &in );
+    return rc;
+}
+
+int ft_store_append( ft_ctx_t *ctx, const char *dir, int in_fd )
+{
+    char path[ ARG_STR_LEN + STORE_NAME_LEN ];
+    int width = ctx->opt.element_size, engine = ctx->opt.engine, old, i, rc;
+    store_t st;
+    spill_t sp;
+    input_t in;
+
+    memset( (void *)&ctx->progress, 0, sizeof(ft_progress_t) );
+    ctx->error[0] = '\0';
+    if ( ctx->opt.header || ctx->opt.labels )
+        return ft_fail( ctx, "%s: a store keeps no header or labels", dir );
+    if ( store_open( ctx, &st, dir, 1 ) < 0 || open_input( ctx, &in, in_fd, (ft_read_fn)0, (void *)0 ) < 0 )
+    {
+        store_close( &st );
+        return -1;
+    }
+
+    /* parse at the store's field width, a band at a time as the external
+     * engine does, each band going to a segment of its own
+     */
+    ctx->opt.element_size = st.width;
+    ctx->opt.engine = FT_ENGINE_EXTERNAL;
+    memset( (void *)&sp, 0, sizeof(sp) );
+    sp.cols  = st.cols;
+    sp.place = store_place;
+    sp.done  = store_done;
+    sp.user  = &st;
+    old = st.nsegs;
+    if ( (rc = plan_stats( ctx, &in, 1 )) == 0 )
+    {
+        ctx->stats.threads = ctx_pool( ctx );
+        if ( ctx->plan.seekable )
+            ATOMIC_SET( ctx->progress.bytes_total, (int64_t)ctx->plan.input_bytes );
+        rc = spill_input( ctx, &in, &sp );
+    }
+    for( i = 0; i < sp.nbands; i++ )
+        if ( sp.bands[i].fd >= 0 )
+            close( sp.bands[i].fd );
+    if ( rc == 0 && sp.nbands > 0 )
+    {
+        st.cols  = sp.cols;
+        st.rows += sp.rows;
+        rc = store_write( ctx, &st );
+    }
+
+    /* segments the manifest does not list would only be overwritten */
+    if ( rc < 0 )
+        for( i = old; i < st.nsegs; i++ )
+        {
+            snprintf( path, sizeof(path), "%s/%s", dir, st.segs[i].name );
+            unlink( path );
+        }
+    ctx->stats.bands = sp.nbands;
+    ctx->stats.rows  = sp.rows;
+    ctx->stats.cols  = sp.cols > 0 ? sp.cols : 0;
+    ctx->stats.elements = ctx->stats.rows * ctx->stats.cols;
+    if ( rc == 0 && ctx->opt.verbosity >= 1 )
+        ft_log( ctx, "%s: %d segments, %ld rows x %ld columns\n", dir, st.nsegs, st.rows, st.cols );
+    progress_stage( ctx, FT_STAGE_IDLE );
+    ctx->opt.element_size = width;
+    ctx->opt.engine = engine;
+    close_input( &in );
+    store_close( &st );
+    free( (void *)sp.bands );
+    return rc;
+}
+
+int ft_store_render( ft_ctx_t *ctx, const char *dir, int64_t first, int64_t count, int out_fd )
+{
+    char path[ ARG_STR_LEN + STORE_NAME_LEN ];
+    int width = ctx->opt.element_size, n = 0, i, rc = 0;
+    band_t *bands = (band_t *)0;
+    struct stat sb;
+    output_t out;
+    store_t st;
+    idx_t rows = 0;
+
+    memset( (void *)&ctx->progress, 0, sizeof(ft_progress_t) );
+    memset( (void *)&ctx->stats, 0, sizeof(ft_stats_t) );
+    ctx->error[0] = '\0';
+    if ( store_open( ctx, &st, dir, 0 ) < 0 )
+    {
+        store_close( &st );
+        return -1;
+    }
+    if ( first < 0 || first > st.nsegs )
+        rc = ft_fail( ctx, "%s: no segment %ld (it has %d)", dir, (idx_t)first, st.nsegs );
+    else
+    {
+        n = count > 0 && first + count < st.nsegs ? (int)count : st.nsegs - (int)first;
+        if ( (bands = calloc( n > 0 ? n : 1, sizeof(band_t) )) == (band_t *)0 )
+            rc = ft_fail( ctx, "%s: out of memory", dir );
+        for( i = 0; i < n && rc == 0; i++ )
+            bands[i].fd = bands[i].dfd = -1;
+    }
+
+    /* each segment is a band on its own file */
+    for( i = 0; i < n && rc == 0; i++ )
+    {
+        struct store_seg *sg = &st.segs[ first + i ];
+
+        snprintf( path, sizeof(path), "%s/%s", dir, sg->name );
+        bands[i].fd   = open( path, O_RDONLY | O_CLOEXEC );
+        bands[i].rows = sg->rows;
+        if ( bands[i].fd < 0 || fstat( bands[i].fd, &sb ) < 0 )
+            rc = ft_fail_errno( ctx, path );
+        else if ( sb.st_size < (off_t)sg->rows * st.cols * st.width )
+            rc = ft_fail( ctx, "%s: %ld bytes, but %ld rows x %ld columns need %ld", path, (idx_t)sb.st_size,
+                          sg->rows, st.cols, sg->rows * st.cols * st.width );
+        rows += sg->rows;
+    }
+
+    if ( rc == 0 && rows > 0 )
+    {
+        /* size the merge buffer as for the external engine */
+        ctx->opt.element_size = st.width;
+        plan_budget( ctx );
+        ctx->plan.rows = rows;
+        ctx->plan.cols = st.cols;
+        plan_estimate( ctx );
+        ctx->stats.engine  = engine_names[ FT_ENGINE_EXTERNAL ];
+        ctx->stats.budget  = ctx->plan.budget;
+        ctx->stats.bands   = n;
+        ctx->stats.rows    = rows;
+        ctx->stats.cols    = st.cols;
+        ctx->stats.elements = rows * st.cols;
+        memset( (void *)&out, 0, sizeof(out) );
+        out.fd = out_fd;
+        if ( ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "rendering segments %ld-%ld of %s ... ", (idx_t)first, (idx_t)first + n - 1, dir );
+        if ( (rc = merge_bands( ctx, bands, n, rows, st.cols, (const text_t *)0, &out, (journal_t *)0 )) == 0 && ctx->opt.verbosity >= 1 )
+            ft_log( ctx, "DONE\n" );
+        progress_stage( ctx, FT_STAGE_IDLE );
+        ctx->opt.element_size = width;
+    }
+    for( i = 0; i < n && bands != (band_t *)0; i++ )
+        if ( bands[i].fd >= 0 )
+            close( bands[i].fd );
+    free( (void *)bands );
+    store_close( &st );
+    return rc;
+}
+
+int ft_index_fd( ft_ctx_t *ctx, int in_fd, const char *index_path )
+{
+    output_t out;
+
+    memset( (void *)&out, 0, sizeof(out) );
+    out.fd = -1;
+    return index_run( ctx, in_fd, index_path, (const int64_t *)0, 0, &out );
+}
+
+int ft_query_fd( ft_ctx_t *ctx, int in_fd, const char *index_path, const int64_t *cols, int64_t n, int out_fd )
+{
+    output_t out;
+
+    memset( (void *)&out, 0, sizeof(out) );
+    out.fd = out_fd;
+    return index_run( ctx, in_fd, index_path, cols, n, &out );
+}
+
+int ft_join_files( ft_ctx_t *ctx, const char *const *paths, int64_t count, int out_fd, int mode )
+{
+    output_t out;
+    join_t j;
+
+    if ( mode != FT_JOIN_ROWS && mode != FT_JOIN_COLUMNS )
+        return ft_fail( ctx, "unknown join mode %d", mode );
+    memset( (void *)&ctx->stats, 0, sizeof(ft_stats_t) );
+    memset( (void *)&ctx->progress, 0, sizeof(ft_progress_t) );
+    ctx->error[0] = '\0';
+    ctx->stats.engine      = mode == FT_JOIN_ROWS ? "join" : "paste";
+    ctx->stats.budget      = ctx->opt.memory_budget;
+    ctx->stats.tune_source = ctx->tune_source;
+    ctx->stats.io_block    = ctx->tune.io_block;
+
+    memset( (void *)&out, 0, sizeof(out) );
+    out.fd = out_fd;
+    memset( (void *)&j, 0, sizeof(j) );
+    j.ctx   = ctx;
+    j.paths = paths;
+    j.count = count;
+    j.mode  = mode;
+    j.out   = &out;
+    pthread_mutex_init( &j.lock, (pthread_mutexattr_t *)0 );
+    pthread_cond_init( &j.turned, (pthread_condattr_t *)0 );
+    ctx->stats.threads = ctx_pool( ctx );
+
+    if ( mode == FT_JOIN_ROWS )
+    {
+        ATOMIC_SET( ctx->progress.lines_total, count );
+        progress_stage( ctx, FT_STAGE_WRITE );
+        ctx_run( ctx, join_rows, &j );
+        ctx->stats.rows = count;
+        ctx->stats.cols = j.lines;
+        ctx->stats.matrix_bytes = (idx_t)ctx->stats.threads * (ctx->tune.io_block + 1);
+    }
+    else
+    {
+        if ( join_columns( ctx, &j ) < 0 )
+            j.rc = -1;
+        ctx->stats.rows = j.lines;
+        ctx->stats.cols = count;
+    }
+    ctx->stats.elements = ctx->stats.rows * ctx->stats.cols;
+    progress_stage( ctx, FT_STAGE_IDLE );
+    pthread_mutex_destroy( &j.lock );
+    pthread_cond_destroy( &j.turned );
+    if ( j.rc < 0 && !ctx->error[0] )
+        ft_fail( ctx, "joining %ld files failed", (idx_t)count );
+    return j.rc < 0 ? -1 : 0;
+}
+
+/* ft_transpose_buffer(): the input is read from, and the output appended
+ * to, memory
+ */
+typedef struct {
+    const char *p;
+    size_t      left;
+    char       *buf;
+    size_t      len, cap;
+} membuf_t;
+
+static ssize_t membuf_read( void *user, char *buf, size_t size )
+{
+    membuf_t *m = (membuf_t *)user;
+
+    if ( size > m->left )
+        size = m->left;
+    memcpy( buf, m->p, size );
+    m->p    += size;
+    m->left -= size;
+    return (ssize_t)size;
+}
+
+static int membuf_write( void *user, const char *buf, size_t size )
+{
+    membuf_t *m = (membuf_t *)user;
+    size_t cap = m->cap ? m->cap : 4096;
+    char *grown;
+
+    while ( cap < m->len + size + 1 )
+        cap *= 2;
+    if ( cap != m->cap )
+    {
+        if ( (grown = realloc( m->buf, cap )) == (char *)0 )
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+        m->buf = grown;
+        m->cap = cap;
+    }
+    memcpy( m->buf + m->len, buf, size );
+    m->len += size;
+    m->buf[ m->len ] = '\0';
+    return 0;
+}
+
+int ft_transpose_buffer( ft_ctx_t *ctx, const char *in, size_t in_size, char **out, size_t *out_size )
+{
+    membuf_t m;
+
+    memset( (void *)&m, 0, sizeof(m) );
+    m.p    = in;
+    m.left = in_size;
+    if ( ft_transpose_stream( ctx, membuf_read, &m, membuf_write, &m ) < 0 ||
+         (m.buf == (char *)0 && membuf_write( &m, "", 0 ) < 0) )
+    {
+        free( (void *)m.buf );
+        if ( !ctx->error[0] )
+            ft_fail( ctx, "output: %s", strerror( ENOMEM ) );
+        return -1;
+    }
+    *out      = m.buf;
+    *out_size = m.len;
+    return 0;
+}
+
+int ft_plan_fd( ft_ctx_t *ctx, int in_fd )
+{
+    return ft_plan_fds( ctx, &in_fd, (const char *const *)0, 1 );
+}
+
+int ft_plan_fds( ft_ctx_t *ctx, const int *in_fds, const char *const *names, int n )
+{
+    input_t *in;
+    int i, rc;
+
+    ctx->error[0] = '\0';
+    if ( (in = open_inputs( ctx, in_fds, names, n )) == (input_t *)0 )
+        return -1;
+    rc = plan_stats( ctx, in, n );
+    for( i = 0; i < n; i++ )
+        close_input( &in[i] );
+    free( (void *)in );
+    return rc;
+}
+
+void ft_print_plan( ft_ctx_t *ctx, FILE *fp )
+{
+    plan_print( ctx, fp );
+}
+
+const ft_stats_t *ft_stats( ft_ctx_t *ctx )
+{
+    return &ctx->stats;
+}
+
+void ft_progress( ft_ctx_t *ctx, ft_progress_t *p )
+{
+    p->stage       = ATOMIC_GET( ctx->progress.stage );
+    p->stage_start = ATOMIC_GET( ctx->progress.stage_start );
+    p->bytes_in    = ATOMIC_GET( ctx->progress.bytes_in );
+    p->bytes_total = ATOMIC_GET( ctx->progress.bytes_total );
+    p->rows_in     = ATOMIC_GET( ctx->progress.rows_in );
+    p->lines_out   = ATOMIC_GET( ctx->progress.lines_out );
+    p->lines_total = ATOMIC_GET( ctx->progress.lines_total );
+    p->bytes_out   = ATOMIC_GET( ctx->progress.bytes_out );
+}
+
+ft_pool_t *ft_pool_create( int threads )
+{
+    pool_t *pool;
+
+    if ( threads < 1 || threads > MAX_THREADS )
+    {
+        errno = EINVAL;
+        return (ft_pool_t *)0;
+    }
+    if ( (pool = pool_start( threads, (const int *)0, 0, (void (*)( void *, const char * ))0, (void *)0 )) ==
+         (pool_t *)0 )
+        return (ft_pool_t *)0;
+    return &pool->api;
+}
+
+void ft_pool_destroy( ft_pool_t *pool )
+{
+    if ( pool )
+        pool_stop( (pool_t *)pool->pool );
+}
+
+const char *ft_engine_name( int engine )
+{
+    return engine >= 0 && engine < FT_N_ENGINES ? engine_names[ engine ] : (const char *)0;
+}
+
+const char *ft_phase_name( int phase )
+{
+    return phase >= 0 && phase < FT_N_PHASES ? phase_names[ phase ] : (const char *)0;
+}
+
+const char *ft_numa_name( int mode )
+{
+    return mode >= 0 && mode < FT_N_NUMA_MODES ? numa_names[ mode ] : (const char *)0;
+}
+
+const char *ft_codec_name( int codec )
+{
+    return codec >= 0 && codec < FT_N_CODECS ? codec_names[ codec ] : (const char *)0;
+}
+
+const char *ft_hw_counter_name( int counter )
+{
+    return counter >= 0 && counter < FT_N_HW_COUNTERS ? hw_counter_names[ counter ] : (const char *)0;
+}